@@ -0,0 +1,7 @@
+add_executable(fdbus_bench
+    ${PACKAGE_SOURCE_ROOT}/server/main_bench.cpp
+)
+
+add_executable(fdbnsstress
+    ${PACKAGE_SOURCE_ROOT}/server/main_ns_stress.cpp
+)
@@ -6,12 +6,16 @@ add_executable(name_server
     ${PACKAGE_SOURCE_ROOT}/server/CInterNameProxy.cpp
     ${PACKAGE_SOURCE_ROOT}/server/CHostProxy.cpp
     ${PACKAGE_SOURCE_ROOT}/server/CAddressAllocator.cpp
+    ${PACKAGE_SOURCE_ROOT}/server/CRegistrySnapshot.cpp
+    ${PACKAGE_SOURCE_ROOT}/server/CChangeLog.cpp
     ${PACKAGE_SOURCE_ROOT}/security/CServerSecurityConfig.cpp
 )
 
 add_executable(host_server
     ${PACKAGE_SOURCE_ROOT}/server/main_hs.cpp
     ${PACKAGE_SOURCE_ROOT}/server/CHostServer.cpp
+    ${PACKAGE_SOURCE_ROOT}/server/CRegistrySnapshot.cpp
+    ${PACKAGE_SOURCE_ROOT}/server/CChangeLog.cpp
     ${PACKAGE_SOURCE_ROOT}/security/CHostSecurityConfig.cpp
 )
 
@@ -53,4 +57,12 @@ add_executable(lsevt
     ${PACKAGE_SOURCE_ROOT}/server/main_le.cpp
 )
 
-install(TARGETS name_server host_server lssvc lshost lsclt logsvc logviewer fdbxclient fdbxserver ntfcenter lsevt RUNTIME DESTINATION usr/bin)
+add_executable(fdbstat
+    ${PACKAGE_SOURCE_ROOT}/server/main_stat.cpp
+)
+
+add_executable(fdbtop
+    ${PACKAGE_SOURCE_ROOT}/server/main_top.cpp
+)
+
+install(TARGETS name_server host_server lssvc lshost lsclt logsvc logviewer fdbxclient fdbxserver ntfcenter lsevt fdbstat fdbtop RUNTIME DESTINATION usr/bin)
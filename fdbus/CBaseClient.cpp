@@ -39,11 +39,10 @@ CClientSocket::~CClientSocket()
     enableSessionDestroyHook(false);
 }
 
-CFdbSession *CClientSocket::connect()
+CFdbSession *CClientSocket::connect(int32_t retries)
 {
     CFdbSession *session = 0;
     auto socket = fdb_dynamic_cast_if_available<CClientSocketImp *>(mSocket);
-    int32_t retries = FDB_ADDRESS_CONNECT_RETRY_NR;
     CSocketImp *sock_imp = 0;
     bool blocking_mode = (mSocket->getAddress().mType == FDB_SOCKET_IPC) ?
                           mOwner->enableIpcBlockingMode() : mOwner->enableTcpBlockingMode();
@@ -54,8 +53,12 @@ CFdbSession *CClientSocket::connect()
             break;
         }
 
+        if (--retries <= 0)
+        {
+            break;
+        }
         FDB_CONTEXT->dispatchInput(FDB_ADDRESS_CONNECT_RETRY_INTERVAL);
-    } while (--retries > 0);
+    } while (true);
 
     if (sock_imp)
     {
@@ -185,7 +188,8 @@ void CBaseClient::cbConnect(CBaseWorker *worker, CMethodJob<CBaseClient> *job, C
     }
 }
 
-CClientSocket *CBaseClient::doConnect(const char *url, const char *host_name, int32_t udp_port)
+CClientSocket *CBaseClient::doConnect(const char *url, const char *host_name, int32_t udp_port,
+                                      const char *multicast_url, int32_t retries)
 {
     CFdbSocketAddr addr;
     EFdbSocketType skt_type;
@@ -223,6 +227,7 @@ CClientSocket *CBaseClient::doConnect(const char *url, const char *host_name, in
                 !FDB_VALID_PORT(socket_info.mAddress->mPort))
             {
                 session->container()->pendingUDPPort(udp_port);
+                session->container()->multicastGroup(multicast_url);
                 updateSessionInfo(session);
             }
         }
@@ -240,11 +245,17 @@ CClientSocket *CBaseClient::doConnect(const char *url, const char *host_name, in
         FdbSocketId_t skid = allocateEntityId();
         auto sk = new CClientSocket(this, skid, client_imp, host_name, udp_port);
         addSocket(sk);
+        sk->multicastGroup(multicast_url);
 
-        auto session = sk->connect();
+        auto session = sk->connect(retries);
         if (session)
         {
-            CFdbContext::getInstance()->registerSession(session);
+            if (!CFdbContext::getInstance()->registerSession(session))
+            {
+                delete session;
+                deleteSocket(skid);
+                return 0;
+            }
             session->attach(CFdbContext::getInstance());
             if (addConnectedSession(sk, session))
             {
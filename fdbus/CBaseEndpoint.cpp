@@ -21,6 +21,7 @@
 #include <utils/CFdbIfMessageHeader.h>
 #include <common_base/CApiSecurityConfig.h>
 #include <server/CIntraNameProxy.h>
+#include <server/CFdbIfNameServer.h>
 #include <utils/Log.h>
 
 CBaseEndpoint::CBaseEndpoint(const char *name, CBaseWorker *worker, EFdbEndpointRole role)
@@ -29,9 +30,11 @@ CBaseEndpoint::CBaseEndpoint(const char *name, CBaseWorker *worker, EFdbEndpoint
     , mSnAllocator(1)
     , mEpid(FDB_INVALID_ID)
     , mEventRouter(this)
+    , mCompressThreshold(FDB_COMPRESS_THRESHOLD)
 {
     mObjId = FDB_OBJECT_MAIN;
     mEndpoint = this;
+    mFlag |= FDB_EP_TCP_COMPRESSION;
     registerSelf();
 }
 
@@ -529,6 +532,23 @@ void CBaseEndpoint::updateSecurityLevel()
     }
 }
 
+void CBaseEndpoint::setNsName(const char *name)
+{
+    if (name)
+    {
+        std::string old_name = mNsName;
+        mNsName = name;
+        if (mName.empty())
+        {
+            mName = mNsName;
+        }
+        if (fdbValidFdbId(epid()) && mNsName.compare(old_name))
+        {
+            FDB_CONTEXT->renameEndpoint(this, old_name);
+        }
+    }
+}
+
 bool CBaseEndpoint::requestServiceAddress(const char *server_name)
 {
     if (role() == FDB_OBJECT_ROLE_NS_SERVER)
@@ -546,6 +566,13 @@ bool CBaseEndpoint::requestServiceAddress(const char *server_name)
         return false;
     }
 
+    if (role() == FDB_OBJECT_ROLE_CLIENT)
+    {
+        // connect at once if address is known, even if name server is
+        // not connected; name server will validate it
+        FDB_CONTEXT->connectCachedService(mNsName.c_str());
+    }
+
     auto name_proxy = FDB_CONTEXT->getNameProxy();
     if (!name_proxy)
     {
@@ -616,6 +643,11 @@ void CBaseEndpoint::onSidebandInvoke(CBaseJob::Ptr &msg_ref)
             }
             session->senderName(sinfo.sender_name().c_str());
             session->pid((CBASE_tProcId)sinfo.pid());
+            session->peerWireVersion(sinfo.wire_version());
+            session->compression(compressionEnabled(session) ?
+                                    (sinfo.compression() & FDB_COMPRESS_SUPPORTED) :
+                                    FDB_COMPRESS_NONE,
+                                 mCompressThreshold);
             std::string peer_ip;
             int32_t udp_port = FDB_INET_PORT_INVALID;
             if (sinfo.has_udp_port())
@@ -628,14 +660,124 @@ void CBaseEndpoint::onSidebandInvoke(CBaseJob::Ptr &msg_ref)
                 udp_addr.mAddr = peer_ip;
                 udp_addr.mPort = udp_port;
             }
+            auto &multicast_group = session->container()->multicastGroup();
+            session->multicastJoined(sinfo.has_multicast_url() && !multicast_group.mAddr.empty() &&
+                                     !sinfo.multicast_url().compare(multicast_group.mUrl));
         }
         break;
+        case FDB_SIDEBAND_QUERY_LATENCY:
+            queryLatency(msg_ref);
+        break;
+        case FDB_SIDEBAND_QUERY_TRAFFIC:
+            queryTraffic(msg_ref);
+        break;
         default:
             CFdbBaseObject::onSidebandInvoke(msg_ref);
         break;
     }
 }
 
+static void fdbFillLatencySummary(const CFdbLatencyHistogram &histogram,
+                                  NFdbBase::FdbMsgLatencySummary &msg_summary)
+{
+    CFdbLatencySummary summary;
+    histogram.summarize(summary);
+    msg_summary.set_summary(summary.mCount, summary.mMin, summary.mMax, summary.mMean,
+                            summary.mP50, summary.mP90, summary.mP99, summary.mP999);
+}
+
+void CBaseEndpoint::queryLatency(CBaseJob::Ptr &msg_ref)
+{
+    auto msg = castToMessage<CFdbMessage *>(msg_ref);
+    NFdbBase::FdbMsgLatencyStats stats;
+    stats.set_endpoint_name(mName.c_str());
+    for (int32_t type = 0; type < FDB_LATENCY_MAX; ++type)
+    {
+        auto &histograms = mLatencyStats.histograms((EFdbLatencyType)type);
+        for (auto it = histograms.begin(); it != histograms.end(); ++it)
+        {
+            auto method = stats.add_methods();
+            method->set_code(it->first);
+            method->set_type(type);
+            fdbFillLatencySummary(*it->second, method->latency());
+        }
+    }
+
+    auto queue_wait = stats.add_queue_wait();
+    queue_wait->set_worker_name(FDB_CONTEXT->name().c_str());
+    fdbFillLatencySummary(FDB_CONTEXT->queueWait(), queue_wait->latency());
+    if (worker() && (worker() != FDB_CONTEXT))
+    {
+        queue_wait = stats.add_queue_wait();
+        queue_wait->set_worker_name(worker()->name().c_str());
+        fdbFillLatencySummary(worker()->queueWait(), queue_wait->latency());
+    }
+
+    CFdbParcelableBuilder builder(stats);
+    msg->replySideband(msg_ref, builder);
+}
+
+static void fdbFillTraffic(const CFdbTrafficStats &stats, NFdbBase::FdbMsgTraffic &traffic)
+{
+    for (int32_t type = 0; type < CFdbTrafficStats::mNrMsgTypes; ++type)
+    {
+        if (stats.msgsIn(type) || stats.msgsOut(type))
+        {
+            traffic.add_types()->set_traffic(type, stats.msgsIn(type), stats.bytesIn(type),
+                                             stats.msgsOut(type), stats.bytesOut(type));
+        }
+    }
+    traffic.set_send_retries(stats.sendRetries());
+    traffic.set_send_blocked_time(stats.sendBlockedTime() / 1000);
+}
+
+void CBaseEndpoint::queryTraffic(CBaseJob::Ptr &msg_ref)
+{
+    auto msg = castToMessage<CFdbMessage *>(msg_ref);
+    NFdbBase::FdbMsgTrafficStats stats;
+    stats.set_endpoint_name(mName.c_str());
+    stats.set_server_name(mNsName.c_str());
+    stats.set_context_jobs(FDB_CONTEXT->jobQueueSize(false) + FDB_CONTEXT->jobQueueSize(true));
+    if (worker() && (worker() != FDB_CONTEXT))
+    {
+        stats.set_worker_jobs(worker()->jobQueueSize(false) + worker()->jobQueueSize(true));
+    }
+    fdbFillTraffic(mTraffic, stats.traffic());
+
+    auto &containers = getContainer();
+    for (auto socket_it = containers.begin(); socket_it != containers.end(); ++socket_it)
+    {
+        auto &tbl = socket_it->second->mConnectedSessionTable;
+        for (auto session_it = tbl.begin(); session_it != tbl.end(); ++session_it)
+        {
+            auto session = *session_it;
+            auto session_stats = stats.add_sessions();
+            session_stats->set_peer_name(session->senderName().c_str());
+            session_stats->set_pid((uint32_t)session->pid());
+            session_stats->set_pending_msgs(session->pendingMsgCount());
+            fdbFillTraffic(session->traffic(), session_stats->traffic());
+        }
+    }
+
+    CFdbParcelableBuilder builder(stats);
+    msg->replySideband(msg_ref, builder);
+}
+
+
+bool CBaseEndpoint::compressionEnabled(CFdbSession *session)
+{
+    CFdbSessionInfo sinfo;
+    session->getSessionInfo(sinfo);
+    switch (sinfo.mContainerSocket.mAddress->mType)
+    {
+        case FDB_SOCKET_TCP:
+            return enableTcpCompression();
+        case FDB_SOCKET_IPC:
+            return enableIpcCompression();
+        default:
+            return false;
+    }
+}
 
 void CBaseEndpoint::updateSessionInfo(CFdbSession *session)
 {
@@ -663,14 +805,30 @@ void CBaseEndpoint::updateSessionInfo(CFdbSession *session)
             FDB_VALID_PORT(socket_info.mAddress->mPort))
         {
             udp_port = socket_info.mAddress->mPort;
+            if (role() == FDB_OBJECT_ROLE_CLIENT)
+            {
+                session->container()->bindMulticastSocket(
+                                    sinfo_connected.mConn->mSelfAddress.mAddr.c_str());
+            }
         }
     }
     NFdbBase::FdbSessionInfo sinfo_sent;
     sinfo_sent.set_sender_name(mName.c_str());
     sinfo_sent.set_pid((uint32_t)CBaseThread::getPid());
+    if (NFdbBase::CFdbPackedMsgHeader::hostSupported())
+    {
+        // packed head is little endian and read in place
+        sinfo_sent.set_wire_version(FDB_WIRE_VERSION);
+    }
+    // always able to decompress no matter if compression is enabled locally
+    sinfo_sent.set_compression(FDB_COMPRESS_SUPPORTED);
     if (FDB_VALID_PORT(udp_port))
     {
         sinfo_sent.set_udp_port(udp_port);
+        if (session->container()->multicastBound())
+        {
+            sinfo_sent.set_multicast_url(session->container()->multicastGroup().mUrl);
+        }
     }
     CFdbParcelableBuilder builder(sinfo_sent);
     if (role() == FDB_OBJECT_ROLE_CLIENT)
@@ -44,7 +44,11 @@ void CServerSocket::onInput(bool &io_error)
     if (sock_imp)
     {
         auto session = new CFdbSession(FDB_INVALID_ID, this, sock_imp);
-        CFdbContext::getInstance()->registerSession(session);
+        if (!CFdbContext::getInstance()->registerSession(session))
+        {
+            delete session;
+            return;
+        }
         session->attach(worker());
         if (!mOwner->addConnectedSession(this, session))
         {
@@ -142,7 +146,7 @@ void CBaseServer::cbBind(CBaseWorker *worker, CMethodJob<CBaseServer> *job, CBas
 }
 
 
-CServerSocket *CBaseServer::doBind(const char *url, int32_t udp_port)
+CServerSocket *CBaseServer::doBind(const char *url, int32_t udp_port, const char *multicast_url)
 {
     CFdbSocketAddr addr;
     EFdbSocketType skt_type;
@@ -183,6 +187,7 @@ CServerSocket *CBaseServer::doBind(const char *url, int32_t udp_port)
         FdbSocketId_t skid = allocateEntityId();
         auto sk = new CServerSocket(this, skid, server_imp);
         addSocket(sk);
+        sk->multicastGroup(multicast_url);
         sk->bindUDPSocket(0, udp_port);
 
         if (sk->bind(CFdbContext::getInstance()))
@@ -17,6 +17,9 @@
 #include <common_base/CEventSubscribeHandle.h>
 #include <common_base/CFdbSession.h>
 #include <common_base/CFdbMessage.h>
+#include <common_base/CFdbSessionContainer.h>
+#include <common_base/CFdbEventCache.h>
+#include <algorithm>
 
 void CEventSubscribeHandle::subscribe(CFdbSession *session,
                                FdbMsgCode_t msg,
@@ -140,24 +143,86 @@ void CEventSubscribeHandle::unsubscribe(FdbObjectId_t obj_id)
 
 void CEventSubscribeHandle::broadcastOneMsg(CFdbSession *session,
                                      CFdbMessage *msg,
-                                     CSubscribeItem &sub_item)
+                                     CSubscribeItem &sub_item,
+                                     const CFdbEventDelta *delta)
 {
     if ((sub_item.mType == FDB_SUB_TYPE_NORMAL) || msg->manualUpdate())
     {
         if ((msg->qos() == FDB_QOS_RELIABLE) || !session->sendUDPMessage(msg))
         {
-            session->sendMessage(msg);
+            if (delta && delta->mGeneration && session->eventDelta())
+            {
+                session->sendEventDelta(msg, *delta);
+            }
+            else
+            {
+                session->sendMessage(msg);
+            }
+        }
+    }
+}
+
+void CEventSubscribeHandle::broadcastOneMsg(CFdbSession *session,
+                                            FdbObjectId_t obj_id,
+                                            CFdbMessage *msg,
+                                            CSubscribeItem &sub_item,
+                                            UDPTargetTable_t &udp_targets,
+                                            const CFdbEventDelta *delta)
+{
+    if (msg->qos() == FDB_QOS_RELIABLE)
+    {
+        broadcastOneMsg(session, msg, sub_item, delta);
+    }
+    else if ((sub_item.mType == FDB_SUB_TYPE_NORMAL) || msg->manualUpdate())
+    {
+        // sent to all UDP peers at once by broadcastUDP()
+        CUDPTarget target = {obj_id, session};
+        udp_targets.push_back(target);
+    }
+}
+
+bool CEventSubscribeHandle::compareUDPTarget(const CUDPTarget &a, const CUDPTarget &b)
+{
+    if (a.mObjId != b.mObjId)
+    {
+        return a.mObjId < b.mObjId;
+    }
+    return a.mSession->container() < b.mSession->container();
+}
+
+void CEventSubscribeHandle::broadcastUDP(CFdbMessage *msg, UDPTargetTable_t &udp_targets,
+                                         bool multicast)
+{
+    /*
+     * Message header depends on object id only; so sessions subscribing
+     * the same object through the same UDP socket share one sendmmsg().
+     */
+    std::stable_sort(udp_targets.begin(), udp_targets.end(), compareUDPTarget);
+    std::vector<CFdbSession *> sessions;
+    for (auto it = udp_targets.begin(); it != udp_targets.end();)
+    {
+        auto obj_id = it->mObjId;
+        auto container = it->mSession->container();
+        sessions.clear();
+        for (; (it != udp_targets.end()) && (it->mObjId == obj_id) &&
+                (it->mSession->container() == container); ++it)
+        {
+            sessions.push_back(it->mSession);
         }
+        msg->updateObjectId(obj_id);
+        container->sendUDPmessage(msg, sessions, multicast);
     }
 }
 
-void CEventSubscribeHandle::broadcast(CFdbMessage *msg, FdbMsgCode_t event)
+void CEventSubscribeHandle::broadcast(CFdbMessage *msg, FdbMsgCode_t event,
+                                      const CFdbEventDelta *delta)
 {
     SubscribeTable_t &subscribe_table = mEventSubscribeTable;
 
     auto it_sessions = subscribe_table.find(event);
     if (it_sessions != subscribe_table.end())
     {
+        UDPTargetTable_t udp_targets;
         auto filter = msg->topic().c_str();
         auto &sessions = it_sessions->second;
         for (auto it_objects = sessions.begin();
@@ -174,7 +239,7 @@ void CEventSubscribeHandle::broadcast(CFdbMessage *msg, FdbMsgCode_t event)
                 auto it_subitem = subitems.find(filter);
                 if (it_subitem != subitems.end())
                 {
-                    broadcastOneMsg(session, msg, it_subitem->second);
+                    broadcastOneMsg(session, object_id, msg, it_subitem->second, udp_targets, delta);
                 }
                 /*
                  * If filter doesn't match, check who registers filter "".
@@ -185,19 +250,30 @@ void CEventSubscribeHandle::broadcast(CFdbMessage *msg, FdbMsgCode_t event)
                     auto it_subitem = subitems.find("");
                     if (it_subitem != subitems.end())
                     {
-                        broadcastOneMsg(session, msg, it_subitem->second);
+                        broadcastOneMsg(session, object_id, msg, it_subitem->second, udp_targets, delta);
                     }
                 }
             }
         }
+        if (!udp_targets.empty())
+        {
+            /*
+             * Multicast receivers only accept events subscribed one by one;
+             * subscribers of event group are served with unicast.
+             */
+            broadcastUDP(msg, udp_targets, !fdbIsGroup(event));
+        }
     }
 }
 
-bool CEventSubscribeHandle::broadcast(CFdbMessage *msg, CFdbSession *session, FdbMsgCode_t event)
+CEventSubscribeHandle::CSubscribeItem *CEventSubscribeHandle::findSubscribeItem(
+                                                CFdbSession *session,
+                                                FdbObjectId_t obj_id,
+                                                FdbMsgCode_t event,
+                                                const char *filter)
 {
     SubscribeTable_t &subscribe_table = mEventSubscribeTable;
 
-    bool sent = false;
     auto it_sessions = subscribe_table.find(event);
     if (it_sessions != subscribe_table.end())
     {
@@ -206,30 +282,39 @@ bool CEventSubscribeHandle::broadcast(CFdbMessage *msg, CFdbSession *session, Fd
         if (it_objects != sessions.end())
         {
             auto &objects = it_objects->second;
-            auto it_subitems = objects.find(msg->objectId());
+            auto it_subitems = objects.find(obj_id);
             if (it_subitems != objects.end())
             {
-                auto filter = msg->topic().c_str();
                 auto &subitems = it_subitems->second;
                 auto it_subitem = subitems.find(filter);
                 if (it_subitem != subitems.end())
                 {
-                    broadcastOneMsg(session, msg, it_subitem->second);
-                    sent = true;
+                    return &it_subitem->second;
                 }
                 else if (filter[0] != '\0')
                 {
                     auto it_subitem = subitems.find("");
                     if (it_subitem != subitems.end())
                     {
-                        broadcastOneMsg(session, msg, it_subitem->second);
-                        sent = true;
+                        return &it_subitem->second;
                     }
                 }
             }
         }
     }
-    return sent;
+    return 0;
+}
+
+bool CEventSubscribeHandle::broadcast(CFdbMessage *msg, CFdbSession *session, FdbMsgCode_t event,
+                                      const CFdbEventDelta *delta)
+{
+    auto sub_item = findSubscribeItem(session, msg->objectId(), event, msg->topic().c_str());
+    if (sub_item)
+    {
+        broadcastOneMsg(session, msg, *sub_item, delta);
+        return true;
+    }
+    return false;
 }
 
 void CEventSubscribeHandle::getSubscribeTable(SessionTable_t &sessions, tFdbFilterSets &filter_tbl)
@@ -242,17 +242,24 @@ bool CFdbBaseObject::publishNoQueue(FdbMsgCode_t code, const char *topic, const
 
 void CFdbBaseObject::publishCachedEvents(CFdbSession *session)
 {
-    for (auto it_events = mEventCache.begin(); it_events != mEventCache.end(); ++it_events)
+    // cache might be updated or evicted while publishing is blocked
+    tFdbReplayItems items;
+    auto &events = mEventCache.events();
+    for (auto it_events = events.begin(); it_events != events.end(); ++it_events)
     {
         auto event_code = it_events->first;
-        auto &events = it_events->second;
-        for (auto it_data = events.begin(); it_data != events.end(); ++it_data)
+        auto &topics = it_events->second;
+        for (auto it_data = topics.begin(); it_data != topics.end(); ++it_data)
         {
-            auto &filter = it_data->first;
             auto &data = it_data->second;
-            publishNoQueue(event_code, filter.c_str(), data.mBuffer, data.mSize, session);
+            CFdbReplayItem item = {event_code, it_data->first, data.mBufferRef, data.mSize};
+            items.push_back(item);
         }
     }
+    for (auto it = items.begin(); it != items.end(); ++it)
+    {
+        publishNoQueue(it->mCode, it->mTopic.c_str(), it->mBuffer.get(), it->mSize, session);
+    }
 }
 
 bool CFdbBaseObject::get(FdbMsgCode_t code, const char *topic, int32_t timeout)
@@ -560,21 +567,59 @@ void CFdbBaseObject::callStatus(CBaseJob::Ptr &msg_ref)
     onStatus(msg_ref, error_code, description.c_str());
 }
 
-const CFdbBaseObject::CEventData *CFdbBaseObject::getCachedEventData(FdbMsgCode_t msg_code,
-                                                                     const char *filter)
+const CFdbEventCache::CEntry *CFdbBaseObject::getCachedEventData(FdbMsgCode_t msg_code,
+                                                                 const char *filter)
+{
+    return mEventCache.find(msg_code, filter);
+}
+
+/*
+ * Collect cached events of msg_code matching topic which are broadcast to
+ * the session; empty topic matches all topics.
+ */
+bool CFdbBaseObject::replayable(CFdbMessage *msg, CFdbSession *session, FdbMsgCode_t msg_code,
+                                const char *topic)
+{
+    auto sub_item = mEventSubscribeHandle.findSubscribeItem(session, msg->objectId(),
+                                                            msg_code, topic);
+    if (!sub_item)
+    {
+        sub_item = mGroupSubscribeHandle.findSubscribeItem(session, msg->objectId(),
+                                                           fdbMakeGroup(msg_code), topic);
+    }
+    return sub_item && ((sub_item->mType == FDB_SUB_TYPE_NORMAL) || msg->manualUpdate());
+}
+
+void CFdbBaseObject::getCachedEvents(CFdbMessage *msg, CFdbSession *session, FdbMsgCode_t msg_code,
+                                     const char *topic, tFdbReplayItems &items)
 {
-    auto it_filters = mEventCache.find(msg_code);
-    if (it_filters != mEventCache.end())
+    if (topic[0] != '\0')
+    {
+        auto cached_data = mEventCache.find(msg_code, topic);
+        if (cached_data && replayable(msg, session, msg_code, topic))
+        {
+            CFdbReplayItem item = {msg_code, topic, cached_data->mBufferRef, cached_data->mSize};
+            items.push_back(item);
+        }
+        return;
+    }
+
+    auto topics = mEventCache.topics(msg_code);
+    if (!topics)
+    {
+        return;
+    }
+    for (auto it_data = topics->begin(); it_data != topics->end(); ++it_data)
     {
-        auto &filters = it_filters->second;
-        auto it_filter = filters.find(filter);
-        if (it_filter != filters.end())
+        auto &cached_topic = it_data->first;
+        auto &cached_data = it_data->second;
+        if (mEventCache.touch(&cached_data) &&
+            replayable(msg, session, msg_code, cached_topic.c_str()))
         {
-            auto &data = it_filter->second;
-            return &data;
+            CFdbReplayItem item = {msg_code, cached_topic, cached_data.mBufferRef, cached_data.mSize};
+            items.push_back(item);
         }
     }
-    return 0;
 }
 
 void CFdbBaseObject::broadcastCached(CBaseJob::Ptr &msg_ref)
@@ -585,6 +630,7 @@ void CFdbBaseObject::broadcastCached(CBaseJob::Ptr &msg_ref)
     {
         return;
     }
+    tFdbReplayItems items;
     const CFdbMsgSubscribeItem *sub_item;
     /* iterate all message id subscribed */
     FDB_BEGIN_FOREACH_SIGNAL(msg, sub_item)
@@ -595,40 +641,38 @@ void CFdbBaseObject::broadcastCached(CBaseJob::Ptr &msg_ref)
         {
             topic = sub_item->filter().c_str();
         }
-        if (topic[0] == '\0')
+        // value replayed is not sent as delta; peer has to be resynced
+        session->resetEventDelta(msg->objectId(), msg_code, topic);
+        getCachedEvents(msg, session, msg_code, topic, items);
+    }
+    FDB_END_FOREACH_SIGNAL()
+
+    if (items.empty())
+    {
+        return;
+    }
+    // events are packed together unless each of them should be logged
+    if (session->replayBatch() && !msg->isLogEnabled())
+    {
+        session->sendReplay(msg, items);
+        return;
+    }
+    for (auto it = items.begin(); it != items.end(); ++it)
+    {
+        CFdbMessage broadcast_msg(it->mCode, msg, it->mTopic.c_str());
+        if (broadcast_msg.serialize(it->mBuffer.get(), it->mSize, this))
         {
-            auto it_filters = mEventCache.find(msg_code);
-            if (it_filters != mEventCache.end())
+            broadcast_msg.forceUpdate(true);
+            if ((it + 1) == items.end())
             {
-                auto &filters = it_filters->second;
-                for (auto it_data = filters.begin(); it_data != filters.end(); ++it_data)
-                {
-                    auto &cached_topic = it_data->first;
-                    auto &cached_data = it_data->second;
-                    CFdbMessage broadcast_msg(msg_code, msg, cached_topic.c_str());
-                    if (broadcast_msg.serialize(cached_data.mBuffer, cached_data.mSize, this))
-                    {
-                        broadcast_msg.forceUpdate(true);
-                        broadcast(&broadcast_msg, session);
-                    }
-                }
+                broadcast_msg.mFlag |= MSG_FLAG_REPLAY_END;
             }
-        }
-        else
-        {
-            auto cached_data = getCachedEventData(msg_code, topic);
-            if (cached_data)
+            if (!session->sendMessage(&broadcast_msg))
             {
-                CFdbMessage broadcast_msg(msg_code, msg, topic);
-                if (broadcast_msg.serialize(cached_data->mBuffer, cached_data->mSize, this))
-                {
-                    broadcast_msg.forceUpdate(true);
-                    broadcast(&broadcast_msg, session);
-                }
+                break;
             }
         }
     }
-    FDB_END_FOREACH_SIGNAL()
 }
 
 void CFdbBaseObject::doSubscribe(CBaseJob::Ptr &msg_ref)
@@ -993,16 +1037,22 @@ void CFdbBaseObject::unsubscribe(FdbObjectId_t obj_id)
     mEventSubscribeHandle.unsubscribe(obj_id);
 }
 
-bool CFdbBaseObject::updateEventCache(CFdbMessage *msg)
+bool CFdbBaseObject::updateEventCache(CFdbMessage *msg, CFdbEventDelta *delta)
 {
     if (mFlag & FDB_OBJ_ENABLE_EVENT_CACHE)
     {
         // update cached event data
-        auto &cached_event = mEventCache[msg->code()][msg->topic()];
-        auto updated = cached_event.setEventCache(msg->getPayloadBuffer(), msg->getPayloadSize());
-        if (!updated)
+        bool changed;
+        // delta is not logged in a readable way
+        if (!(mFlag & FDB_OBJ_ENABLE_EVENT_DELTA) || msg->isLogEnabled())
         {
-            if (!cached_event.mAlwaysUpdate && !msg->isForceUpdate())
+            delta = 0;
+        }
+        auto cached_event = mEventCache.update(msg->code(), msg->topic(), msg->getPayloadBuffer(),
+                                               msg->getPayloadSize(), changed, delta);
+        if (!changed)
+        {
+            if (!cached_event->mAlwaysUpdate && !msg->isForceUpdate())
             {
                 return false;
             }
@@ -1013,20 +1063,22 @@ bool CFdbBaseObject::updateEventCache(CFdbMessage *msg)
 
 void CFdbBaseObject::broadcast(CFdbMessage *msg)
 {
-    if (updateEventCache(msg))
+    CFdbEventDelta delta;
+    if (updateEventCache(msg, &delta))
     {
-        mEventSubscribeHandle.broadcast(msg, msg->code());
-        mGroupSubscribeHandle.broadcast(msg, fdbMakeGroup(msg->code()));
+        mEventSubscribeHandle.broadcast(msg, msg->code(), &delta);
+        mGroupSubscribeHandle.broadcast(msg, fdbMakeGroup(msg->code()), &delta);
     }
 }
 
 bool CFdbBaseObject::broadcast(CFdbMessage *msg, CFdbSession *session)
 {
-    if (updateEventCache(msg))
+    CFdbEventDelta delta;
+    if (updateEventCache(msg, &delta))
     {
-        if (!mEventSubscribeHandle.broadcast(msg, session, msg->code()))
+        if (!mEventSubscribeHandle.broadcast(msg, session, msg->code(), &delta))
         {
-            return mGroupSubscribeHandle.broadcast(msg, session, fdbMakeGroup(msg->code()));
+            return mGroupSubscribeHandle.broadcast(msg, session, fdbMakeGroup(msg->code()), &delta);
         }
     }
     return false;
@@ -1276,15 +1328,16 @@ void CFdbBaseObject::initEventCache(FdbMsgCode_t event
     {
         topic = "";
     }
-    auto &cached_event = mEventCache[event][topic];
-    cached_event.mAlwaysUpdate = always_update;
     int32_t size = data.build();
     if (size < 0)
     {
         return;
     }
-    cached_event.setEventCache(0, size);
-    data.toBuffer(cached_event.mBuffer, size);
+    bool changed;
+    auto cached_event = mEventCache.update(event, topic, 0, size, changed);
+    cached_event->mAlwaysUpdate = always_update;
+    data.toBuffer(cached_event->mBuffer, size);
+    mEventCache.commit(cached_event);
 }
                 
 void CFdbBaseObject::initEventCache(FdbMsgCode_t event
@@ -1297,9 +1350,9 @@ void CFdbBaseObject::initEventCache(FdbMsgCode_t event
     {
         topic = "";
     }
-    auto &cached_event = mEventCache[event][topic];
-    cached_event.mAlwaysUpdate = always_update;
-    cached_event.setEventCache((const uint8_t *)buffer, size);
+    bool changed;
+    auto cached_event = mEventCache.update(event, topic, (const uint8_t *)buffer, size, changed);
+    cached_event->mAlwaysUpdate = always_update;
 }
 
 bool CFdbBaseObject::invokeSideband(FdbMsgCode_t code
@@ -1372,74 +1425,6 @@ bool CFdbBaseObject::sendSideband(FdbMsgCode_t code, const void *buffer, int32_t
     return sendSideband(FDB_INVALID_ID, code, buffer, size);
 }
 
-CFdbBaseObject::CEventData::CEventData()
-    : mBuffer(0)
-    , mSize(0)
-    , mAlwaysUpdate(false)
-{
-}
-
-CFdbBaseObject::CEventData::~CEventData()
-{
-    if (mBuffer)
-    {
-        delete[] mBuffer;
-        mBuffer = 0;
-    }
-}
-
-bool CFdbBaseObject::CEventData::setEventCache(const uint8_t *buffer, int32_t size)
-{
-    if (size == mSize)
-    {
-        if (mBuffer)
-        {
-            if (buffer)
-            {
-                if (!memcmp(mBuffer, buffer, size))
-                {
-                    return false;
-                }
-            }
-        }
-        else if (size)
-        {
-            mBuffer = new uint8_t[size];
-        }
-    }
-    else
-    {
-        if (mBuffer)
-        {
-            delete[] mBuffer;
-            mBuffer = 0;
-        }
-
-        if (size)
-        {
-            mBuffer = new uint8_t[size];
-        }
-        mSize = size;
-    }
-
-    if (size && buffer)
-    {
-        memcpy(mBuffer, buffer, size);
-    }
-    return true;
-}
-
-void CFdbBaseObject::CEventData::replaceEventCache(uint8_t *buffer, int32_t size)
-{
-    if (mBuffer)
-    {
-        delete[] mBuffer;
-        mBuffer = 0;
-    }
-    mBuffer = buffer;
-    mSize = size;
-}
-
 void CFdbBaseObject::onSidebandInvoke(CBaseJob::Ptr &msg_ref)
 {
     auto msg = castToMessage<CFdbMessage *>(msg_ref);
@@ -1448,20 +1433,26 @@ void CFdbBaseObject::onSidebandInvoke(CBaseJob::Ptr &msg_ref)
         case FDB_SIDEBAND_QUERY_EVT_CACHE:
         {
             NFdbBase::FdbMsgEventCache msg_cache;
-            for (auto it_filters = mEventCache.begin(); it_filters != mEventCache.end(); ++it_filters)
+            auto &events = mEventCache.events();
+            for (auto it_topics = events.begin(); it_topics != events.end(); ++it_topics)
             {
-                auto event_code = it_filters->first;
-                auto &filters = it_filters->second;
-                for (auto it_data = filters.begin(); it_data != filters.end(); ++it_data)
+                auto event_code = it_topics->first;
+                auto &topics = it_topics->second;
+                for (auto it_entry = topics.begin(); it_entry != topics.end(); ++it_entry)
                 {
-                    auto &filter = it_data->first;
-                    auto &data = it_data->second;
+                    auto &topic = it_entry->first;
+                    auto &entry = it_entry->second;
                     auto cache_item = msg_cache.add_cache();
                     cache_item->set_event(event_code);
-                    cache_item->set_topic(filter.c_str());
-                    cache_item->set_size(data.mSize);
+                    cache_item->set_topic(topic.c_str());
+                    cache_item->set_size(entry.mSize);
                 }
             }
+            auto &stats = mEventCache.stats();
+            msg_cache.mutable_stats()->set_stats(stats.mHits, stats.mMisses, stats.mUpdates,
+                                                 stats.mUnchanged, stats.mEvictions,
+                                                 stats.mEntries, stats.mBytes,
+                                                 mEventCache.budget());
             CFdbParcelableBuilder builder(msg_cache);
             msg->replySideband(msg_ref, builder);
         }
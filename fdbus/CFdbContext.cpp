@@ -19,6 +19,7 @@
 #include <server/CIntraNameProxy.h>
 #include <common_base/CLogProducer.h>
 #include <utils/Log.h>
+#include <utils/CNsConfig.h>
 #include <iostream>
 
 // template<> FdbSessionId_t CFdbContext::tSessionContainer::mUniqueEntryAllocator = 0;
@@ -32,6 +33,8 @@ CFdbContext::CFdbContext()
     , mLogger(0)
     , mEnableNameProxy(true)
     , mEnableLogger(true)
+    , mEnableSvcAddrCache(true)
+    , mPersistSvcAddrCache(false)
 {
 
 }
@@ -69,6 +72,8 @@ bool CFdbContext::asyncReady()
     if (mEnableNameProxy)
     {
         auto name_proxy = new CIntraNameProxy();
+        name_proxy->enableSvcAddrCache(mEnableSvcAddrCache, mPersistSvcAddrCache ?
+                                       CNsConfig::getSvcAddrCachePath() : 0);
         name_proxy->connectToNameServer();
         mNameProxy = name_proxy;
     }
@@ -101,12 +106,12 @@ bool CFdbContext::destroy()
         delete logger;
     }
 
-    if (!mEndpointContainer.getContainer().empty())
+    if (!mEndpointContainer.empty())
     {
         std::cout << "CFdbContext: Unable to destroy context since there are active endpoint!" << std::endl;
         return false;
     }
-    if (!mSessionContainer.getContainer().empty())
+    if (!mSessionContainer.empty())
     {
         std::cout << "CFdbContext: Unable to destroy context since there are active sessions!\n" << std::endl;
         return false;
@@ -119,39 +124,35 @@ bool CFdbContext::destroy()
 
 CBaseEndpoint *CFdbContext::getEndpoint(FdbEndpointId_t endpoint_id)
 {
-    CBaseEndpoint *endpoint = 0;
-    mEndpointContainer.retrieveEntry(endpoint_id, endpoint);
-    return endpoint;
+    return mEndpointContainer.retrieveEntry(endpoint_id);
 }
 
-void CFdbContext::registerSession(CFdbSession *session)
+bool CFdbContext::registerSession(CFdbSession *session)
 {
-    auto sid = mSessionContainer.allocateEntityId();
+    auto sid = mSessionContainer.insertEntry(session);
+    if (!fdbValidFdbId(sid))
+    {
+        LOG_E("CFdbContext: too many sessions (max %u); connection is dropped!\n",
+              tSessionContainer::capacity());
+        return false;
+    }
     session->sid(sid);
-    mSessionContainer.insertEntry(sid, session);
+    return true;
 }
 
 CFdbSession *CFdbContext::getSession(FdbSessionId_t session_id)
 {
-    CFdbSession *session = 0;
-    mSessionContainer.retrieveEntry(session_id, session);
-    return session;
+    return mSessionContainer.retrieveEntry(session_id);
 }
 
 void CFdbContext::unregisterSession(FdbSessionId_t session_id)
 {
-    CFdbSession *session = 0;
-    auto it = mSessionContainer.retrieveEntry(session_id, session);
-    if (session)
-    {
-        mSessionContainer.deleteEntry(it);
-    }
+    mSessionContainer.deleteEntry(session_id);
 }
 
 void CFdbContext::deleteSession(FdbSessionId_t session_id)
 {
-    CFdbSession *session = 0;
-    (void)mSessionContainer.retrieveEntry(session_id, session);
+    auto session = mSessionContainer.retrieveEntry(session_id);
     if (session)
     {
         delete session;
@@ -160,11 +161,11 @@ void CFdbContext::deleteSession(FdbSessionId_t session_id)
 
 void CFdbContext::deleteSession(CFdbSessionContainer *container)
 {
-    auto &session_tbl = mSessionContainer.getContainer();
-    for (auto it = session_tbl.begin(); it != session_tbl.end();)
+    std::vector<CFdbSession *> sessions;
+    mSessionContainer.getEntries(sessions);
+    for (auto it = sessions.begin(); it != sessions.end(); ++it)
     {
-        CFdbSession *session = it->second;
-        ++it;
+        CFdbSession *session = *it;
         if (session->container() == container)
         {
             delete session;
@@ -177,23 +178,74 @@ FdbEndpointId_t CFdbContext::registerEndpoint(CBaseEndpoint *endpoint)
     auto id = endpoint->epid();
     if (!fdbValidFdbId(id))
     {
-        id = mEndpointContainer.allocateEntityId();
+        id = mEndpointContainer.insertEntry(endpoint);
+        if (!fdbValidFdbId(id))
+        {
+            LOG_E("CFdbContext: too many endpoints (max %u); %s is not registered!\n",
+                  tEndpointContainer::capacity(), endpoint->name().c_str());
+            return id;
+        }
         endpoint->epid(id);
-        mEndpointContainer.insertEntry(id, endpoint);
+        if (!endpoint->nsName().empty())
+        {
+            mEndpointNameTbl[endpoint->nsName()].push_back(id);
+        }
         endpoint->enableMigrate(true);
     }
     return id;
 }
 
+static void removeEndpointName(std::vector<FdbEndpointId_t> &ids, FdbEndpointId_t id)
+{
+    for (auto it = ids.begin(); it != ids.end(); ++it)
+    {
+        if (*it == id)
+        {
+            ids.erase(it);
+            break;
+        }
+    }
+}
+
 void CFdbContext::unregisterEndpoint(CBaseEndpoint *endpoint)
 {
-    CBaseEndpoint *self = 0;
-    auto it = mEndpointContainer.retrieveEntry(endpoint->epid(), self);
-    if (self)
+    auto id = endpoint->epid();
+    if (mEndpointContainer.retrieveEntry(id) == endpoint)
     {
+        auto name_it = mEndpointNameTbl.find(endpoint->nsName());
+        if (name_it != mEndpointNameTbl.end())
+        {
+            removeEndpointName(name_it->second, id);
+            if (name_it->second.empty())
+            {
+                mEndpointNameTbl.erase(name_it);
+            }
+        }
         endpoint->enableMigrate(false);
         endpoint->epid(FDB_INVALID_ID);
-        mEndpointContainer.deleteEntry(it);
+        mEndpointContainer.deleteEntry(id);
+    }
+}
+
+void CFdbContext::renameEndpoint(CBaseEndpoint *endpoint, const std::string &old_name)
+{
+    auto id = endpoint->epid();
+    if (mEndpointContainer.retrieveEntry(id) != endpoint)
+    {
+        return;
+    }
+    auto name_it = mEndpointNameTbl.find(old_name);
+    if (name_it != mEndpointNameTbl.end())
+    {
+        removeEndpointName(name_it->second, id);
+        if (name_it->second.empty())
+        {
+            mEndpointNameTbl.erase(name_it);
+        }
+    }
+    if (!endpoint->nsName().empty())
+    {
+        mEndpointNameTbl[endpoint->nsName()].push_back(id);
     }
 }
 
@@ -201,10 +253,19 @@ void CFdbContext::findEndpoint(const char *name
                                , std::vector<CBaseEndpoint *> &ep_tbl
                                , bool is_server)
 {
-    auto &container = mEndpointContainer.getContainer();
-    for (auto it = container.begin(); it != container.end(); ++it)
+    auto name_it = mEndpointNameTbl.find(name);
+    if (name_it == mEndpointNameTbl.end())
+    {
+        return;
+    }
+    auto &ids = name_it->second;
+    for (auto it = ids.begin(); it != ids.end(); ++it)
     {
-        auto endpoint = it->second;
+        auto endpoint = mEndpointContainer.retrieveEntry(*it);
+        if (!endpoint)
+        {
+            continue;
+        }
         auto found = false;
 
         if (is_server)
@@ -238,11 +299,11 @@ CIntraNameProxy *CFdbContext::getNameProxy()
 
 void CFdbContext::reconnectOnNsConnected()
 {
-    auto &container = mEndpointContainer.getContainer();
-    for (auto it = container.begin(); it != container.end(); ++it)
+    std::vector<CBaseEndpoint *> endpoints;
+    mEndpointContainer.getEntries(endpoints);
+    for (auto it = endpoints.begin(); it != endpoints.end(); ++it)
     {
-        auto endpoint = it->second;
-        endpoint->requestServiceAddress();
+        (*it)->requestServiceAddress();
     }
 }
 
@@ -256,6 +317,20 @@ void CFdbContext::enableLogger(bool enable)
     mEnableLogger = enable;
 }
 
+void CFdbContext::enableSvcAddrCache(bool enable, bool persist)
+{
+    mEnableSvcAddrCache = enable;
+    mPersistSvcAddrCache = persist;
+}
+
+void CFdbContext::connectCachedService(const char *svc_name)
+{
+    if (mNameProxy)
+    {
+        mNameProxy->connectCachedService(svc_name);
+    }
+}
+
 CLogProducer *CFdbContext::getLogger()
 {
     return mLogger;
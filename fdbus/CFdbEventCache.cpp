@@ -0,0 +1,498 @@
+/*
+ * Copyright (C) 2015   Jeremy Chen jeremy_cz@yahoo.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <common_base/CFdbEventCache.h>
+#include <common_base/CBaseSysDep.h>
+#include <utils/CFdbDeltaCodec.h>
+#include <string.h>
+#include <vector>
+
+// value smaller than this is always broadcast as it is
+#define FDB_EVENT_DELTA_MIN_SIZE    64
+
+/*
+ * Free blocks of power-of-two size classes from 64 bytes to 64K bytes.
+ * Larger buffers are allocated and released directly.
+ */
+class CFdbEventCachePool
+{
+public:
+    static const int32_t mMinClassBits = 6;
+    static const int32_t mMaxClassBits = 16;
+    static const int32_t mNrClasses = mMaxClassBits - mMinClassBits + 1;
+    // bytes of free blocks kept for each size class (at least one block)
+    static const int32_t mMaxFreeBytes = 32 * 1024;
+
+    ~CFdbEventCachePool()
+    {
+        for (int32_t i = 0; i < mNrClasses; ++i)
+        {
+            for (auto it = mFreeBlocks[i].begin(); it != mFreeBlocks[i].end(); ++it)
+            {
+                delete[] *it;
+            }
+        }
+    }
+
+    static int32_t capacity(int32_t size)
+    {
+        if (!size)
+        {
+            return 0;
+        }
+        int32_t capacity = 1 << mMinClassBits;
+        while (capacity < size)
+        {
+            if (capacity == (1 << mMaxClassBits))
+            {
+                return size;
+            }
+            capacity <<= 1;
+        }
+        return capacity;
+    }
+
+    uint8_t *alloc(int32_t capacity)
+    {
+        auto blocks = freeBlocks(capacity);
+        if (blocks && !blocks->empty())
+        {
+            auto buffer = blocks->back();
+            blocks->pop_back();
+            return buffer;
+        }
+        return new uint8_t[capacity];
+    }
+
+    void release(uint8_t *buffer, int32_t capacity)
+    {
+        auto blocks = freeBlocks(capacity);
+        if (blocks && (blocks->empty() || ((int32_t)blocks->size() < (mMaxFreeBytes / capacity))))
+        {
+            blocks->push_back(buffer);
+            return;
+        }
+        delete[] buffer;
+    }
+
+private:
+    std::vector<uint8_t *> mFreeBlocks[mNrClasses];
+
+    std::vector<uint8_t *> *freeBlocks(int32_t capacity)
+    {
+        for (int32_t i = 0; i < mNrClasses; ++i)
+        {
+            if (capacity == (1 << (mMinClassBits + i)))
+            {
+                return &mFreeBlocks[i];
+            }
+        }
+        return 0;
+    }
+};
+
+// return buffer to the pool, which lives until all buffers are returned
+struct CFdbEventCacheDeleter
+{
+    std::shared_ptr<CFdbEventCachePool> mPool;
+    int32_t mCapacity;
+
+    void operator()(uint8_t *buffer) const
+    {
+        mPool->release(buffer, mCapacity);
+    }
+};
+
+CFdbEventCache::CEntry::CEntry()
+    : mBuffer(0)
+    , mSize(0)
+    , mCapacity(0)
+    , mAlwaysUpdate(false)
+    , mGeneration(0)
+    , mCode(0)
+    , mTopic(0)
+    , mDigest(0)
+    , mUpdateTime(0)
+    , mPrev(0)
+    , mNext(0)
+{
+}
+
+CFdbEventCache::CFdbEventCache()
+    : mPool(new CFdbEventCachePool())
+    , mLruHead(0)
+    , mLruTail(0)
+    , mBudget(0)
+    , mPolicy(FDB_EVENT_CACHE_LRU)
+    , mTtl(0)
+    , mDigestEnabled(false)
+    , mGeneration(0)
+{
+}
+
+CFdbEventCache::~CFdbEventCache()
+{
+    // buffers still referred by replay return to the pool when released
+    mEvents.clear();
+}
+
+/*
+ * 64-bit MurmurHash2 (MurmurHash64A) of the payload.
+ */
+uint64_t CFdbEventCache::digest(const uint8_t *buffer, int32_t size)
+{
+    const uint64_t m = 0xc6a4a7935bd1e995ULL;
+    const int32_t r = 47;
+    uint64_t h = 0x8445d61a4e774912ULL ^ ((uint64_t)size * m);
+
+    auto end = buffer + (size & ~7);
+    for (; buffer != end; buffer += 8)
+    {
+        uint64_t k;
+        memcpy(&k, buffer, sizeof(k));
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+        h ^= k;
+        h *= m;
+    }
+
+    switch (size & 7)
+    {
+        case 7: h ^= (uint64_t)buffer[6] << 48;
+        // fall through
+        case 6: h ^= (uint64_t)buffer[5] << 40;
+        // fall through
+        case 5: h ^= (uint64_t)buffer[4] << 32;
+        // fall through
+        case 4: h ^= (uint64_t)buffer[3] << 24;
+        // fall through
+        case 3: h ^= (uint64_t)buffer[2] << 16;
+        // fall through
+        case 2: h ^= (uint64_t)buffer[1] << 8;
+        // fall through
+        case 1: h ^= (uint64_t)buffer[0];
+            h *= m;
+        default:
+            break;
+    }
+
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+    return h;
+}
+
+/*
+ * Approximate memory taken by the entry: payload buffer, topic and the
+ * node of hash table.
+ */
+uint64_t CFdbEventCache::entryCost(const CEntry *entry)
+{
+    return sizeof(CEntry) + sizeof(std::string) + 2 * sizeof(void *) +
+           entry->mTopic->size() + entry->mCapacity;
+}
+
+void CFdbEventCache::allocate(CEntry *entry, int32_t size)
+{
+    if (!size)
+    {
+        entry->mBufferRef.reset();
+        entry->mBuffer = 0;
+        entry->mCapacity = 0;
+        return;
+    }
+    auto capacity = CFdbEventCachePool::capacity(size);
+    auto buffer = mPool->alloc(capacity);
+    CFdbEventCacheDeleter deleter = {mPool, capacity};
+    entry->mBufferRef.reset(buffer, deleter);
+    entry->mBuffer = buffer;
+    entry->mCapacity = capacity;
+}
+
+void CFdbEventCache::linkHead(CEntry *entry)
+{
+    entry->mPrev = 0;
+    entry->mNext = mLruHead;
+    if (mLruHead)
+    {
+        mLruHead->mPrev = entry;
+    }
+    else
+    {
+        mLruTail = entry;
+    }
+    mLruHead = entry;
+}
+
+void CFdbEventCache::unlink(CEntry *entry)
+{
+    if (entry->mPrev)
+    {
+        entry->mPrev->mNext = entry->mNext;
+    }
+    else
+    {
+        mLruHead = entry->mNext;
+    }
+    if (entry->mNext)
+    {
+        entry->mNext->mPrev = entry->mPrev;
+    }
+    else
+    {
+        mLruTail = entry->mPrev;
+    }
+    entry->mPrev = 0;
+    entry->mNext = 0;
+}
+
+void CFdbEventCache::remove(CEntry *entry)
+{
+    unlink(entry);
+    mStats.mBytes -= entryCost(entry);
+    mStats.mEntries--;
+
+    auto it_topics = mEvents.find(entry->mCode);
+    if (it_topics == mEvents.end())
+    {
+        return;
+    }
+    auto &topics = it_topics->second;
+    auto it_entry = topics.find(*entry->mTopic);
+    if (it_entry != topics.end())
+    {
+        topics.erase(it_entry);
+    }
+    if (topics.empty())
+    {
+        mEvents.erase(it_topics);
+    }
+}
+
+bool CFdbEventCache::expired(const CEntry *entry, uint64_t now) const
+{
+    return (mPolicy == FDB_EVENT_CACHE_TTL) && mTtl && ((now - entry->mUpdateTime) > mTtl);
+}
+
+/*
+ * Evict from the least recently used (or updated) entry until the cache is
+ * within budget and no entry expires; keep is never evicted.
+ */
+void CFdbEventCache::evict(const CEntry *keep)
+{
+    uint64_t now = ((mPolicy == FDB_EVENT_CACHE_TTL) && mTtl) ? sysdep_getsystemtime_milli() : 0;
+    while (mLruTail && (mLruTail != keep))
+    {
+        if (!(mBudget && (mStats.mBytes > mBudget)) && !(now && expired(mLruTail, now)))
+        {
+            break;
+        }
+        remove(mLruTail);
+        mStats.mEvictions++;
+    }
+}
+
+CFdbEventCache::CEntry *CFdbEventCache::find(FdbMsgCode_t code, const char *topic)
+{
+    auto it_topics = mEvents.find(code);
+    if (it_topics != mEvents.end())
+    {
+        auto &topics = it_topics->second;
+        auto it_entry = topics.find(topic);
+        if (it_entry != topics.end())
+        {
+            auto entry = &it_entry->second;
+            if (touch(entry))
+            {
+                return entry;
+            }
+            remove(entry);
+            mStats.mEvictions++;
+            return 0;
+        }
+    }
+    mStats.mMisses++;
+    return 0;
+}
+
+CFdbEventCache::tTopicTable *CFdbEventCache::topics(FdbMsgCode_t code)
+{
+    auto it_topics = mEvents.find(code);
+    return (it_topics == mEvents.end()) ? 0 : &it_topics->second;
+}
+
+bool CFdbEventCache::touch(CEntry *entry)
+{
+    if ((mPolicy == FDB_EVENT_CACHE_TTL) && mTtl)
+    {
+        if (expired(entry, sysdep_getsystemtime_milli()))
+        {
+            mStats.mMisses++;
+            return false;
+        }
+    }
+    else if (entry != mLruHead)
+    {
+        unlink(entry);
+        linkHead(entry);
+    }
+    mStats.mHits++;
+    return true;
+}
+
+uint32_t CFdbEventCache::newGeneration()
+{
+    // 0 is never used so that it means 'unknown'
+    if (!++mGeneration)
+    {
+        ++mGeneration;
+    }
+    return mGeneration;
+}
+
+/*
+ * Diff is built only if it is at most half of the value; otherwise the
+ * whole value is sent.
+ */
+void CFdbEventCache::buildDelta(const CEntry *entry, const uint8_t *buffer, int32_t size,
+                                CFdbEventDelta *delta)
+{
+    if (!entry->mGeneration || !buffer)
+    {
+        return;
+    }
+    int32_t limit = size / 2;
+    delta->mDiff.resize(limit);
+    int32_t diff_size = CFdbDeltaCodec::encode(entry->mBuffer, entry->mSize, buffer, size,
+                                               delta->mDiff.data(), limit);
+    if (diff_size < 0)
+    {
+        delta->mDiff.clear();
+        return;
+    }
+    delta->mDiff.resize(diff_size);
+    delta->mBaseGeneration = entry->mGeneration;
+}
+
+CFdbEventCache::CEntry *CFdbEventCache::update(FdbMsgCode_t code, const std::string &topic,
+                                               const uint8_t *buffer, int32_t size,
+                                               bool &changed, CFdbEventDelta *delta)
+{
+    if (delta && (size < FDB_EVENT_DELTA_MIN_SIZE))
+    {
+        delta = 0;
+    }
+
+    auto &topics = mEvents[code];
+    auto it_entry = topics.find(topic);
+    CEntry *entry;
+    uint64_t cost = 0;
+    if (it_entry == topics.end())
+    {
+        it_entry = topics.insert(std::make_pair(topic, CEntry())).first;
+        entry = &it_entry->second;
+        entry->mCode = code;
+        entry->mTopic = &it_entry->first;
+        mStats.mEntries++;
+    }
+    else
+    {
+        entry = &it_entry->second;
+        cost = entryCost(entry);
+        unlink(entry);
+    }
+    linkHead(entry);
+
+    uint64_t new_digest = 0;
+    if (cost && buffer && (size == entry->mSize))
+    {
+        bool same = true;
+        if (mDigestEnabled)
+        {
+            // a different digest tells change without reading cached value
+            new_digest = digest(buffer, size);
+            same = new_digest == entry->mDigest;
+        }
+        if (same)
+        {
+            // digest might collide: only the payload tells no change
+            same = !size || !memcmp(entry->mBuffer, buffer, size);
+        }
+        if (same)
+        {
+            entry->mUpdateTime = sysdep_getsystemtime_milli();
+            mStats.mUnchanged++;
+            if (delta)
+            {
+                delta->mGeneration = entry->mGeneration;
+            }
+            changed = false;
+            return entry;
+        }
+    }
+
+    // build diff before the previous value is overwritten
+    auto generation = newGeneration();
+    if (delta)
+    {
+        buildDelta(entry, buffer, size, delta);
+        delta->mGeneration = generation;
+    }
+
+    // overwrite in place only if size class is the same and no one refers to it
+    if ((CFdbEventCachePool::capacity(size) != entry->mCapacity) || !entry->mBuffer ||
+        (entry->mBufferRef.use_count() > 1))
+    {
+        allocate(entry, size);
+    }
+    entry->mSize = size;
+    if (buffer)
+    {
+        if (size)
+        {
+            memcpy(entry->mBuffer, buffer, size);
+        }
+        if (mDigestEnabled && !new_digest)
+        {
+            new_digest = digest(buffer, size);
+        }
+    }
+    entry->mDigest = new_digest;
+    entry->mGeneration = generation;
+    entry->mUpdateTime = sysdep_getsystemtime_milli();
+    mStats.mBytes += entryCost(entry) - cost;
+    mStats.mUpdates++;
+    changed = true;
+
+    evict(entry);
+    return entry;
+}
+
+void CFdbEventCache::commit(CEntry *entry)
+{
+    if (mDigestEnabled)
+    {
+        entry->mDigest = digest(entry->mBuffer, entry->mSize);
+    }
+}
+
+void CFdbEventCache::budget(uint64_t bytes, EFdbEventCachePolicy policy, uint32_t ttl)
+{
+    mBudget = bytes;
+    mPolicy = policy;
+    mTtl = ttl;
+}
@@ -20,10 +20,14 @@
 #include <common_base/CFdbContext.h>
 #include <common_base/CNanoTimer.h>
 #include <common_base/CFdbSession.h>
+#include <common_base/CFdbSessionContainer.h>
+#include <common_base/CBaseEndpoint.h>
 #include <common_base/CLogProducer.h>
 #include <common_base/CFdbBaseObject.h>
+#include <common_base/CFdbBlockPool.h>
 #include <utils/Log.h>
 #include <utils/CFdbIfMessageHeader.h>
+#include <utils/CFdbLZ4.h>
 
 using namespace std::placeholders;
 
@@ -50,6 +54,53 @@ private:
     friend class CFdbMessage;
 };
 
+struct CFdbMsgExtension
+{
+    CFdbMsgExtension()
+        : mTimer(0)
+        , mTimeStampEnabled(false)
+        , mCompressed(0)
+        , mCompressedSize(0)
+    {}
+    ~CFdbMsgExtension()
+    {
+        if (mTimer)
+        {
+            delete mTimer;
+        }
+        dropCompressed();
+    }
+    void dropCompressed()
+    {
+        if (mCompressed)
+        {
+            delete[] mCompressed;
+            mCompressed = 0;
+        }
+        mCompressedSize = 0;
+    }
+    static void *operator new(size_t size)
+    {
+        return CFdbBlockPool::alloc(size);
+    }
+    static void operator delete(void *ptr, size_t size)
+    {
+        CFdbBlockPool::release(ptr, size);
+    }
+    std::string mToken;
+    // text of payload for logging
+    std::string mStringData;
+    CFdbMsgMetadata mTimeStamp;
+    CMessageTimer *mTimer;
+    bool mTimeStampEnabled;
+    /*
+     * Payload compressed by LZ4 and shared by all sessions the message is
+     * sent to; mCompressedSize < 0 if payload can not be compressed well.
+     */
+    uint8_t *mCompressed;
+    int32_t mCompressedSize;
+};
+
 CFdbMessage::CFdbMessage(FdbMsgCode_t code)
     : mType(FDB_MT_REQUEST)
     , mCode(code)
@@ -60,10 +111,11 @@ CFdbMessage::CFdbMessage(FdbMsgCode_t code)
     , mSid(FDB_INVALID_ID)
     , mOid(FDB_INVALID_ID)
     , mBuffer(0)
+    , mPooledSize(0)
     , mFlag(0)
-    , mTimer(0)
-    , mTimeStamp(0)
     , mQOS(FDB_QOS_RELIABLE)
+    , mExt(0)
+    , mLatencyStart(0)
 {
 }
 
@@ -75,10 +127,11 @@ CFdbMessage::CFdbMessage(FdbMsgCode_t code, CFdbBaseObject *obj, FdbSessionId_t
     , mHeadSize(0)
     , mOffset(0)
     , mBuffer(0)
+    , mPooledSize(0)
     , mFlag(0)
-    , mTimer(0)
-    , mTimeStamp(0)
     , mQOS(qos)
+    , mExt(0)
+    , mLatencyStart(0)
 {
     setDestination(obj, alt_receiver);
     if (qos == FDB_QOS_BEST_EFFORTS)
@@ -87,7 +140,7 @@ CFdbMessage::CFdbMessage(FdbMsgCode_t code, CFdbBaseObject *obj, FdbSessionId_t
     }
     if (obj->timeStampEnabled())
     {
-        mTimeStamp = new CFdbMsgMetadata();
+        enableTimeStamp(true);
     }
 }
 
@@ -101,10 +154,11 @@ CFdbMessage::CFdbMessage(FdbMsgCode_t code, CFdbMessage *msg, const char *filter
     , mSid(msg->mSid)
     , mOid(msg->mOid)
     , mBuffer(0)
+    , mPooledSize(0)
     , mFlag(MSG_FLAG_INITIAL_RESPONSE | MSG_FLAG_NOREPLY_EXPECTED)
-    , mTimer(0)
-    , mTimeStamp(0)
     , mQOS(FDB_QOS_RELIABLE)
+    , mExt(0)
+    , mLatencyStart(0)
 {
     if (filter)
     {
@@ -112,9 +166,11 @@ CFdbMessage::CFdbMessage(FdbMsgCode_t code, CFdbMessage *msg, const char *filter
     }
     mFlag |= msg->mFlag & (MSG_FLAG_MANUAL_UPDATE | MSG_FLAG_ENABLE_LOG);
 
-    if (msg->mTimeStamp)
+    auto time_stamp = msg->timeStamp();
+    if (time_stamp)
     {
-        mTimeStamp = new CFdbMsgMetadata(msg->mTimeStamp);
+        enableTimeStamp(true);
+        mExt->mTimeStamp = *time_stamp;
     }
 }
 
@@ -122,6 +178,7 @@ CFdbMessage::CFdbMessage(NFdbBase::CFdbMessageHeader &head
                          , CFdbMsgPrefix &prefix
                          , uint8_t *buffer
                          , FdbSessionId_t sid
+                         , int32_t pooled_size
                         )
     : mType(FDB_MT_REPLY)
     , mCode(head.code())
@@ -132,10 +189,11 @@ CFdbMessage::CFdbMessage(NFdbBase::CFdbMessageHeader &head
     , mSid(sid)
     , mOid(head.object_id())
     , mBuffer(buffer)
+    , mPooledSize(pooled_size)
     , mFlag((head.flag() & MSG_GLOBAL_FLAG_MASK) | MSG_FLAG_EXTERNAL_BUFFER)
-    , mTimer(0)
-    , mTimeStamp(0)
     , mQOS(head.qos())
+    , mExt(0)
+    , mLatencyStart(0)
 {
     if (head.has_broadcast_filter())
     {
@@ -143,7 +201,7 @@ CFdbMessage::CFdbMessage(NFdbBase::CFdbMessageHeader &head
     }
     if (head.has_reply_time() || head.has_send_or_arrive_time())
     {
-        mTimeStamp = new CFdbMsgMetadata();
+        enableTimeStamp(true);
     }
 };
 
@@ -160,10 +218,11 @@ CFdbMessage::CFdbMessage(FdbMsgCode_t code
     , mHeadSize(0)
     , mOffset(0)
     , mBuffer(0)
+    , mPooledSize(0)
     , mFlag(MSG_FLAG_NOREPLY_EXPECTED)
-    , mTimer(0)
-    , mTimeStamp(0)
     , mQOS(qos)
+    , mExt(0)
+    , mLatencyStart(0)
 {
     setDestination(obj, FDB_INVALID_ID);
     if (qos == FDB_QOS_BEST_EFFORTS)
@@ -192,7 +251,7 @@ CFdbMessage::CFdbMessage(FdbMsgCode_t code
     }
     if (obj->timeStampEnabled())
     {
-        mTimeStamp = new CFdbMsgMetadata();
+        enableTimeStamp(true);
     }
 }
 
@@ -205,28 +264,24 @@ CFdbMessage::CFdbMessage(const CFdbMessage *msg)
     mHeadSize = mMaxHeadSize;
     mOffset = 0;
     mBuffer = 0;
+    mPooledSize = 0;
     mSid = msg->mSid;
     mOid = msg->mOid;
     mFlag = msg->mFlag;
-    mTimer = 0;
-    mTimeStamp = 0;
     mQOS = msg->mQOS;
+    mExt = 0;
+    mLatencyStart = 0;
     allocCopyRawBuffer(msg->getPayloadBuffer(), mPayloadSize);
 }
 
 CFdbMessage::~CFdbMessage()
 {
-    if (mTimer)
+    if (mExt)
     {
-        delete mTimer;
-        mTimer = 0;
+        delete mExt;
+        mExt = 0;
     }
     releaseBuffer();
-    if (mTimeStamp)
-    {
-        delete mTimeStamp;
-        mTimeStamp = 0;
-    }
     //LOG_I("Message %d is destroyed!\n", (int32_t)mSn);
 }
 
@@ -260,7 +315,7 @@ void CFdbMessage::setToken(CFdbBaseObject *obj)
         auto token = client->token();
         if (token)
         {
-            mToken = *token;
+            extension()->mToken = *token;
         }
     }
 }
@@ -438,7 +493,7 @@ bool CFdbMessage::submit(CBaseJob::Ptr &msg_ref
         }
         if (timeout > 0)
         {
-            mTimer = new CMessageTimer(timeout);
+            extension()->mTimer = new CMessageTimer(timeout);
         }
     }
 
@@ -598,9 +653,9 @@ bool CFdbMessage::update(CBaseJob::Ptr &msg_ref
     return msg ? msg->subscribe(msg_ref, FDB_MSG_TX_SYNC, FDB_CODE_UPDATE, timeout) : false;
 }
 
-bool CFdbMessage::buildHeader()
+bool CFdbMessage::buildHeader(bool packed, NFdbBase::CFdbStringIdTable *string_ids)
 {
-    if (mFlag & MSG_FLAG_HEAD_OK)
+    if ((mFlag & MSG_FLAG_HEAD_OK) && (!!(mFlag & MSG_FLAG_HEAD_PACKED) == packed))
     {
         return true;
     }
@@ -618,9 +673,9 @@ bool CFdbMessage::buildHeader()
     msg_hdr.set_object_id(mOid);
     msg_hdr.set_payload_size(mPayloadSize);
     msg_hdr.qos(mQOS);
-    if (!mToken.empty())
+    if (mExt && !mExt->mToken.empty())
     {
-        msg_hdr.set_token(mToken.c_str());
+        msg_hdr.set_token(mExt->mToken.c_str());
     }
 
     encodeDebugInfo(msg_hdr);
@@ -630,9 +685,13 @@ bool CFdbMessage::buildHeader()
     {
         msg_hdr.set_broadcast_filter(filter);
     }
+    if (packed && string_ids)
+    {
+        msg_hdr.internStrings(*string_ids);
+    }
 
     CFdbParcelableBuilder builder(msg_hdr);
-    int32_t head_size = builder.build();
+    int32_t head_size = packed ? msg_hdr.packedSize() : builder.build();
     if ((head_size > mMaxHeadSize) || (head_size < 0))
     {
         LOG_E("CFdbMessage: Message %d of Session %d: Head is too long or error!\n", (int32_t)mCode, (int32_t)mSid);
@@ -643,16 +702,33 @@ bool CFdbMessage::buildHeader()
     int32_t prefix_offset = head_offset - mPrefixSize;
     mOffset = prefix_offset;
 
-    if (!builder.toBuffer(mBuffer + head_offset, head_size))
+    if (packed)
     {
-        return false;
+        // maxReservedSize() and packed head size are both multiple of 8
+        msg_hdr.pack(mBuffer + head_offset, head_size);
+        mFlag |= MSG_FLAG_HEAD_PACKED;
+    }
+    else
+    {
+        if (!builder.toBuffer(mBuffer + head_offset, head_size))
+        {
+            return false;
+        }
+        mFlag &= ~MSG_FLAG_HEAD_PACKED;
     }
 
     // Update offset and head size according to actual head size
     CFdbMsgPrefix prefix(getRawDataSize(), mHeadSize);
     prefix.serialize(getRawBuffer());
 
-    mFlag |= MSG_FLAG_HEAD_OK;
+    if (msg_hdr.stringsInterned())
+    {
+        mFlag &= ~MSG_FLAG_HEAD_OK;
+    }
+    else
+    {
+        mFlag |= MSG_FLAG_HEAD_OK;
+    }
     return true;
 }
 
@@ -713,7 +789,7 @@ bool CFdbMessage::serialize(IFdbMsgBuilder &data, const CFdbBaseObject *object)
         auto logger = CFdbContext::getInstance()->getLogger();
         if (logger)
         {
-            data.toString(mStringData);
+            data.toString(extension()->mStringData);
         }
     }
     return true;
@@ -737,7 +813,17 @@ bool CFdbMessage::serialize(const void *buffer, int32_t size, const CFdbBaseObje
 
 void CFdbMessage::releaseBuffer()
 {
-    if (mFlag & MSG_FLAG_EXTERNAL_BUFFER)
+    if (mExt)
+    {
+        mExt->dropCompressed();
+    }
+    if (mPooledSize)
+    {
+        CFdbBlockPool::release(mBuffer, mPooledSize);
+        mBuffer = 0;
+        mPooledSize = 0;
+    }
+    else if (mFlag & MSG_FLAG_EXTERNAL_BUFFER)
     {
         freeRawBuffer();
     }
@@ -748,6 +834,22 @@ void CFdbMessage::releaseBuffer()
     }
 }
 
+void *CFdbMessage::ownBuffer()
+{
+    void *buf = mBuffer;
+    if (mPooledSize && !CFdbBlockPool::isArray(mPooledSize))
+    {
+        // user releases the buffer with releaseBuffer(), i.e. delete[]
+        auto copy = new uint8_t[mPooledSize];
+        memcpy(copy, mBuffer, mPooledSize);
+        CFdbBlockPool::release(mBuffer, mPooledSize);
+        buf = copy;
+    }
+    mPooledSize = 0;
+    mBuffer = 0;
+    return buf;
+}
+
 void CFdbMessage::replaceBuffer(uint8_t *buffer, int32_t payload_size,
                                 int32_t head_size, int32_t offset)
 {
@@ -765,6 +867,11 @@ void CFdbMessage::doRequest(Ptr &ref)
     auto session = getSession();
     if (session)
     {
+        if (mType == FDB_MT_SUBSCRIBE_REQ)
+        {
+            // join multicast group before server might send to it
+            session->container()->updateMulticastSubscription(session, this);
+        }
         if (mFlag & MSG_FLAG_NOREPLY_EXPECTED)
         {
             if ((mQOS == FDB_QOS_RELIABLE) || !session->sendUDPMessage(this))
@@ -778,12 +885,13 @@ void CFdbMessage::doRequest(Ptr &ref)
         }
         else
         {
-            if (session->sendMessage(ref) && mTimer)
+            if (session->sendMessage(ref) && mExt && mExt->mTimer)
             {
-                mTimer->mSession = session;
+                auto timer = mExt->mTimer;
+                timer->mSession = session;
                 //TODO: store ref rather than sn for performance
-                mTimer->mMsgSn = mSn;
-                mTimer->attach(CFdbContext::getInstance());
+                timer->mMsgSn = mSn;
+                timer->attach(CFdbContext::getInstance());
             }
         }
     }
@@ -814,6 +922,12 @@ void CFdbMessage::doReply(Ptr &ref)
         auto session = getSession();
         if (session)
         {
+            if (mLatencyStart && ((mType == FDB_MT_REPLY) || (mType == FDB_MT_STATUS)))
+            {
+                session->container()->owner()->mLatencyStats.record(mCode,
+                                FDB_LATENCY_SERVER_PROCESS,
+                                mLatencyStart, CNanoTimer::getNanoSecTimer());
+            }
             session->sendMessage(this);
         }
     }
@@ -1070,7 +1184,7 @@ void CFdbMessage::setLogData(const char *log_data)
 {
     if (log_data)
     {
-        mStringData = log_data;
+        extension()->mStringData = log_data;
     }
 }
 
@@ -1088,7 +1202,8 @@ void CFdbMessage::checkLogEnabled(const CFdbBaseObject *object, bool lock)
 
 void CFdbMessage::encodeDebugInfo(NFdbBase::CFdbMessageHeader &msg_hdr)
 {
-    if (!mTimeStamp)
+    auto time_stamp = timeStamp();
+    if (!time_stamp)
     {
         return;
     }
@@ -1103,7 +1218,7 @@ void CFdbMessage::encodeDebugInfo(NFdbBase::CFdbMessageHeader &msg_hdr)
         case FDB_MT_REPLY:
         case FDB_MT_STATUS:
         case FDB_MT_RETURN_EVENT:
-            msg_hdr.set_send_or_arrive_time(mTimeStamp->mArriveTime);
+            msg_hdr.set_send_or_arrive_time(time_stamp->mArriveTime);
             msg_hdr.set_reply_time(CNanoTimer::getNanoSecTimer());
             break;
         case FDB_MT_REQUEST:
@@ -1111,8 +1226,8 @@ void CFdbMessage::encodeDebugInfo(NFdbBase::CFdbMessageHeader &msg_hdr)
         case FDB_MT_BROADCAST:
         case FDB_MT_GET_EVENT:
         case FDB_MT_PUBLISH:
-            mTimeStamp->mSendTime = CNanoTimer::getNanoSecTimer();
-            msg_hdr.set_send_or_arrive_time(mTimeStamp->mSendTime);
+            time_stamp->mSendTime = CNanoTimer::getNanoSecTimer();
+            msg_hdr.set_send_or_arrive_time(time_stamp->mSendTime);
             break;
         default:
             break;
@@ -1121,7 +1236,8 @@ void CFdbMessage::encodeDebugInfo(NFdbBase::CFdbMessageHeader &msg_hdr)
 
 void CFdbMessage::decodeDebugInfo(NFdbBase::CFdbMessageHeader &msg_hdr)
 {
-    if (!mTimeStamp)
+    auto time_stamp = timeStamp();
+    if (!time_stamp)
     {
         return;
     }
@@ -1138,23 +1254,23 @@ void CFdbMessage::decodeDebugInfo(NFdbBase::CFdbMessageHeader &msg_hdr)
         case FDB_MT_RETURN_EVENT:
             if (msg_hdr.has_send_or_arrive_time())
             {
-                mTimeStamp->mArriveTime = msg_hdr.send_or_arrive_time();
+                time_stamp->mArriveTime = msg_hdr.send_or_arrive_time();
             }
             if (msg_hdr.has_reply_time())
             {
-                mTimeStamp->mReplyTime = msg_hdr.reply_time();
+                time_stamp->mReplyTime = msg_hdr.reply_time();
             }
-            mTimeStamp->mReceiveTime = CNanoTimer::getNanoSecTimer();
+            time_stamp->mReceiveTime = CNanoTimer::getNanoSecTimer();
             break;
         case FDB_MT_REQUEST:
         case FDB_MT_SUBSCRIBE_REQ:
         case FDB_MT_BROADCAST:
         case FDB_MT_GET_EVENT:
         case FDB_MT_PUBLISH:
-            mTimeStamp->mArriveTime = CNanoTimer::getNanoSecTimer();
+            time_stamp->mArriveTime = CNanoTimer::getNanoSecTimer();
             if (msg_hdr.has_send_or_arrive_time())
             {
-                mTimeStamp->mSendTime = msg_hdr.send_or_arrive_time();
+                time_stamp->mSendTime = msg_hdr.send_or_arrive_time();
             }
             break;
         default:
@@ -1164,7 +1280,70 @@ void CFdbMessage::decodeDebugInfo(NFdbBase::CFdbMessageHeader &msg_hdr)
 
 const CFdbMsgMetadata *CFdbMessage::metadata() const
 {
-    return mTimeStamp;
+    return timeStamp();
+}
+
+CFdbMsgExtension *CFdbMessage::extension()
+{
+    if (!mExt)
+    {
+        mExt = new CFdbMsgExtension();
+    }
+    return mExt;
+}
+
+const uint8_t *CFdbMessage::compressedPayload(int32_t &size)
+{
+    auto payload = getPayloadBuffer();
+    auto payload_size = getPayloadSize();
+    if (!payload || (payload_size <= 0))
+    {
+        return 0;
+    }
+    auto ext = extension();
+    if (!ext->mCompressedSize)
+    {
+        try
+        {
+            ext->mCompressed = new uint8_t[CFdbLZ4::compressBound(payload_size)];
+        }
+        catch (...)
+        {
+            return 0;
+        }
+        ext->mCompressedSize = CFdbLZ4::compress(payload, payload_size, ext->mCompressed);
+        // not worth the cost of decompression if less than 1/16 is saved
+        if (ext->mCompressedSize >= (payload_size - (payload_size >> 4)))
+        {
+            delete[] ext->mCompressed;
+            ext->mCompressed = 0;
+            ext->mCompressedSize = -1;
+        }
+    }
+    size = ext->mCompressedSize;
+    return ext->mCompressed;
+}
+
+CFdbMsgMetadata *CFdbMessage::timeStamp() const
+{
+    return (mExt && mExt->mTimeStampEnabled) ? &mExt->mTimeStamp : 0;
+}
+
+const std::string &CFdbMessage::logData() const
+{
+    static const std::string empty;
+    return mExt ? mExt->mStringData : empty;
+}
+
+const std::string &CFdbMessage::token() const
+{
+    static const std::string empty;
+    return mExt ? mExt->mToken : empty;
+}
+
+void CFdbMessage::token(const char *tk)
+{
+    extension()->mToken = tk;
 }
 
 bool CFdbMessage::invokeSideband(int32_t timeout)
@@ -1213,18 +1392,16 @@ void CFdbMessage::enableTimeStamp(bool active)
 {
     if (active)
     {
-        if (!mTimeStamp)
+        auto ext = extension();
+        if (!ext->mTimeStampEnabled)
         {
-            mTimeStamp = new CFdbMsgMetadata();
+            ext->mTimeStamp = CFdbMsgMetadata();
+            ext->mTimeStampEnabled = true;
         }
     }
-    else
+    else if (mExt)
     {
-        if (mTimeStamp)
-        {
-            delete mTimeStamp;
-            mTimeStamp = 0;
-        }
+        mExt->mTimeStampEnabled = false;
     }
 }
 
@@ -1257,7 +1434,7 @@ bool CFdbMessage::kickDog(CBaseJob::Ptr &msg_ref, CBaseWorker *worker, tCallable
         return false;
     }
     auto msg = castToMessage<CFdbMessage *>(msg_ref);
-    msg->setCallable(fn);
+    msg->setCallable(std::move(fn));
     // watchdog message is urgent!
     return worker->sendAsync(msg_ref, true);
 }
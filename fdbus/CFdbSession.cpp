@@ -20,8 +20,12 @@
 #include <common_base/CBaseEndpoint.h>
 #include <common_base/CLogProducer.h>
 #include <common_base/CSocketImp.h>
+#include <common_base/CNanoTimer.h>
+#include <common_base/CFdbBlockPool.h>
 #include <utils/Log.h>
 #include <utils/CFdbIfMessageHeader.h>
+#include <utils/CFdbLZ4.h>
+#include <utils/CFdbDeltaCodec.h>
 
 #define FDB_SEND_RETRIES (1024 * 10)
 #define FDB_SEND_DELAY 2
@@ -30,6 +34,57 @@
 #define FDB_RECV_RETRIES FDB_SEND_RETRIES
 #define FDB_RECV_DELAY FDB_SEND_DELAY
 
+/*
+ * Payload of a broadcast packing cached events replayed upon subscribe;
+ * kept well below socket buffer so that the frame is hardly blocked.
+ */
+#define FDB_REPLAY_BATCH_SIZE (64 * 1024)
+
+/*
+ * Receive buffer of a compressed frame is no longer needed once payload is
+ * decompressed; it is kept by the thread and the next frame fitting in is
+ * received into it instead of a new buffer from heap. A frame smaller than
+ * half of the block is not taken so that little memory is wasted.
+ */
+struct CFdbRxSpareBlock
+{
+    CFdbRxSpareBlock()
+        : mBuffer(0)
+        , mSize(0)
+    {}
+    ~CFdbRxSpareBlock()
+    {
+        delete[] mBuffer;
+    }
+    uint8_t *take(int32_t &size)
+    {
+        if (!mBuffer || (size > mSize) || (size <= (mSize >> 1)))
+        {
+            return 0;
+        }
+        auto buffer = mBuffer;
+        size = mSize;
+        mBuffer = 0;
+        mSize = 0;
+        return buffer;
+    }
+    void put(uint8_t *buffer, int32_t size)
+    {
+        if (mBuffer && (mSize >= size))
+        {
+            delete[] buffer;
+            return;
+        }
+        delete[] mBuffer;
+        mBuffer = buffer;
+        mSize = size;
+    }
+    uint8_t *mBuffer;
+    int32_t mSize;
+};
+
+static thread_local CFdbRxSpareBlock fdb_rx_spare_block;
+
 CFdbSession::CFdbSession(FdbSessionId_t sid, CFdbSessionContainer *container, CSocketImp *socket)
     : CBaseFdWatch(socket->getFd(), POLLIN | POLLHUP | POLLERR)
     , mSid(sid)
@@ -37,6 +92,12 @@ CFdbSession::CFdbSession(FdbSessionId_t sid, CFdbSessionContainer *container, CS
     , mSocket(socket)
     , mSecurityLevel(FDB_SECURITY_LEVEL_NONE)
     , mRecursiveDepth(0)
+    , mMulticastJoined(false)
+    , mPeerWireVersion(0)
+    , mStringIds(new NFdbBase::CFdbStringIdTable())
+    , mCompression(FDB_COMPRESS_NONE)
+    , mCompressThreshold(FDB_COMPRESS_THRESHOLD)
+    , mRxPooledSize(0)
     , mPid(0)
 {
     mUDPAddr.mPort = FDB_INET_PORT_INVALID;
@@ -45,13 +106,17 @@ CFdbSession::CFdbSession(FdbSessionId_t sid, CFdbSessionContainer *container, CS
 
 CFdbSession::~CFdbSession()
 {
-    auto &sn_generator = mPendingMsgTable.getContainer();
-    while (!sn_generator.empty())
+    std::vector<CBaseJob::Ptr> pending_msgs;
+    while (!mPendingMsgTable.empty())
     {
-        auto it = sn_generator.begin();
-        terminateMessage(it->second, NFdbBase::FDB_ST_PEER_VANISH,
-                         "Message is destroyed due to broken connection.");
-        mPendingMsgTable.deleteEntry(it);
+        // messages might be sent when pending ones are terminated
+        mPendingMsgTable.takeEntries(pending_msgs);
+        for (auto it = pending_msgs.begin(); it != pending_msgs.end(); ++it)
+        {
+            terminateMessage(*it, NFdbBase::FDB_ST_PEER_VANISH,
+                             "Message is destroyed due to broken connection.");
+        }
+        pending_msgs.clear();
     }
 
     mContainer->owner()->deleteConnectedSession(this);
@@ -63,6 +128,8 @@ CFdbSession::~CFdbSession()
         delete mSocket;
         mSocket = 0;
     }
+    delete mStringIds;
+    mStringIds = 0;
     descriptor(0);
 
     mContainer->callSessionDestroyHook(this);
@@ -70,28 +137,63 @@ CFdbSession::~CFdbSession()
 
 bool CFdbSession::sendMessage(const uint8_t *buffer, int32_t size)
 {
-    if (fatalError() || !buffer)
+    if (!buffer)
     {
         return false;
     }
+    CFdbIoVec vec = {buffer, size};
+    return sendGather(&vec, 1);
+}
 
+/*
+ * Send pieces of data as one frame; vecs is consumed while sending.
+ */
+bool CFdbSession::sendGather(CFdbIoVec *vecs, int32_t nr_vecs)
+{
+    if (fatalError())
+    {
+        return false;
+    }
+
+    int32_t size = 0;
+    for (int32_t i = 0; i < nr_vecs; ++i)
+    {
+        size += vecs[i].mSize;
+    }
     int32_t cnt = 0;
     int32_t retries = FDB_SEND_RETRIES;
+    uint64_t blocked_start = 0;
     mRecursiveDepth++;
     while (1)
     {
-        cnt = mSocket->send((uint8_t *)buffer, size);
+        cnt = (nr_vecs == 1) ? mSocket->send(vecs->mData, vecs->mSize) :
+                               mSocket->sendGather(vecs, nr_vecs);
         if (cnt < 0)
         {
             break;
         }
-        buffer += cnt;
         size -= cnt;
+        // skip pieces sent completely and cut the one sent partially
+        while (nr_vecs && (cnt >= vecs->mSize))
+        {
+            cnt -= vecs->mSize;
+            vecs++;
+            nr_vecs--;
+        }
+        if (nr_vecs)
+        {
+            vecs->mData += cnt;
+            vecs->mSize -= cnt;
+        }
         retries--;
         if ((size <= 0) || (retries <= 0))
         {
             break;
         }
+        if (!blocked_start)
+        {
+            blocked_start = CNanoTimer::getNanoSecTimer();
+        }
         if (mRecursiveDepth < FDB_SEND_MAX_RECURSIVE)
         {
             worker()->dispatchInput(FDB_SEND_DELAY >> 1);
@@ -105,6 +207,14 @@ bool CFdbSession::sendMessage(const uint8_t *buffer, int32_t size)
     }
     mRecursiveDepth--;
 
+    if (blocked_start)
+    {
+        auto blocked_time = CNanoTimer::getNanoSecTimer() - blocked_start;
+        auto nr_retries = (uint32_t)(FDB_SEND_RETRIES - retries);
+        mTraffic.recordSendRetry(nr_retries, blocked_time);
+        mContainer->owner()->mTraffic.recordSendRetry(nr_retries, blocked_time);
+    }
+
     if ((cnt < 0) || (size > 0))
     {
         if (cnt < 0)
@@ -122,14 +232,76 @@ bool CFdbSession::sendMessage(const uint8_t *buffer, int32_t size)
     return true;
 }
 
-bool CFdbSession::sendMessage(CFdbMessage *msg)
+/*
+ * Build head marked with MSG_FLAG_COMPRESSED in message buffer for payload
+ * compressed by CFdbMessage::compressedPayload(). Head is not built if
+ * payload can not be compressed well, so that strings are not interned for
+ * a frame never sent.
+ *
+ * @oparam vecs - prefix and head in vecs[0]; compressed payload in vecs[1]
+ * @return true if payload is sent compressed
+ */
+bool CFdbSession::buildCompressedFrame(CFdbMessage *msg, NFdbBase::CFdbStringIdTable *string_ids,
+                                       CFdbIoVec *vecs)
 {
-    if (!msg->buildHeader())
+    int32_t compressed_size = 0;
+    auto compressed = msg->compressedPayload(compressed_size);
+    if (!compressed)
     {
         return false;
     }
-    if (sendMessage(msg->getRawBuffer(), msg->getRawDataSize()))
+
+    msg->mFlag |= MSG_FLAG_COMPRESSED;
+    msg->mFlag &= ~MSG_FLAG_HEAD_OK;
+    bool head_ok = msg->buildHeader(packedHead(), string_ids);
+    // head in message buffer is for compressed payload; never reuse it
+    msg->mFlag &= ~(MSG_FLAG_COMPRESSED | MSG_FLAG_HEAD_OK);
+    if (!head_ok)
     {
+        return false;
+    }
+
+    auto frame = msg->getRawBuffer();
+    auto head_size = CFdbMessage::mPrefixSize + msg->mHeadSize;
+    CFdbMsgPrefix prefix(head_size + compressed_size, msg->mHeadSize);
+    prefix.serialize(frame);
+    vecs[0].mData = frame;
+    vecs[0].mSize = head_size;
+    vecs[1].mData = compressed;
+    vecs[1].mSize = compressed_size;
+    return true;
+}
+
+bool CFdbSession::sendMessage(CFdbMessage *msg)
+{
+    bool string_id = mPeerWireVersion >= FDB_WIRE_VERSION_STRING_ID;
+    auto string_ids = string_id ? mStringIds : 0;
+    CFdbIoVec vecs[2];
+    int32_t nr_vecs = 0;
+    if ((mCompression & FDB_COMPRESS_LZ4) && (msg->getPayloadSize() >= mCompressThreshold) &&
+        buildCompressedFrame(msg, string_ids, vecs))
+    {
+        nr_vecs = 2;
+    }
+    else
+    {
+        if (!msg->buildHeader(packedHead(), string_ids))
+        {
+            return false;
+        }
+        vecs[0].mData = msg->getRawBuffer();
+        vecs[0].mSize = msg->getRawDataSize();
+        nr_vecs = 1;
+    }
+    int32_t frame_size = 0;
+    for (int32_t i = 0; i < nr_vecs; ++i)
+    {
+        frame_size += vecs[i].mSize;
+    }
+    if (sendGather(vecs, nr_vecs))
+    {
+        mTraffic.recordOut(msg->type(), frame_size);
+        mContainer->owner()->mTraffic.recordOut(msg->type(), frame_size);
         if (msg->isLogEnabled())
         {
             auto logger = CFdbContext::getInstance()->getLogger();
@@ -150,15 +322,19 @@ bool CFdbSession::sendMessage(CBaseJob::Ptr &ref)
     {
         return false;
     }
-    msg->sn(mPendingMsgTable.allocateEntityId());
+    // take the slot first since sn is allocated by the table
+    msg->sn(mPendingMsgTable.insertEntry(ref));
+    msg->mLatencyStart = CNanoTimer::getNanoSecTimer();
     if (sendMessage(msg))
     {
         msg->replaceBuffer(0); // free buffer to save memory
-        mPendingMsgTable.insertEntry(msg->sn(), ref);
+        // sync caller is woken up when reply arrives or message is terminated
+        msg->deferCompletion();
         return true;
     }
     else
     {
+        mPendingMsgTable.deleteEntry(msg->sn());
         msg->setStatusMsg(NFdbBase::FDB_ST_UNABLE_TO_SEND, "Fail when sending message!");
         if (!msg->sync())
         {
@@ -168,9 +344,210 @@ bool CFdbSession::sendMessage(CBaseJob::Ptr &ref)
     }
 }
 
+bool CFdbSession::packedHead() const
+{
+    return NFdbBase::CFdbPackedMsgHeader::hostSupported() &&
+           (mPeerWireVersion >= FDB_WIRE_VERSION_PACKED_HEAD);
+}
+
+bool CFdbSession::replayBatch() const
+{
+    return NFdbBase::CFdbPackedMsgHeader::hostSupported() &&
+           (mPeerWireVersion >= FDB_WIRE_VERSION_REPLAY_BATCH);
+}
+
+bool CFdbSession::eventDelta() const
+{
+    return NFdbBase::CFdbPackedMsgHeader::hostSupported() &&
+           (mPeerWireVersion >= FDB_WIRE_VERSION_EVENT_DELTA);
+}
+
+bool CFdbSession::sendReplay(CFdbMessage *msg, const tFdbReplayItems &items)
+{
+    std::vector<NFdbBase::CFdbPackedReplayItem> packed_items(items.size());
+    std::vector<CFdbIoVec> vecs;
+    size_t idx = 0;
+    while (idx < items.size())
+    {
+        /*
+         * vecs[0] is for prefix and head; each event is followed by pieces
+         * of item, topic and payload which is sent from the cache directly.
+         */
+        vecs.resize(1);
+        int32_t payload_size = 0;
+        auto code = items[idx].mCode;
+        for (; idx < items.size(); ++idx)
+        {
+            auto &item = items[idx];
+            int32_t topic_size = (int32_t)item.mTopic.size() + 1;
+            int32_t item_size = (int32_t)sizeof(NFdbBase::CFdbPackedReplayItem) + topic_size + item.mSize;
+            if (payload_size && ((payload_size + item_size) > FDB_REPLAY_BATCH_SIZE))
+            {
+                break;
+            }
+            auto &packed = packed_items[idx];
+            packed.mCode = item.mCode;
+            packed.mPayloadSize = (uint32_t)item.mSize;
+            packed.mTopicLength = (uint16_t)(topic_size - 1);
+            packed.mReserved = 0;
+            CFdbIoVec vec_item = {(const uint8_t *)&packed, (int32_t)sizeof(packed)};
+            vecs.push_back(vec_item);
+            CFdbIoVec vec_topic = {(const uint8_t *)item.mTopic.c_str(), topic_size};
+            vecs.push_back(vec_topic);
+            if (item.mSize)
+            {
+                CFdbIoVec vec_payload = {item.mBuffer.get(), item.mSize};
+                vecs.push_back(vec_payload);
+            }
+            payload_size += item_size;
+        }
+
+        CFdbMessage batch_msg(code, msg, 0);
+        batch_msg.mFlag |= MSG_FLAG_REPLAY_BATCH | MSG_FLAG_FORCE_UPDATE;
+        if (idx == items.size())
+        {
+            batch_msg.mFlag |= MSG_FLAG_REPLAY_END;
+        }
+
+        if ((mCompression & FDB_COMPRESS_LZ4) && (payload_size >= mCompressThreshold))
+        {
+            // compression takes payload in one buffer
+            if (!batch_msg.serialize(0, payload_size))
+            {
+                return false;
+            }
+            auto payload = batch_msg.getPayloadBuffer();
+            for (auto it = vecs.begin() + 1; it != vecs.end(); ++it)
+            {
+                memcpy(payload, it->mData, it->mSize);
+                payload += it->mSize;
+            }
+            if (!sendMessage(&batch_msg))
+            {
+                return false;
+            }
+            continue;
+        }
+
+        // only head is in the buffer; payload_size tells size of pieces
+        if (!batch_msg.serialize(0, 0))
+        {
+            return false;
+        }
+        batch_msg.mPayloadSize = payload_size;
+        if (!batch_msg.buildHeader(true, mStringIds))
+        {
+            return false;
+        }
+        int32_t frame_size = batch_msg.getRawDataSize();
+        vecs[0].mData = batch_msg.getRawBuffer();
+        vecs[0].mSize = frame_size - payload_size;
+        if (!sendGather(vecs.data(), (int32_t)vecs.size()))
+        {
+            return false;
+        }
+        mTraffic.recordOut(batch_msg.type(), frame_size);
+        mContainer->owner()->mTraffic.recordOut(batch_msg.type(), frame_size);
+    }
+    return true;
+}
+
+bool CFdbSession::sendEventDelta(CFdbMessage *msg, const CFdbEventDelta &delta)
+{
+    NFdbBase::CFdbPackedDeltaHead delta_head;
+    memset(&delta_head, 0, sizeof(delta_head));
+    delta_head.mGeneration = delta.mGeneration;
+    delta_head.mSize = (uint32_t)msg->getPayloadSize();
+    const uint8_t *data = 0;
+    int32_t data_size = 0;
+
+    auto key = eventCopyKey(msg->objectId(), msg->code());
+    auto sent_generation = mEventsSent[key][msg->topic()].mGeneration;
+    if (sent_generation && (sent_generation == delta.mGeneration))
+    {
+        // peer has the value; empty diff
+        delta_head.mType = NFdbBase::CFdbPackedDeltaHead::mTypeDiff;
+        delta_head.mBaseGeneration = delta.mGeneration;
+    }
+    else if (sent_generation && (sent_generation == delta.mBaseGeneration))
+    {
+        delta_head.mType = NFdbBase::CFdbPackedDeltaHead::mTypeDiff;
+        delta_head.mBaseGeneration = delta.mBaseGeneration;
+        data = delta.mDiff.data();
+        data_size = (int32_t)delta.mDiff.size();
+    }
+    else
+    {
+        delta_head.mType = NFdbBase::CFdbPackedDeltaHead::mTypeFull;
+        data = msg->getPayloadBuffer();
+        data_size = msg->getPayloadSize();
+    }
+
+    auto reserved = (int32_t)CFdbMessage::maxReservedSize();
+    int32_t payload_size = (int32_t)sizeof(delta_head) + data_size;
+    uint8_t *delta_buffer;
+    try
+    {
+        delta_buffer = new uint8_t[reserved + payload_size];
+    }
+    catch (...)
+    {
+        return false;
+    }
+    memcpy(delta_buffer + reserved, &delta_head, sizeof(delta_head));
+    if (data_size)
+    {
+        memcpy(delta_buffer + reserved + sizeof(delta_head), data, data_size);
+    }
+
+    // send delta in place of payload; head is rebuilt for the next session
+    auto buffer = msg->mBuffer;
+    auto size = msg->mPayloadSize;
+    auto flag = msg->mFlag;
+    msg->mBuffer = delta_buffer;
+    msg->mPayloadSize = payload_size;
+    msg->mFlag = (flag | MSG_FLAG_EVENT_DELTA) & ~MSG_FLAG_HEAD_OK;
+    bool sent = sendMessage(msg);
+    msg->mBuffer = buffer;
+    msg->mPayloadSize = size;
+    msg->mFlag = flag & ~MSG_FLAG_HEAD_OK;
+    delete[] delta_buffer;
+
+    if (sent)
+    {
+        // looked up again since the table might be changed while sending
+        mEventsSent[key][msg->topic()].mGeneration = delta.mGeneration;
+    }
+    return sent;
+}
+
+void CFdbSession::resetEventDelta(FdbObjectId_t obj_id, FdbMsgCode_t code, const char *topic)
+{
+    auto it_topics = mEventsSent.find(eventCopyKey(obj_id, code));
+    if (it_topics == mEventsSent.end())
+    {
+        return;
+    }
+    if (topic[0] == '\0')
+    {
+        mEventsSent.erase(it_topics);
+        return;
+    }
+    it_topics->second.erase(topic);
+    if (it_topics->second.empty())
+    {
+        mEventsSent.erase(it_topics);
+    }
+}
+
 bool CFdbSession::sendUDPMessage(CFdbMessage *msg)
 {
-    return mContainer->sendUDPmessage(msg, mUDPAddr);
+    if (mContainer->sendUDPmessage(msg, mUDPAddr, packedHead()))
+    {
+        mTraffic.recordOut(msg->type(), msg->getRawDataSize());
+        return true;
+    }
+    return false;
 }
 
 bool CFdbSession::receiveData(uint8_t *buf, int32_t size)
@@ -235,17 +612,21 @@ void CFdbSession::onInput(bool &io_error)
      * The leading CFdbMessage::mPrefixSize bytes are not used; just for
      * keeping uniform structure
      */
-    uint8_t *whole_buf;
-    try
-    {
-        whole_buf = new uint8_t[prefix.mTotalLength];
-    }
-    catch (...)
+    int32_t capacity = prefix.mTotalLength;
+    uint8_t *whole_buf = fdb_rx_spare_block.take(capacity);
+    if (!whole_buf)
     {
-        LOG_E("CFdbSession: Session %d: Unable to allocate buffer of size %d!\n",
-                mSid, CFdbMessage::mPrefixSize + data_size);
-        fatalError(true);
-        return;
+        try
+        {
+            whole_buf = new uint8_t[prefix.mTotalLength];
+        }
+        catch (...)
+        {
+            LOG_E("CFdbSession: Session %d: Unable to allocate buffer of size %d!\n",
+                    mSid, CFdbMessage::mPrefixSize + data_size);
+            fatalError(true);
+            return;
+        }
     }
     uint8_t *head_start = whole_buf + CFdbMessage::mPrefixSize;
     if (!receiveData(head_start, data_size))
@@ -257,8 +638,7 @@ void CFdbSession::onInput(bool &io_error)
     }
 
     NFdbBase::CFdbMessageHeader head;
-    CFdbParcelableParser parser(head);
-    if (!parser.parse(head_start, prefix.mHeadLength))
+    if (!head.decode(head_start, prefix.mHeadLength, mStringIds))
     {
         LOG_E("CFdbSession: Session %d: Unable to deserialize message head!\n", mSid);
         delete[] whole_buf;
@@ -266,6 +646,19 @@ void CFdbSession::onInput(bool &io_error)
         return;
     }
 
+    mTraffic.recordIn(head.type(), (int32_t)prefix.mTotalLength);
+    mContainer->owner()->mTraffic.recordIn(head.type(), (int32_t)prefix.mTotalLength);
+
+    mRxPooledSize = 0;
+    if ((head.flag() & MSG_FLAG_COMPRESSED) && !decompressPayload(head, prefix, whole_buf, capacity))
+    {
+        LOG_E("CFdbSession: Session %d: Unable to decompress message %d!\n",
+                mSid, (int32_t)head.serial_number());
+        delete[] whole_buf;
+        fatalError(true);
+        return;
+    }
+
     switch (head.type())
     {
         case FDB_MT_REQUEST:
@@ -307,6 +700,51 @@ void CFdbSession::onInput(bool &io_error)
     }
 }
 
+/*
+ * Decompress payload into a pooled block holding prefix, head and payload
+ * of original size, which replaces the received one and is returned to the
+ * pool when the message is destroyed; the received buffer of capacity bytes
+ * is kept for receiving later frames.
+ */
+bool CFdbSession::decompressPayload(NFdbBase::CFdbMessageHeader &head, CFdbMsgPrefix &prefix,
+                                    uint8_t *&buffer, int32_t capacity)
+{
+    int32_t payload_offset = CFdbMessage::mPrefixSize + prefix.mHeadLength;
+    int32_t compressed_size = prefix.mTotalLength - payload_offset;
+    int32_t payload_size = head.payload_size();
+    // LZ4 never expands a byte into more than 255 bytes
+    if ((compressed_size <= 0) || (payload_size < 0) ||
+        (payload_size > (int64_t)compressed_size * 255 + 16))
+    {
+        return false;
+    }
+    int32_t pooled_size = payload_offset + payload_size;
+    uint8_t *payload_buf;
+    try
+    {
+        payload_buf = (uint8_t *)CFdbBlockPool::alloc(pooled_size);
+    }
+    catch (...)
+    {
+        return false;
+    }
+    if (CFdbLZ4::decompress(buffer + payload_offset, compressed_size,
+                            payload_buf + payload_offset, payload_size) != payload_size)
+    {
+        CFdbBlockPool::release(payload_buf, pooled_size);
+        return false;
+    }
+
+    memcpy(payload_buf, buffer, payload_offset);
+    prefix.mTotalLength = payload_offset + payload_size;
+    prefix.serialize(payload_buf);
+    head.set_flag(head.flag() & ~MSG_FLAG_COMPRESSED);
+    fdb_rx_spare_block.put(buffer, capacity);
+    buffer = payload_buf;
+    mRxPooledSize = pooled_size;
+    return true;
+}
+
 void CFdbSession::onError()
 {
     onHup();
@@ -322,7 +760,7 @@ void CFdbSession::onHup()
 void CFdbSession::doRequest(NFdbBase::CFdbMessageHeader &head,
                             CFdbMsgPrefix &prefix, uint8_t *buffer)
 {
-    auto msg = new CFdbMessage(head, prefix, buffer, mSid);
+    auto msg = new CFdbMessage(head, prefix, buffer, mSid, mRxPooledSize);
     auto object = mContainer->owner()->getObject(msg, true);
     CBaseJob::Ptr msg_ref(msg);
 
@@ -333,6 +771,13 @@ void CFdbSession::doRequest(NFdbBase::CFdbMessageHeader &head,
         switch (head.type())
         {
             case FDB_MT_REQUEST:
+                msg->mLatencyStart = CNanoTimer::getNanoSecTimer();
+                if (msg->timeStamp())
+                {
+                    mContainer->owner()->mLatencyStats.record(msg->code(),
+                                FDB_LATENCY_CLIENT_TO_SERVER,
+                                msg->timeStamp()->mSendTime, msg->timeStamp()->mArriveTime);
+                }
                 if (mContainer->owner()->onMessageAuthentication(msg, this))
                 {
                     object->doInvoke(msg_ref);
@@ -390,10 +835,12 @@ void CFdbSession::doRequest(NFdbBase::CFdbMessageHeader &head,
 void CFdbSession::doResponse(NFdbBase::CFdbMessageHeader &head,
                              CFdbMsgPrefix &prefix, uint8_t *buffer)
 {
-    bool found;
-    PendingMsgTable_t::EntryContainer_t::iterator it;
-    CBaseJob::Ptr &msg_ref = mPendingMsgTable.retrieveEntry(head.serial_number(), it, found);
-    if (found)
+    /*
+     * Take the message out at once: the table might be changed by
+     * callbacks below.
+     */
+    CBaseJob::Ptr msg_ref;
+    if (mPendingMsgTable.takeEntry(head.serial_number(), msg_ref))
     {
         auto msg = castToMessage<CFdbMessage *>(msg_ref);
         auto object_id = head.object_id();
@@ -402,7 +849,6 @@ void CFdbSession::doResponse(NFdbBase::CFdbMessageHeader &head,
             LOG_E("CFdbSession: object id of response %d does not match that in request: %d\n",
                     object_id, msg->objectId());
             terminateMessage(msg_ref, NFdbBase::FDB_ST_OBJECT_NOT_FOUND, "Object ID does not match.");
-            mPendingMsgTable.deleteEntry(it);
             delete[] buffer;
             return;
         }
@@ -412,7 +858,13 @@ void CFdbSession::doResponse(NFdbBase::CFdbMessageHeader &head,
         {
             msg->update(head, prefix);
             msg->decodeDebugInfo(head);
+            if (msg->mType == FDB_MT_REQUEST)
+            {
+                mContainer->owner()->mLatencyStats.record(msg->code(), FDB_LATENCY_TOTAL,
+                                msg->mLatencyStart, CNanoTimer::getNanoSecTimer());
+            }
             msg->replaceBuffer(buffer, head.payload_size(), prefix.mHeadLength);
+            msg->mPooledSize = mRxPooledSize;
             if (!msg->sync())
             {
                 switch (head.type())
@@ -456,29 +908,40 @@ void CFdbSession::doResponse(NFdbBase::CFdbMessageHeader &head,
         }
 
         msg_ref->terminate(msg_ref);
-        mPendingMsgTable.deleteEntry(it);
     }
 }
 
 void CFdbSession::doBroadcast(NFdbBase::CFdbMessageHeader &head,
                               CFdbMsgPrefix &prefix, uint8_t *buffer)
 {
+    if (head.flag() & MSG_FLAG_REPLAY_BATCH)
+    {
+        doReplayBatch(head, prefix, buffer);
+        return;
+    }
+    if ((head.flag() & MSG_FLAG_EVENT_DELTA) && !applyEventDelta(head, prefix, buffer))
+    {
+        return;
+    }
+
     CFdbMessage *msg = 0;
     if (head.flag() & MSG_FLAG_INITIAL_RESPONSE)
     {
-        bool found;
-        PendingMsgTable_t::EntryContainer_t::iterator it;
-        CBaseJob::Ptr &msg_ref = mPendingMsgTable.retrieveEntry(head.serial_number(), it, found);
-        if (found)
+        auto msg_ref = mPendingMsgTable.retrieveEntry(head.serial_number());
+        if (msg_ref)
         {
-            auto outgoing_msg = castToMessage<CFdbMessage *>(msg_ref);
+            auto outgoing_msg = castToMessage<CFdbMessage *>(*msg_ref);
             msg = outgoing_msg->clone(head, prefix, buffer, mSid);
+            if (msg)
+            {
+                msg->mPooledSize = mRxPooledSize;
+            }
         }
     }
 
     if (!msg)
     {
-        msg = new CFdbMessage(head, prefix, buffer, mSid);
+        msg = new CFdbMessage(head, prefix, buffer, mSid, mRxPooledSize);
     }
     auto object = mContainer->owner()->getObject(msg, false);
     CBaseJob::Ptr msg_ref(msg);
@@ -489,12 +952,189 @@ void CFdbSession::doBroadcast(NFdbBase::CFdbMessageHeader &head,
     }
 }
 
+/*
+ * Rebuild payload of broadcast marked with MSG_FLAG_EVENT_DELTA into a new
+ * buffer, which replaces the received one. If diff can not be applied, the
+ * broadcast is dropped and the whole value is requested with update.
+ *
+ * @return false if the broadcast is dropped and buffer is freed
+ */
+bool CFdbSession::applyEventDelta(NFdbBase::CFdbMessageHeader &head, CFdbMsgPrefix &prefix,
+                                  uint8_t *&buffer)
+{
+    auto data = buffer + CFdbMessage::mPrefixSize + prefix.mHeadLength;
+    int32_t data_size = (int32_t)prefix.mTotalLength - CFdbMessage::mPrefixSize - (int32_t)prefix.mHeadLength;
+    NFdbBase::CFdbPackedDeltaHead delta_head;
+    if ((data_size < (int32_t)sizeof(delta_head)) ||
+        ((int32_t)head.payload_size() != data_size))
+    {
+        LOG_E("CFdbSession: Session %d: Malformed delta of event %d!\n", mSid, head.code());
+        delete[] buffer;
+        fatalError(true);
+        return false;
+    }
+    memcpy(&delta_head, data, sizeof(delta_head));
+    data += sizeof(delta_head);
+    data_size -= (int32_t)sizeof(delta_head);
+    int32_t size = (int32_t)delta_head.mSize;
+
+    auto topic = head.has_broadcast_filter() ? head.broadcast_filter().c_str() : "";
+    auto &copy = mEventsReceived[eventCopyKey(head.object_id(), head.code())][topic];
+    uint8_t *value_buffer = 0;
+    if (size >= 0)
+    {
+        try
+        {
+            value_buffer = new uint8_t[CFdbMessage::mPrefixSize + size];
+        }
+        catch (...)
+        {
+            value_buffer = 0;
+        }
+    }
+    bool applied = false;
+    if (value_buffer)
+    {
+        auto value = value_buffer + CFdbMessage::mPrefixSize;
+        if (delta_head.mType == NFdbBase::CFdbPackedDeltaHead::mTypeFull)
+        {
+            if (data_size == size)
+            {
+                memcpy(value, data, size);
+                applied = true;
+            }
+        }
+        else if (copy.mGeneration && (copy.mGeneration == delta_head.mBaseGeneration))
+        {
+            applied = CFdbDeltaCodec::decode(copy.mValue.data(), (int32_t)copy.mValue.size(),
+                                             data, data_size, value, size);
+        }
+    }
+
+    if (!applied)
+    {
+        delete[] value_buffer;
+        delete[] buffer;
+        copy.mGeneration = 0;
+        copy.mValue.clear();
+        // the whole value comes with reply of update; don't request again
+        if (!copy.mResync)
+        {
+            copy.mResync = true;
+            requestEventResync(head.object_id(), head.code(), topic);
+        }
+        return false;
+    }
+
+    copy.mValue.assign(value_buffer + CFdbMessage::mPrefixSize,
+                       value_buffer + CFdbMessage::mPrefixSize + size);
+    copy.mGeneration = delta_head.mGeneration;
+    copy.mResync = false;
+
+    head.set_flag(head.flag() & ~MSG_FLAG_EVENT_DELTA);
+    head.set_payload_size(size);
+    prefix = CFdbMsgPrefix(CFdbMessage::mPrefixSize + size, 0);
+    prefix.serialize(value_buffer);
+    delete[] buffer;
+    buffer = value_buffer;
+    mRxPooledSize = 0;
+    return true;
+}
+
+void CFdbSession::requestEventResync(FdbObjectId_t obj_id, FdbMsgCode_t code, const char *topic)
+{
+    auto endpoint = mContainer->owner();
+    auto object = (obj_id == FDB_OBJECT_MAIN) ? endpoint : endpoint->findObject(obj_id, false);
+    if (!object)
+    {
+        return;
+    }
+    LOG_I("CFdbSession: Session %d: Resync event %d, topic %s of object %d.\n",
+          mSid, code, topic, obj_id);
+    CFdbMsgTriggerList msg_list;
+    CFdbBaseObject::addTriggerItem(msg_list, code, topic);
+    object->update(msg_list);
+}
+
+/*
+ * Split broadcast packing cached events into one broadcast for each event
+ * as if they were sent one by one.
+ */
+void CFdbSession::doReplayBatch(NFdbBase::CFdbMessageHeader &head,
+                                CFdbMsgPrefix &prefix, uint8_t *buffer)
+{
+    auto data = buffer + CFdbMessage::mPrefixSize + prefix.mHeadLength;
+    int32_t left = (int32_t)prefix.mTotalLength - CFdbMessage::mPrefixSize - (int32_t)prefix.mHeadLength;
+    auto flag = head.flag() & ~(MSG_FLAG_REPLAY_BATCH | MSG_FLAG_REPLAY_END);
+    bool ok = true;
+    while (left > 0)
+    {
+        NFdbBase::CFdbPackedReplayItem item;
+        if (left < (int32_t)sizeof(item))
+        {
+            ok = false;
+            break;
+        }
+        memcpy(&item, data, sizeof(item));
+        data += sizeof(item);
+        left -= (int32_t)sizeof(item);
+
+        int32_t topic_size = item.mTopicLength + 1;
+        if ((left < topic_size) || (data[topic_size - 1] != '\0') ||
+            (item.mPayloadSize > (uint32_t)(left - topic_size)))
+        {
+            ok = false;
+            break;
+        }
+        auto topic = (const char *)data;
+        data += topic_size;
+        left -= topic_size;
+
+        int32_t payload_size = (int32_t)item.mPayloadSize;
+        uint8_t *item_buf;
+        try
+        {
+            item_buf = new uint8_t[CFdbMessage::mPrefixSize + payload_size];
+        }
+        catch (...)
+        {
+            ok = false;
+            break;
+        }
+        memcpy(item_buf + CFdbMessage::mPrefixSize, data, payload_size);
+        data += payload_size;
+        left -= payload_size;
+
+        NFdbBase::CFdbMessageHeader item_head;
+        item_head.set_type(FDB_MT_BROADCAST);
+        item_head.set_serial_number(head.serial_number());
+        item_head.set_code(item.mCode);
+        item_head.set_flag(flag | ((left > 0) ? 0 : (head.flag() & MSG_FLAG_REPLAY_END)));
+        item_head.set_object_id(head.object_id());
+        item_head.set_payload_size(payload_size);
+        item_head.qos(head.qos());
+        if (topic[0] != '\0')
+        {
+            item_head.set_broadcast_filter(topic);
+        }
+        CFdbMsgPrefix item_prefix(CFdbMessage::mPrefixSize + payload_size, 0);
+        doBroadcast(item_head, item_prefix, item_buf);
+    }
+    delete[] buffer;
+
+    if (!ok)
+    {
+        LOG_E("CFdbSession: Session %d: Unable to unpack replayed events!\n", mSid);
+        fatalError(true);
+    }
+}
+
 void CFdbSession::doSubscribeReq(NFdbBase::CFdbMessageHeader &head,
                                  CFdbMsgPrefix &prefix,
                                  uint8_t *buffer, bool subscribe)
 {
     auto object_id = head.object_id();
-    auto msg = new CFdbMessage(head, prefix, buffer, mSid);
+    auto msg = new CFdbMessage(head, prefix, buffer, mSid, mRxPooledSize);
     auto object = mContainer->owner()->getObject(msg, true);
     CBaseJob::Ptr msg_ref(msg);
     
@@ -593,7 +1233,7 @@ void CFdbSession::doUpdate(NFdbBase::CFdbMessageHeader &head,
                            CFdbMsgPrefix &prefix,
                            uint8_t *buffer)
 {
-    auto msg = new CFdbMessage(head, prefix, buffer, mSid);
+    auto msg = new CFdbMessage(head, prefix, buffer, mSid, mRxPooledSize);
     auto object = mContainer->owner()->getObject(msg, true);
     CBaseJob::Ptr msg_ref(msg);
 
@@ -630,13 +1270,10 @@ void CFdbSession::terminateMessage(CBaseJob::Ptr &job, int32_t status, const cha
 
 void CFdbSession::terminateMessage(FdbMsgSn_t msg_sn, int32_t status, const char *reason)
 {
-    bool found;
-    PendingMsgTable_t::EntryContainer_t::iterator it;
-    CBaseJob::Ptr &job = mPendingMsgTable.retrieveEntry(msg_sn, it, found);
-    if (found)
+    CBaseJob::Ptr job;
+    if (mPendingMsgTable.takeEntry(msg_sn, job))
     {
         terminateMessage(job, status, reason);
-        mPendingMsgTable.deleteEntry(it);
     }
 }
 
@@ -649,11 +1286,8 @@ void CFdbSession::getSessionInfo(CFdbSessionInfo &info)
 
 CFdbMessage *CFdbSession::peepPendingMessage(FdbMsgSn_t sn)
 {
-    bool found;
-    
-    PendingMsgTable_t::EntryContainer_t::iterator it;
-    CBaseJob::Ptr &job = mPendingMsgTable.retrieveEntry(sn, it, found);
-    return found ? castToMessage<CFdbMessage *>(job) : 0;
+    auto job = mPendingMsgTable.retrieveEntry(sn);
+    return job ? castToMessage<CFdbMessage *>(*job) : 0;
 }
 
 void CFdbSession::securityLevel(int32_t level)
@@ -20,8 +20,12 @@
 #include <common_base/CBaseSocketFactory.h>
 #include <utils/CFdbUDPSession.h>
 #include <common_base/CFdbSession.h>
+#include <common_base/CFdbMessage.h>
+#include <common_base/CFdbMsgSubscribe.h>
 #include <utils/Log.h>
 #include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
 
 CFdbSessionContainer::CFdbSessionContainer(FdbSocketId_t skid , CBaseEndpoint *owner,
                                            CBaseSocket *tcp_socket, int32_t udp_port)
@@ -32,7 +36,12 @@ CFdbSessionContainer::CFdbSessionContainer(FdbSocketId_t skid , CBaseEndpoint *o
     , mUDPSocket(0)
     , mUDPSession(0)
     , mPendingUDPPort(udp_port)
+    , mMulticastSocket(0)
+    , mMulticastSession(0)
+    , mMulticastSlots(0)
 {
+    mMulticastGroup.mType = FDB_SOCKET_UDP;
+    mMulticastGroup.mPort = FDB_INET_PORT_INVALID;
 }
 
 CFdbSessionContainer::~CFdbSessionContainer()
@@ -49,6 +58,7 @@ CFdbSessionContainer::~CFdbSessionContainer()
     {
         mOwner->deleteEntry(it);
     }
+    closeMulticastSocket();
     if (mUDPSession)
     {
         delete mUDPSession;
@@ -89,6 +99,12 @@ void CFdbSessionContainer::addSession(CFdbSession *session)
 void CFdbSessionContainer::removeSession(CFdbSession *session)
 {
     fdb_remove_value_from_container(mConnectedSessionTable, session);
+    if (mConnectedSessionTable.empty() && (mOwner->role() == FDB_OBJECT_ROLE_CLIENT))
+    {
+        // subscription is lost with the connection
+        closeMulticastSocket();
+        mMulticastSubscribeTbl.clear();
+    }
 }
 
 void CFdbSessionContainer::callSessionDestroyHook(CFdbSession *session)
@@ -175,6 +191,14 @@ bool CFdbSessionContainer::bindUDPSocket(const char *ip_address, int32_t udp_por
 
             const CFdbSocketAddr &newly_addr = socket_imp->getAddress();
             mPendingUDPPort = newly_addr.mPort;
+            if (mOwner->multicastEnabled() && (mOwner->role() == FDB_OBJECT_ROLE_SERVER) &&
+                !mMulticastGroup.mAddr.empty() &&
+                !socket_imp->setMulticastInterface(udp_addr.mAddr.c_str()))
+            {
+                LOG_E("CFdbSessionContainer: unable to multicast from %s; fall back to unicast.\n",
+                      udp_addr.mAddr.c_str());
+                mMulticastGroup.mAddr.clear();
+            }
             return true;
         }
         else
@@ -187,9 +211,302 @@ bool CFdbSessionContainer::bindUDPSocket(const char *ip_address, int32_t udp_por
     return false;
 }
 
-bool CFdbSessionContainer::sendUDPmessage(CFdbMessage *msg, const CFdbSocketAddr &dest_addr)
+bool CFdbSessionContainer::sendUDPmessage(CFdbMessage *msg, const CFdbSocketAddr &dest_addr,
+                                          bool packed_head)
+{
+    return mUDPSession ? mUDPSession->sendMessage(msg, dest_addr, packed_head) : false;
+}
+
+// every member of multicast group decodes the head, subscribed or not
+bool CFdbSessionContainer::multicastPackedHead()
+{
+    for (auto it = mConnectedSessionTable.begin(); it != mConnectedSessionTable.end(); ++it)
+    {
+        if ((*it)->multicastJoined() && !(*it)->packedHead())
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void CFdbSessionContainer::sendUDPmessage(CFdbMessage *msg, std::vector<CFdbSession *> &sessions,
+                                          bool multicast)
+{
+    std::vector<const CFdbSocketAddr *> udp_addrs;
+    std::vector<CFdbSession *> udp_sessions;
+    std::vector<CFdbSession *> multicast_sessions;
+    bool packed_head = true;
+    multicast = multicast && mOwner->multicastEnabled() && !mMulticastGroup.mAddr.empty();
+    for (auto it = sessions.begin(); it != sessions.end(); ++it)
+    {
+        auto &udp_addr = (*it)->getPeerUDPAddress();
+        if (mUDPSession && FDB_VALID_PORT(udp_addr.mPort) && !udp_addr.mAddr.empty())
+        {
+            if (multicast && (*it)->multicastJoined())
+            {
+                multicast_sessions.push_back(*it);
+            }
+            else
+            {
+                udp_addrs.push_back(&udp_addr);
+                udp_sessions.push_back(*it);
+                packed_head = packed_head && (*it)->packedHead();
+            }
+        }
+        else
+        {
+            (*it)->sendMessage(msg);
+        }
+    }
+    if (!multicast_sessions.empty())
+    {
+        CFdbSocketAddr group_addr;
+        if (getMulticastAddress(fdbEventGroup(msg->code()), group_addr) &&
+            mUDPSession->sendMessage(msg, group_addr, multicastPackedHead()))
+        {
+            for (auto it = multicast_sessions.begin(); it != multicast_sessions.end(); ++it)
+            {
+                (*it)->mTraffic.recordOut(msg->type(), msg->getRawDataSize());
+            }
+        }
+        else
+        {
+            for (auto it = multicast_sessions.begin(); it != multicast_sessions.end(); ++it)
+            {
+                udp_addrs.push_back(&(*it)->getPeerUDPAddress());
+                udp_sessions.push_back(*it);
+                packed_head = packed_head && (*it)->packedHead();
+            }
+        }
+    }
+    if (udp_sessions.empty())
+    {
+        return;
+    }
+
+    auto sent = mUDPSession->sendMessage(msg, udp_addrs.data(), (int32_t)udp_addrs.size(),
+                                         packed_head);
+    for (int32_t i = 0; i < (int32_t)udp_sessions.size(); ++i)
+    {
+        if (i < sent)
+        {
+            udp_sessions[i]->mTraffic.recordOut(msg->type(), msg->getRawDataSize());
+        }
+        else
+        {
+            udp_sessions[i]->sendMessage(msg);
+        }
+    }
+}
+
+void CFdbSessionContainer::multicastGroup(const char *url)
+{
+    CFdbSocketAddr addr;
+    if (url && CBaseSocketFactory::parseUrl(url, addr) && (addr.mType == FDB_SOCKET_UDP) &&
+        FDB_VALID_PORT(addr.mPort))
+    {
+        mMulticastGroup = addr;
+    }
+    else
+    {
+        mMulticastGroup.mAddr.clear();
+    }
+}
+
+bool CFdbSessionContainer::getMulticastAddress(FdbEventGroup_t event_group, CFdbSocketAddr &addr)
+{
+    auto pos = mMulticastGroup.mAddr.rfind('.');
+    if (pos == std::string::npos)
+    {
+        return false;
+    }
+    // group base is the first host of a block of FDB_MULTICAST_GROUP_SLOTS
+    int32_t base = atoi(mMulticastGroup.mAddr.c_str() + pos + 1);
+    char host[16];
+    snprintf(host, sizeof(host), "%d", base + (int32_t)(event_group % FDB_MULTICAST_GROUP_SLOTS));
+    addr.mAddr = mMulticastGroup.mAddr.substr(0, pos + 1) + host;
+    addr.mPort = mMulticastGroup.mPort;
+    addr.mType = FDB_SOCKET_UDP;
+    return true;
+}
+
+bool CFdbSessionContainer::bindMulticastSocket(const char *interface_ip)
+{
+    if (!mOwner->UDPEnabled() || !mOwner->multicastEnabled() || mMulticastGroup.mAddr.empty())
+    {
+        return false;
+    }
+    if (mMulticastSession)
+    {
+        return true;
+    }
+
+    CFdbSocketAddr group_addr = mMulticastGroup;
+    auto udp_socket = CBaseSocketFactory::createUDPSocket(group_addr);
+    if (!udp_socket)
+    {
+        return false;
+    }
+    auto socket_imp = udp_socket->bind();
+    if (!socket_imp)
+    {
+        LOG_E("CFdbSessionContainer: fail to bind multicast socket: %s\n",
+              mMulticastGroup.mUrl.c_str());
+        delete udp_socket;
+        return false;
+    }
+    mMulticastSocket = udp_socket;
+    mMulticastSession = new CFdbUDPSession(this, socket_imp, true);
+    mMulticastSession->attach(CFdbContext::getInstance());
+    mMulticastInterface = interface_ip ? interface_ip : "";
+    mMulticastSlots = 0;
+
+    // rejoin groups of events subscribed before
+    for (auto obj_it = mMulticastSubscribeTbl.begin(); obj_it != mMulticastSubscribeTbl.end(); ++obj_it)
+    {
+        for (auto code_it = obj_it->second.begin(); code_it != obj_it->second.end(); ++code_it)
+        {
+            if (!joinMulticastGroup(fdbEventGroup(code_it->first)))
+            {
+                closeMulticastSocket();
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void CFdbSessionContainer::closeMulticastSocket()
 {
-    return mUDPSession ? mUDPSession->sendMessage(msg, dest_addr) : false;
+    if (mMulticastSession)
+    {
+        delete mMulticastSession;
+        mMulticastSession = 0;
+    }
+    if (mMulticastSocket)
+    {
+        delete mMulticastSocket;
+        mMulticastSocket = 0;
+    }
+    mMulticastSlots = 0;
+}
+
+bool CFdbSessionContainer::joinMulticastGroup(FdbEventGroup_t event_group)
+{
+    uint32_t slot_bit = 1 << (event_group % FDB_MULTICAST_GROUP_SLOTS);
+    if (mMulticastSlots & slot_bit)
+    {
+        return true;
+    }
+    CFdbSocketAddr group_addr;
+    if (!mMulticastSession || !getMulticastAddress(event_group, group_addr))
+    {
+        return false;
+    }
+    if (!mMulticastSession->getSocket()->joinMulticastGroup(group_addr.mAddr.c_str(),
+                                                            mMulticastInterface.c_str()))
+    {
+        LOG_E("CFdbSessionContainer: fail to join multicast group %s from %s!\n",
+              group_addr.mAddr.c_str(), mMulticastInterface.c_str());
+        return false;
+    }
+    mMulticastSlots |= slot_bit;
+    return true;
+}
+
+void CFdbSessionContainer::updateMulticastSubscription(CFdbSession *session, CFdbMessage *msg)
+{
+    if (!mMulticastSession)
+    {
+        return;
+    }
+    auto subscribe = msg->code() == FDB_CODE_SUBSCRIBE;
+    if (!subscribe && (msg->code() != FDB_CODE_UNSUBSCRIBE))
+    {
+        return;
+    }
+    auto &filter_tbl = mMulticastSubscribeTbl[msg->objectId()];
+    bool success = true;
+    bool empty_list = true;
+    const CFdbMsgSubscribeItem *sub_item;
+    FDB_BEGIN_FOREACH_SIGNAL(msg, sub_item)
+    {
+        empty_list = false;
+        auto code = sub_item->msg_code();
+        // event group is served with unicast; see CEventSubscribeHandle::broadcast()
+        if (fdbIsGroup(code))
+        {
+            continue;
+        }
+        std::string filter;
+        if (sub_item->has_filter())
+        {
+            filter = sub_item->filter();
+        }
+        if (subscribe)
+        {
+            if (sub_item->has_type() && (sub_item->type() != FDB_SUB_TYPE_NORMAL))
+            {
+                continue;
+            }
+            filter_tbl[code].insert(filter);
+            if (success && !joinMulticastGroup(fdbEventGroup(code)))
+            {
+                success = false;
+            }
+        }
+        else
+        {
+            auto it = filter_tbl.find(code);
+            if (it != filter_tbl.end())
+            {
+                if (sub_item->has_filter())
+                {
+                    it->second.erase(filter);
+                }
+                if (!sub_item->has_filter() || it->second.empty())
+                {
+                    filter_tbl.erase(it);
+                }
+            }
+        }
+    }
+    FDB_END_FOREACH_SIGNAL()
+
+    if (!subscribe && empty_list)
+    {
+        // unsubscribe the whole object
+        filter_tbl.clear();
+    }
+    if (filter_tbl.empty())
+    {
+        mMulticastSubscribeTbl.erase(msg->objectId());
+    }
+    if (!success)
+    {
+        // tell server to send with unicast before the subscription is received
+        closeMulticastSocket();
+        mMulticastGroup.mAddr.clear();
+        mOwner->updateSessionInfo(session);
+    }
+}
+
+bool CFdbSessionContainer::multicastSubscribed(FdbObjectId_t obj_id, FdbMsgCode_t code,
+                                               const std::string &topic)
+{
+    auto obj_it = mMulticastSubscribeTbl.find(obj_id);
+    if (obj_it == mMulticastSubscribeTbl.end())
+    {
+        return false;
+    }
+    auto code_it = obj_it->second.find(code);
+    if (code_it == obj_it->second.end())
+    {
+        return false;
+    }
+    auto &filters = code_it->second;
+    return (filters.find(topic) != filters.end()) || (filters.find("") != filters.end());
 }
 
 bool CFdbSessionContainer::getUDPSocketInfo(CFdbSocketInfo &info)
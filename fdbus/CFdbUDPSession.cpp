@@ -20,27 +20,102 @@
 #include <common_base/CBaseEndpoint.h>
 #include <common_base/CLogProducer.h>
 #include <common_base/CSocketImp.h>
+#include <common_base/CBaseSocketFactory.h>
 #include <common_base/CFdbMessage.h>
+#include <common_base/CNanoTimer.h>
+#include <common_base/CFdbBlockPool.h>
 #include <utils/Log.h>
 #include <utils/CFdbIfMessageHeader.h>
 
 #define FDB_UDP_RECEIVE_BUFFER_SIZE     (64 * 1024 - 1)
+// datagrams received per wakeup at most
+#define FDB_UDP_RX_BATCH_SIZE           8
+// datagram bigger than this takes the receive buffer rather than a copy
+#define FDB_UDP_HANDOVER_SIZE           (16 * 1024)
 
-CFdbUDPSession::CFdbUDPSession(CFdbSessionContainer *container, CSocketImp *socket)
+/*
+ * Receive buffers shared by all UDP sessions of a worker, since a session
+ * is only read by the thread it is attached to. They are allocated on first
+ * use; a buffer handed over to a message is replaced at the next input.
+ */
+struct CFdbUDPRxBuffers
+{
+    CFdbUDPRxBuffers()
+    {
+        for (int32_t i = 0; i < FDB_UDP_RX_BATCH_SIZE; ++i)
+        {
+            mBuffers[i] = 0;
+        }
+    }
+    ~CFdbUDPRxBuffers()
+    {
+        for (int32_t i = 0; i < FDB_UDP_RX_BATCH_SIZE; ++i)
+        {
+            delete[] mBuffers[i];
+        }
+    }
+    bool alloc()
+    {
+        for (int32_t i = 0; i < FDB_UDP_RX_BATCH_SIZE; ++i)
+        {
+            if (mBuffers[i])
+            {
+                continue;
+            }
+            try
+            {
+                mBuffers[i] = new uint8_t[FDB_UDP_RECEIVE_BUFFER_SIZE];
+            }
+            catch (...)
+            {
+                LOG_E("CFdbUDPSession: Unable to allocate receive buffer!\n");
+                return false;
+            }
+        }
+        return true;
+    }
+    uint8_t *mBuffers[FDB_UDP_RX_BATCH_SIZE];
+};
+
+static thread_local CFdbUDPRxBuffers fdb_udp_rx_buffers;
+
+CFdbUDPSession::CFdbUDPSession(CFdbSessionContainer *container, CSocketImp *socket, bool multicast)
     : CBaseFdWatch(socket->getFd(), POLLIN | POLLHUP | POLLERR)
     , mContainer(container)
     , mSocket(socket)
+    , mMulticast(multicast)
+    , mFrameId(0)
+    , mReassemblySize(0)
 {
+    CBaseSocketFactory::tIpAddressTbl addr_tbl;
+    if (!multicast && CBaseSocketFactory::getIpAddress(addr_tbl))
+    {
+        for (auto it = addr_tbl.begin(); it != addr_tbl.end(); ++it)
+        {
+            mLocalAddrs.insert(it->second);
+        }
+    }
 }
 
 CFdbUDPSession::~CFdbUDPSession()
 {
-    mContainer->mUDPSession = 0;
+    if (mMulticast)
+    {
+        mContainer->mMulticastSession = 0;
+    }
+    else
+    {
+        mContainer->mUDPSession = 0;
+    }
     if (mSocket)
     {
         delete mSocket;
         mSocket = 0;
     }
+    while (!mReassemblyTbl.empty())
+    {
+        dropReassembly(mReassemblyTbl.begin());
+    }
     descriptor(0);
 }
 
@@ -54,14 +129,42 @@ bool CFdbUDPSession::sendMessage(const uint8_t *buffer, int32_t size, const CFdb
     return false;
 }
 
-bool CFdbUDPSession::sendMessage(CFdbMessage *msg, const CFdbSocketAddr &dest_addr)
+bool CFdbUDPSession::sendMessage(CFdbMessage *msg, const CFdbSocketAddr &dest_addr, bool packed_head)
+{
+    const CFdbSocketAddr *dest_addrs[] = {&dest_addr};
+    return sendMessage(msg, dest_addrs, 1, packed_head) == 1;
+}
+
+int32_t CFdbUDPSession::sendMessage(CFdbMessage *msg, const CFdbSocketAddr **dest_addrs,
+                                    int32_t nr_dests, bool packed_head)
 {
-    if (!msg->buildHeader())
+    for (int32_t i = 0; i < nr_dests; ++i)
     {
-        return false;
+        if (!FDB_VALID_PORT(dest_addrs[i]->mPort) || dest_addrs[i]->mAddr.empty())
+        {
+            // only send to peers before the invalid one
+            nr_dests = i;
+            break;
+        }
+    }
+    if (!nr_dests || !msg->buildHeader(packed_head))
+    {
+        return 0;
     }
-    if (sendMessage(msg->getRawBuffer(), msg->getRawDataSize(), dest_addr))
+    int32_t sent;
+    auto fragment_size = fragmentSize(dest_addrs, nr_dests);
+    if (msg->getRawDataSize() > fragment_size)
     {
+        sent = sendFragments(msg->getRawBuffer(), msg->getRawDataSize(), fragment_size,
+                             dest_addrs, nr_dests);
+    }
+    else
+    {
+        sent = mSocket->sendBatch(msg->getRawBuffer(), msg->getRawDataSize(), dest_addrs, nr_dests);
+    }
+    for (int32_t i = 0; i < sent; ++i)
+    {
+        mContainer->owner()->mTraffic.recordOut(msg->type(), msg->getRawDataSize());
         if (msg->isLogEnabled())
         {
             auto logger = CFdbContext::getInstance()->getLogger();
@@ -70,20 +173,104 @@ bool CFdbUDPSession::sendMessage(CFdbMessage *msg, const CFdbSocketAddr &dest_ad
                 logger->logMessage(msg, 0, mContainer->owner());
             }
         }
-        return true;
     }
-    return false;
+    return sent;
+}
+
+bool CFdbUDPSession::sameHost(const CFdbSocketAddr &addr) const
+{
+    return !addr.mAddr.compare(0, 4, "127.") || (mLocalAddrs.find(addr.mAddr) != mLocalAddrs.end());
+}
+
+int32_t CFdbUDPSession::fragmentSize(const CFdbSocketAddr **dest_addrs, int32_t nr_dests) const
+{
+    // the same fragments go to all peers, so any remote peer limits the size
+    for (int32_t i = 0; i < nr_dests; ++i)
+    {
+        if (!sameHost(*dest_addrs[i]))
+        {
+            return FDB_UDP_FRAGMENT_SIZE;
+        }
+    }
+    return FDB_UDP_LOCAL_FRAGMENT_SIZE;
 }
 
-int32_t CFdbUDPSession::receiveData(uint8_t *buf, int32_t size)
+int32_t CFdbUDPSession::sendFragments(const uint8_t *frame, int32_t size, int32_t fragment_size,
+                                      const CFdbSocketAddr **dest_addrs, int32_t nr_dests)
 {
-    return mSocket->recv(buf, size);
+    if (size > FDB_UDP_MAX_FRAME_SIZE)
+    {
+        // too big for UDP; let the caller fall back to TCP
+        return 0;
+    }
+    int32_t count = (size + fragment_size - 1) / fragment_size;
+    auto frame_id = mFrameId++;
+    std::vector<uint8_t> datagram(CFdbUDPFragmentHead::mSize + fragment_size);
+    /*
+     * A peer missing any fragment loses the whole frame, so the frame is
+     * regarded as sent to the first peers which get all fragments.
+     */
+    int32_t sent = nr_dests;
+    for (int32_t i = 0; (i < count) && sent; ++i)
+    {
+        int32_t offset = i * fragment_size;
+        int32_t length = size - offset;
+        if (length > fragment_size)
+        {
+            length = fragment_size;
+        }
+        CFdbUDPFragmentHead head((uint32_t)size, frame_id, (uint16_t)i, (uint16_t)count,
+                                 (uint32_t)fragment_size);
+        head.serialize(datagram.data());
+        memcpy(datagram.data() + CFdbUDPFragmentHead::mSize, frame + offset, length);
+        auto nr = mSocket->sendBatch(datagram.data(), CFdbUDPFragmentHead::mSize + length,
+                                     dest_addrs, sent);
+        if (nr < sent)
+        {
+            sent = nr;
+        }
+    }
+    return sent;
 }
 
 void CFdbUDPSession::onInput(bool &io_error)
 {
-    uint8_t rx_buffer[FDB_UDP_RECEIVE_BUFFER_SIZE];
-    int32_t rx_size = receiveData(rx_buffer, sizeof(rx_buffer));
+    auto &rx_buffers = fdb_udp_rx_buffers;
+    if (!rx_buffers.alloc())
+    {
+        fatalError(true);
+        return;
+    }
+    int32_t rx_sizes[FDB_UDP_RX_BATCH_SIZE];
+    uint64_t sources[FDB_UDP_RX_BATCH_SIZE];
+    int32_t nr_datagrams = mSocket->recvBatch(rx_buffers.mBuffers, FDB_UDP_RECEIVE_BUFFER_SIZE,
+                                              rx_sizes, FDB_UDP_RX_BATCH_SIZE, sources);
+    for (int32_t i = 0; i < nr_datagrams; ++i)
+    {
+        processDatagram(rx_buffers.mBuffers[i], rx_sizes[i], sources[i]);
+    }
+}
+
+static void releaseFrame(uint8_t *buffer, int32_t pooled_size)
+{
+    if (pooled_size)
+    {
+        CFdbBlockPool::release(buffer, pooled_size);
+    }
+    else
+    {
+        delete[] buffer;
+    }
+}
+
+void CFdbUDPSession::processDatagram(uint8_t *&rx_buffer, int32_t rx_size, uint64_t source)
+{
+    if (CFdbUDPFragmentHead::isFragment(rx_buffer, rx_size))
+    {
+        processFragment(rx_buffer, rx_size, source);
+        return;
+    }
+
     if (rx_size < CFdbMessage::mPrefixSize)
     {
         return;
@@ -101,13 +288,31 @@ void CFdbUDPSession::onInput(bool &io_error)
         return;
     }
     /*
-     * The leading CFdbMessage::mPrefixSize bytes are not used; just for
-     * keeping uniform structure
+     * Received datagram has the same layout as message buffer: the leading
+     * CFdbMessage::mPrefixSize bytes followed by head and payload. Small
+     * datagrams, the most of best-effort traffic, are copied to blocks of
+     * the pool; big ones take the receive buffer so that nothing is copied.
      */
     uint8_t *whole_buf;
+    int32_t pooled_size = 0;
+    if (prefix.mTotalLength > FDB_UDP_HANDOVER_SIZE)
+    {
+        whole_buf = rx_buffer;
+        rx_buffer = 0;
+        processFrame(whole_buf, 0);
+        return;
+    }
     try
     {
-        whole_buf = new uint8_t[prefix.mTotalLength];
+        if (prefix.mTotalLength <= FDB_BLOCK_MAX_SMALL_SIZE)
+        {
+            whole_buf = (uint8_t *)CFdbBlockPool::alloc(prefix.mTotalLength);
+            pooled_size = (int32_t)prefix.mTotalLength;
+        }
+        else
+        {
+            whole_buf = new uint8_t[prefix.mTotalLength];
+        }
     }
     catch (...)
     {
@@ -116,31 +321,182 @@ void CFdbUDPSession::onInput(bool &io_error)
         fatalError(true);
         return;
     }
+    memcpy(whole_buf, rx_buffer, prefix.mTotalLength);
+    processFrame(whole_buf, pooled_size);
+}
+
+void CFdbUDPSession::dropReassembly(tReassemblyTbl::iterator it)
+{
+    mReassemblySize -= it->second.mTotalLength;
+    delete[] it->second.mBuffer;
+    mReassemblyTbl.erase(it);
+}
+
+void CFdbUDPSession::expireReassembly(uint64_t now)
+{
+    for (auto it = mReassemblyTbl.begin(); it != mReassemblyTbl.end();)
+    {
+        auto the_it = it;
+        ++it;
+        if ((now - the_it->second.mStartTime) > (uint64_t)FDB_UDP_REASSEMBLY_TIMEOUT * 1000000)
+        {
+            LOG_I("CFdbUDPSession: frame %u is incomplete (%u/%u) and dropped.\n",
+                  the_it->first.second, the_it->second.mReceived, the_it->second.mCount);
+            dropReassembly(the_it);
+        }
+    }
+}
+
+bool CFdbUDPSession::reserveReassembly(uint32_t size)
+{
+    if (size > FDB_UDP_MAX_REASSEMBLY_SIZE)
+    {
+        return false;
+    }
+    // the oldest frames are the least likely to complete
+    while (!mReassemblyTbl.empty() &&
+           ((mReassemblyTbl.size() >= FDB_UDP_MAX_REASSEMBLY_FRAMES) ||
+            (mReassemblySize + size > FDB_UDP_MAX_REASSEMBLY_SIZE)))
+    {
+        auto oldest = mReassemblyTbl.begin();
+        for (auto it = mReassemblyTbl.begin(); it != mReassemblyTbl.end(); ++it)
+        {
+            if (it->second.mStartTime < oldest->second.mStartTime)
+            {
+                oldest = it;
+            }
+        }
+        dropReassembly(oldest);
+    }
+    return true;
+}
+
+void CFdbUDPSession::processFragment(const uint8_t *datagram, int32_t size, uint64_t source)
+{
+    CFdbUDPFragmentHead head(datagram);
+    if ((head.mTotalLength < (uint32_t)CFdbMessage::mPrefixSize) ||
+        (head.mTotalLength > FDB_UDP_MAX_FRAME_SIZE) ||
+        !head.mFragmentSize || (head.mFragmentSize > FDB_UDP_LOCAL_FRAGMENT_SIZE))
+    {
+        return;
+    }
+    uint32_t count = (head.mTotalLength + head.mFragmentSize - 1) / head.mFragmentSize;
+    if ((head.mCount != count) || (head.mIndex >= count))
+    {
+        return;
+    }
+    uint32_t offset = (uint32_t)head.mIndex * head.mFragmentSize;
+    uint32_t length = head.mTotalLength - offset;
+    if (length > head.mFragmentSize)
+    {
+        length = head.mFragmentSize;
+    }
+    if ((uint32_t)(size - CFdbUDPFragmentHead::mSize) != length)
+    {
+        return;
+    }
+
+    auto now = CNanoTimer::getNanoSecTimer();
+    expireReassembly(now);
+
+    auto key = std::make_pair(source, head.mFrameId);
+    auto it = mReassemblyTbl.find(key);
+    if ((it != mReassemblyTbl.end()) && ((it->second.mTotalLength != head.mTotalLength) ||
+                                         (it->second.mFragmentSize != head.mFragmentSize)))
+    {
+        // frame id is reused by a restarted peer
+        dropReassembly(it);
+        it = mReassemblyTbl.end();
+    }
+    if (it == mReassemblyTbl.end())
+    {
+        if (!reserveReassembly(head.mTotalLength))
+        {
+            return;
+        }
+        uint8_t *buffer;
+        try
+        {
+            buffer = new uint8_t[head.mTotalLength];
+        }
+        catch (...)
+        {
+            LOG_E("CFdbUDPSession: Unable to allocate buffer of size %u!\n", head.mTotalLength);
+            return;
+        }
+        auto &frame = mReassemblyTbl[key];
+        frame.mBuffer = buffer;
+        frame.mTotalLength = head.mTotalLength;
+        frame.mFragmentSize = head.mFragmentSize;
+        frame.mCount = head.mCount;
+        frame.mReceived = 0;
+        frame.mArrived.resize(count, false);
+        frame.mStartTime = now;
+        mReassemblySize += head.mTotalLength;
+        it = mReassemblyTbl.find(key);
+    }
+
+    auto &frame = it->second;
+    if (frame.mArrived[head.mIndex])
+    {
+        return;
+    }
+    frame.mArrived[head.mIndex] = true;
+    frame.mReceived++;
+    memcpy(frame.mBuffer + offset, datagram + CFdbUDPFragmentHead::mSize, length);
+    if (frame.mReceived < frame.mCount)
+    {
+        return;
+    }
+
+    uint8_t *whole_buf = frame.mBuffer;
+    frame.mBuffer = 0;
+    dropReassembly(it);
+
+    CFdbMsgPrefix prefix(whole_buf);
+    if ((prefix.mTotalLength != head.mTotalLength) ||
+        (prefix.mHeadLength > prefix.mTotalLength - CFdbMessage::mPrefixSize))
+    {
+        delete[] whole_buf;
+        return;
+    }
+    processFrame(whole_buf, 0);
+}
+
+void CFdbUDPSession::processFrame(uint8_t *whole_buf, int32_t pooled_size)
+{
+    CFdbMsgPrefix prefix(whole_buf);
     uint8_t *head_start = whole_buf + CFdbMessage::mPrefixSize;
-    memcpy(head_start, rx_buffer + CFdbMessage::mPrefixSize, data_size);
 
     NFdbBase::CFdbMessageHeader head;
-    CFdbParcelableParser parser(head);
-    if (!parser.parse(head_start, prefix.mHeadLength))
+    if (!head.decode(head_start, prefix.mHeadLength))
     {
         LOG_E("CFdbUDPSession: Unable to deserialize message head!\n");
-        delete[] whole_buf;
-        fatalError(true);
+        releaseFrame(whole_buf, pooled_size);
+        /*
+         * Anyone can send to a multicast group; drop the frame rather than
+         * leaving the group.
+         */
+        if (!mMulticast)
+        {
+            fatalError(true);
+        }
         return;
     }
+    mContainer->owner()->mTraffic.recordIn(head.type(), (int32_t)prefix.mTotalLength);
 
     switch (head.type())
     {
         case FDB_MT_BROADCAST:
-            doBroadcast(head, prefix, whole_buf);
+            doBroadcast(head, prefix, whole_buf, pooled_size);
         break;
         case FDB_MT_REQUEST:
         case FDB_MT_PUBLISH:
-            doRequest(head, prefix, whole_buf);
+            doRequest(head, prefix, whole_buf, pooled_size);
         break;
         default:
             LOG_E("CFdbUDPSession: Message %d: Unknown type!\n", (int32_t)head.serial_number());
-            delete[] whole_buf;
+            releaseFrame(whole_buf, pooled_size);
         break;
     }
 }
@@ -154,9 +510,23 @@ void CFdbUDPSession::onHup()
 }
 
 void CFdbUDPSession::doBroadcast(NFdbBase::CFdbMessageHeader &head,
-                                 CFdbMsgPrefix &prefix, uint8_t *buffer)
+                                 CFdbMsgPrefix &prefix, uint8_t *buffer, int32_t pooled_size)
 {
-    auto msg = new CFdbMessage(head, prefix, buffer, FDB_INVALID_ID);
+    /*
+     * All members of multicast group get the broadcast; drop those of
+     * events (or topics) not subscribed.
+     */
+    if (mMulticast)
+    {
+        static const std::string no_topic;
+        auto &topic = head.has_broadcast_filter() ? head.broadcast_filter() : no_topic;
+        if (!mContainer->multicastSubscribed(head.object_id(), head.code(), topic))
+        {
+            releaseFrame(buffer, pooled_size);
+            return;
+        }
+    }
+    auto msg = new CFdbMessage(head, prefix, buffer, FDB_INVALID_ID, pooled_size);
     auto object = mContainer->owner()->getObject(msg, false);
     CBaseJob::Ptr msg_ref(msg);
     if (object)
@@ -167,9 +537,15 @@ void CFdbUDPSession::doBroadcast(NFdbBase::CFdbMessageHeader &head,
 }
 
 void CFdbUDPSession::doRequest(NFdbBase::CFdbMessageHeader &head,
-                               CFdbMsgPrefix &prefix, uint8_t *buffer)
+                               CFdbMsgPrefix &prefix, uint8_t *buffer, int32_t pooled_size)
 {
-    auto msg = new CFdbMessage(head, prefix, buffer, FDB_INVALID_ID);
+    if (mMulticast)
+    {
+        // multicast group carries nothing but broadcast
+        releaseFrame(buffer, pooled_size);
+        return;
+    }
+    auto msg = new CFdbMessage(head, prefix, buffer, FDB_INVALID_ID, pooled_size);
     auto object = mContainer->owner()->getObject(msg, true);
     CBaseJob::Ptr msg_ref(msg);
 
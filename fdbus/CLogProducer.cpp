@@ -273,9 +273,9 @@ void CLogProducer::logMessage(CFdbMessage *msg, const char *sender_name, CBaseEn
                          << msg->objectId()
                          ;
 
-    if (!msg->mStringData.empty())
+    if (!msg->logData().empty())
     {
-        builder.serializer() << true << msg->mStringData;
+        builder.serializer() << true << msg->logData();
         sendLogNoQueue(NFdbBase::REQ_FDBUS_LOG, builder);
     }
     else
@@ -19,6 +19,7 @@
 #include <sys/time.h>
 #include <common_base/CBaseSysDep.h>
 #include <sys/utsname.h>
+#include <unistd.h>
 
 uint64_t sysdep_getsystemtime_milli()
 {
@@ -76,3 +77,21 @@ void sysdep_gethostname(char *name, int32_t size)
     }
 }
 
+
+void sysdep_getprocname(char *name, int32_t size)
+{
+    if (size <= 0)
+    {
+        return;
+    }
+    name[0] = '\0';
+    char path[256];
+    auto len = readlink("/proc/self/exe", path, sizeof(path) - 1);
+    if (len > 0)
+    {
+        path[len] = '\0';
+        const char *base = strrchr(path, '/');
+        strncpy(name, base ? base + 1 : path, size);
+        name[size - 1] = '\0';
+    }
+}
@@ -16,8 +16,14 @@
 
 #include <errno.h>
 #include <stdlib.h>
+#include <sched.h>
+#include <unistd.h>
 #include <common_base/CBaseThread.h>
+#include <utils/Log.h>
 #include <cstring>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
 
 // Min/max thread priority range for QNX
 static const int32_t MIN_THREAD_PRIORITY = 8;
@@ -78,7 +84,11 @@ bool CBaseThread::start(uint32_t flag)
             {
                 if (!pthread_create(&mThread, &threadAttr, threadFunc, this))
                 {
-                    applyPriority(mPriority);
+                    if (mSchedAttr.mPolicy == FDB_SCHED_INHERIT)
+                    {
+                        // otherwise priority is set along with policy by the thread
+                        applyPriority(mPriority);
+                    }
                     name(mThreadName.c_str());
                     ret = true;
                 }
@@ -163,10 +173,160 @@ bool CBaseThread::name(const char* thread_name)
     }
 }
 
+bool CBaseThread::schedAttr(const CThreadSchedAttr &attr)
+{
+    std::lock_guard<std::mutex> _l(mMutex);
+    mSchedAttr = attr;
+    if (started())
+    {
+        return applySchedAttr(mSchedAttr, isSelf());
+    }
+    return true;
+}
+
+CThreadSchedAttr CBaseThread::schedAttr()
+{
+    std::lock_guard<std::mutex> _l(mMutex);
+    return mSchedAttr;
+}
+
+bool CBaseThread::applySchedAttr(const CThreadSchedAttr &attr, bool self)
+{
+    bool status = true;
+    pthread_t thread = self ? pthread_self() : mThread;
+
+#ifdef CPU_SETSIZE
+    if (!attr.mCpus.empty())
+    {
+        cpu_set_t cpu_set;
+        CPU_ZERO(&cpu_set);
+        bool valid = true;
+        for (auto it = attr.mCpus.begin(); it != attr.mCpus.end(); ++it)
+        {
+            if ((*it < 0) || (*it >= CPU_SETSIZE))
+            {
+                LOG_E("CBaseThread: %s: cpu %d is out of range [0, %d)!\n",
+                      mThreadName.c_str(), *it, (int32_t)CPU_SETSIZE);
+                valid = false;
+                break;
+            }
+            CPU_SET(*it, &cpu_set);
+        }
+        if (!valid)
+        {
+            status = false;
+        }
+        else
+        {
+            int32_t rc;
+            if (self)
+            {
+                rc = sched_setaffinity(0, sizeof(cpu_set), &cpu_set) ? errno : 0;
+            }
+            else
+            {
+#ifdef __GLIBC__
+                rc = pthread_setaffinity_np(thread, sizeof(cpu_set), &cpu_set);
+#else
+                rc = ENOTSUP;
+#endif
+            }
+            if (rc)
+            {
+                LOG_E("CBaseThread: %s: fail to set cpu affinity: %s\n",
+                      mThreadName.c_str(), strerror(rc));
+                status = false;
+            }
+        }
+    }
+#endif
+
+    if (attr.mPolicy != FDB_SCHED_INHERIT)
+    {
+        int32_t policy;
+        switch (attr.mPolicy)
+        {
+            case FDB_SCHED_FIFO:
+                policy = SCHED_FIFO;
+            break;
+            case FDB_SCHED_RR:
+                policy = SCHED_RR;
+            break;
+            default:
+                policy = SCHED_OTHER;
+            break;
+        }
+        int32_t level = attr.mPriority;
+        if ((level < sched_get_priority_min(policy)) || (level > sched_get_priority_max(policy)))
+        {
+            LOG_E("CBaseThread: %s: priority %d is out of range of policy %d!\n",
+                  mThreadName.c_str(), level, policy);
+            status = false;
+        }
+        else
+        {
+            struct sched_param schedParam;
+            memset(&schedParam, 0, sizeof(schedParam));
+            schedParam.sched_priority = level;
+            int32_t rc = pthread_setschedparam(thread, policy, &schedParam);
+            if (rc)
+            {
+                LOG_E("CBaseThread: %s: fail to set policy %d priority %d: %s\n",
+                      mThreadName.c_str(), policy, level, strerror(rc));
+                status = false;
+            }
+            else
+            {
+                mPriority = level;
+            }
+        }
+    }
+
+    if (attr.mMemNode >= 0)
+    {
+#if defined(__linux__) && defined(SYS_set_mempolicy)
+        // MPOL_PREFERRED from <numaif.h>; avoid depending on libnuma
+        static const int32_t FDB_MPOL_PREFERRED = 1;
+        static const int32_t FDB_MAX_MEM_NODES = 1024;
+        static const int32_t FDB_BITS_PER_LONG = 8 * sizeof(unsigned long);
+        unsigned long node_mask[FDB_MAX_MEM_NODES / FDB_BITS_PER_LONG];
+        int32_t node = attr.mMemNode;
+        if (!self || (node >= FDB_MAX_MEM_NODES))
+        {
+            LOG_E("CBaseThread: %s: memory node %d can not be set!\n",
+                  mThreadName.c_str(), node);
+            status = false;
+        }
+        else
+        {
+            memset(node_mask, 0, sizeof(node_mask));
+            node_mask[node / FDB_BITS_PER_LONG] |= 1UL << (node % FDB_BITS_PER_LONG);
+            if (syscall(SYS_set_mempolicy, FDB_MPOL_PREFERRED, node_mask,
+                        FDB_MAX_MEM_NODES + 1))
+            {
+                LOG_E("CBaseThread: %s: fail to prefer memory node %d: %s\n",
+                      mThreadName.c_str(), node, strerror(errno));
+                status = false;
+            }
+        }
+#else
+        status = false;
+#endif
+    }
+
+    return status;
+}
+
 void *CBaseThread::threadFunc(void *d)
 {
     CBaseThread *self = static_cast<CBaseThread *>(d);
 
+    CThreadSchedAttr attr;
+    {
+        std::lock_guard<std::mutex> _l(self->mMutex);
+        attr = self->mSchedAttr;
+    }
+    self->applySchedAttr(attr, true);
     self->run();
     return 0;
 }
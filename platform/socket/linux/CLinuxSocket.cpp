@@ -16,6 +16,17 @@
 
 #include "CLinuxSocket.h"
 #include <common_base/CBaseSocketFactory.h>
+#if defined(__linux__)
+#include <string.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/uio.h>
+#define FDB_TCP_MAX_GATHER  64
+#define FDB_UDP_MAX_BATCH   64
+#define FDB_UDP_SOCKET_BUFFER_SIZE  (2 * 1024 * 1024)
+#endif
 
 CTCPTransportSocket::CTCPTransportSocket(sckt::TCPSocket *imp, EFdbSocketType type)
     : mSocketImp(imp)
@@ -75,6 +86,57 @@ int32_t CTCPTransportSocket::recv(uint8_t *data, int32_t size)
     return ret;
 }
 
+int32_t CTCPTransportSocket::sendGather(const CFdbIoVec *vecs, int32_t nr_vecs)
+{
+#if defined(__linux__)
+    int fd = getFd();
+    if (fd < 0)
+    {
+        return -1;
+    }
+    int32_t sent = 0;
+    while (nr_vecs > 0)
+    {
+        int32_t nr_iovs = (nr_vecs > FDB_TCP_MAX_GATHER) ? FDB_TCP_MAX_GATHER : nr_vecs;
+        struct iovec iovs[FDB_TCP_MAX_GATHER];
+        int32_t expected = 0;
+        for (int32_t i = 0; i < nr_iovs; ++i)
+        {
+            iovs[i].iov_base = (void *)vecs[i].mData;
+            iovs[i].iov_len = vecs[i].mSize;
+            expected += vecs[i].mSize;
+        }
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iovs;
+        msg.msg_iovlen = nr_iovs;
+        int ret;
+        do
+        {
+            ret = (int)sendmsg(fd, &msg, MSG_NOSIGNAL);
+        } while ((ret < 0) && (errno == EINTR));
+        if (ret < 0)
+        {
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+            {
+                break;
+            }
+            return sent ? sent : -1;
+        }
+        sent += ret;
+        if (ret != expected)
+        {
+            break;
+        }
+        vecs += nr_iovs;
+        nr_vecs -= nr_iovs;
+    }
+    return sent;
+#else
+    return CSocketImp::sendGather(vecs, nr_vecs);
+#endif
+}
+
 int CTCPTransportSocket::getFd()
 {
     if (mSocketImp)
@@ -304,6 +366,169 @@ int32_t CUDPTransportSocket::recv(uint8_t *data, int32_t size)
     return ret;
 }
 
+int32_t CUDPTransportSocket::sendBatch(const uint8_t *data, int32_t size,
+                                       const CFdbSocketAddr **dest_addrs, int32_t nr_dests)
+{
+#if defined(__linux__)
+    int fd = getFd();
+    if (fd < 0)
+    {
+        return 0;
+    }
+    struct sockaddr_in addrs[FDB_UDP_MAX_BATCH];
+    struct mmsghdr msgs[FDB_UDP_MAX_BATCH];
+    struct iovec iov;
+    iov.iov_base = const_cast<uint8_t *>(data);
+    iov.iov_len = size;
+
+    int32_t total_sent = 0;
+    while (total_sent < nr_dests)
+    {
+        int32_t batch = nr_dests - total_sent;
+        if (batch > FDB_UDP_MAX_BATCH)
+        {
+            batch = FDB_UDP_MAX_BATCH;
+        }
+        memset(msgs, 0, sizeof(msgs[0]) * batch);
+        for (int32_t i = 0; i < batch; ++i)
+        {
+            auto dest = dest_addrs[total_sent + i];
+            memset(&addrs[i], 0, sizeof(addrs[i]));
+            addrs[i].sin_family = AF_INET;
+            addrs[i].sin_port = htons((uint16_t)dest->mPort);
+            if (inet_pton(AF_INET, dest->mAddr.c_str(), &addrs[i].sin_addr) != 1)
+            {
+                // not a numeric address: let sckt resolve it
+                batch = i;
+                break;
+            }
+            msgs[i].msg_hdr.msg_name = &addrs[i];
+            msgs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+            msgs[i].msg_hdr.msg_iov = &iov;
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+        if (!batch)
+        {
+            if (send(data, size, *dest_addrs[total_sent]) != size)
+            {
+                break;
+            }
+            total_sent++;
+            continue;
+        }
+        int ret = sendmmsg(fd, msgs, batch, 0);
+        if (ret <= 0)
+        {
+            if ((ret < 0) && (errno == EINTR))
+            {
+                continue;
+            }
+            break;
+        }
+        total_sent += ret;
+    }
+    return total_sent;
+#else
+    return CSocketImp::sendBatch(data, size, dest_addrs, nr_dests);
+#endif
+}
+
+int32_t CUDPTransportSocket::recvBatch(uint8_t **buffers, int32_t buffer_size,
+                                       int32_t *sizes, int32_t nr_buffers, uint64_t *sources)
+{
+#if defined(__linux__)
+    int fd = getFd();
+    if (fd < 0)
+    {
+        return -1;
+    }
+    if (nr_buffers > FDB_UDP_MAX_BATCH)
+    {
+        nr_buffers = FDB_UDP_MAX_BATCH;
+    }
+    struct mmsghdr msgs[FDB_UDP_MAX_BATCH];
+    struct iovec iovs[FDB_UDP_MAX_BATCH];
+    struct sockaddr_in addrs[FDB_UDP_MAX_BATCH];
+    memset(msgs, 0, sizeof(msgs[0]) * nr_buffers);
+    for (int32_t i = 0; i < nr_buffers; ++i)
+    {
+        iovs[i].iov_base = buffers[i];
+        iovs[i].iov_len = buffer_size;
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        if (sources)
+        {
+            msgs[i].msg_hdr.msg_name = &addrs[i];
+            msgs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+        }
+    }
+    int ret;
+    do
+    {
+        ret = recvmmsg(fd, msgs, nr_buffers, MSG_DONTWAIT, 0);
+    } while ((ret < 0) && (errno == EINTR));
+    if (ret < 0)
+    {
+        return ((errno == EAGAIN) || (errno == EWOULDBLOCK)) ? 0 : -1;
+    }
+    for (int32_t i = 0; i < ret; ++i)
+    {
+        // truncated datagram can not be decoded
+        sizes[i] = (msgs[i].msg_hdr.msg_flags & MSG_TRUNC) ? 0 : (int32_t)msgs[i].msg_len;
+        if (sources)
+        {
+            sources[i] = ((uint64_t)ntohl(addrs[i].sin_addr.s_addr) << 16) | ntohs(addrs[i].sin_port);
+        }
+    }
+    return ret;
+#else
+    return CSocketImp::recvBatch(buffers, buffer_size, sizes, nr_buffers, sources);
+#endif
+}
+
+bool CUDPTransportSocket::joinMulticastGroup(const char *group_ip, const char *interface_ip)
+{
+#if defined(__linux__)
+    int fd = getFd();
+    if (fd < 0)
+    {
+        return false;
+    }
+    struct ip_mreq mreq;
+    memset(&mreq, 0, sizeof(mreq));
+    if (inet_pton(AF_INET, group_ip, &mreq.imr_multiaddr) != 1)
+    {
+        return false;
+    }
+    if (!interface_ip || (inet_pton(AF_INET, interface_ip, &mreq.imr_interface) != 1))
+    {
+        mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+    }
+    return setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) == 0;
+#else
+    return false;
+#endif
+}
+
+bool CUDPTransportSocket::setMulticastInterface(const char *interface_ip)
+{
+#if defined(__linux__)
+    int fd = getFd();
+    if (fd < 0)
+    {
+        return false;
+    }
+    struct in_addr if_addr;
+    if (!interface_ip || (inet_pton(AF_INET, interface_ip, &if_addr) != 1))
+    {
+        if_addr.s_addr = htonl(INADDR_ANY);
+    }
+    return setsockopt(fd, IPPROTO_IP, IP_MULTICAST_IF, &if_addr, sizeof(if_addr)) == 0;
+#else
+    return false;
+#endif
+}
+
 int CUDPTransportSocket::getFd()
 {
     if (mSocketImp)
@@ -330,9 +555,42 @@ CSocketImp *CLinuxUDPSocket::bind()
             {
                 mConn.mSelfAddress.mAddr = "127.0.0.1";
             }
-            sckt::IPAddress address(mConn.mSelfAddress.mAddr.c_str(), (sckt::u16)mConn.mSelfAddress.mPort);
+            bool multicast = false;
+#if defined(__linux__)
+            struct in_addr self_addr;
+            multicast = (inet_pton(AF_INET, mConn.mSelfAddress.mAddr.c_str(), &self_addr) == 1) &&
+                        IN_MULTICAST(ntohl(self_addr.s_addr));
+#endif
             sckt_imp = new sckt::UDPSocket();
-            sckt_imp->Open(address);
+            if (multicast)
+            {
+                /*
+                 * Multicast receiver: listen to the port on all interfaces;
+                 * groups are joined later. The port is shared by all
+                 * receivers of the group in the same host.
+                 */
+                sckt::IPAddress address(FDB_IP_ALL_INTERFACE, (sckt::u16)mConn.mSelfAddress.mPort);
+                sckt_imp->Open(address, true);
+#if defined(__linux__) && defined(IP_MULTICAST_ALL)
+                // only get datagrams of groups joined by this socket
+                int all = 0;
+                setsockopt(sckt_imp->getNativeSocket(), IPPROTO_IP, IP_MULTICAST_ALL, &all, sizeof(all));
+#endif
+            }
+            else
+            {
+                sckt::IPAddress address(mConn.mSelfAddress.mAddr.c_str(), (sckt::u16)mConn.mSelfAddress.mPort);
+                sckt_imp->Open(address);
+            }
+#if defined(__linux__)
+            /*
+             * A big message is sent as a burst of fragments; make room for
+             * it. The kernel silently caps the size to rmem_max/wmem_max.
+             */
+            int buf_size = FDB_UDP_SOCKET_BUFFER_SIZE;
+            setsockopt(sckt_imp->getNativeSocket(), SOL_SOCKET, SO_RCVBUF, &buf_size, sizeof(buf_size));
+            setsockopt(sckt_imp->getNativeSocket(), SOL_SOCKET, SO_SNDBUF, &buf_size, sizeof(buf_size));
+#endif
         }
 
         if (sckt_imp)
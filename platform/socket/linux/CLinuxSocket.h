@@ -29,6 +29,7 @@ public:
     ~CTCPTransportSocket();
     int32_t send(const uint8_t *data, int32_t size);
     int32_t recv(uint8_t *data, int32_t size);
+    int32_t sendGather(const CFdbIoVec *vecs, int32_t nr_vecs);
     int getFd();
 private:
     //sckt::Socket *mSocketImp;
@@ -62,6 +63,12 @@ public:
     ~CUDPTransportSocket();
     int32_t send(const uint8_t *data, int32_t size, const CFdbSocketAddr &dest_addr);
     int32_t recv(uint8_t *data, int32_t size);
+    int32_t sendBatch(const uint8_t *data, int32_t size,
+                      const CFdbSocketAddr **dest_addrs, int32_t nr_dests);
+    int32_t recvBatch(uint8_t **buffers, int32_t buffer_size,
+                      int32_t *sizes, int32_t nr_buffers, uint64_t *sources = 0);
+    bool joinMulticastGroup(const char *group_ip, const char *interface_ip);
+    bool setMulticastInterface(const char *interface_ip);
     int getFd();
 private:
     sckt::UDPSocket *mSocketImp;
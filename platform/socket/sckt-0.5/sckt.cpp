@@ -787,7 +787,7 @@ sckt::uint TCPSocket::Recv(sckt::byte* buf, uint maxSize){
     return uint(len);
 };
 
-void UDPSocket::Open(const IPAddress& ip){
+void UDPSocket::Open(const IPAddress& ip, bool reuseAddr){
     if(this->IsValid())
         throw sckt::Exc("UDPSocket::Open(): the socket is already opened");
     
@@ -795,6 +795,11 @@ void UDPSocket::Open(const IPAddress& ip){
     if(CastToSocket(this->socket) == M_INVALID_SOCKET)
 	throw sckt::Exc("UDPSocket::Open(): ::socket() failed");
     
+    if(reuseAddr){
+        int yes = 1;
+        setsockopt(CastToSocket(this->socket), SOL_SOCKET, SO_REUSEADDR, (char*)&yes, sizeof(yes));
+    }
+    
     /* Bind locally, if appropriate */
     if(ip.port >= 0){
         struct sockaddr_in sockAddr;
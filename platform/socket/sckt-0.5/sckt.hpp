@@ -524,8 +524,10 @@ public:
     In case of errors this method throws sckt::Exc.
     @param port - IP port number on which the socket will listen for incoming datagrams.
         This is useful for server-side sockets, for client-side sockets use UDPSocket::Open().
+    @param reuseAddr - allow other sockets to bind the same address, e.g.
+        to receive the same multicast group.
     */
-    void Open(const IPAddress& ip);
+    void Open(const IPAddress& ip, bool reuseAddr = false);
     
     //returns number of bytes sent, should be less or equal to size.
     uint Send(const byte* buf, u16 size, IPAddress destinationIP);
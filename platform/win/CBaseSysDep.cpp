@@ -15,6 +15,7 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <sys/types.h>
 #include <sys/timeb.h>
@@ -156,3 +157,26 @@ void sysdep_gethostname(char *name, int32_t size)
     gethostname(name, size);
 }
 
+
+void sysdep_getprocname(char *name, int32_t size)
+{
+    if (size <= 0)
+    {
+        return;
+    }
+    name[0] = '\0';
+    char path[MAX_PATH];
+    DWORD len = GetModuleFileNameA(0, path, sizeof(path));
+    if (len && (len < sizeof(path)))
+    {
+        char *base = strrchr(path, '\\');
+        base = base ? base + 1 : path;
+        char *suffix = strrchr(base, '.');
+        if (suffix)
+        {
+            *suffix = '\0';
+        }
+        strncpy(name, base, size);
+        name[size - 1] = '\0';
+    }
+}
@@ -16,6 +16,7 @@
 
 #include <stdlib.h>
 #include <common_base/CBaseThread.h>
+#include <utils/Log.h>
 
 CBaseThread::CBaseThread(const char* thread_name)
     : mThread(0)
@@ -147,6 +148,53 @@ bool CBaseThread::name(const char* thread_name)
     return true;
 }
 
+bool CBaseThread::schedAttr(const CThreadSchedAttr &attr)
+{
+    std::lock_guard<std::mutex> _l(mMutex);
+    mSchedAttr = attr;
+    if (started())
+    {
+        return applySchedAttr(mSchedAttr, isSelf());
+    }
+    return true;
+}
+
+CThreadSchedAttr CBaseThread::schedAttr()
+{
+    std::lock_guard<std::mutex> _l(mMutex);
+    return mSchedAttr;
+}
+
+bool CBaseThread::applySchedAttr(const CThreadSchedAttr &attr, bool self)
+{
+    bool status = true;
+    if (!attr.mCpus.empty())
+    {
+        DWORD_PTR mask = 0;
+        for (auto it = attr.mCpus.begin(); it != attr.mCpus.end(); ++it)
+        {
+            if ((*it < 0) || (*it >= (int32_t)(8 * sizeof(mask))))
+            {
+                LOG_E("CBaseThread: %s: cpu %d is out of range!\n", mThreadName.c_str(), *it);
+                mask = 0;
+                break;
+            }
+            mask |= (DWORD_PTR)1 << *it;
+        }
+        HANDLE thread = self ? GetCurrentThread() : mThread;
+        if (!mask || !SetThreadAffinityMask(thread, mask))
+        {
+            status = false;
+        }
+    }
+    // real-time policy and memory node are not supported
+    if ((attr.mPolicy != FDB_SCHED_INHERIT) || (attr.mMemNode >= 0))
+    {
+        status = false;
+    }
+    return status;
+}
+
 unsigned int __stdcall CBaseThread::threadFunc
 (
     void *d
@@ -154,6 +202,12 @@ unsigned int __stdcall CBaseThread::threadFunc
 {
     CBaseThread *self = static_cast<CBaseThread *>(d);
 
+    CThreadSchedAttr attr;
+    {
+        std::lock_guard<std::mutex> _l(self->mMutex);
+        attr = self->mSchedAttr;
+    }
+    self->applySchedAttr(attr, true);
     self->run();
     self->mThreadId = self->mInvalidTid;
     return 0;
@@ -39,7 +39,7 @@ public:
                   , const char *host_name
                   , int32_t udp_port);
     ~CClientSocket();
-    CFdbSession *connect();
+    CFdbSession *connect(int32_t retries = FDB_ADDRESS_CONNECT_RETRY_NR);
     void setSocket(CClientSocketImp *skt)
     {
         mSocket = skt;
@@ -115,8 +115,14 @@ public:
         return 0;
     }
 protected:
+    /*
+     * retries: how many times connecting is tried, between which
+     * FDB_ADDRESS_CONNECT_RETRY_INTERVAL is waited
+     */
     CClientSocket *doConnect(const char *url, const char *host_name = 0, 
-                             int32_t udp_port = FDB_INET_PORT_INVALID);
+                             int32_t udp_port = FDB_INET_PORT_INVALID,
+                             const char *multicast_url = 0,
+                             int32_t retries = FDB_ADDRESS_CONNECT_RETRY_NR);
     void doDisconnect(FdbSessionId_t sid = FDB_INVALID_ID);
     /*
      * Check whether connection is allowed for the host.
@@ -25,6 +25,8 @@
 #include "CMethodJob.h"
 #include "CFdbToken.h"
 #include "CFdbEventRouter.h"
+#include "CFdbLatencyHistogram.h"
+#include "CFdbTrafficStats.h"
 
 class CBaseWorker;
 class CFdbSessionContainer;
@@ -43,6 +45,9 @@ public:
 #define FDB_EP_ENABLE_UDP               (1 << 11)
 #define FDB_OBJ_TCP_BLOCKING_MODE       (1 << 12)
 #define FDB_OBJ_IPC_BLOCKING_MODE       (1 << 13)
+#define FDB_EP_ENABLE_MULTICAST         (1 << 14)
+#define FDB_EP_TCP_COMPRESSION          (1 << 15)
+#define FDB_EP_IPC_COMPRESSION          (1 << 16)
     CBaseEndpoint(const char *name = 0, CBaseWorker *worker = 0, EFdbEndpointRole role = FDB_OBJECT_ROLE_UNKNOWN);
     ~CBaseEndpoint();
 
@@ -141,6 +146,32 @@ public:
         }
     }
 
+    bool multicastEnabled() const
+    {
+        return !!(mFlag & FDB_EP_ENABLE_MULTICAST);
+    }
+
+    /*
+     * Deliver best-effort (FDB_QOS_BEST_EFFORTS) broadcasts through
+     * multicast group allocated by name server: server sends once for all
+     * clients joining the group; client joins the group of event groups it
+     * subscribes to. Takes effect only when UDP is enabled and should be
+     * called before connecting/binding.
+     * Note that any host in the network can join the group; don't enable
+     * it if events are protected by security level.
+     */
+    void enableMulticast(bool active)
+    {
+        if (active)
+        {
+            mFlag |= FDB_EP_ENABLE_MULTICAST;
+        }
+        else
+        {
+            mFlag &= ~FDB_EP_ENABLE_MULTICAST;
+        }
+    }
+
     void enableTcpBlockingMode(bool active)
     {
         if (active)
@@ -175,6 +206,62 @@ public:
         return !!(mFlag & FDB_OBJ_IPC_BLOCKING_MODE);
     }
 
+    /*
+     * Compress payload sent through tcp:// sessions with LZ4 if peer
+     * accepts it. Enabled by default. Should be called before
+     * connecting/binding.
+     */
+    void enableTcpCompression(bool active)
+    {
+        if (active)
+        {
+            mFlag |= FDB_EP_TCP_COMPRESSION;
+        }
+        else
+        {
+            mFlag &= ~FDB_EP_TCP_COMPRESSION;
+        }
+    }
+
+    bool enableTcpCompression() const
+    {
+        return !!(mFlag & FDB_EP_TCP_COMPRESSION);
+    }
+
+    /*
+     * Compress payload sent through ipc:// sessions. Disabled by default
+     * since local copy is cheaper than compression.
+     */
+    void enableIpcCompression(bool active)
+    {
+        if (active)
+        {
+            mFlag |= FDB_EP_IPC_COMPRESSION;
+        }
+        else
+        {
+            mFlag &= ~FDB_EP_IPC_COMPRESSION;
+        }
+    }
+
+    bool enableIpcCompression() const
+    {
+        return !!(mFlag & FDB_EP_IPC_COMPRESSION);
+    }
+
+    /*
+     * Payload smaller than threshold is never compressed.
+     */
+    void compressThreshold(int32_t size)
+    {
+        mCompressThreshold = size;
+    }
+
+    int32_t compressThreshold() const
+    {
+        return mCompressThreshold;
+    }
+
     void prepareDestroy();
 
     void addPeerRouter(const char *peer_router_name)
@@ -182,6 +269,15 @@ public:
         mEventRouter.addPeer(peer_router_name);
     }
 
+    /*
+     * Traffic of all sessions of the endpoint, including sessions already
+     * closed
+     */
+    const CFdbTrafficStats &traffic() const
+    {
+        return mTraffic;
+    }
+
 protected:
     std::string mNsName;
     CFdbToken::tTokenList mTokens;
@@ -204,17 +300,7 @@ protected:
     virtual bool onMessageAuthentication(CFdbMessage *msg);
     virtual bool onEventAuthentication(CFdbMessage *msg);
 
-    void setNsName(const char *name)
-    {
-        if (name)
-        {
-            mNsName = name;
-            if (mName.empty())
-            {
-                mName = mNsName;
-            }
-        }
-    }
+    void setNsName(const char *name);
     void onPublish(CBaseJob :: Ptr &msg_ref);
 
 private:
@@ -225,6 +311,9 @@ private:
     FdbObjectId_t mSnAllocator;
     FdbEndpointId_t mEpid;
     CFdbEventRouter mEventRouter;
+    CFdbLatencyStats mLatencyStats;
+    CFdbTrafficStats mTraffic;
+    int32_t mCompressThreshold;
     
     CFdbSession *preferredPeer();
     void checkAutoRemove();
@@ -245,6 +334,9 @@ private:
     int32_t checkSecurityLevel(const char *token);
     void updateSecurityLevel();
     void updateSessionInfo(CFdbSession *session);
+    bool compressionEnabled(CFdbSession *session);
+    void queryLatency(CBaseJob::Ptr &msg_ref);
+    void queryTraffic(CBaseJob::Ptr &msg_ref);
     CFdbSession *connected(const CFdbSocketAddr &addr);
     CFdbSession *bound(const CFdbSocketAddr &addr);
     virtual const CApiSecurityConfig *getApiSecurityConfig()
@@ -255,6 +347,7 @@ private:
     friend class CFdbSession;
     friend class CFdbUDPSession;
     friend class CFdbMessage;
+    friend class CFdbSessionContainer;
     friend class CFdbContext;
     friend class CBaseServer;
     friend class CBaseClient;
@@ -17,23 +17,42 @@
 #ifndef _CBASEJOB_H_
 #define _CBASEJOB_H_
 
-#include <memory>
+#include <stddef.h>
+#include <atomic>
 #include <mutex>
+#include <utility>
 #include "CBaseSemaphore.h"
 #include "common_defs.h"
 
 class CBaseWorker;
+class CBaseJobPtr;
 class CBaseJob
 {
 #define JOB_FORCE_RUN           (1 << 0)
 #define JOB_IS_URGENT           (1 << 1)
 #define JOB_IS_SYNC             (1 << 2)
 #define JOB_RUN_SUCCESS         (1 << 3)
+#define JOB_COMPLETION_DEFERRED (1 << 4)
 public:
-    typedef std::shared_ptr<CBaseJob> Ptr;
+    typedef CBaseJobPtr Ptr;
     CBaseJob(uint32_t flag = 0);
     virtual ~CBaseJob();
+    // jobs (including subclasses) are allocated from per-thread pool
+    static void *operator new(size_t size);
+    static void operator delete(void *ptr, size_t size);
+    /*
+     * Complete the job: wake up the thread waiting in sendSync() if any.
+     */
     void terminate(Ptr &ref);
+    /*
+     * Called by run() of a sync job if it is completed later by calling
+     * terminate(), such as a request waiting for reply; otherwise the
+     * job is completed once run() returns.
+     */
+    void deferCompletion()
+    {
+        mFlag |= JOB_COMPLETION_DEFERRED;
+    }
     void forceRun(bool force)
     {
         if (force)
@@ -81,13 +100,11 @@ protected:
 private:
     struct CSyncRequest
     {
-        CSyncRequest(long int init_shared_cnt)
-            : mInitSharedCnt(init_shared_cnt)
-            , mSem(0)
+        CSyncRequest()
+            : mSem(0)
         {
         }
 
-        long int mInitSharedCnt;
         CBaseSemaphore mSem;
     };
 
@@ -127,12 +144,118 @@ private:
         }
     }
 
-    void wakeup(Ptr &ref);
+    void wakeup();
 
+    // reference count held by CBaseJobPtr
+    std::atomic<int32_t> mRefCount;
     int32_t mFlag;
     std::mutex mSyncLock;
     CSyncRequest *mSyncReq;
+    // time (ns) when the job is put into queue of the worker
+    uint64_t mQueuedTime;
     friend class CBaseWorker;
+    friend class CBaseJobPtr;
+};
+
+/*
+ * Reference to a job; the count is kept in the job itself so that no
+ * control block is allocated. The job is deleted with the last reference.
+ */
+class CBaseJobPtr
+{
+public:
+    CBaseJobPtr()
+        : mJob(0)
+    {}
+    explicit CBaseJobPtr(CBaseJob *job)
+        : mJob(job)
+    {
+        acquire();
+    }
+    CBaseJobPtr(const CBaseJobPtr &other)
+        : mJob(other.mJob)
+    {
+        acquire();
+    }
+    CBaseJobPtr(CBaseJobPtr &&other)
+        : mJob(other.mJob)
+    {
+        other.mJob = 0;
+    }
+    ~CBaseJobPtr()
+    {
+        release();
+    }
+    CBaseJobPtr &operator=(const CBaseJobPtr &other)
+    {
+        CBaseJobPtr(other).swap(*this);
+        return *this;
+    }
+    CBaseJobPtr &operator=(CBaseJobPtr &&other)
+    {
+        CBaseJobPtr(std::move(other)).swap(*this);
+        return *this;
+    }
+    void reset(CBaseJob *job = 0)
+    {
+        CBaseJobPtr(job).swap(*this);
+    }
+    void swap(CBaseJobPtr &other)
+    {
+        std::swap(mJob, other.mJob);
+    }
+    CBaseJob *get() const
+    {
+        return mJob;
+    }
+    CBaseJob *operator->() const
+    {
+        return mJob;
+    }
+    CBaseJob &operator*() const
+    {
+        return *mJob;
+    }
+    explicit operator bool() const
+    {
+        return !!mJob;
+    }
+    // for information only; it might be changed by other threads at once
+    long use_count() const
+    {
+        return mJob ? (long)mJob->mRefCount.load(std::memory_order_relaxed) : 0;
+    }
+    // true if this is the only reference to the job
+    bool unique() const
+    {
+        return mJob && (mJob->mRefCount.load(std::memory_order_acquire) == 1);
+    }
+    bool operator==(const CBaseJobPtr &other) const
+    {
+        return mJob == other.mJob;
+    }
+    bool operator!=(const CBaseJobPtr &other) const
+    {
+        return mJob != other.mJob;
+    }
+private:
+    CBaseJob *mJob;
+
+    void acquire()
+    {
+        if (mJob)
+        {
+            mJob->mRefCount.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    void release()
+    {
+        if (mJob && (mJob->mRefCount.fetch_sub(1, std::memory_order_acq_rel) == 1))
+        {
+            delete mJob;
+        }
+        mJob = 0;
+    }
 };
 
 template <typename T>
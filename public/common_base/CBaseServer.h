@@ -77,7 +77,8 @@ private:
     CApiSecurityConfig mApiSecurity;
 
     void cbBind(CBaseWorker *worker, CMethodJob<CBaseServer> *job, CBaseJob::Ptr &ref);
-    CServerSocket *doBind(const char *url, int32_t udp_port = FDB_INET_PORT_INVALID);
+    CServerSocket *doBind(const char *url, int32_t udp_port = FDB_INET_PORT_INVALID,
+                          const char *multicast_url = 0);
 
     void cbUnbind(CBaseWorker *worker, CMethodJob<CBaseServer> *job, CBaseJob::Ptr &ref);
     void doUnbind(FdbSocketId_t skid = FDB_INVALID_ID);
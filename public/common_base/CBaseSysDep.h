@@ -103,6 +103,8 @@ uint64_t sysdep_getsystemtime_milli();
 uint64_t sysdep_getsystemtime_nano();
 int32_t sysdep_gettimeofday(struct timeval *tv);
 void sysdep_gethostname(char *name, int32_t size);
+// Get name of the executable running in current process, without path.
+void sysdep_getprocname(char *name, int32_t size);
 
 #ifdef __cplusplus
 }
@@ -19,6 +19,7 @@
 
 #include "CBaseSysDep.h"
 #include <string>
+#include <vector>
 #include <mutex>
 
 /*
@@ -33,6 +34,39 @@
 
 #define FDB_BASE_WORKER_FLAG_SHIFT    1
 
+/*
+ * Scheduling policy of a thread
+ */
+enum EFdbSchedPolicy
+{
+    FDB_SCHED_INHERIT,      // keep the policy of the thread calling start()
+    FDB_SCHED_OTHER,        // normal time-sharing scheduling
+    FDB_SCHED_FIFO,         // real-time, first-in first-out
+    FDB_SCHED_RR            // real-time, round-robin
+};
+
+/*
+ * Placement and scheduling options applied to a thread when it starts.
+ *      The options are applied from within the thread before the main
+ *      loop is entered, so they also take effect for
+ *      FDB_WORKER_EXE_IN_PLACE.
+ */
+struct CThreadSchedAttr
+{
+    CThreadSchedAttr()
+        : mPolicy(FDB_SCHED_INHERIT)
+        , mPriority(0)
+        , mMemNode(-1)
+    {}
+    // cpus the thread is allowed to run at; empty: no binding
+    std::vector<int32_t> mCpus;
+    EFdbSchedPolicy mPolicy;
+    // priority used with mPolicy; ignored if mPolicy is FDB_SCHED_INHERIT
+    int32_t mPriority;
+    // preferred memory (NUMA) node for allocation; < 0: no preference
+    int32_t mMemNode;
+};
+
 class CBaseThread
 {
 public:
@@ -55,8 +89,21 @@ public:
     }
     static CBASE_tProcId getPid(); 
 
+    /*
+     * Set cpu affinity, scheduling policy and preferred memory node.
+     *      If called before start(), the options are applied when the
+     *      thread starts; otherwise they are applied immediately. Note
+     *      that memory node can only be changed from the thread itself.
+     *
+     * @iparam attr - the options to apply
+     * @return true - success; false - fail
+     */
+    bool schedAttr(const CThreadSchedAttr &attr);
+    CThreadSchedAttr schedAttr();
+
 protected:
     bool applyPriority(int32_t level);
+    bool applySchedAttr(const CThreadSchedAttr &attr, bool self);
     /*-----------------------------------------------------------------------------
      * The virtual function should be implemented by subclass
      *---------------------------------------------------------------------------*/
@@ -72,6 +119,7 @@ protected:
 private:
     int32_t mPriority;
     std::string mThreadName;
+    CThreadSchedAttr mSchedAttr;
 
 #ifdef __WIN32__
     static unsigned int __stdcall threadFunc(void *d);
@@ -20,6 +20,7 @@
 #include <vector>
 #include "CBaseThread.h"
 #include "CBaseJob.h"
+#include "CFdbLatencyHistogram.h"
 
 /*
  * If set, the worker thread can run jobs, timers and watches;
@@ -27,7 +28,12 @@
  * allowed
  */
 #define FDB_WORKER_ENABLE_FD_LOOP   (1 << (FDB_BASE_WORKER_FLAG_SHIFT + 0))
-#define FDB_WORKER_FLAG_SHIFT       (FDB_BASE_WORKER_FLAG_SHIFT + 1)
+/*
+ * Same as FDB_WORKER_ENABLE_FD_LOOP but fds are polled with io_uring if
+ * available; see CUringEventLoop
+ */
+#define FDB_WORKER_ENABLE_URING_LOOP (1 << (FDB_BASE_WORKER_FLAG_SHIFT + 1))
+#define FDB_WORKER_FLAG_SHIFT       (FDB_BASE_WORKER_FLAG_SHIFT + 2)
 
 class CBaseEventLoop;
 class CBaseWorker : public CBaseThread
@@ -40,8 +46,11 @@ public:
      * start work thread of the worker
      *
      * @iparam flag - can be none or or-ed by FDB_WORKER_EXE_IN_PLACE and
-     *      FDB_WORKER_ENABLE_FD_LOOP
+     *      FDB_WORKER_ENABLE_FD_LOOP or FDB_WORKER_ENABLE_URING_LOOP
      * @return true - success; false - fail
+     * Cpu affinity, scheduling policy and memory node set with schedAttr()
+     *      are applied when the thread starts. Options configured for the
+     *      worker in fdbus.fdb (see utils/CWorkerConfig.h) override them.
      */
     bool start(uint32_t flag = FDB_WORKER_DEFAULT);
 
@@ -174,6 +183,14 @@ public:
 
     void dispatchInput(int32_t timeout);
 
+    /*
+     * Histogram of time jobs waiting in the queue before being run.
+     */
+    const CFdbLatencyHistogram &queueWait() const
+    {
+        return mQueueWait;
+    }
+
 protected:
     /*
      * called after job queue is initialized but thread is not started. You can
@@ -208,6 +225,7 @@ private:
         CJobQueue(uint32_t max_size = 0);
         bool enqueue(CBaseJob::Ptr &job);
         void dumpJobs(tJobContainer &job_queue);
+        void recycleJobs(tJobContainer &job_queue);
         void discardJobs();
         void pickupJobs();
         bool jobDiscarded();
@@ -227,6 +245,8 @@ private:
         int32_t mDiscardCnt;
         CBaseEventLoop *mEventLoop;
         tJobContainer mJobQueue;
+        // emptied container kept for next dumpJobs() to avoid allocation
+        tJobContainer mSpareQueue;
 
         friend class CBaseWorker;
     };
@@ -251,6 +271,7 @@ private:
 
     CJobQueue mNormalJobQueue;
     CJobQueue mUrgentJobQueue;
+    CFdbLatencyHistogram mQueueWait;
 
     friend class CExitRequestJob;
     friend class CNotifyFdWatch;
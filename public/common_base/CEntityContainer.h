@@ -18,6 +18,11 @@
 #define _CENTITYCONTAINER_H_
 
 #include <map>
+#include <deque>
+#include <vector>
+#include <type_traits>
+#include <utility>
+#include "common_defs.h"
 #define FDB_FIRST_ENTRY_ID 0
 
 template<typename IDX, typename EP>
@@ -106,4 +111,309 @@ private:
     bool mValidIt;
 };
 
+/*
+ * Entries kept in an array of slots. Id of an entry is made of index of
+ * the slot (lower SLOT_BITS) and generation of the slot, which increases
+ * each time the slot is taken; so lookup is O(1) and an id kept after
+ * its entry is deleted never matches the entry taking the slot later
+ * until generation of the slot wraps. Id of signed type is never negative.
+ *
+ * At most 2^SLOT_BITS entries live at the same time. Generation has only
+ * the remaining bits of IDX, so freed slots are quarantined: they are
+ * taken in FIFO order and only when a quarter of the capacity is free;
+ * before that the array grows instead. A stale id therefore matches a new
+ * entry only after 2^(generation bits) * 2^(SLOT_BITS - 2) deletions, or
+ * earlier once more than 3/4 of the capacity is used.
+ */
+template<typename IDX, typename EP, uint32_t SLOT_BITS>
+class CEntitySlotContainer
+{
+public:
+    CEntitySlotContainer()
+        : mCount(0)
+    {}
+    /*
+     * Put entry in a free slot.
+     * @return: id of the entry; FDB_INVALID_ID if all slots are taken
+     */
+    IDX insertEntry(EP ep)
+    {
+        uint32_t index;
+        bool full = mSlots.size() >= capacity();
+        if (!mFreeSlots.empty() && (full || (mFreeSlots.size() >= (capacity() >> 2))))
+        {
+            index = mFreeSlots.front();
+            mFreeSlots.pop_front();
+        }
+        else if (!full)
+        {
+            index = (uint32_t)mSlots.size();
+            mSlots.push_back(CSlot());
+        }
+        else
+        {
+            return (IDX)FDB_INVALID_ID;
+        }
+
+        auto &slot = mSlots[index];
+        IDX id;
+        do
+        {
+            slot.mGeneration = (slot.mGeneration + 1) & generationMask();
+            id = makeId(slot.mGeneration, index);
+        } while (!fdbValidFdbId(id));
+        slot.mEntry = ep;
+        slot.mUsed = true;
+        ++mCount;
+        return id;
+    }
+
+    // max number of entries living at the same time
+    static uint32_t capacity()
+    {
+        return (uint32_t)((uint64_t)1 << SLOT_BITS);
+    }
+
+    // @return: the entry; EP() if id is invalid or stale
+    EP retrieveEntry(IDX id) const
+    {
+        auto slot = findSlot(id);
+        return slot ? slot->mEntry : EP();
+    }
+
+    bool deleteEntry(IDX id)
+    {
+        auto slot = const_cast<CSlot *>(findSlot(id));
+        if (!slot)
+        {
+            return false;
+        }
+        slot->mEntry = EP();
+        slot->mUsed = false;
+        mFreeSlots.push_back((uint32_t)id & slotMask());
+        --mCount;
+        return true;
+    }
+
+    uint32_t size() const
+    {
+        return mCount;
+    }
+    bool empty() const
+    {
+        return !mCount;
+    }
+
+    /*
+     * Copy all entries out so that entries can be deleted while they are
+     * walked through.
+     */
+    void getEntries(std::vector<EP> &entries) const
+    {
+        entries.reserve(entries.size() + mCount);
+        for (auto it = mSlots.begin(); it != mSlots.end(); ++it)
+        {
+            if (it->mUsed)
+            {
+                entries.push_back(it->mEntry);
+            }
+        }
+    }
+
+private:
+    struct CSlot
+    {
+        CSlot()
+            : mEntry()
+            , mGeneration(0)
+            , mUsed(false)
+        {}
+        EP mEntry;
+        uint32_t mGeneration;
+        bool mUsed;
+    };
+    std::vector<CSlot> mSlots;
+    std::deque<uint32_t> mFreeSlots;
+    uint32_t mCount;
+
+    static uint32_t slotMask()
+    {
+        return (uint32_t)(((uint64_t)1 << SLOT_BITS) - 1);
+    }
+    static uint32_t generationMask()
+    {
+        const uint32_t bits = sizeof(IDX) * 8 - SLOT_BITS - (std::is_signed<IDX>::value ? 1 : 0);
+        return (uint32_t)(((uint64_t)1 << bits) - 1);
+    }
+    static IDX makeId(uint32_t generation, uint32_t index)
+    {
+        return (IDX)((generation << SLOT_BITS) | index);
+    }
+    const CSlot *findSlot(IDX id) const
+    {
+        auto index = (uint32_t)id & slotMask();
+        if (!fdbValidFdbId(id) || (index >= mSlots.size()))
+        {
+            return 0;
+        }
+        auto &slot = mSlots[index];
+        if (!slot.mUsed || (makeId(slot.mGeneration, index) != id))
+        {
+            return 0;
+        }
+        return &slot;
+    }
+};
+
+/*
+ * Entries indexed by serial number in a power-of-two array of slots: an
+ * entry lives in slot (sn & mask). Serial numbers are allocated here and
+ * those whose slot is still taken by a long-living entry are skipped, so
+ * no two live entries share a slot and wraparound of IDX needs no special
+ * care. The array doubles when half full; entries keep their slot modulo
+ * the old size, so rehash never collides. Nothing is allocated once the
+ * array has grown to the working set. IDX should be unsigned.
+ */
+template<typename IDX, typename EP>
+class CEntityRingContainer
+{
+public:
+    // init_size: number of slots allocated at first insert; power of two
+    CEntityRingContainer(uint32_t init_size = 16)
+        : mInitSize(init_size)
+        , mMask(0)
+        , mCount(0)
+        , mNextSn(FDB_FIRST_ENTRY_ID)
+    {}
+    // @return: serial number allocated for the entry
+    IDX insertEntry(const EP &ep)
+    {
+        if ((mCount + 1) * 2 > mSlots.size())
+        {
+            grow();
+        }
+        while (mSlots[mNextSn & mMask].mUsed)
+        {
+            ++mNextSn;
+        }
+        IDX sn = mNextSn++;
+        auto &slot = mSlots[sn & mMask];
+        slot.mSn = sn;
+        slot.mEntry = ep;
+        slot.mUsed = true;
+        ++mCount;
+        return sn;
+    }
+
+    /*
+     * The pointer is valid until next insertEntry(), which might grow
+     * the array.
+     * @return: the entry; 0 if not found
+     */
+    EP *retrieveEntry(IDX sn)
+    {
+        auto slot = findSlot(sn);
+        return slot ? &slot->mEntry : 0;
+    }
+
+    // Remove the entry and move it to ep
+    bool takeEntry(IDX sn, EP &ep)
+    {
+        auto slot = findSlot(sn);
+        if (!slot)
+        {
+            return false;
+        }
+        ep = std::move(slot->mEntry);
+        release(*slot);
+        return true;
+    }
+
+    bool deleteEntry(IDX sn)
+    {
+        auto slot = findSlot(sn);
+        if (!slot)
+        {
+            return false;
+        }
+        release(*slot);
+        return true;
+    }
+
+    // Remove all entries and move them to entries
+    void takeEntries(std::vector<EP> &entries)
+    {
+        entries.reserve(entries.size() + mCount);
+        for (auto it = mSlots.begin(); mCount && (it != mSlots.end()); ++it)
+        {
+            if (it->mUsed)
+            {
+                entries.push_back(std::move(it->mEntry));
+                release(*it);
+            }
+        }
+    }
+
+    uint32_t size() const
+    {
+        return mCount;
+    }
+    bool empty() const
+    {
+        return !mCount;
+    }
+
+private:
+    struct CSlot
+    {
+        CSlot()
+            : mSn(0)
+            , mEntry()
+            , mUsed(false)
+        {}
+        IDX mSn;
+        EP mEntry;
+        bool mUsed;
+    };
+    std::vector<CSlot> mSlots;
+    uint32_t mInitSize;
+    uint32_t mMask;
+    uint32_t mCount;
+    IDX mNextSn;
+
+    CSlot *findSlot(IDX sn)
+    {
+        if (mSlots.empty())
+        {
+            return 0;
+        }
+        auto &slot = mSlots[sn & mMask];
+        return (slot.mUsed && (slot.mSn == sn)) ? &slot : 0;
+    }
+    void release(CSlot &slot)
+    {
+        slot.mEntry = EP();
+        slot.mUsed = false;
+        --mCount;
+    }
+    void grow()
+    {
+        uint32_t size = mSlots.empty() ? mInitSize : (uint32_t)mSlots.size() * 2;
+        std::vector<CSlot> slots(size);
+        uint32_t mask = size - 1;
+        for (auto it = mSlots.begin(); it != mSlots.end(); ++it)
+        {
+            if (it->mUsed)
+            {
+                auto &slot = slots[it->mSn & mask];
+                slot.mSn = it->mSn;
+                slot.mEntry = std::move(it->mEntry);
+                slot.mUsed = true;
+            }
+        }
+        mSlots.swap(slots);
+        mMask = mask;
+    }
+};
+
 #endif
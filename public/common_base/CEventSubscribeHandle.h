@@ -19,11 +19,13 @@
 
 #include <map>
 #include <set>
+#include <vector>
 #include <string>
 #include "common_defs.h"
 
 class CFdbSession;
 class CFdbMessage;
+struct CFdbEventDelta;
 
 enum CFdbSubscribeType {
   FDB_SUB_TYPE_NORMAL = 0,
@@ -52,8 +54,21 @@ public:
                      const char *filter);
     void unsubscribe(CFdbSession *session);
     void unsubscribe(FdbObjectId_t obj_id);
-    void broadcast(CFdbMessage *msg, FdbMsgCode_t event);
-    bool broadcast(CFdbMessage *msg, CFdbSession *session, FdbMsgCode_t event);
+    /*
+     * Broadcast msg to subscribers of the event. If delta is given, it is
+     * sent instead of msg to sessions supporting it; see
+     * CFdbSession::sendEventDelta().
+     */
+    void broadcast(CFdbMessage *msg, FdbMsgCode_t event, const CFdbEventDelta *delta = 0);
+    bool broadcast(CFdbMessage *msg, CFdbSession *session, FdbMsgCode_t event,
+                   const CFdbEventDelta *delta = 0);
+    /*
+     * Find the item by which event with the filter is broadcast to object
+     * obj_id of the session; the item with empty filter matches any filter.
+     * @return: 0 if not subscribed
+     */
+    CSubscribeItem *findSubscribeItem(CFdbSession *session, FdbObjectId_t obj_id,
+                                      FdbMsgCode_t event, const char *filter);
     void getSubscribeTable(SessionTable_t &sessions, tFdbFilterSets &filter_tbl);
     void getSubscribeTable(tFdbSubscribeMsgTbl &table);
     void getSubscribeTable(FdbMsgCode_t code, tFdbFilterSets &filters);
@@ -62,9 +77,21 @@ public:
     void getSubscribeTable(FdbMsgCode_t code, const char *filter,
                            tSubscribedSessionSets &session_tbl);
 private:
+    struct CUDPTarget
+    {
+        FdbObjectId_t mObjId;
+        CFdbSession *mSession;
+    };
+    typedef std::vector<CUDPTarget> UDPTargetTable_t;
+
     SubscribeTable_t mEventSubscribeTable;
     void broadcastOneMsg(CFdbSession *session, CFdbMessage *msg,
-                         CSubscribeItem &sub_item);
+                         CSubscribeItem &sub_item, const CFdbEventDelta *delta);
+    void broadcastOneMsg(CFdbSession *session, FdbObjectId_t obj_id, CFdbMessage *msg,
+                         CSubscribeItem &sub_item, UDPTargetTable_t &udp_targets,
+                         const CFdbEventDelta *delta);
+    void broadcastUDP(CFdbMessage *msg, UDPTargetTable_t &udp_targets, bool multicast);
+    static bool compareUDPTarget(const CUDPTarget &a, const CUDPTarget &b);
 };
 
 #endif
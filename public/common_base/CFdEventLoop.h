@@ -39,21 +39,52 @@ public:
     bool notify();
     bool init(CBaseWorker *worker);
 
-private:
-    typedef std::list< CSysFdWatch *> tCFdWatchList;
-    typedef std::set<CSysFdWatch *> tWatchTbl;
+protected:
     typedef std::vector<CSysFdWatch *> tWatchPollTbl;
     typedef std::vector<pollfd> tFdPollTbl;
+    // index in mPollFds/mPollWatches
+    typedef std::vector<uint32_t> tReadyTbl;
 
+    // fds to poll and watches they belong to; rebuilt when mRebuildPollFd
     tFdPollTbl mPollFds;
+    tWatchPollTbl mPollWatches;
+    bool mRebuildPollFd;
+    // bumped each time input is processed by dispatchInput()
+    uint32_t mInputEpoch;
+
+    void buildFdArray();
+    void processWatches();
+    /*
+     * Process only watches whose revents is set in mPollFds.
+     *
+     * @iparam ready - index of the watches in descending order
+     * @iparam epoch - mInputEpoch when revents was known to be valid; if
+     *      input has been consumed by dispatchInput() since then, revents
+     *      is checked again to avoid reading socket without data.
+     */
+    void processWatches(const tReadyTbl &ready, uint32_t epoch);
+    // disable watch with fatal error and report by onError()
+    void errorWatch(CSysFdWatch *watch);
+    /*
+     * Called when a watch is enabled, or disabled (removed), or fatal error
+     * of the watch is changed, so that subclass can update what it keeps
+     * for the watch only; mRebuildPollFd is set anyway.
+     */
+    virtual void onWatchEnabled(CSysFdWatch *watch, bool enable)
+    {}
+    virtual void onWatchFatalError(CSysFdWatch *watch)
+    {}
+
+private:
+    typedef std::list< CSysFdWatch *> tCFdWatchList;
+    typedef std::set<CSysFdWatch *> tWatchTbl;
+
     tCFdWatchList mWatchList;
     tCFdWatchList mWatchWorkingList;
-    tWatchPollTbl mPollWatches;
     tWatchTbl mWatchBlackList;
     int32_t mWatchRecursiveCnt;
     CNotifyFdWatch *mNotifyWatch;
     CEventFd mEventFd;
-    bool mRebuildPollFd;
     
     bool watchDestroyed(CSysFdWatch *watch);
     void addWatchToBlacklist(CSysFdWatch *watch);
@@ -61,16 +92,16 @@ private:
     void beginWatchBlackList();
     void endWatchBlackList();
 
-    void buildFdArray();
     void buildInputFdArray(tWatchPollTbl &watches, tFdPollTbl &fds);
-    void processWatches();
+    void processWatch(uint32_t index);
     void processInputWatches(tWatchPollTbl &watches, tFdPollTbl &fds);
     bool registerWatch(CSysFdWatch *watch, bool enable);
     bool enableWatch(CSysFdWatch *watch, bool enable);
     bool addWatchToList(tCFdWatchList &wlist, CSysFdWatch *watch, bool enable);
-    void rebuildPollFd()
+    void rebuildPollFd(CSysFdWatch *watch)
     {
 	mRebuildPollFd = true;
+        onWatchFatalError(watch);
     }
 
     friend CSysFdWatch;
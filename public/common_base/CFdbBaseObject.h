@@ -19,11 +19,13 @@
 
 #include <map>
 #include <set>
+#include <vector>
 #include <functional>
 #include "CEventSubscribeHandle.h"
 #include "CFdbMsgDispatcher.h"
 #include "CMethodJob.h"
 #include "CFdbMsgSubscribe.h"
+#include "CFdbEventCache.h"
 
 enum EFdbEndpointRole
 {
@@ -39,6 +41,7 @@ class CBaseEndpoint;
 class IFdbMsgBuilder;
 class CFdbMessage;
 struct CFdbSessionInfo;
+struct CFdbReplayItem;
 class CFdbWatchdog;
 class CFdbMsgProcessList;
 
@@ -56,6 +59,7 @@ public:
 #define FDB_OBJ_ENABLE_TIMESTAMP        (1 << 3)
 #define FDB_OBJ_ENABLE_EVENT_ROUTE      (1 << 4)
 #define FDB_OBJ_ENABLE_WATCHDOG         (1 << 5)
+#define FDB_OBJ_ENABLE_EVENT_DELTA      (1 << 6)
 
     typedef uint32_t tRegEntryId;
     typedef std::function<void(CFdbBaseObject *obj, FdbSessionId_t sid, bool is_online, bool first_or_last)> tConnCallbackFn;
@@ -661,6 +665,59 @@ public:
         return !!(mFlag & FDB_OBJ_ENABLE_EVENT_CACHE);
     }
 
+    /*
+     * Bound memory used by event cache; should be called before the object
+     * is bound. Entries are evicted upon update when over budget.
+     *
+     * @iparam bytes - the budget; 0 for unlimited
+     * @iparam policy - FDB_EVENT_CACHE_LRU or FDB_EVENT_CACHE_TTL
+     * @iparam ttl - for FDB_EVENT_CACHE_TTL: time to live in ms
+     */
+    void eventCacheBudget(uint64_t bytes,
+                          EFdbEventCachePolicy policy = FDB_EVENT_CACHE_LRU,
+                          uint32_t ttl = 0)
+    {
+        mEventCache.budget(bytes, policy, ttl);
+    }
+
+    /*
+     * Tell if cached event is updated by digest of payload before comparing
+     * the whole payload; should be called before the object is bound.
+     */
+    void enableEventCacheDigest(bool active)
+    {
+        mEventCache.enableDigest(active);
+    }
+
+    const CFdbEventCacheStats &eventCacheStats() const
+    {
+        return mEventCache.stats();
+    }
+
+    /*
+     * Broadcast cached event as diff against the value the subscriber
+     * received last time, which is rebuilt by the subscriber from its own
+     * copy. Only works with event cache enabled and for subscribers
+     * supporting it; others always receive the whole value. Good for large
+     * events of which only a small part changes each time.
+     */
+    void enableEventDelta(bool active)
+    {
+        if (active)
+        {
+            mFlag |= FDB_OBJ_ENABLE_EVENT_DELTA;
+        }
+        else
+        {
+            mFlag &= ~FDB_OBJ_ENABLE_EVENT_DELTA;
+        }
+    }
+
+    bool eventDeltaEnabled() const
+    {
+        return !!(mFlag & FDB_OBJ_ENABLE_EVENT_DELTA);
+    }
+
     void enableTimeStamp(bool active)
     {
         if (active)
@@ -909,27 +966,13 @@ protected:
     void publishCachedEvents(CFdbSession *session);
     void getDroppedProcesses(CFdbMsgProcessList &process_list);
 private:
-    struct CEventData
-    {
-        uint8_t *mBuffer;
-        int32_t mSize;
-        bool mAlwaysUpdate;
-
-        bool setEventCache(const uint8_t *buffer, int32_t size);
-        void replaceEventCache(uint8_t *buffer, int32_t size);
-        CEventData();
-        ~CEventData();
-    };
-    typedef std::map<std::string, CEventData> CacheDataTable_t;
-    typedef std::map<FdbMsgCode_t, CacheDataTable_t> EventCacheTable_t;
-
     CBaseWorker *mWorker;
     CEventSubscribeHandle mEventSubscribeHandle;
     CEventSubscribeHandle mGroupSubscribeHandle;
     FdbObjectId_t mObjId;
     EFdbEndpointRole mRole;
     FdbSessionId_t mSid;
-    EventCacheTable_t mEventCache;
+    CFdbEventCache mEventCache;
 
     CFdbEventDispatcher mEvtDispather;
     CFdbMsgDispatcher mMsgDispather;
@@ -950,7 +993,7 @@ private:
     void unsubscribe(CFdbSession *session);
     void unsubscribe(FdbObjectId_t obj_id);
 
-    bool updateEventCache(CFdbMessage *msg);
+    bool updateEventCache(CFdbMessage *msg, CFdbEventDelta *delta);
     void broadcast(CFdbMessage *msg);
 
     bool sendLog(FdbMsgCode_t code, IFdbMsgBuilder &data);
@@ -990,12 +1033,16 @@ private:
     void notifyOffline(CFdbSession *session, bool is_last);
 
     void broadcastCached(CBaseJob::Ptr &msg_ref);
+    void getCachedEvents(CFdbMessage *msg, CFdbSession *session, FdbMsgCode_t msg_code,
+                         const char *topic, std::vector<CFdbReplayItem> &items);
+    bool replayable(CFdbMessage *msg, CFdbSession *session, FdbMsgCode_t msg_code,
+                    const char *topic);
      
     CBaseEndpoint *endpoint() const
     {
         return mEndpoint;
     }
-    const CEventData *getCachedEventData(FdbMsgCode_t msg_code, const char *filter);
+    const CFdbEventCache::CEntry *getCachedEventData(FdbMsgCode_t msg_code, const char *filter);
 
     void callDispOnOnline(CBaseWorker *worker, CMethodJob<CFdbBaseObject> *job, CBaseJob::Ptr &ref);
     void callInvoke(CBaseJob::Ptr &msg_ref);
@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) 2015   Jeremy Chen jeremy_cz@yahoo.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __CFDBBLOCKPOOL_H__
+#define __CFDBBLOCKPOOL_H__
+
+#include <stddef.h>
+#include "common_defs.h"
+
+#define FDB_BLOCK_CLASS_BITS        6
+#define FDB_BLOCK_NR_CLASSES        8
+// blocks up to this size are small ones
+#define FDB_BLOCK_MAX_SMALL_SIZE    (FDB_BLOCK_NR_CLASSES << FDB_BLOCK_CLASS_BITS)
+
+/*
+ * Per-thread cache of free memory blocks allocated and released at high
+ * rate, such as messages and received payloads. Small blocks are grouped
+ * in size classes of 64 bytes up to 512 bytes; large ones in classes of
+ * power of 2 from 1K to 256K, of which only a few are kept. Blocks beyond
+ * go to the heap directly.
+ * A block released by a thread joins the cache of that thread regardless
+ * of which thread allocated it, and each cache is bounded, so memory moved
+ * between threads is never lost. Caches are freed when threads exit.
+ */
+class CFdbBlockPool
+{
+public:
+    static void *alloc(size_t size);
+    // size should be the same as that given to alloc()
+    static void release(void *block, size_t size);
+    /*
+     * Blocks larger than FDB_BLOCK_MAX_SMALL_SIZE are arrays of uint8_t:
+     * they can be freed by delete[] instead of release(), only missing the
+     * cache, and handed over to those freeing with delete[].
+     */
+    static bool isArray(size_t size)
+    {
+        return size > FDB_BLOCK_MAX_SMALL_SIZE;
+    }
+};
+
+#endif
@@ -0,0 +1,243 @@
+/*
+ * Copyright (C) 2015   Jeremy Chen jeremy_cz@yahoo.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __CFDBCALLABLE_H__
+#define __CFDBCALLABLE_H__
+
+#include <stddef.h>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+/*
+ * Size of storage in CFdbCallable for the callable itself. It holds a
+ * pointer to member function bound with an object, or a lambda capturing
+ * up to three pointers, without heap allocation.
+ */
+#define FDB_CALLABLE_INLINE_SIZE    (3 * sizeof(void *))
+
+template<typename SIG>
+class CFdbCallable;
+
+/*
+ * Move-only replacement of std::function used when a message is handed
+ * over between workers. Callables fitting FDB_CALLABLE_INLINE_SIZE are
+ * kept inline; larger ones are allocated from heap.
+ */
+template<typename R, typename... ARGS>
+class CFdbCallable<R(ARGS...)>
+{
+public:
+    CFdbCallable()
+        : mOps(0)
+    {}
+    CFdbCallable(std::nullptr_t)
+        : mOps(0)
+    {}
+    template<typename F, typename = typename std::enable_if<
+                !std::is_same<typename std::decay<F>::type, CFdbCallable>::value>::type>
+    CFdbCallable(F &&fn)
+        : mOps(0)
+    {
+        assign(std::forward<F>(fn));
+    }
+    CFdbCallable(CFdbCallable &&other)
+        : mOps(0)
+    {
+        moveFrom(other);
+    }
+    ~CFdbCallable()
+    {
+        reset();
+    }
+    CFdbCallable &operator=(CFdbCallable &&other)
+    {
+        if (this != &other)
+        {
+            reset();
+            moveFrom(other);
+        }
+        return *this;
+    }
+    CFdbCallable &operator=(std::nullptr_t)
+    {
+        reset();
+        return *this;
+    }
+    template<typename F, typename = typename std::enable_if<
+                !std::is_same<typename std::decay<F>::type, CFdbCallable>::value>::type>
+    CFdbCallable &operator=(F &&fn)
+    {
+        reset();
+        assign(std::forward<F>(fn));
+        return *this;
+    }
+    CFdbCallable(const CFdbCallable &) = delete;
+    CFdbCallable &operator=(const CFdbCallable &) = delete;
+
+    explicit operator bool() const
+    {
+        return !!mOps;
+    }
+    R operator()(ARGS... args) const
+    {
+        if (!mOps)
+        {
+            throw std::bad_function_call();
+        }
+        return mOps->mInvoke(&mStorage, std::forward<ARGS>(args)...);
+    }
+    void reset()
+    {
+        if (mOps)
+        {
+            mOps->mDestroy(&mStorage);
+            mOps = 0;
+        }
+    }
+
+private:
+    typedef typename std::aligned_storage<FDB_CALLABLE_INLINE_SIZE,
+                                          alignof(void *)>::type tStorage;
+    struct COps
+    {
+        R (*mInvoke)(void *storage, ARGS&&... args);
+        // move callable from src to uninitialized dst and destroy src
+        void (*mMove)(void *dst, void *src);
+        void (*mDestroy)(void *storage);
+    };
+
+    template<typename F>
+    struct CInline
+    {
+        static R invoke(void *storage, ARGS&&... args)
+        {
+            return (*static_cast<F *>(storage))(std::forward<ARGS>(args)...);
+        }
+        static void move(void *dst, void *src)
+        {
+            new (dst) F(std::move(*static_cast<F *>(src)));
+            static_cast<F *>(src)->~F();
+        }
+        static void destroy(void *storage)
+        {
+            static_cast<F *>(storage)->~F();
+        }
+        static const COps mOps;
+    };
+
+    template<typename F>
+    struct CAllocated
+    {
+        static F *get(void *storage)
+        {
+            return *static_cast<F **>(storage);
+        }
+        static R invoke(void *storage, ARGS&&... args)
+        {
+            return (*get(storage))(std::forward<ARGS>(args)...);
+        }
+        static void move(void *dst, void *src)
+        {
+            *static_cast<F **>(dst) = get(src);
+        }
+        static void destroy(void *storage)
+        {
+            delete get(storage);
+        }
+        static const COps mOps;
+    };
+
+    mutable tStorage mStorage;
+    const COps *mOps;
+
+    template<typename F>
+    static bool isNull(const F &)
+    {
+        return false;
+    }
+    template<typename F>
+    static bool isNull(F *fn)
+    {
+        return !fn;
+    }
+    template<typename C, typename M>
+    static bool isNull(M C::*fn)
+    {
+        return !fn;
+    }
+    template<typename S>
+    static bool isNull(const std::function<S> &fn)
+    {
+        return !fn;
+    }
+
+    template<typename F>
+    struct CFitInline : std::integral_constant<bool,
+                            (sizeof(F) <= sizeof(tStorage)) &&
+                            (alignof(F) <= alignof(tStorage)) &&
+                            std::is_nothrow_move_constructible<F>::value>
+    {};
+
+    template<typename F>
+    void assign(F &&fn)
+    {
+        typedef typename std::decay<F>::type tFn;
+        if (isNull(fn))
+        {
+            return;
+        }
+        construct<tFn>(std::forward<F>(fn), CFitInline<tFn>());
+    }
+    template<typename T, typename F>
+    void construct(F &&fn, std::true_type)
+    {
+        new (&mStorage) T(std::forward<F>(fn));
+        mOps = &CInline<T>::mOps;
+    }
+    template<typename T, typename F>
+    void construct(F &&fn, std::false_type)
+    {
+        *reinterpret_cast<T **>(&mStorage) = new T(std::forward<F>(fn));
+        mOps = &CAllocated<T>::mOps;
+    }
+    void moveFrom(CFdbCallable &other)
+    {
+        if (other.mOps)
+        {
+            other.mOps->mMove(&mStorage, &other.mStorage);
+            mOps = other.mOps;
+            other.mOps = 0;
+        }
+    }
+};
+
+template<typename R, typename... ARGS>
+template<typename F>
+const typename CFdbCallable<R(ARGS...)>::COps CFdbCallable<R(ARGS...)>::CInline<F>::mOps =
+    {&CFdbCallable<R(ARGS...)>::CInline<F>::invoke,
+     &CFdbCallable<R(ARGS...)>::CInline<F>::move,
+     &CFdbCallable<R(ARGS...)>::CInline<F>::destroy};
+
+template<typename R, typename... ARGS>
+template<typename F>
+const typename CFdbCallable<R(ARGS...)>::COps CFdbCallable<R(ARGS...)>::CAllocated<F>::mOps =
+    {&CFdbCallable<R(ARGS...)>::CAllocated<F>::invoke,
+     &CFdbCallable<R(ARGS...)>::CAllocated<F>::move,
+     &CFdbCallable<R(ARGS...)>::CAllocated<F>::destroy};
+
+#endif
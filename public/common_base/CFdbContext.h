@@ -18,6 +18,8 @@
 #define _CFDBCONTEXT_H_
 
 #include <vector>
+#include <string>
+#include <unordered_map>
 #include <mutex>
 #include <functional>
 #include "common_defs.h"
@@ -63,17 +65,29 @@ public:
                       , bool is_server);
 
     CBaseEndpoint *getEndpoint(FdbEndpointId_t server_id);
-    void registerSession(CFdbSession *session);
+    // @return: false if there are too many sessions
+    bool registerSession(CFdbSession *session);
     CFdbSession *getSession(FdbSessionId_t session_id);
     void unregisterSession(FdbSessionId_t session_id);
     void deleteSession(FdbSessionId_t session_id);
     void deleteSession(CFdbSessionContainer *container);
     FdbEndpointId_t registerEndpoint(CBaseEndpoint *endpoint);
     void unregisterEndpoint(CBaseEndpoint *endpoint);
+    // called when name of registered endpoint is changed from old_name
+    void renameEndpoint(CBaseEndpoint *endpoint, const std::string &old_name);
     CIntraNameProxy *getNameProxy();
     void reconnectOnNsConnected();
     void enableNameProxy(bool enable);
     void enableLogger(bool enable);
+    /*
+     * Connect svc:// clients with address last resolved by name server
+     * before name server replies, which is then validated in background.
+     * If persist is true, the address is also kept in a file shared by
+     * processes of the same user so that restarted process need not wait
+     * for name server. Should be called before start().
+     */
+    void enableSvcAddrCache(bool enable, bool persist = false);
+    void connectCachedService(const char *svc_name);
     CLogProducer *getLogger();
     void registerNsWatchdogListener(tNsWatchdogListenerFn watchdog_listener);
     static const char *getFdbLibVersion();
@@ -82,11 +96,22 @@ protected:
     bool asyncReady();
     
 private:
-    typedef CEntityContainer<FdbEndpointId_t, CBaseEndpoint *> tEndpointContainer;
-    typedef CEntityContainer<FdbSessionId_t, CFdbSession *> tSessionContainer;
+    /*
+     * Looked up by id in the message path: slot containers give O(1)
+     * lookup and detect ids of deleted sessions/endpoints.
+     * Up to 65536 endpoints and 262144 sessions live at the same time;
+     * registration fails beyond that. An id held after its endpoint or
+     * session is destroyed stays stale for at least 2^29 registrations
+     * (15 generation bits for endpoints, 13 for sessions).
+     */
+    typedef CEntitySlotContainer<FdbEndpointId_t, CBaseEndpoint *, 16> tEndpointContainer;
+    typedef CEntitySlotContainer<FdbSessionId_t, CFdbSession *, 18> tSessionContainer;
+    // service name -> endpoints; ids are validated upon lookup
+    typedef std::unordered_map<std::string, std::vector<FdbEndpointId_t> > tEndpointNameTbl;
 
     tEndpointContainer mEndpointContainer;
     tSessionContainer mSessionContainer;
+    tEndpointNameTbl mEndpointNameTbl;
     CIntraNameProxy *mNameProxy;
     CLogProducer *mLogger;
     static std::mutex mSingletonLock;
@@ -94,6 +119,8 @@ private:
 
     bool mEnableNameProxy;
     bool mEnableLogger;
+    bool mEnableSvcAddrCache;
+    bool mPersistSvcAddrCache;
 
     CFdbContext();
     ~CFdbContext() {}
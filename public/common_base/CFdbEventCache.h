@@ -0,0 +1,209 @@
+/*
+ * Copyright (C) 2015   Jeremy Chen jeremy_cz@yahoo.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __CFDBEVENTCACHE_H__
+#define __CFDBEVENTCACHE_H__
+
+#include <string>
+#include <memory>
+#include <vector>
+#include <unordered_map>
+#include "common_defs.h"
+
+/*
+ * How entries are evicted when the cache is over budget.
+ */
+enum EFdbEventCachePolicy
+{
+    // entry least recently updated or read is evicted first
+    FDB_EVENT_CACHE_LRU,
+    /*
+     * entry least recently updated is evicted first; besides, entry not
+     * updated within ttl is dropped even if the cache is within budget
+     */
+    FDB_EVENT_CACHE_TTL
+};
+
+struct CFdbEventCacheStats
+{
+    CFdbEventCacheStats()
+        : mHits(0)
+        , mMisses(0)
+        , mUpdates(0)
+        , mUnchanged(0)
+        , mEvictions(0)
+        , mEntries(0)
+        , mBytes(0)
+    {}
+    // lookup of cached event found/not found
+    uint64_t mHits;
+    uint64_t mMisses;
+    // publish changing cached value/carrying the same value
+    uint64_t mUpdates;
+    uint64_t mUnchanged;
+    uint64_t mEvictions;
+    uint64_t mEntries;
+    // memory charged to the budget
+    uint64_t mBytes;
+};
+
+/*
+ * Change of cached value made by one publish; sent as diff to subscribers
+ * who have the value of mBaseGeneration.
+ */
+struct CFdbEventDelta
+{
+    CFdbEventDelta()
+        : mBaseGeneration(0)
+        , mGeneration(0)
+    {}
+    // generation of the value mDiff is built against; 0 if diff is not built
+    uint32_t mBaseGeneration;
+    // generation of the value published; 0 if delta is not sent
+    uint32_t mGeneration;
+    // built by CFdbDeltaCodec
+    std::vector<uint8_t> mDiff;
+};
+
+class CFdbEventCachePool;
+
+/*
+ * Value of events cached by an object, indexed by event code and topic.
+ * Buffers are allocated from pools of power-of-two size classes, so that
+ * value of an event can be updated in place even if its size changes.
+ * Total memory is bounded by an optional budget. All methods are called
+ * from FDB_CONTEXT.
+ */
+class CFdbEventCache
+{
+public:
+    struct CEntry
+    {
+        /*
+         * mBuffer is owned by mBufferRef, which might be shared with
+         * replay being sent; in that case a new buffer is allocated upon
+         * update instead of overwriting it.
+         */
+        std::shared_ptr<uint8_t> mBufferRef;
+        uint8_t *mBuffer;
+        int32_t mSize;
+        int32_t mCapacity;
+        bool mAlwaysUpdate;
+        // changed upon each update of value; unique in the cache
+        uint32_t mGeneration;
+
+        CEntry();
+    private:
+        FdbMsgCode_t mCode;
+        const std::string *mTopic;
+        uint64_t mDigest;
+        uint64_t mUpdateTime;
+        // list ordered by time of use: mLruHead is the most recent
+        CEntry *mPrev;
+        CEntry *mNext;
+        friend class CFdbEventCache;
+    };
+    typedef std::unordered_map<std::string, CEntry> tTopicTable;
+    typedef std::unordered_map<FdbMsgCode_t, tTopicTable> tEventTable;
+
+    CFdbEventCache();
+    ~CFdbEventCache();
+
+    /*
+     * Find cached value of the event and topic.
+     * @return: 0 if not cached
+     */
+    CEntry *find(FdbMsgCode_t code, const char *topic);
+    /*
+     * All topics cached for the event; 0 if none. Entries read from the
+     * table should be passed to touch().
+     */
+    tTopicTable *topics(FdbMsgCode_t code);
+    /*
+     * Tell entry is read.
+     * @return: false if the entry expires and should be taken as not cached
+     */
+    bool touch(CEntry *entry);
+    /*
+     * Update cached value of the event and topic; create the entry if not
+     * exist. If buffer is 0, the buffer is allocated without being filled.
+     * Entries are evicted if the cache goes over budget.
+     * @return: the entry
+     * @oparam changed: true if the value is changed
+     * @oparam delta: if not 0, filled with generation of the value and its
+     *      diff against the previous value
+     */
+    CEntry *update(FdbMsgCode_t code, const std::string &topic, const uint8_t *buffer,
+                   int32_t size, bool &changed, CFdbEventDelta *delta = 0);
+    // call after writing to buffer allocated by update()
+    void commit(CEntry *entry);
+    const tEventTable &events() const
+    {
+        return mEvents;
+    }
+
+    /*
+     * Limit memory charged to cached events: payload buffers and topics.
+     *
+     * @iparam bytes - the budget; 0 for unlimited
+     * @iparam policy - how entries are evicted
+     * @iparam ttl - for FDB_EVENT_CACHE_TTL: time to live in ms
+     */
+    void budget(uint64_t bytes, EFdbEventCachePolicy policy, uint32_t ttl);
+    uint64_t budget() const
+    {
+        return mBudget;
+    }
+    /*
+     * Compare value with 64-bit digest before the whole payload, so that
+     * a changed value is told without reading the cached one. Matched
+     * digest is still confirmed by comparing payload.
+     */
+    void enableDigest(bool active)
+    {
+        mDigestEnabled = active;
+    }
+    const CFdbEventCacheStats &stats() const
+    {
+        return mStats;
+    }
+
+private:
+    tEventTable mEvents;
+    std::shared_ptr<CFdbEventCachePool> mPool;
+    CEntry *mLruHead;
+    CEntry *mLruTail;
+    uint64_t mBudget;
+    EFdbEventCachePolicy mPolicy;
+    uint32_t mTtl;
+    bool mDigestEnabled;
+    uint32_t mGeneration;
+    CFdbEventCacheStats mStats;
+
+    static uint64_t digest(const uint8_t *buffer, int32_t size);
+    static uint64_t entryCost(const CEntry *entry);
+    void allocate(CEntry *entry, int32_t size);
+    bool expired(const CEntry *entry, uint64_t now) const;
+    void linkHead(CEntry *entry);
+    void unlink(CEntry *entry);
+    void remove(CEntry *entry);
+    void evict(const CEntry *keep);
+    uint32_t newGeneration();
+    void buildDelta(const CEntry *entry, const uint8_t *buffer, int32_t size,
+                    CFdbEventDelta *delta);
+};
+
+#endif
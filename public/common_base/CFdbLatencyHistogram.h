@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2015   Jeremy Chen jeremy_cz@yahoo.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __CFDBLATENCYHISTOGRAM_H__
+#define __CFDBLATENCYHISTOGRAM_H__
+
+#include <atomic>
+#include <map>
+#include "common_defs.h"
+
+/*
+ * Statistics calculated from a histogram; all values are in microsecond.
+ */
+struct CFdbLatencySummary
+{
+    CFdbLatencySummary()
+        : mCount(0)
+        , mMin(0)
+        , mMax(0)
+        , mMean(0)
+        , mP50(0)
+        , mP90(0)
+        , mP99(0)
+        , mP999(0)
+    {}
+    uint64_t mCount;
+    uint64_t mMin;
+    uint64_t mMax;
+    uint64_t mMean;
+    uint64_t mP50;
+    uint64_t mP90;
+    uint64_t mP99;
+    uint64_t mP999;
+};
+
+/*
+ * Log-linear (HDR style) histogram of latency in microsecond. Values are
+ * grouped by power of two and each group is split into 16 linear buckets,
+ * so that the recorded value is accurate to 1/16 (6.25%) at any magnitude.
+ * Recording is lock-free and can be done from any thread; snapshot can be
+ * taken while recording is in progress.
+ */
+class CFdbLatencyHistogram
+{
+public:
+    CFdbLatencyHistogram();
+    /*
+     * Record one sample.
+     *
+     * @iparam us - latency in microsecond
+     */
+    void record(uint64_t us);
+    void recordNano(uint64_t start_ns, uint64_t end_ns)
+    {
+        record((end_ns > start_ns) ? (end_ns - start_ns) / 1000 : 0);
+    }
+    uint64_t count() const
+    {
+        return mCount.load(std::memory_order_relaxed);
+    }
+    /*
+     * Get value at the given percentile.
+     *
+     * @iparam percentile - 0.0 ~ 100.0
+     * @return upper bound of the bucket the percentile falls in, in us
+     */
+    uint64_t percentile(double percentile) const;
+    void summarize(CFdbLatencySummary &summary) const;
+    /*
+     * Add samples of another histogram to this one, e.g. to combine
+     * histograms recorded by different threads.
+     */
+    void merge(const CFdbLatencyHistogram &other);
+    void reset();
+
+private:
+    static const int32_t mSubBucketBits = 4;
+    static const int32_t mSubBuckets = 1 << mSubBucketBits;
+    // values above 2^36 us (about 19 hours) are counted in the last bucket
+    static const int32_t mMaxValueBits = 36;
+    static const int32_t mNrBuckets = mSubBuckets * (mMaxValueBits - mSubBucketBits + 1);
+
+    static int32_t bucketIndex(uint64_t value);
+    static uint64_t bucketUpperBound(int32_t index);
+
+    std::atomic<uint32_t> mBuckets[mNrBuckets];
+    std::atomic<uint64_t> mCount;
+    std::atomic<uint64_t> mSum;
+    std::atomic<uint64_t> mMin;
+    std::atomic<uint64_t> mMax;
+};
+
+enum EFdbLatencyType
+{
+    FDB_LATENCY_CLIENT_TO_SERVER,   // request sent by client -> arrived at server
+    FDB_LATENCY_SERVER_PROCESS,     // request arrived at server -> replied by server
+    FDB_LATENCY_TOTAL,              // request sent by client -> reply received by client
+    FDB_LATENCY_MAX
+};
+
+/*
+ * Latency histograms of each method (message code) of an endpoint.
+ * Histograms are created and looked up only from FDB_CONTEXT.
+ */
+class CFdbLatencyStats
+{
+public:
+    typedef std::map<FdbMsgCode_t, CFdbLatencyHistogram *> tHistogramTbl;
+
+    ~CFdbLatencyStats();
+    void record(FdbMsgCode_t code, EFdbLatencyType type, uint64_t start_ns, uint64_t end_ns);
+    const tHistogramTbl &histograms(EFdbLatencyType type) const
+    {
+        return mHistograms[type];
+    }
+    void reset();
+
+private:
+    tHistogramTbl mHistograms[FDB_LATENCY_MAX];
+};
+
+#endif
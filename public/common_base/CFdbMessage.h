@@ -21,6 +21,7 @@
 #include <functional>
 #include "common_defs.h"
 #include "CBaseJob.h"
+#include "CFdbCallable.h"
 #include "CBaseLoopTimer.h"
 
 namespace NFdbBase
@@ -77,6 +78,8 @@ enum EFdbSidebandMessage
     FDB_SIDEBAND_QUERY_EVT_CACHE = 4,
     FDB_SIDEBAND_KICK_WATCHDOG = 5,
     FDB_SIDEBAND_FEED_WATCHDOG = 6,
+    FDB_SIDEBAND_QUERY_LATENCY = 7,
+    FDB_SIDEBAND_QUERY_TRAFFIC = 8,
     FDB_SIDEBAND_SYSTEM_MAX = 4095,
     FDB_SIDEBAND_USER_MIN = FDB_SIDEBAND_SYSTEM_MAX + 1
 };
@@ -185,11 +188,13 @@ typedef int32_t FdbMessageType_t;
 #define FDB_MSG_TYPE_SYSTEM       0
 
 class CMessageTimer;
+struct CFdbMsgExtension;
 class CFdbSession;
 class CFdbBaseObject;
 class CBaseEndpoint;
 namespace NFdbBase {
     class CFdbMessageHeader;
+    class CFdbStringIdTable;
 }
 class IFdbMsgBuilder;
 class IFdbMsgParser;
@@ -209,18 +214,23 @@ private:
 #define MSG_FLAG_STATUS             (1 << 5)
 #define MSG_FLAG_INITIAL_RESPONSE   (1 << 6)
 #define MSG_FLAG_FORCE_UPDATE       (1 << 8)
+#define MSG_FLAG_COMPRESSED         (1 << 9)
+#define MSG_FLAG_REPLAY_BATCH       (1 << 10)
+#define MSG_FLAG_REPLAY_END         (1 << 11)
+#define MSG_FLAG_EVENT_DELTA        (1 << 12)
 
 #define MSG_FLAG_HEAD_OK            (1 << (MSG_LOCAL_FLAG_SHIFT + 0))
 #define MSG_FLAG_ENDPOINT           (1 << (MSG_LOCAL_FLAG_SHIFT + 1))
 #define MSG_FLAG_REPLIED            (1 << (MSG_LOCAL_FLAG_SHIFT + 2))
 #define MSG_FLAG_ENABLE_LOG         (1 << (MSG_LOCAL_FLAG_SHIFT + 3))
 #define MSG_FLAG_EXTERNAL_BUFFER    (1 << (MSG_LOCAL_FLAG_SHIFT + 4))
+#define MSG_FLAG_HEAD_PACKED        (1 << (MSG_LOCAL_FLAG_SHIFT + 5))
 #define MSG_FLAG_MANUAL_UPDATE      (1 << (MSG_LOCAL_FLAG_SHIFT + 6))
     static const int32_t mPrefixSize = sizeof(CFdbMsgPrefix);
     static const int32_t mMaxHeadSize = 256;
 
 public:
-    typedef std::function<void(CBaseJob::Ptr &)> tCallableFn;
+    typedef CFdbCallable<void(CBaseJob::Ptr &)> tCallableFn;
     struct Callable
     {
         tCallableFn mFunc;
@@ -228,18 +238,19 @@ public:
     };
     void setCallable(tCallableFn fn)
     {
-        mCallable.mFunc = fn;
+        mCallable.mFunc = std::move(fn);
     }
     void setPostProcessing(tCallableFn fn)
     {
-        mCallable.mPostFunc = fn;
+        mCallable.mPostFunc = std::move(fn);
     }
 
     CFdbMessage(FdbMsgCode_t code = FDB_INVALID_ID);
     CFdbMessage(NFdbBase::CFdbMessageHeader &head
                 , CFdbMsgPrefix &prefix
                 , uint8_t *buffer
-                , FdbSessionId_t sid);
+                , FdbSessionId_t sid
+                , int32_t pooled_size = 0);
     CFdbMessage(const CFdbMessage *msg);
     virtual ~CFdbMessage();
 
@@ -348,12 +359,7 @@ public:
     /*
      * Own the buffer (so that user should release it manually)
      */
-    void *ownBuffer()
-    {
-        void *buf = mBuffer;
-        mBuffer = 0;
-        return buf;
-    }
+    void *ownBuffer();
 
     /*
      * Release the buffer obtained from ownBuffer().
@@ -453,6 +459,15 @@ public:
     {
         return !!(mFlag & MSG_FLAG_INITIAL_RESPONSE);
     }
+    /*
+     * in CBaseEndpoint::onBroadcast(), check if the message is the last
+     *      cached event replayed upon subscribe, after which the subscriber
+     *      holds current value of all events it subscribed.
+     */
+    bool isReplayEnd() const
+    {
+        return !!(mFlag & MSG_FLAG_REPLAY_END);
+    }
 
     bool isLogEnabled() const
     {
@@ -518,15 +533,8 @@ public:
         return FDB_MSG_TYPE_SYSTEM;
     }
 
-    const std::string &token() const
-    {
-        return mToken;
-    }
-
-    void token(const char *tk)
-    {
-        mToken = tk;
-    }
+    const std::string &token() const;
+    void token(const char *tk);
 
     void enableTimeStamp(bool active);
 
@@ -655,7 +663,16 @@ private:
     static bool update(CBaseJob::Ptr &msg_ref, int32_t timeout = 0);
 
     void run(CBaseWorker *worker, Ptr &ref);
-    bool buildHeader();
+    /*
+     * Build message head in front of payload. If packed is true, the head
+     * is in fixed layout of NFdbBase::CFdbPackedMsgHeader, which can only
+     * be sent to peer of FDB_WIRE_VERSION_PACKED_HEAD or above. The head
+     * is built again if it is of the other layout.
+     * If string_ids is given, filter and token of packed head are replaced
+     * with ids of the session. Such head is only valid for that session
+     * and is always built again.
+     */
+    bool buildHeader(bool packed = false, NFdbBase::CFdbStringIdTable *string_ids = 0);
     bool serialize(IFdbMsgBuilder &data, const CFdbBaseObject *object = 0);
     bool serialize(const void *buffer, int32_t size, const CFdbBaseObject *object = 0);
 
@@ -752,20 +769,41 @@ private:
     };
     FdbObjectId_t mOid;
     uint8_t *mBuffer;
+    // size given to CFdbBlockPool::alloc() if mBuffer is a pooled block; 0 if from new[]
+    int32_t mPooledSize;
     uint32_t mFlag;
-    CMessageTimer *mTimer;
-    std::string mStringData;
+    EFdbQOS mQOS;
+    /*
+     * Rarely used fields (token, log text, timestamp, timer) allocated
+     * when first set; 0 if none of them is used.
+     */
+    CFdbMsgExtension *mExt;
+    // small topics are held inline by std::string
     std::string mFilter;
-
-    CFdbMsgMetadata *mTimeStamp;
-
-    std::string mToken;
+    /*
+     * Local time (ns) when request is sent (client) or arrives (server);
+     * always recorded for latency statistics regardless of timestamp.
+     */
+    uint64_t mLatencyStart;
     Callable mCallable;
-    EFdbQOS mQOS;
+
+    CFdbMsgExtension *extension();
+    /*
+     * Compress payload at the first call and return the same data for
+     * following ones, so that a broadcast is compressed once for all
+     * subscribers; released together with the payload.
+     *
+     * @oparam size - size of compressed payload
+     * @return compressed payload; 0 if payload can not be compressed well
+     */
+    const uint8_t *compressedPayload(int32_t &size);
+    CFdbMsgMetadata *timeStamp() const;
+    const std::string &logData() const;
 
     friend class CFdbSession;
     friend class CFdbUDPSession;
     friend class CFdbBaseObject;
+    friend class CBaseEndpoint;
     friend class CBaseServer;
     friend class CBaseClient;
     friend class CLogProducer;
@@ -48,7 +48,16 @@ inline void fdbMigrateCallback(CBaseJob::Ptr &msg_ref, CFdbMessage *msg, tDispat
     }
     else
     {
-        msg->setCallable(std::bind(fn, std::placeholders::_1, obj));
+        /*
+         * Refer to fn instead of copying it: registered callbacks are never
+         * removed before obj is destroyed and reply callback of AFC lives
+         * in msg itself. Thus the hop to worker never allocates.
+         */
+        auto fn_ptr = &fn;
+        msg->setCallable([fn_ptr, obj](CBaseJob::Ptr &msg_ref)
+            {
+                (*fn_ptr)(msg_ref, obj);
+            });
         worker->sendAsync(msg_ref);
     }
 }
@@ -18,12 +18,16 @@
 #define _CFDBSESSION_
 
 #include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
 #include <common_base/CBaseFdWatch.h>
 #include <common_base/common_defs.h>
 //#include "CFdbMessage.h"
 #include <common_base/CBaseJob.h>
 #include <common_base/CEntityContainer.h>
 #include <common_base/CFdbSessionContainer.h>
+#include <common_base/CFdbTrafficStats.h>
 
 struct CFdbSessionInfo
 {
@@ -32,13 +36,30 @@ struct CFdbSessionInfo
     CFdbSocketConnInfo const *mConn;
 };
 
+/*
+ * Cached event replayed to subscriber by CFdbSession::sendReplay(). The
+ * buffer is shared with the event cache so that it is not released if the
+ * cache is updated while the replay is being sent.
+ */
+struct CFdbReplayItem
+{
+    FdbMsgCode_t mCode;
+    std::string mTopic;
+    std::shared_ptr<uint8_t> mBuffer;
+    int32_t mSize;
+};
+typedef std::vector<CFdbReplayItem> tFdbReplayItems;
+
 class CFdbSessionContainer;
 class CSocketImp;
 class CFdbMessage;
 struct CFdbMsgPrefix;
+struct CFdbIoVec;
+struct CFdbEventDelta;
 
 namespace NFdbBase {
     class CFdbMessageHeader;
+    class CFdbStringIdTable;
 }
 class CFdbSession : public CBaseFdWatch
 {
@@ -50,6 +71,26 @@ public:
     bool sendMessage(CBaseJob::Ptr &ref);
     bool sendMessage(CFdbMessage *msg);
     bool sendUDPMessage(CFdbMessage *msg);
+    /*
+     * Send cached events to subscriber in reply to subscribe request msg,
+     * packed into as few broadcasts as possible. Only for peer supporting
+     * replayBatch(). The last broadcast is marked with MSG_FLAG_REPLAY_END.
+     */
+    bool sendReplay(CFdbMessage *msg, const tFdbReplayItems &items);
+    /*
+     * Send broadcast msg of cached event with payload replaced by delta:
+     * the diff if peer is known to have the value delta.mBaseGeneration;
+     * nothing but the generation if peer has the value already; otherwise
+     * the whole value. Only for peer supporting eventDelta().
+     */
+    bool sendEventDelta(CFdbMessage *msg, const CFdbEventDelta &delta);
+    /*
+     * Forget the value sent to object obj_id of peer, so that the whole
+     * value is sent next time.
+     *
+     * @iparam topic - topic of the event; "" for all topics
+     */
+    void resetEventDelta(FdbObjectId_t obj_id, FdbMsgCode_t code, const char *topic);
     FdbSessionId_t sid() const
     {
         return mSid;
@@ -92,6 +133,38 @@ public:
     {
         return mUDPAddr;
     }
+    // whether peer receives best-effort broadcast from multicast group
+    bool multicastJoined() const
+    {
+        return mMulticastJoined;
+    }
+    void multicastJoined(bool joined)
+    {
+        mMulticastJoined = joined;
+    }
+    // wire version told by peer in FdbSessionInfo
+    void peerWireVersion(uint32_t version)
+    {
+        mPeerWireVersion = version;
+    }
+    // whether peer understands message head of fixed layout
+    bool packedHead() const;
+    // whether peer understands broadcast marked with MSG_FLAG_REPLAY_BATCH
+    bool replayBatch() const;
+    // whether peer understands broadcast marked with MSG_FLAG_EVENT_DELTA
+    bool eventDelta() const;
+    /*
+     * Set how payload is compressed before sending.
+     *
+     * @iparam compression - FDB_COMPRESS_XXX accepted by peer and enabled
+     *      locally; FDB_COMPRESS_NONE to disable compression
+     * @iparam threshold - payload smaller than this is sent as it is
+     */
+    void compression(uint32_t compression, int32_t threshold)
+    {
+        mCompression = compression;
+        mCompressThreshold = threshold;
+    }
     bool hostIp(std::string &host_ip);
     bool peerIp(std::string &host_ip);
 
@@ -107,20 +180,60 @@ public:
     {
         return mSocket;
     }
+    const CFdbTrafficStats &traffic() const
+    {
+        return mTraffic;
+    }
+    // number of requests waiting for reply
+    uint32_t pendingMsgCount()
+    {
+        return mPendingMsgTable.size();
+    }
 protected:
     void onInput(bool &io_error);
     void onError();
     void onHup();
 private:
-    typedef CEntityContainer<FdbMsgSn_t, CBaseJob::Ptr> PendingMsgTable_t;
+    typedef CEntityRingContainer<FdbMsgSn_t, CBaseJob::Ptr> PendingMsgTable_t;
+    /*
+     * Value of cached event sent to/received from peer with
+     * MSG_FLAG_EVENT_DELTA. Only generation is kept for values sent.
+     */
+    struct CEventCopy
+    {
+        CEventCopy()
+            : mGeneration(0)
+            , mResync(false)
+        {}
+        // 0 if the value is unknown
+        uint32_t mGeneration;
+        // update is requested since diff can not be applied
+        bool mResync;
+        std::vector<uint8_t> mValue;
+    };
+    typedef std::unordered_map<std::string, CEventCopy> tEventCopyTopics;
+    // indexed by object id and event code; see eventCopyKey()
+    typedef std::unordered_map<uint64_t, tEventCopyTopics> tEventCopyTable;
 
     void doRequest(NFdbBase::CFdbMessageHeader &head, CFdbMsgPrefix &prefix, uint8_t *buffer);
     void doResponse(NFdbBase::CFdbMessageHeader &head, CFdbMsgPrefix &prefix, uint8_t *buffer);
     void doBroadcast(NFdbBase::CFdbMessageHeader &head, CFdbMsgPrefix &prefix, uint8_t *buffer);
     void doSubscribeReq(NFdbBase::CFdbMessageHeader &head, CFdbMsgPrefix &prefix, uint8_t *buffer, bool subscribe);
     void doUpdate(NFdbBase::CFdbMessageHeader &head, CFdbMsgPrefix &prefix, uint8_t *buffer);
+    void doReplayBatch(NFdbBase::CFdbMessageHeader &head, CFdbMsgPrefix &prefix, uint8_t *buffer);
+    bool sendGather(CFdbIoVec *vecs, int32_t nr_vecs);
     void checkLogEnabled(CFdbMessage *msg);
     bool receiveData(uint8_t *buf, int32_t size);
+    bool buildCompressedFrame(CFdbMessage *msg, NFdbBase::CFdbStringIdTable *string_ids,
+                              CFdbIoVec *vecs);
+    bool decompressPayload(NFdbBase::CFdbMessageHeader &head, CFdbMsgPrefix &prefix,
+                           uint8_t *&buffer, int32_t capacity);
+    static uint64_t eventCopyKey(FdbObjectId_t obj_id, FdbMsgCode_t code)
+    {
+        return ((uint64_t)obj_id << 32) | (uint32_t)code;
+    }
+    bool applyEventDelta(NFdbBase::CFdbMessageHeader &head, CFdbMsgPrefix &prefix, uint8_t *&buffer);
+    void requestEventResync(FdbObjectId_t obj_id, FdbMsgCode_t code, const char *topic);
 
     PendingMsgTable_t mPendingMsgTable;
     FdbSessionId_t mSid;
@@ -131,7 +244,21 @@ private:
     std::string mSenderName;
     int32_t mRecursiveDepth;
     CFdbSocketAddr mUDPAddr;
+    bool mMulticastJoined;
+    uint32_t mPeerWireVersion;
+    // strings interned for this session; see NFdbBase::CFdbStringIdTable
+    NFdbBase::CFdbStringIdTable *mStringIds;
+    uint32_t mCompression;
+    int32_t mCompressThreshold;
+    // size given to CFdbBlockPool::alloc() if the frame being dispatched is
+    // held by a pooled block; 0 if by new[]
+    int32_t mRxPooledSize;
     CBASE_tProcId mPid;
+    CFdbTrafficStats mTraffic;
+    tEventCopyTable mEventsSent;
+    tEventCopyTable mEventsReceived;
+
+    friend class CFdbSessionContainer;
 };
 
 #endif
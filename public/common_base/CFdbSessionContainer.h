@@ -19,9 +19,19 @@
 
 #include <string>
 #include <list>
+#include <vector>
+#include <map>
+#include <set>
 #include "common_defs.h"
 #include "CSocketImp.h"
 
+/*
+ * Number of multicast groups each endpoint address uses at most; client
+ * joins one group per slot, below the default limit of IGMP memberships
+ * (20) of a socket.
+ */
+#define FDB_MULTICAST_GROUP_SLOTS   16
+
 class CFdbSession;
 class CBaseEndpoint;
 class CFdbUDPSession;
@@ -56,7 +66,15 @@ public:
     }
 
     bool bindUDPSocket(const char *ip_address = 0, int32_t udp_port = FDB_INET_PORT_INVALID);
-    bool sendUDPmessage(CFdbMessage *msg, const CFdbSocketAddr &dest_addr);
+    bool sendUDPmessage(CFdbMessage *msg, const CFdbSocketAddr &dest_addr, bool packed_head = false);
+    /*
+     * Send msg to UDP peers of all sessions in one go. Sessions whose peer
+     * can not be reached with UDP get msg from TCP/UDS instead. If
+     * multicast is true, msg is sent only once to the multicast group for
+     * sessions whose peer joins the group.
+     */
+    void sendUDPmessage(CFdbMessage *msg, std::vector<CFdbSession *> &sessions,
+                        bool multicast = false);
     bool getUDPSocketInfo(CFdbSocketInfo &info);
 
     CFdbSession *connected(const CFdbSocketAddr &addr);
@@ -66,6 +84,26 @@ public:
     {
         mPendingUDPPort = udp_port;
     }
+
+    /*
+     * Set multicast group (udp://<group base>:<port>) allocated by name
+     * server. Event group N of the endpoint is delivered to host
+     * <group base> + N % FDB_MULTICAST_GROUP_SLOTS.
+     */
+    void multicastGroup(const char *url);
+    const CFdbSocketAddr &multicastGroup() const
+    {
+        return mMulticastGroup;
+    }
+    /*
+     * For client: create socket receiving multicast group from the
+     * interface with address interface_ip.
+     */
+    bool bindMulticastSocket(const char *interface_ip);
+    bool multicastBound() const
+    {
+        return !!mMulticastSession;
+    }
 protected:
     FdbSocketId_t mSkid;
     virtual void onSessionDeleted(CFdbSession *session) {}
@@ -73,23 +111,43 @@ protected:
     CBaseSocket *mSocket;
 private:
     typedef std::list<CFdbSession *> ConnectedSessionTable_t;
+    typedef std::map<FdbMsgCode_t, std::set<std::string> > tMulticastFilterTbl;
+    typedef std::map<FdbObjectId_t, tMulticastFilterTbl> tMulticastSubscribeTbl;
     bool mEnableSessionDestroyHook;
     CBaseSocket *mUDPSocket;
     CFdbUDPSession *mUDPSession;
     int32_t mPendingUDPPort;
 
+    CFdbSocketAddr mMulticastGroup;
+    // address of interface joining multicast group
+    std::string mMulticastInterface;
+    CBaseSocket *mMulticastSocket;
+    CFdbUDPSession *mMulticastSession;
+    // bit N is set if group of slot N is joined
+    uint32_t mMulticastSlots;
+    // events subscribed by client; used to filter multicast broadcast
+    tMulticastSubscribeTbl mMulticastSubscribeTbl;
+
     ConnectedSessionTable_t mConnectedSessionTable;
 
     void addSession(CFdbSession *session);
     void removeSession(CFdbSession *session);
     void callSessionDestroyHook(CFdbSession *session);
 
+    bool getMulticastAddress(FdbEventGroup_t event_group, CFdbSocketAddr &addr);
+    bool joinMulticastGroup(FdbEventGroup_t event_group);
+    void closeMulticastSocket();
+    void updateMulticastSubscription(CFdbSession *session, CFdbMessage *msg);
+    bool multicastSubscribed(FdbObjectId_t obj_id, FdbMsgCode_t code, const std::string &topic);
+    bool multicastPackedHead();
+
     friend class CFdbSession;
     friend class CBaseEndpoint;
     friend class CFdbUDPSession;
     friend class CBaseServer;
     friend class CBaseClient;
     friend class CFdbBaseObject;
+    friend class CFdbMessage;
 };
 
 #endif
@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2015   Jeremy Chen jeremy_cz@yahoo.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __CFDBTRAFFICSTATS_H__
+#define __CFDBTRAFFICSTATS_H__
+
+#include <atomic>
+#include "common_defs.h"
+
+/*
+ * Traffic counters of a session or an endpoint. Counters are updated with
+ * relaxed atomics so they can be snapshotted from any thread while
+ * FDB_CONTEXT is updating them.
+ */
+class CFdbTrafficStats
+{
+public:
+    // large enough to hold all of EFdbMessageType
+    static const int32_t mNrMsgTypes = 16;
+
+    CFdbTrafficStats()
+    {
+        reset();
+    }
+    void recordIn(int32_t type, int32_t bytes)
+    {
+        if ((type >= 0) && (type < mNrMsgTypes))
+        {
+            mIn[type].mMsgs.fetch_add(1, std::memory_order_relaxed);
+            mIn[type].mBytes.fetch_add((uint64_t)bytes, std::memory_order_relaxed);
+        }
+    }
+    void recordOut(int32_t type, int32_t bytes)
+    {
+        if ((type >= 0) && (type < mNrMsgTypes))
+        {
+            mOut[type].mMsgs.fetch_add(1, std::memory_order_relaxed);
+            mOut[type].mBytes.fetch_add((uint64_t)bytes, std::memory_order_relaxed);
+        }
+    }
+    /*
+     * Record that socket is not able to accept all data at once.
+     *
+     * @iparam retries - times of retry before all data is sent
+     * @iparam blocked_ns - time spent in retrying
+     */
+    void recordSendRetry(uint32_t retries, uint64_t blocked_ns)
+    {
+        mSendRetries.fetch_add(retries, std::memory_order_relaxed);
+        mSendBlockedTime.fetch_add(blocked_ns, std::memory_order_relaxed);
+    }
+
+    uint64_t msgsIn(int32_t type) const
+    {
+        return mIn[type].mMsgs.load(std::memory_order_relaxed);
+    }
+    uint64_t bytesIn(int32_t type) const
+    {
+        return mIn[type].mBytes.load(std::memory_order_relaxed);
+    }
+    uint64_t msgsOut(int32_t type) const
+    {
+        return mOut[type].mMsgs.load(std::memory_order_relaxed);
+    }
+    uint64_t bytesOut(int32_t type) const
+    {
+        return mOut[type].mBytes.load(std::memory_order_relaxed);
+    }
+    uint64_t sendRetries() const
+    {
+        return mSendRetries.load(std::memory_order_relaxed);
+    }
+    // in nano second
+    uint64_t sendBlockedTime() const
+    {
+        return mSendBlockedTime.load(std::memory_order_relaxed);
+    }
+
+    void reset()
+    {
+        for (int32_t i = 0; i < mNrMsgTypes; ++i)
+        {
+            mIn[i].mMsgs.store(0, std::memory_order_relaxed);
+            mIn[i].mBytes.store(0, std::memory_order_relaxed);
+            mOut[i].mMsgs.store(0, std::memory_order_relaxed);
+            mOut[i].mBytes.store(0, std::memory_order_relaxed);
+        }
+        mSendRetries.store(0, std::memory_order_relaxed);
+        mSendBlockedTime.store(0, std::memory_order_relaxed);
+    }
+
+private:
+    struct CCounter
+    {
+        std::atomic<uint64_t> mMsgs;
+        std::atomic<uint64_t> mBytes;
+    };
+    CCounter mIn[mNrMsgTypes];
+    CCounter mOut[mNrMsgTypes];
+    std::atomic<uint64_t> mSendRetries;
+    std::atomic<uint64_t> mSendBlockedTime;
+};
+
+#endif
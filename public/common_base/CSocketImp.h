@@ -101,6 +101,13 @@ protected:
     CFdbSocketConnInfo mConn;
 };
 
+// one piece of data sent by CSocketImp::sendGather()
+struct CFdbIoVec
+{
+    const uint8_t *mData;
+    int32_t mSize;
+};
+
 class CSocketImp : public CBaseSocket
 {
 public:
@@ -128,6 +135,92 @@ public:
     {
         return -1;
     }
+
+    /*
+     * Send pieces of data in order as if they were in one buffer.
+     * @return: number of bytes sent, which may stop in the middle of a
+     *      piece; < 0 if error occurs
+     */
+    virtual int32_t sendGather(const CFdbIoVec *vecs, int32_t nr_vecs)
+    {
+        int32_t sent = 0;
+        for (int32_t i = 0; i < nr_vecs; ++i)
+        {
+            auto cnt = send(vecs[i].mData, vecs[i].mSize);
+            if (cnt < 0)
+            {
+                return sent ? sent : -1;
+            }
+            sent += cnt;
+            if (cnt != vecs[i].mSize)
+            {
+                break;
+            }
+        }
+        return sent;
+    }
+
+    /*
+     * Send the same datagram to several destinations.
+     * @return: number of destinations, counted from the first, the datagram
+     *      is sent to.
+     */
+    virtual int32_t sendBatch(const uint8_t *data, int32_t size,
+                              const CFdbSocketAddr **dest_addrs, int32_t nr_dests)
+    {
+        int32_t i;
+        for (i = 0; i < nr_dests; ++i)
+        {
+            if (send(data, size, *dest_addrs[i]) != size)
+            {
+                break;
+            }
+        }
+        return i;
+    }
+
+    /*
+     * Receive up to nr_buffers datagrams without blocking except for the
+     * first one. Datagram n is stored in buffers[n] and its size is in
+     * sizes[n]. Each buffer is buffer_size bytes. If sources is not 0,
+     * sources[n] identifies the sender of datagram n (the same sender
+     * always gets the same value).
+     * @return: number of datagrams received; < 0 if error occurs
+     */
+    virtual int32_t recvBatch(uint8_t **buffers, int32_t buffer_size,
+                              int32_t *sizes, int32_t nr_buffers,
+                              uint64_t *sources = 0)
+    {
+        int32_t size = recv(buffers[0], buffer_size);
+        if (size < 0)
+        {
+            return -1;
+        }
+        sizes[0] = size;
+        if (sources)
+        {
+            sources[0] = 0;
+        }
+        return 1;
+    }
+
+    /*
+     * Receive datagrams sent to multicast group group_ip from the
+     * interface with address interface_ip.
+     */
+    virtual bool joinMulticastGroup(const char *group_ip, const char *interface_ip)
+    {
+        return false;
+    }
+
+    /*
+     * Send datagrams to multicast groups from the interface with address
+     * interface_ip.
+     */
+    virtual bool setMulticastInterface(const char *interface_ip)
+    {
+        return false;
+    }
 };
 
 class CClientSocketImp : public CBaseSocket
@@ -17,6 +17,7 @@
 #ifndef _CSYSFDWATCH_H_
 #define _CSYSFDWATCH_H_
 
+#include <list>
 #include "common_defs.h"
 
 class CFdEventLoop;
@@ -152,6 +153,8 @@ private:
     bool mEnable;
     bool mFatalError;
     CFdEventLoop *mEventLoop;
+    // position in working list of the event loop while enabled
+    std::list<CSysFdWatch *>::iterator mWorkingPos;
     
     friend class CFdEventLoop;
     friend class CNotifyFdWatch;
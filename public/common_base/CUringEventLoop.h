@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2015   Jeremy Chen jeremy_cz@yahoo.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef _CURINGEVENTLOOP_H_
+#define _CURINGEVENTLOOP_H_
+
+#include <vector>
+#include <unordered_map>
+#include "CFdEventLoop.h"
+
+struct CUringRing;
+/*
+ * Event loop polling fds with io_uring instead of poll(): each fd is armed
+ * once with IORING_OP_POLL_ADD and re-armed only after it is reported, so
+ * that waiting for events costs one io_uring_enter() no matter how many
+ * fds are watched, and only ready watches are visited afterwards. Re-arm
+ * requests are submitted by the same io_uring_enter() which waits for
+ * events and timers.
+ * Watches keep their slots in mPollFds rather than rebuilding it from all
+ * watches: enabling, disabling or failing a watch only touches the slot
+ * and the poll of that watch.
+ * Only readiness comes from io_uring: watches still read and write their
+ * fds with one syscall per message as they do with poll().
+ * If io_uring is not available (old kernel, seccomp, or not built with
+ * CONFIG_FDB_IO_URING), it falls back to poll() as CFdEventLoop does.
+ */
+class CUringEventLoop : public CFdEventLoop
+{
+public:
+    CUringEventLoop();
+    ~CUringEventLoop();
+
+    void dispatch();
+    bool init(CBaseWorker *worker);
+    // whether io_uring is in use rather than poll()
+    bool uringEnabled() const
+    {
+        return !!mRing;
+    }
+
+protected:
+    void onWatchEnabled(CSysFdWatch *watch, bool enable);
+    void onWatchFatalError(CSysFdWatch *watch);
+
+private:
+    struct CUringPoll
+    {
+        // user_data of poll request: sequence number and index of the slot
+        uint64_t mTag;
+        bool mArmed;
+        // slot is taken by an enabled watch
+        bool mEnabled;
+    };
+    typedef std::vector<CUringPoll> tUringPollTbl;
+    typedef std::unordered_map<CSysFdWatch *, uint32_t> tWatchSlotTbl;
+
+    CUringRing *mRing;
+    // poll of each slot of mPollFds/mPollWatches
+    tUringPollTbl mPolls;
+    // slot of enabled watches
+    tWatchSlotTbl mSlots;
+    // slots free to use
+    tReadyTbl mFreeSlots;
+    // slots of watches disabled in this round; freed at the next one
+    tReadyTbl mReleasedSlots;
+    tWatchPollTbl mFatalWatches;
+    uint32_t mNextSeq;
+    // mInputEpoch when completions were reaped last time
+    uint32_t mReapEpoch;
+    tReadyTbl mReady;
+    // slots whose poll is to be armed
+    tReadyTbl mUnarmed;
+
+    bool setupRing();
+    void releaseRing();
+    void cancelPoll(uint32_t slot);
+    void freeSlots();
+    void rearmPolls();
+    int32_t waitCompletions(int32_t timeout);
+};
+
+#endif
@@ -24,7 +24,7 @@
 #define FDB_VERSION_BUILD 0
 
 #define FDB_INVALID_ID (~0)
-typedef uint16_t FdbEndpointId_t;
+typedef int32_t FdbEndpointId_t;
 typedef int32_t FdbSessionId_t;
 typedef int32_t FdbSocketId_t;
 typedef int32_t FdbMsgCode_t;
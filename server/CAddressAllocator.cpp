@@ -17,6 +17,7 @@
 #include <stdio.h>
 #include "CAddressAllocator.h"
 #include <utils/CNsConfig.h>
+#include <common_base/CFdbSessionContainer.h>
 #include <string.h>
 
 FdbServerType IAddressAllocator::getSvcType(const char *svc_name)
@@ -118,6 +119,14 @@ void CTCPAddressAllocator::reset()
     mPort = mMinPort;
 }
 
+void CTCPAddressAllocator::position(int32_t pos)
+{
+    if ((pos >= mMinPort) && (pos <= mMaxPort))
+    {
+        mPort = pos;
+    }
+}
+
 void CTCPAddressAllocator::setInterfaceIp(const char *ip_addr)
 {
     if (mInterfaceIp.empty())
@@ -147,3 +156,61 @@ int32_t CUDPPortAllocator::allocate()
     return port;
 }
 
+void CUDPPortAllocator::position(int32_t pos)
+{
+    if ((pos >= mMinPort) && (pos <= mMaxPort))
+    {
+        mPort = pos;
+    }
+}
+
+CMulticastAllocator::CMulticastAllocator()
+    : mSubnet(0)
+    , mPort(CNsConfig::getMulticastPortMin())
+{
+}
+
+void CMulticastAllocator::allocate(CFdbSocketAddr &sckt_addr)
+{
+    /*
+     * Each /24 holds FDB_MULTICAST_GROUP_BLOCKS blocks of
+     * FDB_MULTICAST_GROUP_SLOTS hosts starting from host 1 so that neither
+     * .0 nor .255 is used; 239.255.0.0/24 and 239.255.255.0/24 are skipped.
+     */
+    int32_t block = mSubnet++ % (FDB_MULTICAST_GROUP_SUBNETS * FDB_MULTICAST_GROUP_BLOCKS);
+    int32_t subnet = block / FDB_MULTICAST_GROUP_BLOCKS + 1;
+    int32_t host = block % FDB_MULTICAST_GROUP_BLOCKS * FDB_MULTICAST_GROUP_SLOTS + 1;
+    int32_t port = mPort++;
+    if (mPort > CNsConfig::getMulticastPortMax())
+    {
+        mPort = CNsConfig::getMulticastPortMin();
+    }
+
+    char addr_string[64];
+    snprintf(addr_string, sizeof(addr_string), "%s.%d.%d",
+             CNsConfig::getMulticastPrefix(), subnet, host);
+    char port_string[64];
+    snprintf(port_string, sizeof(port_string), "%d", port);
+
+    sckt_addr.mPort = port;
+    sckt_addr.mType = FDB_SOCKET_UDP;
+    sckt_addr.mAddr = addr_string;
+    sckt_addr.mUrl = FDB_URL_UDP;
+    sckt_addr.mUrl = sckt_addr.mUrl + addr_string + ":" + port_string;
+}
+
+void CMulticastAllocator::reset()
+{
+    mSubnet = 0;
+    mPort = CNsConfig::getMulticastPortMin();
+}
+
+void CMulticastAllocator::position(int32_t subnet, int32_t port)
+{
+    if ((subnet >= 0) && (port >= CNsConfig::getMulticastPortMin()) &&
+        (port <= CNsConfig::getMulticastPortMax()))
+    {
+        mSubnet = subnet;
+        mPort = port;
+    }
+}
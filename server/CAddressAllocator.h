@@ -42,6 +42,15 @@ public:
     CIPCAddressAllocator();
     void allocate(CFdbSocketAddr &sckt_addr, FdbServerType svc_type);
     void reset();
+    // where next allocation starts; kept in snapshot of name server
+    int32_t position() const
+    {
+        return (int32_t)mSocketId;
+    }
+    void position(int32_t pos)
+    {
+        mSocketId = (uint32_t)pos;
+    }
 
 private:
     uint32_t mSocketId;
@@ -54,6 +63,11 @@ public:
     void allocate(CFdbSocketAddr &sckt_addr, FdbServerType svc_type);
     void reset();
     void setInterfaceIp(const char *ip_addr);
+    int32_t position() const
+    {
+        return mPort;
+    }
+    void position(int32_t pos);
 
 private:
     int32_t mMinPort;
@@ -68,10 +82,53 @@ public:
     CUDPPortAllocator();
     int32_t allocate();
     void reset();
+    int32_t position() const
+    {
+        return mPort;
+    }
+    void position(int32_t pos);
 private:
     int32_t mMinPort;
     int32_t mMaxPort;
     int32_t mPort;
 };
 
+// subnets 239.255.1.0/24 ~ 239.255.254.0/24 are used
+#define FDB_MULTICAST_GROUP_SUBNETS     254
+// blocks of FDB_MULTICAST_GROUP_SLOTS hosts in a subnet: .1 ~ .240
+#define FDB_MULTICAST_GROUP_BLOCKS      15
+
+/*
+ * Allocate multicast group for best-effort broadcast of a service, in the
+ * form of udp://239.255.<n>.<m>:<port>, where 239.255.<n>.<m> is the first
+ * host of a block of FDB_MULTICAST_GROUP_SLOTS addresses. Event group N of
+ * the service is sent to host <m> + N % FDB_MULTICAST_GROUP_SLOTS (see
+ * CFdbSessionContainer), so groups N and N + FDB_MULTICAST_GROUP_SLOTS
+ * share an address and receivers drop events they don't subscribe.
+ *
+ * Blocks and ports are handed out round robin: the 3810 blocks wrap
+ * independently of the port range, and a group already in use is skipped
+ * by name server. Two services share an address only after both wrapped,
+ * in which case they are still apart by port.
+ */
+class CMulticastAllocator
+{
+public:
+    CMulticastAllocator();
+    void allocate(CFdbSocketAddr &sckt_addr);
+    void reset();
+    int32_t subnet() const
+    {
+        return mSubnet;
+    }
+    int32_t port() const
+    {
+        return mPort;
+    }
+    void position(int32_t subnet, int32_t port);
+private:
+    int32_t mSubnet;
+    int32_t mPort;
+};
+
 #endif
@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2015   Jeremy Chen jeremy_cz@yahoo.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <set>
+#include <common_base/CBaseSysDep.h>
+#include "CChangeLog.h"
+
+CChangeLog::CChangeLog(int32_t max_size)
+    : mVersion(0)
+    , mMaxSize(max_size)
+{
+    // differs between runs so that versions of former run are detected
+    mEpoch = (uint32_t)sysdep_getsystemtime_milli();
+    if (!mEpoch)
+    {
+        mEpoch = 1;
+    }
+}
+
+uint64_t CChangeLog::log(const std::string &key, const std::string &data)
+{
+    CChange change;
+    change.mVersion = ++mVersion;
+    change.mKey = key;
+    change.mData = data;
+    mLog.push_back(change);
+    while (mLog.size() > (size_t)mMaxSize)
+    {
+        mLog.pop_front();
+    }
+    return mVersion;
+}
+
+CChangeLog::EDeltaType CChangeLog::getDelta(uint32_t epoch, uint64_t since_version,
+                                            tChangeList &changes) const
+{
+    if ((epoch == mEpoch) && (since_version >= mVersion))
+    {
+        return DELTA_NONE;
+    }
+    if ((epoch != mEpoch) || mLog.empty() || (since_version + 1 < mLog.front().mVersion))
+    {
+        return DELTA_FULL;
+    }
+
+    // walk from the latest so that each entry is taken only once
+    std::set<std::string> changed;
+    for (auto it = mLog.rbegin(); it != mLog.rend(); ++it)
+    {
+        if (it->mVersion <= since_version)
+        {
+            break;
+        }
+        if (changed.insert(it->mKey).second)
+        {
+            changes.push_back(&*it);
+        }
+    }
+    std::reverse(changes.begin(), changes.end());
+    return DELTA_CHANGES;
+}
@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2015   Jeremy Chen jeremy_cz@yahoo.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __CCHANGELOG_H__
+#define __CCHANGELOG_H__
+
+#include <stdint.h>
+#include <deque>
+#include <string>
+#include <vector>
+
+/*
+ * Version of a table served by name server or host server and the entries
+ * changed by the latest versions, oldest first, so that a peer at an older
+ * version gets only what is changed since then rather than the whole table.
+ * Only keys of entries are logged since the entries are taken from the
+ * table when the changes are sent.
+ * Epoch differs between runs so that versions of former run are detected.
+ */
+class CChangeLog
+{
+public:
+    struct CChange
+    {
+        uint64_t mVersion;
+        // which entry is changed: service name or ip address of host
+        std::string mKey;
+        // what is still needed once the entry is removed, such as host name
+        std::string mData;
+    };
+    typedef std::vector<const CChange *> tChangeList;
+    enum EDeltaType
+    {
+        // the peer is up to date
+        DELTA_NONE,
+        // the peer should take the changes
+        DELTA_CHANGES,
+        // changes are no longer logged: the peer should take the whole table
+        DELTA_FULL
+    };
+
+    // @iparam max_size - how many changes are kept
+    CChangeLog(int32_t max_size);
+    uint32_t epoch() const
+    {
+        return mEpoch;
+    }
+    uint64_t version() const
+    {
+        return mVersion;
+    }
+    /*
+     * Log change of an entry.
+     * @return: version of the change
+     */
+    uint64_t log(const std::string &key, const std::string &data = "");
+    /*
+     * What a peer at since_version of epoch misses.
+     * @oparam changes - latest change of each entry changed since then,
+     *      oldest first; only filled for DELTA_CHANGES
+     */
+    EDeltaType getDelta(uint32_t epoch, uint64_t since_version, tChangeList &changes) const;
+
+private:
+    uint32_t mEpoch;
+    uint64_t mVersion;
+    std::deque<CChange> mLog;
+    int32_t mMaxSize;
+};
+
+#endif
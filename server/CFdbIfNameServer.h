@@ -41,7 +41,26 @@ enum FdbNsMsgCode
     NTF_HOST_ONLINE_LOCAL = 11,
     NTF_HOST_INFO = 12,
 
-    NTF_WATCHDOG = 13
+    NTF_WATCHDOG = 13,
+
+    /*
+     * The same as REQ_ALLOC_SERVICE_ADDRESS and REQ_REGISTER_SERVICE but
+     * for all services of a process at once; used when name server is
+     * reconnected.
+     */
+    REQ_ALLOC_SERVICE_ADDRESS_BULK = 14,
+    REQ_REGISTER_SERVICE_BULK = 15,
+
+    /*
+     * Changes of local registry since a version (FdbMsgRegistryVersion);
+     * replied with FdbMsgServiceDelta.
+     */
+    REQ_QUERY_SERVICE_DELTA = 16,
+    /*
+     * Stream of FdbMsgServiceDelta, one per change of local registry. The
+     * whole registry is sent upon subscribe.
+     */
+    NTF_SERVICE_DELTA_MONITOR = 17
 };
 
 enum FdbHsMsgCode
@@ -54,6 +73,17 @@ enum FdbHsMsgCode
 
     NTF_HOST_ONLINE = 5,
     NTF_HEART_BEAT = 6,
+
+    /*
+     * Versioned host table. NTF_HOST_DELTA carries the hosts changed in
+     * a batch (FdbMsgHostDelta); upon subscribe only the current version
+     * is sent. A name server whose version differs from base version of
+     * a delta catches up with REQ_QUERY_HOST_DELTA (FdbMsgRegistryVersion).
+     * Subscribing NTF_HOST_DELTA before NTF_HOST_ONLINE tells host server
+     * not to send NTF_HOST_ONLINE to the name server.
+     */
+    REQ_QUERY_HOST_DELTA = 7,
+    NTF_HOST_DELTA = 8
 };
 
 class FdbMsgAddressItem : public IFdbParcelable
@@ -116,6 +146,19 @@ public:
     {
         return !!(mOptions & mMaskHasUDPPort);
     }
+    const std::string &multicast_url() const
+    {
+        return mMulticastUrl;
+    }
+    void set_multicast_url(const std::string &url)
+    {
+        mMulticastUrl = url;
+        mOptions |= mMaskHasMulticastUrl;
+    }
+    bool has_multicast_url() const
+    {
+        return !!(mOptions & mMaskHasMulticastUrl);
+    }
     void fromSocketAddress(const CFdbSocketAddr &sckt_addr)
     {
         mTCPIPCAddress = sckt_addr.mAddr;
@@ -141,6 +184,10 @@ public:
         {
             serializer << mUDPPort;
         }
+        if (mOptions & mMaskHasMulticastUrl)
+        {
+            serializer << mMulticastUrl;
+        }
     }
     void deserialize(CFdbSimpleDeserializer &deserializer)
     {
@@ -155,6 +202,10 @@ public:
         {
             deserializer >> mUDPPort;
         }
+        if (mOptions & mMaskHasMulticastUrl)
+        {
+            deserializer >> mMulticastUrl;
+        }
     }
 private:
     std::string mTCPIPCAddress;
@@ -163,8 +214,11 @@ private:
 
     std::string mTCPIPCUrl;
     int32_t mUDPPort;
+    // udp://<group base>:<port> best-effort broadcasts are multicast to
+    std::string mMulticastUrl;
     uint8_t mOptions;
         static const uint8_t mMaskHasUDPPort = 1 << 0;
+        static const uint8_t mMaskHasMulticastUrl = 1 << 1;
 };
 
 class FdbMsgAddressList : public IFdbParcelable
@@ -222,6 +276,10 @@ public:
     {
         return !!(mOptions & mMaskTokenList);
     }
+    void clear_token_list()
+    {
+        mOptions &= ~mMaskTokenList;
+    }
 
     void serialize(CFdbSimpleSerializer &serializer) const
     {
@@ -363,6 +421,78 @@ private:
     std::string mName;
 };
 
+class FdbMsgServerNameBulk : public IFdbParcelable
+{
+public:
+    CFdbParcelableArray<std::string> &name_list()
+    {
+        return mNameList;
+    }
+    void add_name_list(const std::string &name)
+    {
+        mNameList.Add(name);
+    }
+
+    void serialize(CFdbSimpleSerializer &serializer) const
+    {
+        serializer << mNameList;
+    }
+    void deserialize(CFdbSimpleDeserializer &deserializer)
+    {
+        deserializer >> mNameList;
+    }
+private:
+    CFdbParcelableArray<std::string> mNameList;
+};
+
+class FdbMsgAddressListBulk : public IFdbParcelable
+{
+public:
+    CFdbParcelableArray<FdbMsgAddressList> &service_list()
+    {
+        return mServiceList;
+    }
+    FdbMsgAddressList *add_service_list()
+    {
+        return mServiceList.Add();
+    }
+
+    void serialize(CFdbSimpleSerializer &serializer) const
+    {
+        serializer << mServiceList;
+    }
+    void deserialize(CFdbSimpleDeserializer &deserializer)
+    {
+        deserializer >> mServiceList;
+    }
+private:
+    CFdbParcelableArray<FdbMsgAddressList> mServiceList;
+};
+
+class FdbMsgAddrBindResultsBulk : public IFdbParcelable
+{
+public:
+    CFdbParcelableArray<FdbMsgAddrBindResults> &service_list()
+    {
+        return mServiceList;
+    }
+    FdbMsgAddrBindResults *add_service_list()
+    {
+        return mServiceList.Add();
+    }
+
+    void serialize(CFdbSimpleSerializer &serializer) const
+    {
+        serializer << mServiceList;
+    }
+    void deserialize(CFdbSimpleDeserializer &deserializer)
+    {
+        deserializer >> mServiceList;
+    }
+private:
+    CFdbParcelableArray<FdbMsgAddrBindResults> mServiceList;
+};
+
 class FdbMsgHostAddress : public IFdbParcelable
 {
 public:
@@ -610,6 +740,181 @@ private:
     CFdbParcelableArray<FdbMsgServiceInfo> mServiceTbl;
 };
 
+/*
+ * Registry of name server is versioned: each change of a service (address
+ * bound or service removed) increases the version by one. Epoch is picked
+ * when name server starts; versions from other epoch are meaningless.
+ */
+class FdbMsgRegistryVersion : public IFdbParcelable
+{
+public:
+    FdbMsgRegistryVersion()
+        : mEpoch(0)
+        , mVersion(0)
+    {}
+    uint32_t epoch() const
+    {
+        return mEpoch;
+    }
+    void set_epoch(uint32_t epoch)
+    {
+        mEpoch = epoch;
+    }
+    uint64_t version() const
+    {
+        return mVersion;
+    }
+    void set_version(uint64_t version)
+    {
+        mVersion = version;
+    }
+
+    void serialize(CFdbSimpleSerializer &serializer) const
+    {
+        serializer << mEpoch << mVersion;
+    }
+    void deserialize(CFdbSimpleDeserializer &deserializer)
+    {
+        deserializer >> mEpoch >> mVersion;
+    }
+private:
+    uint32_t mEpoch;
+    uint64_t mVersion;
+};
+
+/*
+ * Changes of registry up to version. Each item holds the current bound
+ * address of a service; empty address list means the service is removed.
+ * A service changed several times appears only once.
+ *
+ * If full is set, the versions requested are no longer logged (or from
+ * other epoch); the items are then the whole registry and should replace
+ * what the receiver holds. For NTF_SERVICE_DELTA_MONITOR, a version other
+ * than the last one received plus one means changes are lost, and
+ * REQ_QUERY_SERVICE_DELTA should be issued to catch up.
+ */
+class FdbMsgServiceDelta : public IFdbParcelable
+{
+public:
+    FdbMsgServiceDelta()
+        : mEpoch(0)
+        , mVersion(0)
+        , mFull(false)
+    {}
+    uint32_t epoch() const
+    {
+        return mEpoch;
+    }
+    void set_epoch(uint32_t epoch)
+    {
+        mEpoch = epoch;
+    }
+    uint64_t version() const
+    {
+        return mVersion;
+    }
+    void set_version(uint64_t version)
+    {
+        mVersion = version;
+    }
+    bool full() const
+    {
+        return mFull;
+    }
+    void set_full(bool full)
+    {
+        mFull = full;
+    }
+    CFdbParcelableArray<FdbMsgAddressList> &change_list()
+    {
+        return mChangeList;
+    }
+    FdbMsgAddressList *add_change_list()
+    {
+        return mChangeList.Add();
+    }
+
+    void serialize(CFdbSimpleSerializer &serializer) const
+    {
+        serializer << mEpoch << mVersion << mFull << mChangeList;
+    }
+    void deserialize(CFdbSimpleDeserializer &deserializer)
+    {
+        deserializer >> mEpoch >> mVersion >> mFull >> mChangeList;
+    }
+private:
+    uint32_t mEpoch;
+    uint64_t mVersion;
+    bool mFull;
+    CFdbParcelableArray<FdbMsgAddressList> mChangeList;
+};
+
+/*
+ * Hosts changed from base version to version; host with empty ns_url is
+ * offline. If full is set, host_list is the whole host table.
+ */
+class FdbMsgHostDelta : public IFdbParcelable
+{
+public:
+    FdbMsgHostDelta()
+        : mEpoch(0)
+        , mBaseVersion(0)
+        , mVersion(0)
+        , mFull(false)
+    {}
+    uint32_t epoch() const
+    {
+        return mEpoch;
+    }
+    void set_epoch(uint32_t epoch)
+    {
+        mEpoch = epoch;
+    }
+    uint64_t base_version() const
+    {
+        return mBaseVersion;
+    }
+    void set_base_version(uint64_t version)
+    {
+        mBaseVersion = version;
+    }
+    uint64_t version() const
+    {
+        return mVersion;
+    }
+    void set_version(uint64_t version)
+    {
+        mVersion = version;
+    }
+    bool full() const
+    {
+        return mFull;
+    }
+    void set_full(bool full)
+    {
+        mFull = full;
+    }
+    FdbMsgHostAddressList &host_list()
+    {
+        return mHostList;
+    }
+
+    void serialize(CFdbSimpleSerializer &serializer) const
+    {
+        serializer << mEpoch << mBaseVersion << mVersion << mFull << mHostList;
+    }
+    void deserialize(CFdbSimpleDeserializer &deserializer)
+    {
+        deserializer >> mEpoch >> mBaseVersion >> mVersion >> mFull >> mHostList;
+    }
+private:
+    uint32_t mEpoch;
+    uint64_t mBaseVersion;
+    uint64_t mVersion;
+    bool mFull;
+    FdbMsgHostAddressList mHostList;
+};
+
 enum FdbMsgDogStatus
 {
     FDB_DOG_ST_DIE = -1,
@@ -789,9 +1094,104 @@ private:
     int32_t mSize;
 };
 
+class FdbMsgEventCacheStats : public IFdbParcelable
+{
+public:
+    FdbMsgEventCacheStats()
+        : mHits(0)
+        , mMisses(0)
+        , mUpdates(0)
+        , mUnchanged(0)
+        , mEvictions(0)
+        , mEntries(0)
+        , mBytes(0)
+        , mBudget(0)
+    {}
+    uint64_t hits() const
+    {
+        return mHits;
+    }
+    uint64_t misses() const
+    {
+        return mMisses;
+    }
+    uint64_t updates() const
+    {
+        return mUpdates;
+    }
+    uint64_t unchanged() const
+    {
+        return mUnchanged;
+    }
+    uint64_t evictions() const
+    {
+        return mEvictions;
+    }
+    uint64_t entries() const
+    {
+        return mEntries;
+    }
+    uint64_t bytes() const
+    {
+        return mBytes;
+    }
+    uint64_t budget() const
+    {
+        return mBudget;
+    }
+    void set_stats(uint64_t hits, uint64_t misses, uint64_t updates, uint64_t unchanged,
+                   uint64_t evictions, uint64_t entries, uint64_t bytes, uint64_t budget)
+    {
+        mHits = hits;
+        mMisses = misses;
+        mUpdates = updates;
+        mUnchanged = unchanged;
+        mEvictions = evictions;
+        mEntries = entries;
+        mBytes = bytes;
+        mBudget = budget;
+    }
+    void serialize(CFdbSimpleSerializer &serializer) const
+    {
+        serializer << mHits
+                   << mMisses
+                   << mUpdates
+                   << mUnchanged
+                   << mEvictions
+                   << mEntries
+                   << mBytes
+                   << mBudget;
+    }
+    void deserialize(CFdbSimpleDeserializer &deserializer)
+    {
+        deserializer >> mHits
+                     >> mMisses
+                     >> mUpdates
+                     >> mUnchanged
+                     >> mEvictions
+                     >> mEntries
+                     >> mBytes
+                     >> mBudget;
+    }
+private:
+    uint64_t mHits;
+    uint64_t mMisses;
+    uint64_t mUpdates;
+    uint64_t mUnchanged;
+    uint64_t mEvictions;
+    uint64_t mEntries;
+    uint64_t mBytes;
+    // 0 for unlimited
+    uint64_t mBudget;
+};
+
 class FdbMsgEventCache : public IFdbParcelable
 {
 public:
+    FdbMsgEventCache()
+        : mOptions(0)
+    {
+    }
     CFdbParcelableArray<FdbMsgEventCacheItem> &cache()
     {
         return mCache;
@@ -800,20 +1200,510 @@ public:
     {
         return mCache.Add();
     }
+    FdbMsgEventCacheStats &stats()
+    {
+        return mStats;
+    }
+    FdbMsgEventCacheStats *mutable_stats()
+    {
+        mOptions |= mMaskHasStats;
+        return &mStats;
+    }
+    bool has_stats() const
+    {
+        return !!(mOptions & mMaskHasStats);
+    }
     void serialize(CFdbSimpleSerializer &serializer) const
     {
-        serializer << mCache; 
+        serializer << mCache
+                   << mOptions;
+        if (mOptions & mMaskHasStats)
+        {
+            serializer << mStats;
+        }
     }
     void deserialize(CFdbSimpleDeserializer &deserializer)
     {
-        deserializer >> mCache; 
+        deserializer >> mCache
+                     >> mOptions;
+        if (mOptions & mMaskHasStats)
+        {
+            deserializer >> mStats;
+        }
     }
     
 private:
     CFdbParcelableArray<FdbMsgEventCacheItem> mCache;
+    FdbMsgEventCacheStats mStats;
+    uint8_t mOptions;
+        static const uint8_t mMaskHasStats = 1 << 0;
+};
+
+class FdbMsgLatencySummary : public IFdbParcelable
+{
+public:
+    FdbMsgLatencySummary()
+        : mCount(0)
+        , mMin(0)
+        , mMax(0)
+        , mMean(0)
+        , mP50(0)
+        , mP90(0)
+        , mP99(0)
+        , mP999(0)
+    {}
+    uint64_t count() const
+    {
+        return mCount;
+    }
+    uint64_t min() const
+    {
+        return mMin;
+    }
+    uint64_t max() const
+    {
+        return mMax;
+    }
+    uint64_t mean() const
+    {
+        return mMean;
+    }
+    uint64_t p50() const
+    {
+        return mP50;
+    }
+    uint64_t p90() const
+    {
+        return mP90;
+    }
+    uint64_t p99() const
+    {
+        return mP99;
+    }
+    uint64_t p999() const
+    {
+        return mP999;
+    }
+    void set_summary(uint64_t count, uint64_t min, uint64_t max, uint64_t mean,
+                     uint64_t p50, uint64_t p90, uint64_t p99, uint64_t p999)
+    {
+        mCount = count;
+        mMin = min;
+        mMax = max;
+        mMean = mean;
+        mP50 = p50;
+        mP90 = p90;
+        mP99 = p99;
+        mP999 = p999;
+    }
+
+    void serialize(CFdbSimpleSerializer &serializer) const
+    {
+        serializer << mCount
+                   << mMin
+                   << mMax
+                   << mMean
+                   << mP50
+                   << mP90
+                   << mP99
+                   << mP999;
+    }
+    void deserialize(CFdbSimpleDeserializer &deserializer)
+    {
+        deserializer >> mCount
+                     >> mMin
+                     >> mMax
+                     >> mMean
+                     >> mP50
+                     >> mP90
+                     >> mP99
+                     >> mP999;
+    }
+private:
+    uint64_t mCount;
+    uint64_t mMin;
+    uint64_t mMax;
+    uint64_t mMean;
+    uint64_t mP50;
+    uint64_t mP90;
+    uint64_t mP99;
+    uint64_t mP999;
+};
+
+class FdbMsgMethodLatency : public IFdbParcelable
+{
+public:
+    int32_t code() const
+    {
+        return mCode;
+    }
+    void set_code(int32_t code)
+    {
+        mCode = code;
+    }
+    // one of EFdbLatencyType
+    int32_t type() const
+    {
+        return mType;
+    }
+    void set_type(int32_t type)
+    {
+        mType = type;
+    }
+    FdbMsgLatencySummary &latency()
+    {
+        return mLatency;
+    }
+
+    void serialize(CFdbSimpleSerializer &serializer) const
+    {
+        serializer << mCode
+                   << mType
+                   << mLatency;
+    }
+    void deserialize(CFdbSimpleDeserializer &deserializer)
+    {
+        deserializer >> mCode
+                     >> mType
+                     >> mLatency;
+    }
+private:
+    int32_t mCode;
+    int32_t mType;
+    FdbMsgLatencySummary mLatency;
+};
+
+class FdbMsgQueueWait : public IFdbParcelable
+{
+public:
+    const std::string &worker_name() const
+    {
+        return mWorkerName;
+    }
+    void set_worker_name(const char *name)
+    {
+        mWorkerName = name;
+    }
+    FdbMsgLatencySummary &latency()
+    {
+        return mLatency;
+    }
+
+    void serialize(CFdbSimpleSerializer &serializer) const
+    {
+        serializer << mWorkerName
+                   << mLatency;
+    }
+    void deserialize(CFdbSimpleDeserializer &deserializer)
+    {
+        deserializer >> mWorkerName
+                     >> mLatency;
+    }
+private:
+    std::string mWorkerName;
+    FdbMsgLatencySummary mLatency;
+};
+
+class FdbMsgLatencyStats : public IFdbParcelable
+{
+public:
+    const std::string &endpoint_name() const
+    {
+        return mEndpointName;
+    }
+    void set_endpoint_name(const char *name)
+    {
+        mEndpointName = name;
+    }
+    CFdbParcelableArray<FdbMsgMethodLatency> &methods()
+    {
+        return mMethods;
+    }
+    FdbMsgMethodLatency *add_methods()
+    {
+        return mMethods.Add();
+    }
+    CFdbParcelableArray<FdbMsgQueueWait> &queue_wait()
+    {
+        return mQueueWait;
+    }
+    FdbMsgQueueWait *add_queue_wait()
+    {
+        return mQueueWait.Add();
+    }
+
+    void serialize(CFdbSimpleSerializer &serializer) const
+    {
+        serializer << mEndpointName
+                   << mMethods
+                   << mQueueWait;
+    }
+    void deserialize(CFdbSimpleDeserializer &deserializer)
+    {
+        deserializer >> mEndpointName
+                     >> mMethods
+                     >> mQueueWait;
+    }
+private:
+    std::string mEndpointName;
+    CFdbParcelableArray<FdbMsgMethodLatency> mMethods;
+    CFdbParcelableArray<FdbMsgQueueWait> mQueueWait;
+};
+
+class FdbMsgTypeTraffic : public IFdbParcelable
+{
+public:
+    FdbMsgTypeTraffic()
+        : mType(0)
+        , mMsgsIn(0)
+        , mBytesIn(0)
+        , mMsgsOut(0)
+        , mBytesOut(0)
+    {}
+    // one of EFdbMessageType
+    int32_t type() const
+    {
+        return mType;
+    }
+    uint64_t msgs_in() const
+    {
+        return mMsgsIn;
+    }
+    uint64_t bytes_in() const
+    {
+        return mBytesIn;
+    }
+    uint64_t msgs_out() const
+    {
+        return mMsgsOut;
+    }
+    uint64_t bytes_out() const
+    {
+        return mBytesOut;
+    }
+    void set_traffic(int32_t type, uint64_t msgs_in, uint64_t bytes_in,
+                     uint64_t msgs_out, uint64_t bytes_out)
+    {
+        mType = type;
+        mMsgsIn = msgs_in;
+        mBytesIn = bytes_in;
+        mMsgsOut = msgs_out;
+        mBytesOut = bytes_out;
+    }
+
+    void serialize(CFdbSimpleSerializer &serializer) const
+    {
+        serializer << mType
+                   << mMsgsIn
+                   << mBytesIn
+                   << mMsgsOut
+                   << mBytesOut;
+    }
+    void deserialize(CFdbSimpleDeserializer &deserializer)
+    {
+        deserializer >> mType
+                     >> mMsgsIn
+                     >> mBytesIn
+                     >> mMsgsOut
+                     >> mBytesOut;
+    }
+private:
+    int32_t mType;
+    uint64_t mMsgsIn;
+    uint64_t mBytesIn;
+    uint64_t mMsgsOut;
+    uint64_t mBytesOut;
+};
+
+class FdbMsgTraffic : public IFdbParcelable
+{
+public:
+    FdbMsgTraffic()
+        : mSendRetries(0)
+        , mSendBlockedTime(0)
+    {}
+    CFdbParcelableArray<FdbMsgTypeTraffic> &types()
+    {
+        return mTypes;
+    }
+    FdbMsgTypeTraffic *add_types()
+    {
+        return mTypes.Add();
+    }
+    uint64_t send_retries() const
+    {
+        return mSendRetries;
+    }
+    void set_send_retries(uint64_t retries)
+    {
+        mSendRetries = retries;
+    }
+    // in micro second
+    uint64_t send_blocked_time() const
+    {
+        return mSendBlockedTime;
+    }
+    void set_send_blocked_time(uint64_t blocked_time)
+    {
+        mSendBlockedTime = blocked_time;
+    }
+
+    void serialize(CFdbSimpleSerializer &serializer) const
+    {
+        serializer << mTypes
+                   << mSendRetries
+                   << mSendBlockedTime;
+    }
+    void deserialize(CFdbSimpleDeserializer &deserializer)
+    {
+        deserializer >> mTypes
+                     >> mSendRetries
+                     >> mSendBlockedTime;
+    }
+private:
+    CFdbParcelableArray<FdbMsgTypeTraffic> mTypes;
+    uint64_t mSendRetries;
+    uint64_t mSendBlockedTime;
+};
+
+class FdbMsgSessionTraffic : public IFdbParcelable
+{
+public:
+    FdbMsgSessionTraffic()
+        : mPid(0)
+        , mPendingMsgs(0)
+    {}
+    const std::string &peer_name() const
+    {
+        return mPeerName;
+    }
+    void set_peer_name(const char *name)
+    {
+        mPeerName = name;
+    }
+    uint32_t pid() const
+    {
+        return mPid;
+    }
+    void set_pid(uint32_t pid)
+    {
+        mPid = pid;
+    }
+    uint32_t pending_msgs() const
+    {
+        return mPendingMsgs;
+    }
+    void set_pending_msgs(uint32_t pending_msgs)
+    {
+        mPendingMsgs = pending_msgs;
+    }
+    FdbMsgTraffic &traffic()
+    {
+        return mTraffic;
+    }
+
+    void serialize(CFdbSimpleSerializer &serializer) const
+    {
+        serializer << mPeerName
+                   << mPid
+                   << mPendingMsgs
+                   << mTraffic;
+    }
+    void deserialize(CFdbSimpleDeserializer &deserializer)
+    {
+        deserializer >> mPeerName
+                     >> mPid
+                     >> mPendingMsgs
+                     >> mTraffic;
+    }
+private:
+    std::string mPeerName;
+    uint32_t mPid;
+    uint32_t mPendingMsgs;
+    FdbMsgTraffic mTraffic;
+};
+
+class FdbMsgTrafficStats : public IFdbParcelable
+{
+public:
+    FdbMsgTrafficStats()
+        : mContextJobs(0)
+        , mWorkerJobs(0)
+    {}
+    const std::string &endpoint_name() const
+    {
+        return mEndpointName;
+    }
+    void set_endpoint_name(const char *name)
+    {
+        mEndpointName = name;
+    }
+    const std::string &server_name() const
+    {
+        return mServerName;
+    }
+    void set_server_name(const char *name)
+    {
+        mServerName = name;
+    }
+    // jobs queued in FDB_CONTEXT
+    uint32_t context_jobs() const
+    {
+        return mContextJobs;
+    }
+    void set_context_jobs(uint32_t jobs)
+    {
+        mContextJobs = jobs;
+    }
+    // jobs queued in worker of the endpoint
+    uint32_t worker_jobs() const
+    {
+        return mWorkerJobs;
+    }
+    void set_worker_jobs(uint32_t jobs)
+    {
+        mWorkerJobs = jobs;
+    }
+    FdbMsgTraffic &traffic()
+    {
+        return mTraffic;
+    }
+    CFdbParcelableArray<FdbMsgSessionTraffic> &sessions()
+    {
+        return mSessions;
+    }
+    FdbMsgSessionTraffic *add_sessions()
+    {
+        return mSessions.Add();
+    }
+
+    void serialize(CFdbSimpleSerializer &serializer) const
+    {
+        serializer << mEndpointName
+                   << mServerName
+                   << mContextJobs
+                   << mWorkerJobs
+                   << mTraffic
+                   << mSessions;
+    }
+    void deserialize(CFdbSimpleDeserializer &deserializer)
+    {
+        deserializer >> mEndpointName
+                     >> mServerName
+                     >> mContextJobs
+                     >> mWorkerJobs
+                     >> mTraffic
+                     >> mSessions;
+    }
+private:
+    std::string mEndpointName;
+    std::string mServerName;
+    uint32_t mContextJobs;
+    uint32_t mWorkerJobs;
+    FdbMsgTraffic mTraffic;
+    CFdbParcelableArray<FdbMsgSessionTraffic> mSessions;
 };
 
 }
 
 #endif
-
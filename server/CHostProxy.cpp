@@ -28,9 +28,14 @@
 CHostProxy::CHostProxy(CNameServer *ns, const char *host_name)
     : CBaseClient(0)
     , mNameServer(ns)
+    , mHostEpoch(0)
+    , mHostVersion(0)
+    , mQueryingHosts(false)
+    , mLastHbAck(0)
     , mConnectTimer(this)
 {
     mNotifyHdl.registerCallback(NFdbBase::NTF_HOST_ONLINE, &CHostProxy::onHostOnlineNotify);
+    mNotifyHdl.registerCallback(NFdbBase::NTF_HOST_DELTA, &CHostProxy::onHostDeltaNotify);
     mNotifyHdl.registerCallback(NFdbBase::NTF_HEART_BEAT, &CHostProxy::onHeartbeatOk);
     if (host_name)
     {
@@ -94,9 +99,18 @@ bool CHostProxy::connectToHostServer()
 void CHostProxy::onOnline(FdbSessionId_t sid, bool is_first)
 {
     mConnectTimer.disable();
+    mQueryingHosts = false;
 
-    subscribeListener(NFdbBase::NTF_HOST_ONLINE, true);
-    subscribeListener(NFdbBase::NTF_HEART_BEAT, true);
+    /*
+     * NTF_HOST_DELTA goes first so that host server supporting it doesn't
+     * send NTF_HOST_ONLINE; NTF_HOST_ONLINE is still taken from host server
+     * not knowing NTF_HOST_DELTA.
+     */
+    CFdbMsgSubscribeList subscribe_list;
+    addNotifyItem(subscribe_list, NFdbBase::NTF_HOST_DELTA);
+    addNotifyItem(subscribe_list, NFdbBase::NTF_HOST_ONLINE);
+    addNotifyItem(subscribe_list, NFdbBase::NTF_HEART_BEAT);
+    subscribe(subscribe_list);
 
     mNameServer->onHostOnline(true);
     hostOnline();
@@ -118,25 +132,6 @@ void CHostProxy::onOffline(FdbSessionId_t sid, bool is_last)
             mHostUrl.c_str());
 }
 
-void CHostProxy::subscribeListener(NFdbBase::FdbHsMsgCode code, bool sub)
-{
-    if (!connected())
-    {
-        return;
-    }
-
-    CFdbMsgSubscribeList subscribe_list;
-    addNotifyItem(subscribe_list, code);
-    if (sub)
-    {
-        subscribe(subscribe_list);
-    }
-    else
-    {
-        unsubscribe(subscribe_list);
-    }
-}
-
 void CHostProxy::onReply(CBaseJob::Ptr &msg_ref)
 {
     auto msg = castToMessage<CFdbMessage *>(msg_ref);
@@ -169,6 +164,22 @@ void CHostProxy::onReply(CBaseJob::Ptr &msg_ref)
             send(NFdbBase::REQ_HOST_READY);
         }
         break;
+        case NFdbBase::REQ_QUERY_HOST_DELTA:
+        {
+            mQueryingHosts = false;
+            NFdbBase::FdbMsgHostDelta delta;
+            CFdbParcelableParser parser(delta);
+            if (!msg->deserialize(parser))
+            {
+                return;
+            }
+            auto session = FDB_CONTEXT->getSession(msg->session());
+            if (session)
+            {
+                applyHostDelta(delta, session);
+            }
+        }
+        break;
         default:
         break;
     }
@@ -193,7 +204,67 @@ void CHostProxy::onHostOnlineNotify(CBaseJob::Ptr &msg_ref)
     {
         return;
     }
+    applyHostList(host_list, session,
+                  msg->isInitialResponse() && !host_list.address_list().empty());
+}
+
+void CHostProxy::onHostDeltaNotify(CBaseJob::Ptr &msg_ref)
+{
+    auto msg = castToMessage<CFdbMessage *>(msg_ref);
+    NFdbBase::FdbMsgHostDelta delta;
+    auto session = FDB_CONTEXT->getSession(msg->session());
+    if (!session)
+    {
+        return; //never happen!!!
+    }
+    CFdbParcelableParser parser(delta);
+    if (!msg->deserialize(parser))
+    {
+        return;
+    }
+    // host server is alive as long as deltas come
+    refreshHeartbeat(false);
+    if (mQueryingHosts)
+    {
+        // covered by the reply of query
+        return;
+    }
+    if (!delta.full() && ((delta.epoch() != mHostEpoch) || (delta.base_version() != mHostVersion)))
+    {
+        if ((delta.epoch() == mHostEpoch) && (delta.version() <= mHostVersion))
+        {
+            return;
+        }
+        // some changes are missed: ask what happened since the last one received
+        queryHostDelta();
+        return;
+    }
+    applyHostDelta(delta, session);
+}
+
+void CHostProxy::queryHostDelta()
+{
+    NFdbBase::FdbMsgRegistryVersion since;
+    since.set_epoch(mHostEpoch);
+    since.set_version(mHostVersion);
+    CFdbParcelableBuilder builder(since);
+    invoke(NFdbBase::REQ_QUERY_HOST_DELTA, builder);
+    mQueryingHosts = true;
+}
 
+void CHostProxy::applyHostDelta(NFdbBase::FdbMsgHostDelta &delta, CFdbSession *session)
+{
+    mHostEpoch = delta.epoch();
+    mHostVersion = delta.version();
+    if (delta.full() || !delta.host_list().address_list().empty())
+    {
+        applyHostList(delta.host_list(), session, delta.full());
+    }
+}
+
+void CHostProxy::applyHostList(NFdbBase::FdbMsgHostAddressList &host_list, CFdbSession *session,
+                               bool is_full)
+{
     std::string host_ip;
     hostIp(host_ip, session);
 
@@ -286,7 +357,7 @@ void CHostProxy::onHostOnlineNotify(CBaseJob::Ptr &msg_ref)
         }
     }
 
-    if (msg->isInitialResponse() && !online_host_list.empty())
+    if (is_full)
     {
         for (auto np_it = mNameProxyTbl.begin(); np_it != mNameProxyTbl.end();)
         {
@@ -304,7 +375,21 @@ void CHostProxy::onHostOnlineNotify(CBaseJob::Ptr &msg_ref)
 
 void CHostProxy::onHeartbeatOk(CBaseJob::Ptr &msg_ref)
 {
-    send(NFdbBase::REQ_HEARTBEAT_OK);
+    refreshHeartbeat(true);
+}
+
+void CHostProxy::refreshHeartbeat(bool force_ack)
+{
+    /*
+     * Heartbeat is acknowledged at most once per interval if host server
+     * sends something else, so that heartbeat is piggybacked on it.
+     */
+    auto now = sysdep_getsystemtime_milli();
+    if (force_ack || (now - mLastHbAck >= (uint64_t)CNsConfig::getHeartBeatInterval()))
+    {
+        send(NFdbBase::REQ_HEARTBEAT_OK);
+        mLastHbAck = now;
+    }
     mConnectTimer.startHeartbeatMode();
 }
 
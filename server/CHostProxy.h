@@ -72,10 +72,21 @@ private:
     CFdbMessageHandle<CHostProxy> mNotifyHdl;
     std::string mHostName;
     std::string mHostUrl;
+    // version of host table received from host server
+    uint32_t mHostEpoch;
+    uint64_t mHostVersion;
+    bool mQueryingHosts;
+    // time (ms) when heartbeat is acknowledged last time
+    uint64_t mLastHbAck;
 
-    void subscribeListener(NFdbBase::FdbHsMsgCode code, bool sub);
     void onHostOnlineNotify(CBaseJob::Ptr &msg_ref);
+    void onHostDeltaNotify(CBaseJob::Ptr &msg_ref);
+    void applyHostList(NFdbBase::FdbMsgHostAddressList &host_list, CFdbSession *session,
+                       bool is_full);
+    void applyHostDelta(NFdbBase::FdbMsgHostDelta &delta, CFdbSession *session);
+    void queryHostDelta();
     void onHeartbeatOk(CBaseJob::Ptr &msg_ref);
+    void refreshHeartbeat(bool force_ack);
     void hostOnline();
     void hostOnline(FdbMsgCode_t code);
     void isolate();
@@ -19,15 +19,30 @@
 #include <common_base/CFdbMessage.h>
 #include <common_base/CBaseSocketFactory.h>
 #include <common_base/CFdbSession.h>
+#include <common_base/CBaseSysDep.h>
 #include <security/CFdbusSecurityConfig.h>
 #include <utils/CNsConfig.h>
 #include <utils/Log.h>
 #include "CFdbIfNameServer.h"
+#include <algorithm>
+
+#define FDB_HS_HB_LOST_TIME (CNsConfig::getHeartBeatRetryNr() * CNsConfig::getHeartBeatInterval())
 
 CHostServer::CHostServer()
     : CBaseServer(CNsConfig::getHostServerName())
+    , mHostLog(CNsConfig::getHostLogSize())
+    , mBatchBaseVersion(0)
+    , mBatchPending(false)
+    , mHbTick(0)
     , mHeartBeatTimer(this)
+    , mBatchTimer(this)
+    , mRecoveryTimer(this)
+    , mSnapshotDirty(false)
+    , mSnapshotTimer(this)
 {
+    // a slot beyond the longest timer so that it never wraps to the current tick
+    mHbWheel.resize(FDB_HS_HB_LOST_TIME / CNsConfig::getHeartBeatTick() + 2);
+
     mHostSecurity.importSecurity();
     enableTcpBlockingMode(true);
     enableIpcBlockingMode(true);
@@ -37,13 +52,22 @@ CHostServer::CHostServer()
     mMsgHdl.registerCallback(NFdbBase::REQ_QUERY_HOST, &CHostServer::onQueryHostReq);
     mMsgHdl.registerCallback(NFdbBase::REQ_HEARTBEAT_OK, &CHostServer::onHeartbeatOk);
     mMsgHdl.registerCallback(NFdbBase::REQ_HOST_READY, &CHostServer::onHostReady);
+    mMsgHdl.registerCallback(NFdbBase::REQ_QUERY_HOST_DELTA, &CHostServer::onQueryHostDeltaReq);
 
     mSubscribeHdl.registerCallback(NFdbBase::NTF_HOST_ONLINE, &CHostServer::onHostOnlineReg);
+    mSubscribeHdl.registerCallback(NFdbBase::NTF_HOST_DELTA, &CHostServer::onHostDeltaReg);
     mHeartBeatTimer.attach(FDB_CONTEXT, false);
+    mBatchTimer.attach(FDB_CONTEXT, false);
+    mRecoveryTimer.attach(FDB_CONTEXT, false);
+    mSnapshotTimer.attach(FDB_CONTEXT, false);
 }
 
 CHostServer::~CHostServer()
 {
+    if (mSnapshotDirty)
+    {
+        flushSnapshot();
+    }
 }
 
 void CHostServer::onSubscribe(CBaseJob::Ptr &msg_ref)
@@ -59,11 +83,19 @@ void CHostServer::onSubscribe(CBaseJob::Ptr &msg_ref)
 
 void CHostServer::onInvoke(CBaseJob::Ptr &msg_ref)
 {
+    auto msg = castToMessage<CFdbMessage *>(msg_ref);
+    auto it = mHostTbl.find(msg->session());
+    if (it != mHostTbl.end())
+    {
+        // any request from the host tells it is alive
+        it->second.mLastRx = sysdep_getsystemtime_milli();
+    }
     mMsgHdl.processMessage(this, msg_ref);
 }
 
 void CHostServer::onOffline(FdbSessionId_t sid, bool is_last)
 {
+    mDeltaSessions.erase(sid);
     auto it = mHostTbl.find(sid);
     if (it != mHostTbl.end())
     {
@@ -72,11 +104,13 @@ void CHostServer::onOffline(FdbSessionId_t sid, bool is_last)
                                                                           info.mIpAddress.c_str(),
                                                                           info.mNsUrl.c_str());
         broadcastSingleHost(sid, false, info);
+        logHostChange(info);
         mHostTbl.erase(it);
         if (mHostTbl.size() == 0)
         {
             mHeartBeatTimer.disable();
         }
+        saveSnapshot();
     }
 }
 
@@ -124,7 +158,8 @@ void CHostServer::onRegisterHostReq(CBaseJob::Ptr &msg_ref)
     info.mHostName = host_name;
     info.mIpAddress = ip_addr;
     info.mNsUrl = ns_url;
-    info.mHbCount = 0;
+    info.mLastRx = sysdep_getsystemtime_milli();
+    info.mLastTx = info.mLastRx;
     info.mReady = false;
     info.mAuthorized = false;
     if (host_addr.has_cred() && !host_addr.cred().empty())
@@ -135,13 +170,26 @@ void CHostServer::onRegisterHostReq(CBaseJob::Ptr &msg_ref)
             info.mAuthorized = true;
         }
     }
-    CFdbToken::allocateToken(info.mTokens);
+    auto recovered_it = mRecoveredHosts.find(host_name);
+    if ((recovered_it != mRecoveredHosts.end()) && (recovered_it->second.mIpAddress == ip_addr))
+    {
+        // the same host is back after host server restarts: services it
+        // exported are still guarded by the same tokens
+        info.mTokens = recovered_it->second.mTokens;
+        mRecoveredHosts.erase(recovered_it);
+    }
+    else
+    {
+        CFdbToken::allocateToken(info.mTokens);
+    }
+    saveSnapshot();
 
     NFdbBase::FdbMsgHostRegisterAck ack;
     populateTokens(info.mTokens, ack);
     CFdbParcelableBuilder builder(ack);
     msg->reply(msg_ref, builder);
 
+    scheduleHost(msg->session(), info, info.mLastRx);
     if (mHostTbl.size() == 1)
     {
         mHeartBeatTimer.enable();
@@ -160,6 +208,7 @@ void CHostServer::onHostReady(CBaseJob::Ptr &msg_ref)
         CHostInfo &info = it->second;
         info.mReady = true;
         broadcastSingleHost(msg->session(), true, info);
+        logHostChange(info);
     }
 }
 
@@ -199,29 +248,145 @@ void CHostServer::broadcastSingleHost(FdbSessionId_t sid, bool online, CHostInfo
     addr->set_ip_address(info.mIpAddress);
     addr->set_ns_url(online ? info.mNsUrl : ""); // ns_url being empty means offline
 
-    if (online)
+    // name servers taking NTF_HOST_DELTA get the change in the next batch
+    tSubscribedSessionSets sessions;
+    getSubscribeTable(NFdbBase::NTF_HOST_ONLINE, 0, sessions);
+    for (auto session_it = sessions.begin(); session_it != sessions.end(); ++session_it)
     {
-        tSubscribedSessionSets sessions;
-        getSubscribeTable(NFdbBase::NTF_HOST_ONLINE, 0, sessions);
-        for (auto session_it = sessions.begin(); session_it != sessions.end(); ++session_it)
+        CFdbSession *session = *session_it;
+        if (mDeltaSessions.count(session->sid()))
+        {
+            continue;
+        }
+        if (online)
         {
-            CFdbSession *session = *session_it;
             auto info_it = mHostTbl.find(session->sid());
             if (info_it != mHostTbl.end()) 
             {
                 addToken(info, info_it->second, *addr);
             }
-            CFdbParcelableBuilder builder(addr_list);
-            broadcast(session->sid(), FDB_OBJECT_MAIN, NFdbBase::NTF_HOST_ONLINE, builder);
         }
+        CFdbParcelableBuilder builder(addr_list);
+        broadcast(session->sid(), FDB_OBJECT_MAIN, NFdbBase::NTF_HOST_ONLINE, builder);
     }
-    else
+}
+
+CHostServer::CHostInfo *CHostServer::findHost(const std::string &ip_addr)
+{
+    for (auto it = mHostTbl.begin(); it != mHostTbl.end(); ++it)
     {
-        CFdbParcelableBuilder builder(addr_list);
-        broadcast(NFdbBase::NTF_HOST_ONLINE, builder);
+        if (it->second.mIpAddress == ip_addr)
+        {
+            return &it->second;
+        }
+    }
+    return 0;
+}
+
+void CHostServer::populateHost(const CHostInfo &info, const CHostInfo *receiver,
+                               NFdbBase::FdbMsgHostAddress &host_addr)
+{
+    host_addr.set_host_name(info.mHostName);
+    host_addr.set_ip_address(info.mIpAddress);
+    host_addr.set_ns_url(info.mNsUrl);
+    if (receiver)
+    {
+        addToken(info, *receiver, host_addr);
+    }
+}
+
+void CHostServer::populateHostDelta(FdbSessionId_t receiver, uint32_t epoch, uint64_t since_version,
+                                    NFdbBase::FdbMsgHostDelta &delta)
+{
+    auto receiver_it = mHostTbl.find(receiver);
+    const CHostInfo *receiver_info = (receiver_it == mHostTbl.end()) ? 0 : &receiver_it->second;
+    delta.set_epoch(mHostLog.epoch());
+    delta.set_version(mHostLog.version());
+    CChangeLog::tChangeList changes;
+    switch (mHostLog.getDelta(epoch, since_version, changes))
+    {
+        case CChangeLog::DELTA_NONE:
+            delta.set_base_version(mHostLog.version());
+        break;
+        case CChangeLog::DELTA_FULL:
+            delta.set_full(true);
+            for (auto it = mHostTbl.begin(); it != mHostTbl.end(); ++it)
+            {
+                if (it->second.mReady)
+                {
+                    populateHost(it->second, receiver_info, *delta.host_list().add_address_list());
+                }
+            }
+        break;
+        case CChangeLog::DELTA_CHANGES:
+            delta.set_base_version(since_version);
+            for (auto it = changes.begin(); it != changes.end(); ++it)
+            {
+                auto addr = delta.host_list().add_address_list();
+                auto info = findHost((*it)->mKey);
+                if (info && info->mReady)
+                {
+                    populateHost(*info, receiver_info, *addr);
+                }
+                else
+                {
+                    addr->set_host_name((*it)->mData);
+                    addr->set_ip_address((*it)->mKey);
+                    addr->set_ns_url(""); // ns_url being empty means offline
+                }
+            }
+        break;
     }
 }
 
+void CHostServer::logHostChange(const CHostInfo &info)
+{
+    auto version = mHostLog.log(info.mIpAddress, info.mHostName);
+
+    // hosts going online/offline together are pushed in one batch
+    if (!mBatchPending)
+    {
+        mBatchPending = true;
+        mBatchBaseVersion = version - 1;
+        mBatchTimer.enable();
+    }
+}
+
+void CHostServer::onBatchTimer(CMethodLoopTimer<CHostServer> *timer)
+{
+    mBatchPending = false;
+    auto now = sysdep_getsystemtime_milli();
+    for (auto it = mDeltaSessions.begin(); it != mDeltaSessions.end(); ++it)
+    {
+        NFdbBase::FdbMsgHostDelta delta;
+        populateHostDelta(*it, mHostLog.epoch(), mBatchBaseVersion, delta);
+        CFdbParcelableBuilder builder(delta);
+        broadcast(*it, FDB_OBJECT_MAIN, NFdbBase::NTF_HOST_DELTA, builder);
+        auto info_it = mHostTbl.find(*it);
+        if (info_it != mHostTbl.end())
+        {
+            // the delta also serves as heartbeat
+            info_it->second.mLastTx = now;
+        }
+    }
+}
+
+void CHostServer::onQueryHostDeltaReq(CBaseJob::Ptr &msg_ref)
+{
+    auto msg = castToMessage<CFdbMessage *>(msg_ref);
+    NFdbBase::FdbMsgRegistryVersion since;
+    CFdbParcelableParser parser(since);
+    if (!msg->deserialize(parser))
+    {
+        msg->status(msg_ref, NFdbBase::FDB_ST_MSG_DECODE_FAIL);
+        return;
+    }
+    NFdbBase::FdbMsgHostDelta delta;
+    populateHostDelta(msg->session(), since.epoch(), since.version(), delta);
+    CFdbParcelableBuilder builder(delta);
+    msg->reply(msg_ref, builder);
+}
+
 void CHostServer::onUnregisterHostReq(CBaseJob::Ptr &msg_ref)
 {
     auto msg = castToMessage<CFdbMessage *>(msg_ref);
@@ -242,6 +407,7 @@ void CHostServer::onUnregisterHostReq(CBaseJob::Ptr &msg_ref)
             LOG_I("CHostServer: host is unregistered: name: %s, ip: %s, ns: %s\n",
                     info.mHostName.c_str(), info.mIpAddress.c_str(), info.mNsUrl.c_str());
             broadcastSingleHost(msg->session(), false, info);
+            logHostChange(info);
             mHostTbl.erase(it);
             return;
         }
@@ -257,19 +423,29 @@ void CHostServer::onQueryHostReq(CBaseJob::Ptr &msg_ref)
 
 void CHostServer::onHeartbeatOk(CBaseJob::Ptr &msg_ref)
 {
-    auto msg = castToMessage<CFdbMessage *>(msg_ref);
-    auto it = mHostTbl.find(msg->session());
+    // nothing to do: the host is marked alive by onInvoke()
+}
 
-    if (it != mHostTbl.end())
-    {
-        CHostInfo &info = it->second;
-        info.mHbCount = 0;
-    }
+void CHostServer::onHostDeltaReg(CBaseJob::Ptr &msg_ref, const CFdbMsgSubscribeItem *sub_item)
+{
+    auto msg = castToMessage<CFdbMessage *>(msg_ref);
+    mDeltaSessions.insert(msg->session());
+    // only tell current version; name server asks what it misses
+    NFdbBase::FdbMsgHostDelta delta;
+    delta.set_epoch(mHostLog.epoch());
+    delta.set_base_version(mHostLog.version());
+    delta.set_version(mHostLog.version());
+    CFdbParcelableBuilder builder(delta);
+    msg->broadcast(sub_item->msg_code(), builder);
 }
 
 void CHostServer::onHostOnlineReg(CBaseJob::Ptr &msg_ref, const CFdbMsgSubscribeItem *sub_item)
 {
     auto msg = castToMessage<CFdbMessage *>(msg_ref);
+    if (mDeltaSessions.count(msg->session()))
+    {
+        return;
+    }
     NFdbBase::FdbMsgHostAddressList addr_list;
     auto session = FDB_CONTEXT->getSession(msg->session());
     for (auto it = mHostTbl.begin(); it != mHostTbl.end(); ++it)
@@ -296,20 +472,53 @@ void CHostServer::onHostOnlineReg(CBaseJob::Ptr &msg_ref, const CFdbMsgSubscribe
     }
 }
 
+void CHostServer::scheduleHost(FdbSessionId_t sid, CHostInfo &info, uint64_t now)
+{
+    uint64_t tick = CNsConfig::getHeartBeatTick();
+    auto due = std::min(info.mLastTx + CNsConfig::getHeartBeatInterval(),
+                        info.mLastRx + FDB_HS_HB_LOST_TIME);
+    uint64_t nr_ticks = (due > now) ? (due - now + tick - 1) / tick : 1;
+    if (nr_ticks >= mHbWheel.size())
+    {
+        nr_ticks = mHbWheel.size() - 1;
+    }
+    info.mDueTick = mHbTick + (uint32_t)nr_ticks;
+    mHbWheel[info.mDueTick % mHbWheel.size()].push_back(sid);
+}
+
+void CHostServer::checkHost(FdbSessionId_t sid, CHostInfo &info, uint64_t now)
+{
+    if (now - info.mLastRx >= (uint64_t)FDB_HS_HB_LOST_TIME)
+    {
+        // will trigger offline callback which do everything for me.
+        LOG_E("Host %s is kicked out due to HB!\n", info.mHostName.c_str());
+        kickOut(sid);
+        return;
+    }
+    // no need to send heartbeat if something is sent recently
+    if (now - info.mLastTx >= (uint64_t)CNsConfig::getHeartBeatInterval())
+    {
+        broadcast(sid, FDB_OBJECT_MAIN, NFdbBase::NTF_HEART_BEAT, (const void *)0);
+        info.mLastTx = now;
+    }
+    scheduleHost(sid, info, now);
+}
+
 void CHostServer::broadcastHeartBeat(CMethodLoopTimer<CHostServer> *timer)
 {
-    for (auto it = mHostTbl.begin(); it != mHostTbl.end();)
+    ++mHbTick;
+    std::vector<FdbSessionId_t> due_hosts;
+    due_hosts.swap(mHbWheel[mHbTick % mHbWheel.size()]);
+    auto now = sysdep_getsystemtime_milli();
+    for (auto it = due_hosts.begin(); it != due_hosts.end(); ++it)
     {
-        auto the_it = it++;
-        auto &info = the_it->second;
-        if (++info.mHbCount >= CNsConfig::getHeartBeatRetryNr())
+        auto info_it = mHostTbl.find(*it);
+        // the host might be gone or rescheduled
+        if ((info_it != mHostTbl.end()) && (info_it->second.mDueTick == mHbTick))
         {
-            // will trigger offline callback which do everything for me.
-            LOG_E("Host %s is kicked out due to HB!\n", info.mHostName.c_str());
-            kickOut(the_it->first);
+            checkHost(*it, info_it->second, now);
         }
     }
-    broadcast(NFdbBase::NTF_HEART_BEAT);
 }
 
 void CHostServer::populateTokens(const CFdbToken::tTokenList &tokens,
@@ -323,3 +532,98 @@ void CHostServer::populateTokens(const CFdbToken::tTokenList &tokens,
     }
 }
 
+bool CHostServer::enableSnapshot(const char *path)
+{
+    if (!mSnapshot.open(path))
+    {
+        return false;
+    }
+
+    NFdbBase::FdbHsSnapshot snapshot;
+    if (!mSnapshot.load(snapshot))
+    {
+        return true;
+    }
+    auto &host_list = snapshot.host_list();
+    for (auto it = host_list.vpool().begin(); it != host_list.vpool().end(); ++it)
+    {
+        auto &info = mRecoveredHosts[it->host_name()];
+        info.mHostName = it->host_name();
+        info.mIpAddress = it->ip_address();
+        info.mLastRx = 0;
+        info.mLastTx = 0;
+        info.mDueTick = 0;
+        info.mReady = false;
+        info.mAuthorized = false;
+        auto &tokens = it->tokens();
+        info.mTokens.assign(tokens.pool().begin(), tokens.pool().end());
+    }
+    if (!mRecoveredHosts.empty())
+    {
+        LOG_I("CHostServer: %d hosts are recovered from snapshot.\n", (int32_t)mRecoveredHosts.size());
+        mRecoveryTimer.enable();
+    }
+    return true;
+}
+
+void CHostServer::saveSnapshot()
+{
+    // changes arriving in a burst are written at once as name server does
+    if (!mSnapshot.opened() || mSnapshotDirty)
+    {
+        return;
+    }
+    mSnapshotDirty = true;
+    mSnapshotTimer.enable();
+}
+
+void CHostServer::onSnapshotTimer(CMethodLoopTimer<CHostServer> *timer)
+{
+    mSnapshotDirty = false;
+    flushSnapshot();
+}
+
+void CHostServer::flushSnapshot()
+{
+    if (!mSnapshot.opened())
+    {
+        return;
+    }
+
+    NFdbBase::FdbHsSnapshot snapshot;
+    std::vector<const CHostInfo *> hosts;
+    for (auto it = mHostTbl.begin(); it != mHostTbl.end(); ++it)
+    {
+        hosts.push_back(&it->second);
+    }
+    for (auto it = mRecoveredHosts.begin(); it != mRecoveredHosts.end(); ++it)
+    {
+        hosts.push_back(&it->second);
+    }
+    for (auto it = hosts.begin(); it != hosts.end(); ++it)
+    {
+        auto host = snapshot.add_host_list();
+        host->set_host_name((*it)->mHostName);
+        host->set_ip_address((*it)->mIpAddress);
+        for (auto token_it = (*it)->mTokens.begin(); token_it != (*it)->mTokens.end(); ++token_it)
+        {
+            host->tokens().Add(*token_it);
+        }
+    }
+
+    if (!mSnapshot.save(snapshot))
+    {
+        LOG_E("CHostServer: unable to save snapshot!\n");
+    }
+}
+
+void CHostServer::onRecoveryTimer(CMethodLoopTimer<CHostServer> *timer)
+{
+    // hosts not registering within grace period are gone; tokens are dropped
+    if (!mRecoveredHosts.empty())
+    {
+        LOG_I("CHostServer: %d hosts recovered from snapshot are expired.\n", (int32_t)mRecoveredHosts.size());
+        mRecoveredHosts.clear();
+        saveSnapshot();
+    }
+}
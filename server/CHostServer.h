@@ -17,6 +17,7 @@
 #ifndef _CHOSTSERVER_H_
 #define _CHOSTSERVER_H_
 #include <map>
+#include <set>
 #include <string>
 #include <vector>
 #include <common_base/CBaseServer.h>
@@ -24,10 +25,13 @@
 #include <utils/CNsConfig.h>
 #include <security/CHostSecurityConfig.h>
 #include <common_base/CFdbMsgDispatcher.h>
+#include "CRegistrySnapshot.h"
+#include "CChangeLog.h"
 
 namespace NFdbBase {
     class FdbMsgHostRegisterAck;
     class FdbMsgHostAddress;
+    class FdbMsgHostDelta;
 }
 class CFdbMessage;
 class CHostServer : public CBaseServer
@@ -35,6 +39,11 @@ class CHostServer : public CBaseServer
 public:
     CHostServer();
     ~CHostServer();
+    /*
+     * Keep tokens of hosts in snapshot file so that they are handed over
+     * to the same hosts when host server restarts.
+     */
+    bool enableSnapshot(const char *path);
 
 protected:
     void onSubscribe(CBaseJob::Ptr &msg_ref);
@@ -46,37 +55,119 @@ private:
         std::string mHostName;
         std::string mIpAddress;
         std::string mNsUrl;
-        int32_t mHbCount;
+        // time (ms) when the last message is received from/sent to the host
+        uint64_t mLastRx;
+        uint64_t mLastTx;
+        // tick of heartbeat wheel at which the host is checked
+        uint32_t mDueTick;
         bool mReady;
         bool mAuthorized;
         CFdbToken::tTokenList mTokens;
     };
     typedef std::map<FdbSessionId_t, CHostInfo> tHostTbl;
     tHostTbl mHostTbl;
+    // hosts rebuilt from snapshot which are not registered again: name -> info
+    typedef std::map<std::string, CHostInfo> tRecoveredHostTbl;
+    tRecoveredHostTbl mRecoveredHosts;
+    CRegistrySnapshot mSnapshot;
     CFdbMessageHandle<CHostServer> mMsgHdl;
     CFdbSubscribeHandle<CHostServer> mSubscribeHdl;
+    // name servers subscribing NTF_HOST_DELTA, to which NTF_HOST_ONLINE is not sent
+    std::set<FdbSessionId_t> mDeltaSessions;
+
+    /*
+     * Version of host table and the hosts changed by the latest versions,
+     * keyed by ip address with host name as data. Host info and tokens are
+     * taken from host table when the change is sent since tokens differ by
+     * receiver.
+     */
+    CChangeLog mHostLog;
+    // version before the changes not yet pushed; valid if mBatchTimer runs
+    uint64_t mBatchBaseVersion;
+    bool mBatchPending;
+
+    /*
+     * Each host is checked only when its timer expires rather than
+     * scanning all hosts upon each tick: the host is kept in the slot of
+     * the tick at which heartbeat should be sent to it or it should be
+     * kicked out. Receiving from or sending to the host only updates its
+     * timestamp; the slot is fixed up when the host is checked.
+     */
+    typedef std::vector<std::vector<FdbSessionId_t> > tHbWheel;
+    tHbWheel mHbWheel;
+    uint32_t mHbTick;
 
     void onRegisterHostReq(CBaseJob::Ptr &msg_ref);
     void onUnregisterHostReq(CBaseJob::Ptr &msg_ref);
     void onQueryHostReq(CBaseJob::Ptr &msg_ref);
     void onHeartbeatOk(CBaseJob::Ptr &msg_ref);
     void onHostReady(CBaseJob::Ptr &msg_ref);
+    void onQueryHostDeltaReq(CBaseJob::Ptr &msg_ref);
 
     void onHostOnlineReg(CBaseJob::Ptr &msg_ref, const CFdbMsgSubscribeItem *sub_item);
+    void onHostDeltaReg(CBaseJob::Ptr &msg_ref, const CFdbMsgSubscribeItem *sub_item);
 
     void broadcastSingleHost(FdbSessionId_t sid, bool online, CHostInfo &info);
+    void logHostChange(const CHostInfo &info);
+    void populateHostDelta(FdbSessionId_t receiver, uint32_t epoch, uint64_t since_version,
+                           NFdbBase::FdbMsgHostDelta &delta);
+    void populateHost(const CHostInfo &info, const CHostInfo *receiver,
+                      NFdbBase::FdbMsgHostAddress &host_addr);
+    CHostInfo *findHost(const std::string &ip_addr);
+    void scheduleHost(FdbSessionId_t sid, CHostInfo &info, uint64_t now);
+    void checkHost(FdbSessionId_t sid, CHostInfo &info, uint64_t now);
 
     class CHeartBeatTimer : public CMethodLoopTimer<CHostServer>
     {
     public:
         CHeartBeatTimer(CHostServer *proxy)
-            : CMethodLoopTimer<CHostServer>(CNsConfig::getHeartBeatInterval(), true,
+            : CMethodLoopTimer<CHostServer>(CNsConfig::getHeartBeatTick(), true,
                                             proxy, &CHostServer::broadcastHeartBeat)
         {
         }
     };
     CHeartBeatTimer mHeartBeatTimer;
     void broadcastHeartBeat(CMethodLoopTimer<CHostServer> *timer);
+
+    class CBatchTimer : public CMethodLoopTimer<CHostServer>
+    {
+    public:
+        CBatchTimer(CHostServer *hs)
+            : CMethodLoopTimer<CHostServer>(CNsConfig::getHostBatchInterval(), false,
+                                            hs, &CHostServer::onBatchTimer)
+        {
+        }
+    };
+    CBatchTimer mBatchTimer;
+    void onBatchTimer(CMethodLoopTimer<CHostServer> *timer);
+
+    class CRecoveryTimer : public CMethodLoopTimer<CHostServer>
+    {
+    public:
+        CRecoveryTimer(CHostServer *hs)
+            : CMethodLoopTimer<CHostServer>(CNsConfig::getSnapshotGracePeriod(), false,
+                                            hs, &CHostServer::onRecoveryTimer)
+        {
+        }
+    };
+    CRecoveryTimer mRecoveryTimer;
+    void onRecoveryTimer(CMethodLoopTimer<CHostServer> *timer);
+
+    class CSnapshotTimer : public CMethodLoopTimer<CHostServer>
+    {
+    public:
+        CSnapshotTimer(CHostServer *hs)
+            : CMethodLoopTimer<CHostServer>(CNsConfig::getSnapshotFlushDelay(), false,
+                                            hs, &CHostServer::onSnapshotTimer)
+        {
+        }
+    };
+    // changes since snapshot is written last time; flushed by mSnapshotTimer
+    bool mSnapshotDirty;
+    CSnapshotTimer mSnapshotTimer;
+    void onSnapshotTimer(CMethodLoopTimer<CHostServer> *timer);
+    void saveSnapshot();
+    void flushSnapshot();
     CHostSecurityConfig mHostSecurity;
 
     void populateTokens(const CFdbToken::tTokenList &tokens,
@@ -14,7 +14,9 @@
  * limitations under the License.
  */
 
+#include <algorithm>
 #include "CIntraNameProxy.h"
+#include <common_base/CBaseSysDep.h>
 #include <common_base/CFdbContext.h>
 #include <common_base/CFdbMessage.h>
 #include <common_base/CBaseServer.h>
@@ -29,6 +31,8 @@ CIntraNameProxy::CIntraNameProxy()
     , mNotificationCenter(this)
     , mEnableReconnectToNS(true)
     , mNsWatchdogListener(0)
+    , mSvcAddrCacheEnabled(true)
+    , mBatching(false)
 {
     mName  = std::to_string(CBaseThread::getPid());
     mName += "-nsproxy(local)";
@@ -66,18 +70,38 @@ bool CIntraNameProxy::connectToNameServer()
 CIntraNameProxy::CConnectTimer::CConnectTimer(CIntraNameProxy *proxy)
     : CMethodLoopTimer<CIntraNameProxy>(CNsConfig::getNsReconnectInterval(), false,
                                    proxy, &CIntraNameProxy::onConnectTimer)
+    , mRandom((uint32_t)CBaseThread::getPid() ^ (uint32_t)sysdep_getsystemtime_milli())
+    , mBackoff(CNsConfig::getNsReconnectInterval())
 {
 }
 
 void CIntraNameProxy::CConnectTimer::fire()
 {
-    enableOneShot(CNsConfig::getNsReconnectInterval());
+    /*
+     * When name server restarts, all processes lose it at the same time.
+     * Randomize the interval in [backoff/2, backoff] so that they do not
+     * come back at the same instant, and double the backoff each time up
+     * to the limit.
+     */
+    auto half = mBackoff / 2;
+    enableOneShot(half + (int32_t)(mRandom() % (uint32_t)(mBackoff - half + 1)));
+    mBackoff = std::min(mBackoff * 2, CNsConfig::getNsReconnectIntervalMax());
+}
+
+void CIntraNameProxy::CConnectTimer::reset()
+{
+    mBackoff = CNsConfig::getNsReconnectInterval();
 }
 
 void CIntraNameProxy::addServiceListener(const char *svc_name)
 {
     if (connected())
     {
+        if (mBatching)
+        {
+            mBatchListeners.push_back(tBatchListener(NFdbBase::NTF_SERVICE_ONLINE, svc_name));
+            return;
+        }
         subscribeListener(NFdbBase::NTF_SERVICE_ONLINE, svc_name);
     }
 }
@@ -94,6 +118,11 @@ void CIntraNameProxy::addAddressListener(const char *svc_name)
 {
     if (connected())
     {
+        if (mBatching)
+        {
+            mBatchListeners.push_back(tBatchListener(NFdbBase::NTF_MORE_ADDRESS, svc_name));
+            return;
+        }
         subscribeListener(NFdbBase::NTF_MORE_ADDRESS, svc_name);
     }
 }
@@ -112,6 +141,11 @@ void CIntraNameProxy::registerService(const char *svc_name)
     {
         return;
     }
+    if (mBatching)
+    {
+        mBulkServices.push_back(svc_name);
+        return;
+    }
     NFdbBase::FdbMsgServerName msg_svc_name;
     msg_svc_name.set_name(svc_name);
     CFdbParcelableBuilder builder(msg_svc_name);
@@ -139,6 +173,16 @@ void CIntraNameProxy::processClientOnline(CFdbMessage *msg, NFdbBase::FdbMsgAddr
     bool is_offline = msg_addr_list.address_list().empty();
     int32_t success_count = 0;
     int32_t failure_count = 0;
+
+    if (!is_offline)
+    {
+        replaceSourceUrl(msg_addr_list, FDB_CONTEXT->getSession(msg->session()));
+    }
+    if (mSvcAddrCacheEnabled)
+    {
+        // invalidate before disconnecting so that clients do not reconnect to it
+        mSvcAddrCache.update(msg_addr_list);
+    }
     
     FDB_CONTEXT->findEndpoint(svc_name, endpoints, false);
     for (auto ep_it = endpoints.begin(); ep_it != endpoints.end(); ++ep_it)
@@ -150,9 +194,21 @@ void CIntraNameProxy::processClientOnline(CFdbMessage *msg, NFdbBase::FdbMsgAddr
             continue;
         }
 
+        if (!verifyCachedConnection(client, msg_addr_list))
+        {
+            client->doDisconnect();
+            LOG_E("CIntraNameProxy: Session %d: Client %s is disconnected from stale address!\n",
+                    msg->session(), svc_name);
+        }
+
         if (is_offline)
         {
-            if (client->hostConnected(host_name.c_str()))
+            if (msg->isInitialResponse())
+            {
+                // service is unknown to name server when subscribing; only
+                // connection made with cached address is dropped.
+            }
+            else if (client->hostConnected(host_name.c_str()))
             {
                 // only disconnect the connected server (host name should match)
                 client->doDisconnect();
@@ -178,7 +234,6 @@ void CIntraNameProxy::processClientOnline(CFdbMessage *msg, NFdbBase::FdbMsgAddr
                 client->local(msg_addr_list.is_local());
 
                 // for client, size of addr_list is always 1, which is ensured by name server
-                replaceSourceUrl(msg_addr_list, FDB_CONTEXT->getSession(msg->session()));
                 auto &addr_list = msg_addr_list.address_list();
                 for (auto it = addr_list.vpool().begin(); it != addr_list.vpool().end(); ++it)
                 {
@@ -187,9 +242,15 @@ void CIntraNameProxy::processClientOnline(CFdbMessage *msg, NFdbBase::FdbMsgAddr
                     {
                         udp_port = it->udp_port();
                     }
+                    const char *multicast_url = 0;
+                    if (it->has_multicast_url())
+                    {
+                        multicast_url = it->multicast_url().c_str();
+                    }
 
                     auto session_container = client->doConnect(it->tcp_ipc_url().c_str(),
-                                                               host_name.c_str(), udp_port);
+                                                               host_name.c_str(), udp_port,
+                                                               multicast_url);
                     if (session_container)
                     {
                         if (client->UDPEnabled() && (it->address_type() != FDB_SOCKET_IPC)
@@ -255,6 +316,111 @@ void CIntraNameProxy::processClientOnline(CFdbMessage *msg, NFdbBase::FdbMsgAddr
     }
 }
 
+bool CIntraNameProxy::verifyCachedConnection(CBaseClient *client, NFdbBase::FdbMsgAddressList &msg_addr_list)
+{
+    if (!mUnverifiedClients.erase(client->epid()))
+    {
+        return true;
+    }
+    if (!client->connected())
+    {
+        return true;
+    }
+
+    auto &addr_list = msg_addr_list.address_list();
+    auto &containers = client->getContainer();
+    for (auto socket_it = containers.begin(); socket_it != containers.end(); ++socket_it)
+    {
+        auto client_socket = fdb_dynamic_cast_if_available<CClientSocket *>(socket_it->second);
+        if (!client_socket || !client_socket->getSocket())
+        {
+            continue;
+        }
+        auto &url = client_socket->getSocket()->getAddress().mUrl;
+        for (auto it = addr_list.vpool().begin(); it != addr_list.vpool().end(); ++it)
+        {
+            if (it->tcp_ipc_url() == url)
+            {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void CIntraNameProxy::enableSvcAddrCache(bool enable, const char *persist_path)
+{
+    mSvcAddrCacheEnabled = enable;
+    if (enable && persist_path)
+    {
+        mSvcAddrCache.attach(persist_path);
+    }
+    else
+    {
+        mSvcAddrCache.detach();
+    }
+}
+
+void CIntraNameProxy::connectCachedService(const char *svc_name)
+{
+    NFdbBase::FdbMsgAddressList msg_addr_list;
+    if (!mSvcAddrCacheEnabled || !mSvcAddrCache.find(svc_name, msg_addr_list))
+    {
+        return;
+    }
+
+    const std::string &host_name = msg_addr_list.host_name();
+    std::vector<CBaseEndpoint *> endpoints;
+    FDB_CONTEXT->findEndpoint(svc_name, endpoints, false);
+    for (auto ep_it = endpoints.begin(); ep_it != endpoints.end(); ++ep_it)
+    {
+        auto client = fdb_dynamic_cast_if_available<CBaseClient *>(*ep_it);
+        if (!client || client->connected() || !client->connectionEnabled(msg_addr_list))
+        {
+            continue;
+        }
+
+        if (msg_addr_list.has_token_list() && client->importTokens(msg_addr_list.token_list().tokens()))
+        {
+            client->updateSecurityLevel();
+        }
+        client->local(msg_addr_list.is_local());
+
+        bool connected = false;
+        auto &addr_list = msg_addr_list.address_list();
+        for (auto it = addr_list.vpool().begin(); it != addr_list.vpool().end(); ++it)
+        {
+            int32_t udp_port = FDB_INET_PORT_INVALID;
+            if (it->has_udp_port())
+            {
+                udp_port = it->udp_port();
+            }
+            const char *multicast_url = 0;
+            if (it->has_multicast_url())
+            {
+                multicast_url = it->multicast_url().c_str();
+            }
+            // try only once: if server is gone, name server will tell
+            if (client->doConnect(it->tcp_ipc_url().c_str(), host_name.c_str(),
+                                  udp_port, multicast_url, 1))
+            {
+                mUnverifiedClients.insert(client->epid());
+                LOG_I("CIntraNameProxy: Server: %s, cached address %s is connected.\n",
+                        svc_name, it->tcp_ipc_url().c_str());
+                connected = true;
+                break;
+            }
+        }
+        if (!connected)
+        {
+            // server is gone: wait for name server
+            LOG_I("CIntraNameProxy: Server: %s, cached address is stale.\n", svc_name);
+            mSvcAddrCache.invalidate(svc_name);
+            break;
+        }
+    }
+}
+
 void CIntraNameProxy::onBroadcast(CBaseJob::Ptr &msg_ref)
 {
     auto msg = castToMessage<CFdbMessage *>(msg_ref);
@@ -323,10 +489,18 @@ void CIntraNameProxy::onBroadcast(CBaseJob::Ptr &msg_ref)
 }
 
 void CIntraNameProxy::processServiceOnline(CFdbMessage *msg, NFdbBase::FdbMsgAddressList &msg_addr_list, bool force_reconnect)
+{
+    NFdbBase::FdbMsgAddrBindResults bound_list;
+    bindServiceAddress(msg, msg_addr_list, force_reconnect, bound_list);
+    CFdbParcelableBuilder builder(bound_list);
+    send(msg->session(), NFdbBase::REQ_REGISTER_SERVICE, builder);
+}
+
+void CIntraNameProxy::bindServiceAddress(CFdbMessage *msg, NFdbBase::FdbMsgAddressList &msg_addr_list,
+                                         bool force_reconnect, NFdbBase::FdbMsgAddrBindResults &bound_list)
 {
     auto svc_name = msg_addr_list.service_name().c_str();
     std::vector<CBaseEndpoint *> endpoints;
-    NFdbBase::FdbMsgAddrBindResults bound_list;
 
     bound_list.service_name(msg_addr_list.service_name());
     FDB_CONTEXT->findEndpoint(svc_name, endpoints, true);
@@ -347,7 +521,41 @@ void CIntraNameProxy::processServiceOnline(CFdbMessage *msg, NFdbBase::FdbMsgAdd
         auto &addr_list = msg_addr_list.address_list();
         if (force_reconnect)
         {
-            server->doUnbind();
+            /*
+             * Keep sockets whose address is still allocated to the server,
+             * e.g. name server recovers the registry after restart, so that
+             * connected clients are not dropped.
+             */
+            std::vector<FdbSocketId_t> stale_sockets;
+            auto &containers = server->getContainer();
+            for (auto sk_it = containers.begin(); sk_it != containers.end(); ++sk_it)
+            {
+                CFdbSocketInfo info;
+                bool allocated = false;
+                if (sk_it->second->getSocketInfo(info))
+                {
+                    for (auto it = addr_list.vpool().begin(); it != addr_list.vpool().end(); ++it)
+                    {
+                        if ((it->address_type() == info.mAddress->mType) &&
+                            ((it->address_type() == FDB_SOCKET_IPC) ?
+                                !it->tcp_ipc_url().compare(info.mAddress->mUrl) :
+                                (!it->tcp_ipc_address().compare(info.mAddress->mAddr) &&
+                                 (it->tcp_port() == info.mAddress->mPort))))
+                        {
+                            allocated = true;
+                            break;
+                        }
+                    }
+                }
+                if (!allocated)
+                {
+                    stale_sockets.push_back(sk_it->first);
+                }
+            }
+            for (auto sk_it = stale_sockets.begin(); sk_it != stale_sockets.end(); ++sk_it)
+            {
+                server->doUnbind(*sk_it);
+            }
         }
         for (auto it = addr_list.vpool().begin(); it != addr_list.vpool().end(); ++it)
         {
@@ -359,7 +567,12 @@ void CIntraNameProxy::processServiceOnline(CFdbMessage *msg, NFdbBase::FdbMsgAdd
             {
                 udp_port = it->udp_port();
             }
-            CServerSocket *sk = server->doBind(tcp_ipc_url.c_str(), udp_port);
+            const char *multicast_url = 0;
+            if (it->has_multicast_url())
+            {
+                multicast_url = it->multicast_url().c_str();
+            }
+            CServerSocket *sk = server->doBind(tcp_ipc_url.c_str(), udp_port, multicast_url);
             if (!sk)
             {
                 continue;
@@ -413,9 +626,6 @@ void CIntraNameProxy::processServiceOnline(CFdbMessage *msg, NFdbBase::FdbMsgAdd
             }
         }
     }
-
-    CFdbParcelableBuilder builder(bound_list);
-    send(msg->session(), NFdbBase::REQ_REGISTER_SERVICE, builder);
 }
 
 void CIntraNameProxy::onReply(CBaseJob::Ptr &msg_ref)
@@ -431,6 +641,16 @@ void CIntraNameProxy::onReply(CBaseJob::Ptr &msg_ref)
             LOG_I("CIntraNameProxy: status is received: msg code: %d, id: %d, reason: %s\n",
                     msg->code(), id, reason.c_str());
         }
+        if (msg->code() == NFdbBase::REQ_ALLOC_SERVICE_ADDRESS_BULK)
+        {
+            // name server doesn't support bulk request: register one by one
+            std::vector<std::string> services;
+            services.swap(mBulkServices);
+            for (auto it = services.begin(); it != services.end(); ++it)
+            {
+                registerService(it->c_str());
+            }
+        }
 
         return;
     }
@@ -449,6 +669,26 @@ void CIntraNameProxy::onReply(CBaseJob::Ptr &msg_ref)
             processServiceOnline(msg, msg_addr_list, true);
         }
         break;
+        case NFdbBase::REQ_ALLOC_SERVICE_ADDRESS_BULK:
+        {
+            mBulkServices.clear();
+            NFdbBase::FdbMsgAddressListBulk msg_addr_bulk;
+            CFdbParcelableParser parser(msg_addr_bulk);
+            if (!msg->deserialize(parser))
+            {
+                LOG_E("CIntraNameProxy: unable to decode message for REQ_ALLOC_SERVICE_ADDRESS_BULK!\n");
+                return;
+            }
+            NFdbBase::FdbMsgAddrBindResultsBulk bound_bulk;
+            auto &svc_list = msg_addr_bulk.service_list();
+            for (auto it = svc_list.vpool().begin(); it != svc_list.vpool().end(); ++it)
+            {
+                bindServiceAddress(msg, *it, true, *bound_bulk.add_service_list());
+            }
+            CFdbParcelableBuilder builder(bound_bulk);
+            send(msg->session(), NFdbBase::REQ_REGISTER_SERVICE_BULK, builder);
+        }
+        break;
         default:
         break;
     }
@@ -468,16 +708,42 @@ void CIntraNameProxy::onConnectTimer(CMethodLoopTimer<CIntraNameProxy> *timer)
 void CIntraNameProxy::onOnline(FdbSessionId_t sid, bool is_first)
 {
     mConnectTimer.disable();
-    
+    mConnectTimer.reset();
+
+    /*
+     * Collect registration and listeners of all endpoints, then send them
+     * in one subscribe request and one bulk allocation request rather than
+     * one request per endpoint.
+     */
+    mBatchListeners.clear();
+    mBulkServices.clear();
+    mBatching = true;
+    FDB_CONTEXT->reconnectOnNsConnected();
+    mBatching = false;
+
     CFdbMsgSubscribeList subscribe_list;
     addNotifyItem(subscribe_list, NFdbBase::NTF_HOST_INFO);
     if (mNsWatchdogListener)
     {
         addNotifyItem(subscribe_list, NFdbBase::NTF_WATCHDOG);
     }
+    for (auto it = mBatchListeners.begin(); it != mBatchListeners.end(); ++it)
+    {
+        addNotifyItem(subscribe_list, it->first, it->second.c_str());
+    }
+    mBatchListeners.clear();
     subscribe(subscribe_list);
-    
-    FDB_CONTEXT->reconnectOnNsConnected();
+
+    if (!mBulkServices.empty())
+    {
+        NFdbBase::FdbMsgServerNameBulk svc_names;
+        for (auto it = mBulkServices.begin(); it != mBulkServices.end(); ++it)
+        {
+            svc_names.add_name_list(*it);
+        }
+        CFdbParcelableBuilder builder(svc_names);
+        invoke(NFdbBase::REQ_ALLOC_SERVICE_ADDRESS_BULK, builder);
+    }
 }
 
 void CIntraNameProxy::onOffline(FdbSessionId_t sid, bool is_last)
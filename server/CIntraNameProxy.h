@@ -19,10 +19,13 @@
 
 #include <vector>
 #include <string>
+#include <set>
+#include <random>
 #include <common_base/CMethodLoopTimer.h>
 #include <common_base/CNotificationCenter.h>
 #include <common_base/CFdbContext.h>
 #include "CBaseNameProxy.h"
+#include "CSvcAddrCache.h"
 
 class CIntraNameProxy : public CBaseNameProxy
 {
@@ -53,6 +56,21 @@ public:
         mEnableReconnectToNS = enb;
     }
     void registerNsWatchdogListener(tNsWatchdogListenerFn &watchdog_listener);
+    /*
+     * Keep address of services resolved by name server so that clients
+     * can be connected without waiting for name server.
+     * @iparam enable - whether address is cached
+     * @iparam persist_path - if not 0, the cache is also kept in the file
+     *      shared by processes so that it survives restart of process
+     */
+    void enableSvcAddrCache(bool enable, const char *persist_path = 0);
+    /*
+     * Connect clients of the service with cached address if they are not
+     * connected. The connection is regarded as unverified until address
+     * is confirmed by name server; if name server tells another address
+     * or the service is unknown, the clients are disconnected.
+     */
+    void connectCachedService(const char *svc_name);
     
 protected:
     void onReply(CBaseJob::Ptr &msg_ref);
@@ -67,6 +85,10 @@ private:
     public:
         CConnectTimer(CIntraNameProxy *proxy);
         void fire();
+        void reset();
+    private:
+        std::minstd_rand mRandom;
+        int32_t mBackoff;
     };
     CConnectTimer mConnectTimer;
     class CHostNameNotificationCenter : public CBaseNotificationCenter<CHostNameReady>
@@ -93,12 +115,24 @@ private:
     CHostNameNotificationCenter mNotificationCenter;
     bool mEnableReconnectToNS;
     tNsWatchdogListenerFn mNsWatchdogListener;
+    CSvcAddrCache mSvcAddrCache;
+    bool mSvcAddrCacheEnabled;
+    // clients connected with cached address and not yet verified
+    std::set<FdbEndpointId_t> mUnverifiedClients;
+    // requests of endpoints collected while name server is being reconnected
+    typedef std::pair<FdbMsgCode_t, std::string> tBatchListener;
+    bool mBatching;
+    std::vector<tBatchListener> mBatchListeners;
+    std::vector<std::string> mBulkServices;
 
     void onConnectTimer(CMethodLoopTimer<CIntraNameProxy> *timer);
     
     void processClientOnline(CFdbMessage *msg, NFdbBase::FdbMsgAddressList &msg_addr_list);
     void processServiceOnline(CFdbMessage *msg, NFdbBase::FdbMsgAddressList &msg_addr_list, bool force_reconnect);
+    void bindServiceAddress(CFdbMessage *msg, NFdbBase::FdbMsgAddressList &msg_addr_list,
+                            bool force_reconnect, NFdbBase::FdbMsgAddrBindResults &bound_list);
     void doRegisterNsWatchdogListener(tNsWatchdogListenerFn &watchdog_listener);
+    bool verifyCachedConnection(CBaseClient *client, NFdbBase::FdbMsgAddressList &msg_addr_list);
 
     friend class CRegisterWatchdogJob;
 };
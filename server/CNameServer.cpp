@@ -20,6 +20,7 @@
 #include <common_base/CFdbMessage.h>
 #include <common_base/CBaseSocketFactory.h>
 #include <common_base/CFdbSession.h>
+#include <common_base/CBaseSysDep.h>
 #include <utils/CFdbIfMessageHeader.h>
 #include "CFdbIfNameServer.h"
 #include <security/CFdbusSecurityConfig.h>
@@ -31,6 +32,10 @@
 CNameServer::CNameServer()
     : CBaseServer()
     , mHostProxy(0)
+    , mRecoveryTimer(this)
+    , mSnapshotDirty(false)
+    , mSnapshotTimer(this)
+    , mRegistryLog(CNsConfig::getRegistryLogSize())
 {
     setNsName(CNsConfig::getNameServerName());
     mServerSecruity.importSecurity();
@@ -41,11 +46,14 @@ CNameServer::CNameServer()
     mMsgHdl.registerCallback(NFdbBase::REQ_ALLOC_SERVICE_ADDRESS, &CNameServer::onAllocServiceAddressReq);
     mMsgHdl.registerCallback(NFdbBase::REQ_REGISTER_SERVICE, &CNameServer::onRegisterServiceReq);
     mMsgHdl.registerCallback(NFdbBase::REQ_UNREGISTER_SERVICE, &CNameServer::onUnegisterServiceReq);
+    mMsgHdl.registerCallback(NFdbBase::REQ_ALLOC_SERVICE_ADDRESS_BULK, &CNameServer::onAllocServiceAddressBulkReq);
+    mMsgHdl.registerCallback(NFdbBase::REQ_REGISTER_SERVICE_BULK, &CNameServer::onRegisterServiceBulkReq);
 
     mMsgHdl.registerCallback(NFdbBase::REQ_QUERY_SERVICE, &CNameServer::onQueryServiceReq);
     mMsgHdl.registerCallback(NFdbBase::REQ_QUERY_SERVICE_INTER_MACHINE, &CNameServer::onQueryServiceInterMachineReq);
 
     mMsgHdl.registerCallback(NFdbBase::REQ_QUERY_HOST_LOCAL, &CNameServer::onQueryHostReq);
+    mMsgHdl.registerCallback(NFdbBase::REQ_QUERY_SERVICE_DELTA, &CNameServer::onQueryServiceDeltaReq);
 
     mSubscribeHdl.registerCallback(NFdbBase::NTF_SERVICE_ONLINE, &CNameServer::onServiceOnlineReg);
     mSubscribeHdl.registerCallback(NFdbBase::NTF_SERVICE_ONLINE_INTER_MACHINE, &CNameServer::onServiceOnlineReg);
@@ -56,14 +64,21 @@ CNameServer::CNameServer()
     mSubscribeHdl.registerCallback(NFdbBase::NTF_HOST_INFO, &CNameServer::onHostInfoReg);
 
     mSubscribeHdl.registerCallback(NFdbBase::NTF_WATCHDOG, &CNameServer::onWatchdogReg);
+    mSubscribeHdl.registerCallback(NFdbBase::NTF_SERVICE_DELTA_MONITOR, &CNameServer::onServiceDeltaReg);
 
 #ifdef __WIN32__
     mLocalAllocator.setInterfaceIp(FDB_LOCAL_HOST);
 #endif
+    mRecoveryTimer.attach(FDB_CONTEXT, false);
+    mSnapshotTimer.attach(FDB_CONTEXT, false);
 }
 
 CNameServer::~CNameServer()
 {
+    if (mSnapshotDirty)
+    {
+        flushSnapshot();
+    }
     if (mHostProxy)
     {
         mHostProxy->prepareDestroy();
@@ -94,6 +109,10 @@ void CNameServer::prepareAddress(const CFdbAddressDesc &addr_desc, NFdbBase::Fdb
     {
         item->set_udp_port(addr_desc.mUDPPort);
     }
+    if (!addr_desc.mMulticastUrl.empty())
+    {
+        item->set_multicast_url(addr_desc.mMulticastUrl);
+    }
 }
 
 void CNameServer::populateAddrList(const tAddressDescTbl &addr_tbl, NFdbBase::FdbMsgAddressList &list,
@@ -187,6 +206,7 @@ void CNameServer::addOneServiceAddress(const std::string &svc_name,
         if (skt_type != FDB_SOCKET_IPC)
         {
             allocateUDPPort(desc.mAddress.mAddr.c_str(), desc.mUDPPort);
+            allocateMulticastGroup(desc.mMulticastUrl);
         }
         if (msg_addr_list)
         {
@@ -244,24 +264,94 @@ void CNameServer::onAllocServiceAddressReq(CBaseJob::Ptr &msg_ref)
         return;
     }
 
-    auto it = mRegistryTbl.find(svc_name.name());
-    if (it != mRegistryTbl.end())
+    NFdbBase::FdbMsgAddressList reply_addr_list;
+    auto status = allocServiceAddress(svc_name.name(), sid, reply_addr_list);
+    if (status != NFdbBase::FDB_ST_OK)
     {
-        msg->status(msg_ref, NFdbBase::FDB_ST_ALREADY_EXIST);
+        msg->status(msg_ref, status);
         return;
     }
 
-    NFdbBase::FdbMsgAddressList reply_addr_list;
-    if (!addServiceAddress(svc_name.name(), sid, getSocketType(sid), &reply_addr_list))
+    saveSnapshot();
+    CFdbParcelableBuilder builder(reply_addr_list);
+    msg->reply(msg_ref, builder);
+}
+
+void CNameServer::onAllocServiceAddressBulkReq(CBaseJob::Ptr &msg_ref)
+{
+    auto msg = castToMessage<CFdbMessage *>(msg_ref);
+    NFdbBase::FdbMsgServerNameBulk svc_names;
+    auto sid = msg->session();
+    CFdbParcelableParser parser(svc_names);
+    if (!msg->deserialize(parser))
     {
-        msg->status(msg_ref, NFdbBase::FDB_ST_NOT_AVAILABLE);
+        msg->status(msg_ref, NFdbBase::FDB_ST_MSG_DECODE_FAIL);
         return;
     }
 
-    CFdbParcelableBuilder builder(reply_addr_list);
+    NFdbBase::FdbMsgAddressListBulk reply_bulk;
+    auto &name_list = svc_names.name_list();
+    for (auto it = name_list.pool().begin(); it != name_list.pool().end(); ++it)
+    {
+        NFdbBase::FdbMsgAddressList reply_addr_list;
+        auto status = allocServiceAddress(*it, sid, reply_addr_list);
+        if (status == NFdbBase::FDB_ST_OK)
+        {
+            *reply_bulk.add_service_list() = reply_addr_list;
+        }
+        else
+        {
+            LOG_E("CNameServer: Service %s: unable to allocate address: %d.\n", it->c_str(), status);
+        }
+    }
+
+    saveSnapshot();
+    CFdbParcelableBuilder builder(reply_bulk);
     msg->reply(msg_ref, builder);
 }
 
+int32_t CNameServer::allocServiceAddress(const std::string &svc_name, FdbSessionId_t sid,
+                                         NFdbBase::FdbMsgAddressList &reply_addr_list)
+{
+    auto it = mRegistryTbl.find(svc_name);
+    if (it != mRegistryTbl.end())
+    {
+        if (!it->second.mRecovered)
+        {
+            return NFdbBase::FDB_ST_ALREADY_EXIST;
+        }
+        reclaimService(it, sid, reply_addr_list);
+    }
+    else if (!addServiceAddress(svc_name, sid, getSocketType(sid), &reply_addr_list))
+    {
+        return NFdbBase::FDB_ST_NOT_AVAILABLE;
+    }
+    return NFdbBase::FDB_ST_OK;
+}
+
+void CNameServer::reclaimService(tRegistryTbl::iterator &reg_it, FdbSessionId_t sid,
+                                 NFdbBase::FdbMsgAddressList &msg_addr_list)
+{
+    /*
+     * The server is still running when name server restarts: hand over the
+     * same address and tokens so that it keeps sockets already bound and
+     * connected clients are not disturbed.
+     */
+    auto &addr_tbl = reg_it->second;
+    addr_tbl.mSid = sid;
+    addr_tbl.mRecovered = false;
+    populateTokens(addr_tbl.mTokens, msg_addr_list);
+    for (auto it = addr_tbl.mAddrTbl.begin(); it != addr_tbl.mAddrTbl.end(); ++it)
+    {
+        it->mStatus = CFdbAddressDesc::ADDR_PENDING;
+        it->reconnect_cnt = 0;
+        prepareAddress(*it, msg_addr_list.add_address_list());
+    }
+    // address of interfaces which are not in snapshot
+    addServiceAddress(reg_it->first, addr_tbl, FDB_SOCKET_TCP, &msg_addr_list);
+    LOG_I("CNameServer: Service %s is reclaimed from snapshot.\n", reg_it->first.c_str());
+}
+
 void CNameServer::buildSpecificTCPAddress(CFdbSession *session,
                                           int32_t port,
                                           std::string &out_url)
@@ -422,14 +512,45 @@ void CNameServer::onRegisterServiceReq(CBaseJob::Ptr &msg_ref)
         msg->status(msg_ref, NFdbBase::FDB_ST_MSG_DECODE_FAIL);
         return;
     }
+    if (!registerServiceAddress(msg->session(), addr_list))
+    {
+        msg->status(msg_ref, NFdbBase::FDB_ST_NON_EXIST);
+        return;
+    }
+    saveSnapshot();
+}
+
+void CNameServer::onRegisterServiceBulkReq(CBaseJob::Ptr &msg_ref)
+{
+    auto msg = castToMessage<CFdbMessage *>(msg_ref);
+    NFdbBase::FdbMsgAddrBindResultsBulk bind_results;
+    CFdbParcelableParser parser(bind_results);
+    if (!msg->deserialize(parser))
+    {
+        msg->status(msg_ref, NFdbBase::FDB_ST_MSG_DECODE_FAIL);
+        return;
+    }
+    auto &svc_list = bind_results.service_list();
+    for (auto it = svc_list.vpool().begin(); it != svc_list.vpool().end(); ++it)
+    {
+        if (!registerServiceAddress(msg->session(), *it))
+        {
+            LOG_E("CNameServer: Service %s: registered before address is allocated.\n",
+                  it->service_name().c_str());
+        }
+    }
+    saveSnapshot();
+}
+
+bool CNameServer::registerServiceAddress(FdbSessionId_t sid, NFdbBase::FdbMsgAddrBindResults &addr_list)
+{
     const std::string &svc_name = addr_list.service_name();
 
     auto reg_it = mRegistryTbl.find(svc_name);
 #if 1
     if (reg_it == mRegistryTbl.end())
     {
-        msg->status(msg_ref, NFdbBase::FDB_ST_NON_EXIST);
-        return;
+        return false;
     }
 #else
     if (reg_it == mRegistryTbl.end())
@@ -440,7 +561,7 @@ void CNameServer::onRegisterServiceReq(CBaseJob::Ptr &msg_ref)
 #endif
 
     auto &addr_tbl = reg_it->second;
-    addr_tbl.mSid = msg->session();
+    addr_tbl.mSid = sid;
     tAddressDescTbl new_addr_tbl;
     NFdbBase::FdbMsgAddressList broadcast_ipc_addr_list;
     broadcast_ipc_addr_list.set_service_name(svc_name);
@@ -538,7 +659,7 @@ void CNameServer::onRegisterServiceReq(CBaseJob::Ptr &msg_ref)
                     {
                         if (hs_tcp_url.empty())
                         {
-                            buildSpecificTCPAddress(FDB_CONTEXT->getSession(msg->session()),
+                            buildSpecificTCPAddress(FDB_CONTEXT->getSession(sid),
                                                     desc->mAddress.mPort, hs_tcp_url);
                         }
                     }
@@ -561,7 +682,7 @@ void CNameServer::onRegisterServiceReq(CBaseJob::Ptr &msg_ref)
     {
         mRegistryTbl.erase(reg_it);
         LOG_I("CNameServer: Service %s: registry fails.\n", svc_name.c_str());
-        return;
+        return true;
     }
     else
     {
@@ -609,6 +730,7 @@ void CNameServer::onRegisterServiceReq(CBaseJob::Ptr &msg_ref)
         broadcast(NFdbBase::NTF_SERVICE_ONLINE_MONITOR_INTER_MACHINE,
                   builder, svc_name.c_str());
         }
+        logRegistryChange(svc_name);
     }
     if (broadcast_ipc_addr_list.address_list().empty())
     {
@@ -643,6 +765,7 @@ void CNameServer::onRegisterServiceReq(CBaseJob::Ptr &msg_ref)
         // token to local clients according to security level
         broadcastSvcAddrRemote(reg_it->second.mTokens, broadcast_tcp_addr_list);
     }
+    return true;
 }
 
 bool CNameServer::reconnectToAddress(CFdbAddressDesc *addr_desc, const char *svc_name)
@@ -694,6 +817,10 @@ bool CNameServer::reconnectToAddress(CFdbAddressDesc *addr_desc, const char *svc
         {
             item->set_udp_port(udp_port);
         }
+        if (!addr_desc->mMulticastUrl.empty())
+        {
+            item->set_multicast_url(addr_desc->mMulticastUrl);
+        }
         addr_list.set_service_name(svc_name);
         addr_list.set_host_name((mHostProxy->hostName()));
         addr_list.set_is_local(true);
@@ -748,6 +875,7 @@ void CNameServer::onHostOnline(bool online)
             }
         }
     }
+    saveSnapshot();
 }
 
 void CNameServer::removeService(tRegistryTbl::iterator &reg_it)
@@ -779,7 +907,10 @@ void CNameServer::removeService(tRegistryTbl::iterator &reg_it)
     broadcast(NFdbBase::NTF_SERVICE_ONLINE_MONITOR_INTER_MACHINE, builder, svc_name);
     }
 
+    std::string removed_name = reg_it->first;
     mRegistryTbl.erase(reg_it);
+    logRegistryChange(removed_name);
+    saveSnapshot();
 }
 
 void CNameServer::onUnegisterServiceReq(CBaseJob::Ptr &msg_ref)
@@ -825,6 +956,74 @@ void CNameServer::onQueryHostReq(CBaseJob::Ptr &msg_ref)
     msg->reply(msg_ref, builder);
 }
 
+void CNameServer::onQueryServiceDeltaReq(CBaseJob::Ptr &msg_ref)
+{
+    auto msg = castToMessage<CFdbMessage *>(msg_ref);
+    NFdbBase::FdbMsgRegistryVersion since;
+    CFdbParcelableParser parser(since);
+    if (!msg->deserialize(parser))
+    {
+        msg->status(msg_ref, NFdbBase::FDB_ST_MSG_DECODE_FAIL);
+        return;
+    }
+
+    NFdbBase::FdbMsgServiceDelta delta;
+    populateServiceDelta(since.epoch(), since.version(), delta);
+    CFdbParcelableBuilder builder(delta);
+    msg->reply(msg_ref, builder);
+}
+
+void CNameServer::populateServiceChange(const std::string &svc_name,
+                                        NFdbBase::FdbMsgAddressList &addr_list)
+{
+    addr_list.set_service_name(svc_name);
+    addr_list.set_host_name(mHostProxy->hostName());
+    addr_list.set_is_local(true);
+    auto it = mRegistryTbl.find(svc_name);
+    if (it != mRegistryTbl.end())
+    {
+        populateAddrList(it->second.mAddrTbl, addr_list, FDB_SOCKET_MAX);
+    }
+}
+
+void CNameServer::populateServiceDelta(uint32_t epoch, uint64_t since_version,
+                                       NFdbBase::FdbMsgServiceDelta &delta)
+{
+    delta.set_epoch(mRegistryLog.epoch());
+    delta.set_version(mRegistryLog.version());
+    CChangeLog::tChangeList changes;
+    switch (mRegistryLog.getDelta(epoch, since_version, changes))
+    {
+        case CChangeLog::DELTA_FULL:
+            delta.set_full(true);
+            for (auto it = mRegistryTbl.begin(); it != mRegistryTbl.end(); ++it)
+            {
+                populateServiceChange(it->first, *delta.add_change_list());
+            }
+        break;
+        case CChangeLog::DELTA_CHANGES:
+            for (auto it = changes.begin(); it != changes.end(); ++it)
+            {
+                populateServiceChange((*it)->mKey, *delta.add_change_list());
+            }
+        break;
+        default:
+        break;
+    }
+}
+
+void CNameServer::logRegistryChange(const std::string &svc_name)
+{
+    mRegistryLog.log(svc_name);
+
+    NFdbBase::FdbMsgServiceDelta delta;
+    delta.set_epoch(mRegistryLog.epoch());
+    delta.set_version(mRegistryLog.version());
+    populateServiceChange(svc_name, *delta.add_change_list());
+    CFdbParcelableBuilder builder(delta);
+    broadcast(NFdbBase::NTF_SERVICE_DELTA_MONITOR, builder);
+}
+
 void CNameServer::broadServiceAddress(tRegistryTbl::iterator &reg_it, CFdbMessage *msg,
                                         FdbMsgCode_t msg_code)
 {
@@ -898,6 +1097,22 @@ void CNameServer::onServiceOnlineReg(CBaseJob::Ptr &msg_ref, const CFdbMsgSubscr
         {
             broadServiceAddress(it, msg, msg_code);
         }
+        else if (msg_code == NFdbBase::NTF_SERVICE_ONLINE)
+        {
+            /*
+             * Tell the requesting client the service is unknown so that
+             * connection made with cached address can be dropped. It is
+             * initial response of the subscription and only goes to the
+             * session of msg; other subscribers of the service never see
+             * the empty address list.
+             */
+            NFdbBase::FdbMsgAddressList addr_list;
+            addr_list.set_service_name(svc_name);
+            addr_list.set_host_name(mHostProxy->hostName());
+            addr_list.set_is_local(true);
+            CFdbParcelableBuilder builder(addr_list);
+            msg->broadcast(msg_code, builder, svc_name);
+        }
     }
     else
     {
@@ -928,6 +1143,16 @@ void CNameServer::onHostOnlineReg(CBaseJob::Ptr &msg_ref, const CFdbMsgSubscribe
     msg->broadcast(sub_item->msg_code(), builder);
 }
 
+void CNameServer::onServiceDeltaReg(CBaseJob::Ptr &msg_ref, const CFdbMsgSubscribeItem *sub_item)
+{
+    auto msg = castToMessage<CFdbMessage *>(msg_ref);
+    // start the stream with the whole registry
+    NFdbBase::FdbMsgServiceDelta delta;
+    populateServiceDelta(0, 0, delta);
+    CFdbParcelableBuilder builder(delta);
+    msg->broadcast(sub_item->msg_code(), builder);
+}
+
 void CNameServer::onHostInfoReg(CBaseJob::Ptr &msg_ref, const CFdbMsgSubscribeItem *sub_item)
 {
     auto msg = castToMessage<CFdbMessage *>(msg_ref);
@@ -1011,6 +1236,39 @@ bool CNameServer::allocateUDPPort(const char *ip_address, int32_t &port)
     return false;
 }
 
+CNameServer::CFdbAddressDesc *CNameServer::findMulticastGroup(const std::string &url)
+{
+    for (auto it = mRegistryTbl.begin(); it != mRegistryTbl.end(); ++it)
+    {
+        auto &desc_tbl = it->second;
+        for (auto desc_it = desc_tbl.mAddrTbl.begin();
+                desc_it != desc_tbl.mAddrTbl.end(); ++desc_it)
+        {
+            if (!desc_it->mMulticastUrl.compare(url))
+            {
+                return &(*desc_it);
+            }
+        }
+    }
+    return 0;
+}
+
+bool CNameServer::allocateMulticastGroup(std::string &url)
+{
+    int32_t retries =  (int32_t)mRegistryTbl.size() + 8;
+    while (--retries > 0)
+    {
+        CFdbSocketAddr sckt_addr;
+        mMulticastAllocator.allocate(sckt_addr);
+        if (!findMulticastGroup(sckt_addr.mUrl))
+        {
+            url = sckt_addr.mUrl;
+            return true;
+        }
+    }
+    return false;
+}
+
 void CNameServer::allocateUDPPortForClients(NFdbBase::FdbMsgAddressList &addr_list)
 {
     auto &addrs = addr_list.address_list();
@@ -1071,14 +1329,12 @@ void CNameServer::createTCPAllocator()
     if (!host_ip.empty())
     {   // add ip address of HS if connection with HS is via TCP
         // this means interface of HS will always binded
-        auto &allocator = mTCPAllocators[host_ip];
-        allocator.setInterfaceIp(host_ip.c_str());
+        tcpAllocator(host_ip);
     }
 
     for (auto it = mIpInterfaces.begin(); it != mIpInterfaces.end(); ++it)
     {
-        auto &allocator = mTCPAllocators[*it];
-        allocator.setInterfaceIp(it->c_str());
+        tcpAllocator(*it);
     }
 
     if (!mNameInterfaces.empty())
@@ -1094,17 +1350,33 @@ void CNameServer::createTCPAllocator()
             }
             else
             {
-                auto &allocator = mTCPAllocators[if_pair->second];
-                allocator.setInterfaceIp(if_pair->second.c_str());
+                tcpAllocator(if_pair->second);
             }
         }
     }
 
     if (mTCPAllocators.empty())
     {   // for local HS of xNX, we come here if interface is not specified
-        auto &allocator = mTCPAllocators[FDB_IP_ALL_INTERFACE];
-        allocator.setInterfaceIp(FDB_IP_ALL_INTERFACE);
+        tcpAllocator(FDB_IP_ALL_INTERFACE);
+    }
+}
+
+CTCPAddressAllocator &CNameServer::tcpAllocator(const std::string &ip_addr)
+{
+    auto it = mTCPAllocators.find(ip_addr);
+    if (it != mTCPAllocators.end())
+    {
+        return it->second;
     }
+    auto &allocator = mTCPAllocators[ip_addr];
+    allocator.setInterfaceIp(ip_addr.c_str());
+    // continue from where it was before restart to avoid conflict with recovered services
+    auto pos_it = mTCPPositions.find(ip_addr);
+    if (pos_it != mTCPPositions.end())
+    {
+        allocator.position(pos_it->second);
+    }
+    return allocator;
 }
 
 void CNameServer::allocateTCPAddress(FdbServerType svc_type, tSocketAddrTbl &sckt_addr_tbl)
@@ -1138,8 +1410,7 @@ void CNameServer::allocateTCPAddress(const std::string &svc_name, tSocketAddrTbl
         {
             // It is not possible to come here. But anyway have to do something
             // to avoid failure
-            auto &allocator = mTCPAllocators[FDB_IP_ALL_INTERFACE];
-            allocator.setInterfaceIp(FDB_IP_ALL_INTERFACE);
+            tcpAllocator(FDB_IP_ALL_INTERFACE);
         }
         else
         {
@@ -1279,6 +1550,7 @@ bool CNameServer::online(const char *hs_url, const char *hs_name,
     }
 
     mHostProxy = new CHostProxy(this, hs_name);
+    loadSnapshot();
     auto ns_name = name().c_str();
     addServiceAddress(ns_name, FDB_INVALID_ID, FDB_SOCKET_IPC, 0);
     auto it = mRegistryTbl.find(ns_name);
@@ -1293,10 +1565,178 @@ bool CNameServer::online(const char *hs_url, const char *hs_name,
         return false;
     }
 
+    saveSnapshot();
     connectToHostServer(hs_url, hs_url ? false : true);
     return true;
 }
 
+bool CNameServer::enableSnapshot(const char *path)
+{
+    return mSnapshot.open(path);
+}
+
+void CNameServer::loadSnapshot()
+{
+    NFdbBase::FdbNsSnapshot snapshot;
+    if (!mSnapshot.opened() || !mSnapshot.load(snapshot))
+    {
+        return;
+    }
+
+#ifdef __WIN32__
+    mLocalAllocator.position(snapshot.local_position());
+#else
+    mIPCAllocator.position(snapshot.local_position());
+#endif
+    auto &tcp_allocators = snapshot.tcp_allocators();
+    for (auto it = tcp_allocators.vpool().begin(); it != tcp_allocators.vpool().end(); ++it)
+    {
+        mTCPPositions[it->interface_ip()] = it->position();
+    }
+    auto &udp_allocators = snapshot.udp_allocators();
+    for (auto it = udp_allocators.vpool().begin(); it != udp_allocators.vpool().end(); ++it)
+    {
+        mUDPAllocators[it->interface_ip()].position(it->position());
+    }
+    mMulticastAllocator.position(snapshot.multicast_subnet(), snapshot.multicast_port());
+
+    int32_t nr_recovered = 0;
+    auto &service_list = snapshot.service_list();
+    for (auto svc_it = service_list.vpool().begin(); svc_it != service_list.vpool().end(); ++svc_it)
+    {
+        if (!svc_it->name().compare(name()) || mRegistryTbl.count(svc_it->name()))
+        {
+            continue;
+        }
+        CSvcRegistryEntry entry;
+        auto &address_list = svc_it->address_list();
+        for (auto addr_it = address_list.vpool().begin(); addr_it != address_list.vpool().end(); ++addr_it)
+        {
+            CFdbAddressDesc desc;
+            if (!addr_it->bound() || !CBaseSocketFactory::parseUrl(addr_it->url().c_str(), desc.mAddress))
+            {
+                continue;
+            }
+            desc.mStatus = CFdbAddressDesc::ADDR_BOUND;
+            desc.mUDPPort = addr_it->udp_port();
+            desc.mMulticastUrl = addr_it->multicast_url();
+            entry.mAddrTbl.push_back(desc);
+        }
+        if (entry.mAddrTbl.empty())
+        {
+            continue;
+        }
+        auto &tokens = svc_it->tokens();
+        entry.mTokens.assign(tokens.pool().begin(), tokens.pool().end());
+        entry.mRecovered = true;
+        mRegistryTbl[svc_it->name()] = entry;
+        nr_recovered++;
+    }
+
+    if (nr_recovered)
+    {
+        LOG_I("CNameServer: %d services are recovered from snapshot.\n", nr_recovered);
+        mRecoveryTimer.enable();
+    }
+}
+
+void CNameServer::saveSnapshot()
+{
+    /*
+     * Writing snapshot serializes the whole registry and syncs it to file;
+     * instead of doing so upon each change, changes arriving in a burst
+     * (such as services registering at startup) are written at once.
+     */
+    if (!mSnapshot.opened() || mSnapshotDirty)
+    {
+        return;
+    }
+    mSnapshotDirty = true;
+    mSnapshotTimer.enable();
+}
+
+void CNameServer::onSnapshotTimer(CMethodLoopTimer<CNameServer> *timer)
+{
+    mSnapshotDirty = false;
+    flushSnapshot();
+}
+
+void CNameServer::flushSnapshot()
+{
+    if (!mSnapshot.opened())
+    {
+        return;
+    }
+
+    NFdbBase::FdbNsSnapshot snapshot;
+#ifdef __WIN32__
+    snapshot.set_local_position(mLocalAllocator.position());
+#else
+    snapshot.set_local_position(mIPCAllocator.position());
+#endif
+    for (auto it = mTCPAllocators.begin(); it != mTCPAllocators.end(); ++it)
+    {
+        mTCPPositions[it->first] = it->second.position();
+    }
+    for (auto it = mTCPPositions.begin(); it != mTCPPositions.end(); ++it)
+    {
+        auto allocator = snapshot.tcp_allocators().Add();
+        allocator->set_interface_ip(it->first);
+        allocator->set_position(it->second);
+    }
+    for (auto it = mUDPAllocators.begin(); it != mUDPAllocators.end(); ++it)
+    {
+        auto allocator = snapshot.udp_allocators().Add();
+        allocator->set_interface_ip(it->first);
+        allocator->set_position(it->second.position());
+    }
+    snapshot.set_multicast(mMulticastAllocator.subnet(), mMulticastAllocator.port());
+
+    for (auto it = mRegistryTbl.begin(); it != mRegistryTbl.end(); ++it)
+    {
+        if (!it->first.compare(name()))
+        {
+            continue;
+        }
+        auto svc = snapshot.add_service_list();
+        svc->set_name(it->first);
+        auto &tokens = it->second.mTokens;
+        for (auto token_it = tokens.begin(); token_it != tokens.end(); ++token_it)
+        {
+            svc->tokens().Add(*token_it);
+        }
+        auto &addr_tbl = it->second.mAddrTbl;
+        for (auto addr_it = addr_tbl.begin(); addr_it != addr_tbl.end(); ++addr_it)
+        {
+            auto addr = svc->add_address_list();
+            addr->set_url(addr_it->mAddress.mUrl);
+            addr->set_udp_port(addr_it->mUDPPort);
+            addr->set_multicast_url(addr_it->mMulticastUrl);
+            addr->set_bound(addr_it->mStatus == CFdbAddressDesc::ADDR_BOUND);
+        }
+    }
+
+    if (!mSnapshot.save(snapshot))
+    {
+        LOG_E("CNameServer: unable to save snapshot!\n");
+    }
+}
+
+void CNameServer::onRecoveryTimer(CMethodLoopTimer<CNameServer> *timer)
+{
+    // servers not reclaiming their address within grace period are gone
+    for (auto it = mRegistryTbl.begin(); it != mRegistryTbl.end();)
+    {
+        auto cur_it = it;
+        ++it;
+        if (cur_it->second.mRecovered)
+        {
+            LOG_I("CNameServer: Service %s recovered from snapshot is expired.\n", cur_it->first.c_str());
+            removeService(cur_it);
+        }
+    }
+}
+
 void CNameServer::connectToHostServer(const char *hs_url, bool is_local)
 {
     mHostProxy->local(is_local);
@@ -26,13 +26,19 @@
 #include <common_base/CSocketImp.h>
 #include <security/CServerSecurityConfig.h>
 #include <common_base/CFdbMsgDispatcher.h>
+#include <common_base/CMethodLoopTimer.h>
+#include <utils/CNsConfig.h>
 #include "CAddressAllocator.h"
+#include "CRegistrySnapshot.h"
+#include "CChangeLog.h"
 
 namespace NFdbBase {
     class FdbMsgServiceTable;
     class FdbMsgAddressList;
     class FdbMsgServiceInfo;
     class FdbMsgAddressItem;
+    class FdbMsgAddrBindResults;
+    class FdbMsgServiceDelta;
 }
 class CFdbMessage;
 class CHostProxy;
@@ -59,6 +65,8 @@ private:
         CFdbSocketAddr mAddress;
         // Actually it doesn't make sense to have UDP port for server
         int32_t mUDPPort;
+        // multicast group of best-effort broadcast; empty if not allocated
+        std::string mMulticastUrl;
         int32_t reconnect_cnt;
     };
 
@@ -69,6 +77,12 @@ public:
                 char **interface_ips = 0, uint32_t num_interface_ips = 0,
                 char **interface_names = 0, uint32_t num_interface_names = 0);
     const std::string getNsTCPUrl(const char *ip_addr = 0);
+    /*
+     * Keep registry and address allocators in snapshot file so that they
+     * are rebuilt when name server restarts. Should be called before
+     * online().
+     */
+    bool enableSnapshot(const char *path);
     void populateServerTable(CFdbSession *session, NFdbBase::FdbMsgServiceTable &svc_tbl, bool is_local);
 
     void notifyRemoteNameServerDrop(const char *host_name);
@@ -82,15 +96,25 @@ private:
     typedef std::list<CFdbAddressDesc> tAddressDescTbl;
     struct CSvcRegistryEntry
     {
+        CSvcRegistryEntry()
+            : mSid(FDB_INVALID_ID)
+            , mRecovered(false)
+        {}
         FdbSessionId_t mSid;
         tAddressDescTbl mAddrTbl;
         CFdbToken::tTokenList mTokens;
+        /*
+         * rebuilt from snapshot and not yet claimed by the server; removed
+         * if not claimed within grace period.
+         */
+        bool mRecovered;
     };
     typedef std::map<std::string, CSvcRegistryEntry> tRegistryTbl;
     typedef std::map<std::string, CTCPAddressAllocator> tTCPAllocatorTbl;
     typedef std::map<std::string, CUDPPortAllocator> tUDPAllocatorTbl;
     typedef std::vector<CFdbSocketAddr> tSocketAddrTbl;
     typedef std::set<std::string> tInterfaceTbl;
+    typedef std::map<std::string, int32_t> tAllocatorPositionTbl;
 
     tRegistryTbl mRegistryTbl;
     CFdbMessageHandle<CNameServer> mMsgHdl;
@@ -103,28 +127,68 @@ private:
 #endif
     tTCPAllocatorTbl mTCPAllocators; // TCP (other than lo for windows) address allocator
     tUDPAllocatorTbl mUDPAllocators; // UDP port allocator
+    CMulticastAllocator mMulticastAllocator; // multicast group allocator
     CHostProxy *mHostProxy;
     CServerSecurityConfig mServerSecruity;
     tInterfaceTbl mIpInterfaces;
     tInterfaceTbl mNameInterfaces;
+    CRegistrySnapshot mSnapshot;
+    // positions of TCP allocators from snapshot, applied once they are created
+    tAllocatorPositionTbl mTCPPositions;
+    class CRecoveryTimer : public CMethodLoopTimer<CNameServer>
+    {
+    public:
+        CRecoveryTimer(CNameServer *ns)
+            : CMethodLoopTimer<CNameServer>(CNsConfig::getSnapshotGracePeriod(), false,
+                                            ns, &CNameServer::onRecoveryTimer)
+        {
+        }
+    };
+    CRecoveryTimer mRecoveryTimer;
+    class CSnapshotTimer : public CMethodLoopTimer<CNameServer>
+    {
+    public:
+        CSnapshotTimer(CNameServer *ns)
+            : CMethodLoopTimer<CNameServer>(CNsConfig::getSnapshotFlushDelay(), false,
+                                            ns, &CNameServer::onSnapshotTimer)
+        {
+        }
+    };
+    // changes since snapshot is written last time; flushed by mSnapshotTimer
+    bool mSnapshotDirty;
+    CSnapshotTimer mSnapshotTimer;
+    // version of registry and the services changed by the latest versions
+    CChangeLog mRegistryLog;
 
     void populateAddrList(const tAddressDescTbl &addr_tbl, NFdbBase::FdbMsgAddressList &list,
                           EFdbSocketType type);
 
     void onAllocServiceAddressReq(CBaseJob::Ptr &msg_ref);
+    void onAllocServiceAddressBulkReq(CBaseJob::Ptr &msg_ref);
+    int32_t allocServiceAddress(const std::string &svc_name, FdbSessionId_t sid,
+                                NFdbBase::FdbMsgAddressList &reply_addr_list);
     void onRegisterServiceReq(CBaseJob::Ptr &msg_ref);
+    void onRegisterServiceBulkReq(CBaseJob::Ptr &msg_ref);
+    bool registerServiceAddress(FdbSessionId_t sid, NFdbBase::FdbMsgAddrBindResults &addr_list);
     void onUnegisterServiceReq(CBaseJob::Ptr &msg_ref);
     void onQueryServiceReq(CBaseJob::Ptr &msg_ref);
     void onQueryServiceInterMachineReq(CBaseJob::Ptr &msg_ref);
     void onQueryHostReq(CBaseJob::Ptr &msg_ref);
+    void onQueryServiceDeltaReq(CBaseJob::Ptr &msg_ref);
     
     void onServiceOnlineReg(CBaseJob::Ptr &msg_ref, const CFdbMsgSubscribeItem *sub_item);
     void onHostOnlineReg(CBaseJob::Ptr &msg_ref, const CFdbMsgSubscribeItem *sub_item);
     void onHostInfoReg(CBaseJob::Ptr &msg_ref, const CFdbMsgSubscribeItem *sub_item);
     void onWatchdogReg(CBaseJob::Ptr &msg_ref, const CFdbMsgSubscribeItem *sub_item);
+    void onServiceDeltaReg(CBaseJob::Ptr &msg_ref, const CFdbMsgSubscribeItem *sub_item);
+
+    void logRegistryChange(const std::string &svc_name);
+    void populateServiceChange(const std::string &svc_name, NFdbBase::FdbMsgAddressList &addr_list);
+    void populateServiceDelta(uint32_t epoch, uint64_t since_version, NFdbBase::FdbMsgServiceDelta &delta);
 
     CFdbAddressDesc *findAddress(EFdbSocketType type, const char *url);
     void createTCPAllocator();
+    CTCPAddressAllocator &tcpAllocator(const std::string &ip_addr);
     bool allocateAddress(IAddressAllocator &allocator, FdbServerType svc_type, CFdbSocketAddr &sckt_addr);
     void allocateTCPAddress(const std::string &svc_name, tSocketAddrTbl &sckt_addr_tbl);
     void allocateTCPAddress(FdbServerType svc_type, tSocketAddrTbl &sckt_addr_tbl);
@@ -188,6 +252,16 @@ private:
     bool allocateUDPPort(const char *ip_address, int32_t &port);
     void allocateUDPPortForClients(NFdbBase::FdbMsgAddressList &addr_list);
     CFdbAddressDesc *findUDPPort(const char *ip_address, int32_t port);
+    bool allocateMulticastGroup(std::string &url);
+    CFdbAddressDesc *findMulticastGroup(const std::string &url);
+
+    void loadSnapshot();
+    void saveSnapshot();
+    void flushSnapshot();
+    void reclaimService(tRegistryTbl::iterator &reg_it, FdbSessionId_t sid,
+                        NFdbBase::FdbMsgAddressList &msg_addr_list);
+    void onRecoveryTimer(CMethodLoopTimer<CNameServer> *timer);
+    void onSnapshotTimer(CMethodLoopTimer<CNameServer> *timer);
 
     friend class CInterNameProxy;
 };
@@ -0,0 +1,336 @@
+/*
+ * Copyright (C) 2015   Jeremy Chen jeremy_cz@yahoo.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+#include <atomic>
+#include <vector>
+#include <common_base/CFdbSimpleMsgBuilder.h>
+#include <utils/Log.h>
+#include <vector>
+#include "CRegistrySnapshot.h"
+#ifndef __WIN32__
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#define FDB_SNAPSHOT_MAGIC          0x46445353
+#define FDB_SNAPSHOT_VERSION        1
+#define FDB_SNAPSHOT_MIN_CAPACITY   (64 * 1024)
+
+struct CRegistrySnapshotCopy
+{
+    // 0 if never written; the copy with larger sequence is the latest
+    uint32_t mSeq;
+    uint32_t mSize;
+    uint32_t mChecksum;
+    uint32_t mReserved;
+};
+
+struct CRegistrySnapshotHead
+{
+    uint32_t mMagic;
+    uint32_t mVersion;
+    // size of each copy; copies follow the head
+    uint32_t mCapacity;
+    uint32_t mReserved;
+    CRegistrySnapshotCopy mCopies[2];
+};
+
+static uint32_t snapshotChecksum(const uint8_t *data, uint32_t size)
+{
+    // FNV-1a
+    uint32_t h = 2166136261u;
+    for (uint32_t i = 0; i < size; ++i)
+    {
+        h ^= data[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+CRegistrySnapshot::CRegistrySnapshot()
+    : mFd(-1)
+    , mHead(0)
+    , mCapacity(0)
+{
+}
+
+CRegistrySnapshot::~CRegistrySnapshot()
+{
+    close();
+}
+
+uint8_t *CRegistrySnapshot::region(uint32_t idx)
+{
+    return (uint8_t *)(mHead + 1) + idx * mCapacity;
+}
+
+int32_t CRegistrySnapshot::latest()
+{
+    int32_t found = -1;
+    for (int32_t i = 0; i < 2; ++i)
+    {
+        auto &copy = mHead->mCopies[i];
+        if (!copy.mSeq || (copy.mSize > mCapacity))
+        {
+            continue;
+        }
+        if (snapshotChecksum(region(i), copy.mSize) != copy.mChecksum)
+        {
+            continue;
+        }
+        if ((found < 0) || ((int32_t)(copy.mSeq - mHead->mCopies[found].mSeq) > 0))
+        {
+            found = i;
+        }
+    }
+    return found;
+}
+
+#ifdef __WIN32__
+bool CRegistrySnapshot::open(const char *path)
+{
+    return false;
+}
+
+void CRegistrySnapshot::close()
+{
+}
+
+bool CRegistrySnapshot::map(uint32_t capacity)
+{
+    return false;
+}
+
+void CRegistrySnapshot::unmap()
+{
+}
+
+bool CRegistrySnapshot::create(uint32_t capacity, const uint8_t *data, uint32_t size, uint32_t seq)
+{
+    return false;
+}
+
+void CRegistrySnapshot::sync(const void *addr, size_t size)
+{
+}
+#else
+bool CRegistrySnapshot::open(const char *path)
+{
+    close();
+    mPath = path;
+    // never follow a link planted at the path
+    mFd = ::open(path, O_RDWR | O_CREAT | O_CLOEXEC | O_NOFOLLOW, 0600);
+    if (mFd < 0)
+    {
+        LOG_E("CRegistrySnapshot: unable to open %s!\n", path);
+        return false;
+    }
+
+    /*
+     * The file holds tokens and its content is trusted upon restart: take
+     * it only if it is owned by the same user and nobody else can access it.
+     */
+    struct stat st;
+    if (fstat(mFd, &st) || !S_ISREG(st.st_mode) || (st.st_uid != geteuid()) ||
+        ((st.st_mode & (S_IRWXG | S_IRWXO)) && fchmod(mFd, S_IRUSR | S_IWUSR)))
+    {
+        LOG_E("CRegistrySnapshot: %s is not a private file of uid %d!\n", path, (int)geteuid());
+        close();
+        return false;
+    }
+
+    CRegistrySnapshotHead head;
+    if ((st.st_size >= (off_t)sizeof(head))
+        && (pread(mFd, &head, sizeof(head), 0) == (ssize_t)sizeof(head))
+        && (head.mMagic == FDB_SNAPSHOT_MAGIC)
+        && (head.mVersion == FDB_SNAPSHOT_VERSION)
+        && (st.st_size == (off_t)(sizeof(head) + 2 * (uint64_t)head.mCapacity))
+        && map(head.mCapacity))
+    {
+        return true;
+    }
+
+    // created just now or written by other version: start from scratch
+    if (!create(FDB_SNAPSHOT_MIN_CAPACITY))
+    {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void CRegistrySnapshot::close()
+{
+    unmap();
+    if (mFd >= 0)
+    {
+        ::close(mFd);
+        mFd = -1;
+    }
+}
+
+bool CRegistrySnapshot::map(uint32_t capacity)
+{
+    unmap();
+    auto size = sizeof(CRegistrySnapshotHead) + 2 * (size_t)capacity;
+    auto ptr = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, mFd, 0);
+    if (ptr == MAP_FAILED)
+    {
+        return false;
+    }
+    mHead = (CRegistrySnapshotHead *)ptr;
+    mCapacity = capacity;
+    return true;
+}
+
+void CRegistrySnapshot::unmap()
+{
+    if (mHead)
+    {
+        munmap(mHead, sizeof(CRegistrySnapshotHead) + 2 * (size_t)mCapacity);
+        mHead = 0;
+        mCapacity = 0;
+    }
+}
+
+bool CRegistrySnapshot::create(uint32_t capacity, const uint8_t *data, uint32_t size, uint32_t seq)
+{
+    /*
+     * Build the file aside, with the state if given as the first copy, and
+     * rename it into place so that the current file stays valid until the
+     * new one is complete on disk.
+     */
+    auto tmp_path = mPath + ".tmp";
+    // left by a crash, or planted: never write through it
+    unlink(tmp_path.c_str());
+    auto fd = ::open(tmp_path.c_str(), O_RDWR | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0600);
+    if (fd < 0)
+    {
+        LOG_E("CRegistrySnapshot: unable to create %s!\n", tmp_path.c_str());
+        return false;
+    }
+    CRegistrySnapshotHead head;
+    memset(&head, 0, sizeof(head));
+    head.mMagic = FDB_SNAPSHOT_MAGIC;
+    head.mVersion = FDB_SNAPSHOT_VERSION;
+    head.mCapacity = capacity;
+    if (data)
+    {
+        head.mCopies[0].mSeq = seq;
+        head.mCopies[0].mSize = size;
+        head.mCopies[0].mChecksum = snapshotChecksum(data, size);
+    }
+    if (ftruncate(fd, sizeof(head) + 2 * (off_t)capacity) ||
+        (data && (pwrite(fd, data, size, sizeof(head)) != (ssize_t)size)) ||
+        (pwrite(fd, &head, sizeof(head), 0) != (ssize_t)sizeof(head)) ||
+        fdatasync(fd) ||
+        rename(tmp_path.c_str(), mPath.c_str()))
+    {
+        LOG_E("CRegistrySnapshot: unable to create %s!\n", mPath.c_str());
+        ::close(fd);
+        unlink(tmp_path.c_str());
+        return false;
+    }
+    unmap();
+    if (mFd >= 0)
+    {
+        ::close(mFd);
+    }
+    mFd = fd;
+    return map(capacity);
+}
+
+void CRegistrySnapshot::sync(const void *addr, size_t size)
+{
+    // msync() takes page aligned address
+    auto page = (uintptr_t)sysconf(_SC_PAGESIZE);
+    auto start = (uintptr_t)addr & ~(page - 1);
+    msync((void *)start, (uintptr_t)addr + size - start, MS_SYNC);
+}
+#endif
+
+bool CRegistrySnapshot::load(IFdbParcelable &state)
+{
+    if (!mHead)
+    {
+        return false;
+    }
+    auto idx = latest();
+    if (idx < 0)
+    {
+        return false;
+    }
+    CFdbParcelableParser parser(state);
+    return parser.parse(region(idx), (int32_t)mHead->mCopies[idx].mSize);
+}
+
+bool CRegistrySnapshot::save(const IFdbParcelable &state)
+{
+    if (!mHead)
+    {
+        return false;
+    }
+    CFdbParcelableBuilder builder(state);
+    auto size = builder.build();
+    if (size < 0)
+    {
+        return false;
+    }
+
+    auto idx = latest();
+    uint32_t seq = (idx < 0) ? 1 : mHead->mCopies[idx].mSeq + 1;
+    if (!seq)
+    {
+        seq = 1;
+    }
+    if ((uint32_t)size > mCapacity)
+    {
+        // replace with a larger file holding the state as the only copy
+        auto capacity = mCapacity ? mCapacity : FDB_SNAPSHOT_MIN_CAPACITY;
+        while (capacity < (uint32_t)size * 2)
+        {
+            capacity <<= 1;
+        }
+        std::vector<uint8_t> buffer(size);
+        builder.toBuffer(buffer.data(), size);
+        return create(capacity, buffer.data(), (uint32_t)size, seq);
+    }
+
+    // overwrite the copy which is not the latest
+    uint32_t target = (idx == 0) ? 1 : 0;
+    auto &copy = mHead->mCopies[target];
+    copy.mSeq = 0;
+    std::atomic_thread_fence(std::memory_order_release);
+    auto buffer = region(target);
+    builder.toBuffer(buffer, size);
+    copy.mSize = (uint32_t)size;
+    copy.mChecksum = snapshotChecksum(buffer, (uint32_t)size);
+    /*
+     * The copy must reach the file before it is published; otherwise the
+     * sequence might be written back first and a crash leaves a published
+     * copy which only the checksum tells from a complete one.
+     */
+    sync(buffer, size);
+    sync(mHead, sizeof(*mHead));
+    std::atomic_thread_fence(std::memory_order_release);
+    copy.mSeq = seq;
+    sync(mHead, sizeof(*mHead));
+    return true;
+}
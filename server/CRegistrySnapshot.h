@@ -0,0 +1,333 @@
+/*
+ * Copyright (C) 2015   Jeremy Chen jeremy_cz@yahoo.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __CREGISTRYSNAPSHOT_H__
+#define __CREGISTRYSNAPSHOT_H__
+
+#include <string>
+#include <common_base/CFdbSimpleSerializer.h>
+
+struct CRegistrySnapshotHead;
+
+/*
+ * State of name server or host server kept in a mapped file so that it can
+ * be rebuilt when the server restarts. The file holds two copies of the
+ * state; each save overwrites the older copy and publishes it by bumping
+ * its sequence, so that a crash in the middle of a save leaves the other
+ * copy intact. A copy whose checksum mismatches is ignored upon load.
+ * The file is only accessible by owner since it holds tokens.
+ */
+class CRegistrySnapshot
+{
+public:
+    CRegistrySnapshot();
+    ~CRegistrySnapshot();
+    /*
+     * Map the file; it is created if not exist.
+     * @return: false if the file can not be mapped
+     */
+    bool open(const char *path);
+    void close();
+    bool opened() const
+    {
+        return !!mHead;
+    }
+    /*
+     * Rebuild state from the latest valid copy.
+     * @return: false if the file holds no valid copy
+     */
+    bool load(IFdbParcelable &state);
+    // replace the older copy with state
+    bool save(const IFdbParcelable &state);
+
+private:
+    std::string mPath;
+    int mFd;
+    CRegistrySnapshotHead *mHead;
+    uint32_t mCapacity;
+
+    bool map(uint32_t capacity);
+    void unmap();
+    // replace the file with an empty one, or with data as the first copy
+    bool create(uint32_t capacity, const uint8_t *data = 0, uint32_t size = 0, uint32_t seq = 0);
+    // write the mapped range back to the file
+    void sync(const void *addr, size_t size);
+    uint8_t *region(uint32_t idx);
+    int32_t latest();
+};
+
+namespace NFdbBase {
+class FdbSnapshotAddress : public IFdbParcelable
+{
+public:
+    FdbSnapshotAddress()
+        : mUDPPort(0)
+        , mBound(false)
+    {}
+    std::string &url()
+    {
+        return mUrl;
+    }
+    void set_url(const std::string &url)
+    {
+        mUrl = url;
+    }
+    int32_t udp_port() const
+    {
+        return mUDPPort;
+    }
+    void set_udp_port(int32_t port)
+    {
+        mUDPPort = port;
+    }
+    std::string &multicast_url()
+    {
+        return mMulticastUrl;
+    }
+    void set_multicast_url(const std::string &url)
+    {
+        mMulticastUrl = url;
+    }
+    bool bound() const
+    {
+        return mBound;
+    }
+    void set_bound(bool bound)
+    {
+        mBound = bound;
+    }
+    void serialize(CFdbSimpleSerializer &serializer) const
+    {
+        serializer << mUrl << mUDPPort << mMulticastUrl << mBound;
+    }
+    void deserialize(CFdbSimpleDeserializer &deserializer)
+    {
+        deserializer >> mUrl >> mUDPPort >> mMulticastUrl >> mBound;
+    }
+private:
+    std::string mUrl;
+    int32_t mUDPPort;
+    std::string mMulticastUrl;
+    bool mBound;
+};
+
+class FdbSnapshotService : public IFdbParcelable
+{
+public:
+    std::string &name()
+    {
+        return mName;
+    }
+    void set_name(const std::string &name)
+    {
+        mName = name;
+    }
+    CFdbParcelableArray<std::string> &tokens()
+    {
+        return mTokens;
+    }
+    CFdbParcelableArray<FdbSnapshotAddress> &address_list()
+    {
+        return mAddressList;
+    }
+    FdbSnapshotAddress *add_address_list()
+    {
+        return mAddressList.Add();
+    }
+    void serialize(CFdbSimpleSerializer &serializer) const
+    {
+        serializer << mName << mTokens << mAddressList;
+    }
+    void deserialize(CFdbSimpleDeserializer &deserializer)
+    {
+        deserializer >> mName >> mTokens >> mAddressList;
+    }
+private:
+    std::string mName;
+    CFdbParcelableArray<std::string> mTokens;
+    CFdbParcelableArray<FdbSnapshotAddress> mAddressList;
+};
+
+class FdbSnapshotAllocator : public IFdbParcelable
+{
+public:
+    FdbSnapshotAllocator()
+        : mPosition(0)
+    {}
+    std::string &interface_ip()
+    {
+        return mInterfaceIp;
+    }
+    void set_interface_ip(const std::string &ip)
+    {
+        mInterfaceIp = ip;
+    }
+    int32_t position() const
+    {
+        return mPosition;
+    }
+    void set_position(int32_t position)
+    {
+        mPosition = position;
+    }
+    void serialize(CFdbSimpleSerializer &serializer) const
+    {
+        serializer << mInterfaceIp << mPosition;
+    }
+    void deserialize(CFdbSimpleDeserializer &deserializer)
+    {
+        deserializer >> mInterfaceIp >> mPosition;
+    }
+private:
+    std::string mInterfaceIp;
+    int32_t mPosition;
+};
+
+class FdbNsSnapshot : public IFdbParcelable
+{
+public:
+    FdbNsSnapshot()
+        : mLocalPosition(0)
+        , mMulticastSubnet(0)
+        , mMulticastPort(0)
+    {}
+    // allocator of local address: IPC; or TCP of loopback for windows
+    int32_t local_position() const
+    {
+        return mLocalPosition;
+    }
+    void set_local_position(int32_t position)
+    {
+        mLocalPosition = position;
+    }
+    CFdbParcelableArray<FdbSnapshotAllocator> &tcp_allocators()
+    {
+        return mTCPAllocators;
+    }
+    CFdbParcelableArray<FdbSnapshotAllocator> &udp_allocators()
+    {
+        return mUDPAllocators;
+    }
+    int32_t multicast_subnet() const
+    {
+        return mMulticastSubnet;
+    }
+    int32_t multicast_port() const
+    {
+        return mMulticastPort;
+    }
+    void set_multicast(int32_t subnet, int32_t port)
+    {
+        mMulticastSubnet = subnet;
+        mMulticastPort = port;
+    }
+    CFdbParcelableArray<FdbSnapshotService> &service_list()
+    {
+        return mServiceList;
+    }
+    FdbSnapshotService *add_service_list()
+    {
+        return mServiceList.Add();
+    }
+    void serialize(CFdbSimpleSerializer &serializer) const
+    {
+        serializer << mLocalPosition
+                   << mTCPAllocators
+                   << mUDPAllocators
+                   << mMulticastSubnet
+                   << mMulticastPort
+                   << mServiceList;
+    }
+    void deserialize(CFdbSimpleDeserializer &deserializer)
+    {
+        deserializer >> mLocalPosition
+                     >> mTCPAllocators
+                     >> mUDPAllocators
+                     >> mMulticastSubnet
+                     >> mMulticastPort
+                     >> mServiceList;
+    }
+private:
+    int32_t mLocalPosition;
+    CFdbParcelableArray<FdbSnapshotAllocator> mTCPAllocators;
+    CFdbParcelableArray<FdbSnapshotAllocator> mUDPAllocators;
+    int32_t mMulticastSubnet;
+    int32_t mMulticastPort;
+    CFdbParcelableArray<FdbSnapshotService> mServiceList;
+};
+
+class FdbSnapshotHost : public IFdbParcelable
+{
+public:
+    std::string &host_name()
+    {
+        return mHostName;
+    }
+    void set_host_name(const std::string &name)
+    {
+        mHostName = name;
+    }
+    std::string &ip_address()
+    {
+        return mIpAddress;
+    }
+    void set_ip_address(const std::string &address)
+    {
+        mIpAddress = address;
+    }
+    CFdbParcelableArray<std::string> &tokens()
+    {
+        return mTokens;
+    }
+    void serialize(CFdbSimpleSerializer &serializer) const
+    {
+        serializer << mHostName << mIpAddress << mTokens;
+    }
+    void deserialize(CFdbSimpleDeserializer &deserializer)
+    {
+        deserializer >> mHostName >> mIpAddress >> mTokens;
+    }
+private:
+    std::string mHostName;
+    std::string mIpAddress;
+    CFdbParcelableArray<std::string> mTokens;
+};
+
+class FdbHsSnapshot : public IFdbParcelable
+{
+public:
+    CFdbParcelableArray<FdbSnapshotHost> &host_list()
+    {
+        return mHostList;
+    }
+    FdbSnapshotHost *add_host_list()
+    {
+        return mHostList.Add();
+    }
+    void serialize(CFdbSimpleSerializer &serializer) const
+    {
+        serializer << mHostList;
+    }
+    void deserialize(CFdbSimpleDeserializer &deserializer)
+    {
+        deserializer >> mHostList;
+    }
+private:
+    CFdbParcelableArray<FdbSnapshotHost> mHostList;
+};
+}
+
+#endif
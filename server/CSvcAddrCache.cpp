@@ -0,0 +1,389 @@
+/*
+ * Copyright (C) 2015   Jeremy Chen jeremy_cz@yahoo.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+#include <atomic>
+#include <common_base/CFdbSimpleMsgBuilder.h>
+#include <utils/Log.h>
+#include "CSvcAddrCache.h"
+#ifndef __WIN32__
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#define FDB_SVC_CACHE_MAGIC         0x46445343
+#define FDB_SVC_CACHE_VERSION       1
+#define FDB_SVC_CACHE_READ_RETRIES  4
+
+struct CSvcAddrCacheSlot
+{
+    // odd while the slot is being written
+    volatile uint32_t mSeq;
+    // size of mData; 0 if invalidated
+    uint32_t mSize;
+    // empty if the slot is never used
+    char mName[FDB_SVC_CACHE_NAME_SIZE];
+    uint8_t mData[FDB_SVC_CACHE_DATA_SIZE];
+};
+
+struct CSvcAddrCacheFile
+{
+    uint32_t mMagic;
+    uint32_t mVersion;
+    uint32_t mNrSlots;
+    uint32_t mSlotSize;
+    CSvcAddrCacheSlot mSlots[FDB_SVC_CACHE_NR_SLOTS];
+};
+
+CSvcAddrCache::CSvcAddrCache()
+    : mFile(0)
+    , mFd(-1)
+    , mWritable(false)
+{
+}
+
+CSvcAddrCache::~CSvcAddrCache()
+{
+    detach();
+}
+
+uint32_t CSvcAddrCache::hash(const char *svc_name)
+{
+    // FNV-1a
+    uint32_t h = 2166136261u;
+    for (; *svc_name; ++svc_name)
+    {
+        h ^= (uint8_t)*svc_name;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+#ifdef __WIN32__
+bool CSvcAddrCache::attach(const char *path)
+{
+    return false;
+}
+
+void CSvcAddrCache::detach()
+{
+}
+
+bool CSvcAddrCache::lockFile(bool lock)
+{
+    return false;
+}
+#else
+bool CSvcAddrCache::attach(const char *path)
+{
+    detach();
+
+    mWritable = true;
+    // never follow a link planted at the path
+    auto fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC | O_NOFOLLOW, 0600);
+    if (fd < 0)
+    {
+        mWritable = false;
+        fd = open(path, O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+        if (fd < 0)
+        {
+            LOG_I("CSvcAddrCache: unable to open %s; only memory is used.\n", path);
+            return false;
+        }
+    }
+    mFd = fd;
+
+    /*
+     * Clients connect to whatever address is in the file: take it only if
+     * it is owned by the same user and nobody else can write it.
+     */
+    struct stat st;
+    if (fstat(fd, &st) || !S_ISREG(st.st_mode) || (st.st_uid != geteuid()) ||
+        ((st.st_mode & (S_IRWXG | S_IRWXO)) && fchmod(fd, S_IRUSR | S_IWUSR)))
+    {
+        LOG_E("CSvcAddrCache: %s is not a private file of uid %d; only memory is used.\n",
+              path, (int)geteuid());
+        detach();
+        return false;
+    }
+
+    bool valid = false;
+    lockFile(true);
+    if (!fstat(fd, &st) && (st.st_size == sizeof(CSvcAddrCacheFile)))
+    {
+        CSvcAddrCacheFile head;
+        if ((pread(fd, &head, sizeof(head.mMagic) * 4, 0) == (ssize_t)(sizeof(head.mMagic) * 4))
+            && (head.mMagic == FDB_SVC_CACHE_MAGIC)
+            && (head.mVersion == FDB_SVC_CACHE_VERSION)
+            && (head.mNrSlots == FDB_SVC_CACHE_NR_SLOTS)
+            && (head.mSlotSize == sizeof(CSvcAddrCacheSlot)))
+        {
+            valid = true;
+        }
+    }
+    if (!valid && mWritable)
+    {
+        // created just now or written by other version: start from scratch
+        if (!ftruncate(fd, 0) && !ftruncate(fd, sizeof(CSvcAddrCacheFile)))
+        {
+            uint32_t fields[4] = {FDB_SVC_CACHE_MAGIC, FDB_SVC_CACHE_VERSION,
+                                  FDB_SVC_CACHE_NR_SLOTS, sizeof(CSvcAddrCacheSlot)};
+            valid = pwrite(fd, fields, sizeof(fields), 0) == (ssize_t)sizeof(fields);
+        }
+    }
+    if (valid)
+    {
+        auto ptr = mmap(0, sizeof(CSvcAddrCacheFile), mWritable ? (PROT_READ | PROT_WRITE) : PROT_READ,
+                        MAP_SHARED, fd, 0);
+        if (ptr == MAP_FAILED)
+        {
+            valid = false;
+        }
+        else
+        {
+            mFile = (CSvcAddrCacheFile *)ptr;
+        }
+    }
+    lockFile(false);
+
+    if (!valid)
+    {
+        LOG_I("CSvcAddrCache: unable to map %s; only memory is used.\n", path);
+        detach();
+        return false;
+    }
+    return true;
+}
+
+void CSvcAddrCache::detach()
+{
+    if (mFile)
+    {
+        munmap(mFile, sizeof(CSvcAddrCacheFile));
+        mFile = 0;
+    }
+    if (mFd >= 0)
+    {
+        close(mFd);
+        mFd = -1;
+    }
+    mWritable = false;
+}
+
+bool CSvcAddrCache::lockFile(bool lock)
+{
+    if (mFd < 0)
+    {
+        return false;
+    }
+    int ret;
+    do
+    {
+        ret = flock(mFd, lock ? LOCK_EX : LOCK_UN);
+    } while ((ret < 0) && (errno == EINTR));
+    return !ret;
+}
+#endif
+
+bool CSvcAddrCache::loadSlot(uint32_t idx, const char *svc_name, std::vector<uint8_t> &data)
+{
+    auto &slot = mFile->mSlots[idx];
+    for (int32_t i = 0; i < FDB_SVC_CACHE_READ_RETRIES; ++i)
+    {
+        uint32_t seq = slot.mSeq;
+        if (seq & 1)
+        {
+            continue;
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        char name[FDB_SVC_CACHE_NAME_SIZE];
+        memcpy(name, slot.mName, sizeof(name));
+        name[sizeof(name) - 1] = '\0';
+        uint32_t size = slot.mSize;
+        if (size > FDB_SVC_CACHE_DATA_SIZE)
+        {
+            size = 0;
+        }
+        data.assign(slot.mData, slot.mData + size);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.mSeq != seq)
+        {
+            continue;
+        }
+        if (strcmp(name, svc_name))
+        {
+            data.clear();
+            return false;
+        }
+        return true;
+    }
+    data.clear();
+    return false;
+}
+
+void CSvcAddrCache::storeSlot(const char *svc_name, const uint8_t *data, uint32_t size)
+{
+    if (!mFile || !mWritable || !lockFile(true))
+    {
+        return;
+    }
+    /*
+     * Open addressing: probe from the hashed slot; invalidated slots keep
+     * the name so that probing goes on. If the table is full, the hashed
+     * slot is replaced.
+     */
+    auto start = hash(svc_name) % FDB_SVC_CACHE_NR_SLOTS;
+    int32_t target = -1;
+    int32_t free_slot = -1;
+    for (uint32_t i = 0; i < FDB_SVC_CACHE_NR_SLOTS; ++i)
+    {
+        auto idx = (start + i) % FDB_SVC_CACHE_NR_SLOTS;
+        auto &slot = mFile->mSlots[idx];
+        if (!strncmp(slot.mName, svc_name, FDB_SVC_CACHE_NAME_SIZE))
+        {
+            target = idx;
+            break;
+        }
+        if ((free_slot < 0) && !slot.mSize)
+        {
+            free_slot = idx;
+        }
+        if (slot.mName[0] == '\0')
+        {
+            break;
+        }
+    }
+    if (target < 0)
+    {
+        if (!size)
+        {
+            lockFile(false);
+            return;
+        }
+        target = (free_slot < 0) ? start : free_slot;
+    }
+
+    auto &slot = mFile->mSlots[target];
+    slot.mSeq = slot.mSeq + 1;
+    std::atomic_thread_fence(std::memory_order_release);
+    strncpy(slot.mName, svc_name, FDB_SVC_CACHE_NAME_SIZE - 1);
+    slot.mName[FDB_SVC_CACHE_NAME_SIZE - 1] = '\0';
+    if (size)
+    {
+        memcpy(slot.mData, data, size);
+    }
+    slot.mSize = size;
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.mSeq = slot.mSeq + 1;
+    lockFile(false);
+}
+
+void CSvcAddrCache::update(NFdbBase::FdbMsgAddressList &addr_list)
+{
+    auto &svc_name = addr_list.service_name();
+    if (svc_name.empty())
+    {
+        return;
+    }
+    // only local server is cached since connecting remote host might block
+    if (addr_list.address_list().empty() || !addr_list.is_local())
+    {
+        invalidate(svc_name.c_str());
+        return;
+    }
+
+    {
+        CFdbParcelableBuilder builder(addr_list);
+        auto size = builder.build();
+        if (size <= 0)
+        {
+            return;
+        }
+        auto &data = mAddrTable[svc_name];
+        data.resize(size);
+        builder.toBuffer(data.data(), size);
+    }
+
+    if (!mFile || !mWritable || (svc_name.size() >= FDB_SVC_CACHE_NAME_SIZE))
+    {
+        return;
+    }
+    // tokens are secret to the process and never shared by file
+    NFdbBase::FdbMsgAddressList file_list = addr_list;
+    file_list.clear_token_list();
+    CFdbParcelableBuilder builder(file_list);
+    auto size = builder.build();
+    if ((size <= 0) || (size > FDB_SVC_CACHE_DATA_SIZE))
+    {
+        storeSlot(svc_name.c_str(), 0, 0);
+        return;
+    }
+    uint8_t buffer[FDB_SVC_CACHE_DATA_SIZE];
+    builder.toBuffer(buffer, size);
+    storeSlot(svc_name.c_str(), buffer, size);
+}
+
+bool CSvcAddrCache::find(const char *svc_name, NFdbBase::FdbMsgAddressList &addr_list)
+{
+    std::vector<uint8_t> data;
+    auto it = mAddrTable.find(svc_name);
+    if (it != mAddrTable.end())
+    {
+        data = it->second;
+    }
+    else if (mFile && (strlen(svc_name) < FDB_SVC_CACHE_NAME_SIZE))
+    {
+        auto start = hash(svc_name) % FDB_SVC_CACHE_NR_SLOTS;
+        for (uint32_t i = 0; i < FDB_SVC_CACHE_NR_SLOTS; ++i)
+        {
+            auto idx = (start + i) % FDB_SVC_CACHE_NR_SLOTS;
+            if (mFile->mSlots[idx].mName[0] == '\0')
+            {
+                break;
+            }
+            if (loadSlot(idx, svc_name, data))
+            {
+                break;
+            }
+        }
+    }
+    if (data.empty())
+    {
+        return false;
+    }
+
+    CFdbParcelableParser parser(addr_list);
+    if (!parser.parse(data.data(), (int32_t)data.size()) ||
+        addr_list.address_list().empty() || addr_list.service_name().compare(svc_name))
+    {
+        invalidate(svc_name);
+        return false;
+    }
+    return true;
+}
+
+void CSvcAddrCache::invalidate(const char *svc_name)
+{
+    mAddrTable.erase(svc_name);
+    if (strlen(svc_name) < FDB_SVC_CACHE_NAME_SIZE)
+    {
+        storeSlot(svc_name, 0, 0);
+    }
+}
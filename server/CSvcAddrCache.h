@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2015   Jeremy Chen jeremy_cz@yahoo.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __CSVCADDRCACHE_H__
+#define __CSVCADDRCACHE_H__
+
+#include <map>
+#include <string>
+#include <vector>
+#include <common_base/CSocketImp.h>
+#include "CFdbIfNameServer.h"
+
+#define FDB_SVC_CACHE_NAME_SIZE     64
+#define FDB_SVC_CACHE_DATA_SIZE     448
+#define FDB_SVC_CACHE_NR_SLOTS      64
+
+struct CSvcAddrCacheFile;
+
+/*
+ * Address of services last resolved by name server, so that client can be
+ * connected before name server replies. Each entry is FdbMsgAddressList
+ * broadcasted by NTF_SERVICE_ONLINE in serialized form.
+ *
+ * Optionally entries are also kept in a small file mapped by all processes
+ * of the host so that they survive restart of process. Writers are
+ * serialized with flock(); readers take a slot only if its sequence is
+ * unchanged while copying. Tokens are never written to the file. The file
+ * is created with mode 0600 and only used if it is owned by the effective
+ * user, so it is shared by processes of the same user only.
+ */
+class CSvcAddrCache
+{
+public:
+    CSvcAddrCache();
+    ~CSvcAddrCache();
+    /*
+     * Map the file shared by processes. If the file can not be written,
+     * it is mapped read-only.
+     * @return: false if the file can not be mapped; only memory is used
+     */
+    bool attach(const char *path);
+    void detach();
+    /*
+     * Store address of a service. Address list from other host or being
+     * empty (server is offline) invalidates the entry.
+     */
+    void update(NFdbBase::FdbMsgAddressList &addr_list);
+    /*
+     * Find address of the service, which is looked up from the file if
+     * not in memory.
+     * @return: true if found
+     */
+    bool find(const char *svc_name, NFdbBase::FdbMsgAddressList &addr_list);
+    void invalidate(const char *svc_name);
+
+private:
+    typedef std::map<std::string, std::vector<uint8_t> > tAddrTable;
+    tAddrTable mAddrTable;
+    CSvcAddrCacheFile *mFile;
+    int mFd;
+    bool mWritable;
+
+    static uint32_t hash(const char *svc_name);
+    bool lockFile(bool lock);
+    bool loadSlot(uint32_t idx, const char *svc_name, std::vector<uint8_t> &data);
+    void storeSlot(const char *svc_name, const uint8_t *data, uint32_t size);
+};
+
+#endif
@@ -0,0 +1,1181 @@
+/*
+ * Copyright (C) 2015   Jeremy Chen jeremy_cz@yahoo.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <iostream>
+#include <new>
+#ifdef __LINUX__
+#include <unistd.h>
+#include <sys/resource.h>
+#endif
+#include <common_base/fdbus.h>
+#include <common_base/CFdbLatencyHistogram.h>
+#include <common_base/CBasePipe.h>
+#include <common_base/fdb_option_parser.h>
+#include <server/CFdbIfNameServer.h>
+#include <utils/CFdbIfMessageHeader.h>
+#include <utils/CFdbLZ4.h>
+
+/*
+ * Micro benchmarks of the hot paths of fdbus. Everything runs inside this
+ * process: servers are bound to ipc:// and loopback tcp:// addresses
+ * directly so neither name server nor network is needed. Result is printed
+ * as JSON so that it can be compared between releases.
+ */
+
+#define BENCH_METHOD_ECHO           0
+#define BENCH_EVENT_FANOUT          1
+#define BENCH_IPC_URL               "ipc:///tmp/fdb-bench"
+#define BENCH_TCP_URL               "tcp://127.0.0.1:60111"
+#define BENCH_TIMEOUT               10000
+
+struct CBenchParam
+{
+    CBenchParam(const char *name, int64_t value)
+        : mName(name)
+        , mValue(value)
+    {}
+    std::string mName;
+    int64_t mValue;
+};
+
+struct CBenchResult
+{
+    std::string mName;
+    std::vector<CBenchParam> mParams;
+    uint64_t mIterations;
+    uint64_t mElapsedNs;
+    bool mHasLatency;
+    CFdbLatencySummary mLatency;
+};
+
+static std::vector<CBenchResult> fdb_bench_results;
+static int32_t fdb_bench_iterations = 100000;
+static char *fdb_bench_filter = 0;
+static char *fdb_bench_output = 0;
+
+static bool benchSelected(const char *name)
+{
+    return !fdb_bench_filter || strstr(name, fdb_bench_filter);
+}
+
+static CBenchResult &addResult(const char *name, uint64_t iterations, uint64_t elapsed_ns)
+{
+    fdb_bench_results.resize(fdb_bench_results.size() + 1);
+    auto &result = fdb_bench_results.back();
+    result.mName = name;
+    result.mIterations = iterations;
+    result.mElapsedNs = elapsed_ns ? elapsed_ns : 1;
+    result.mHasLatency = false;
+    fprintf(stderr, "%-32s %10llu iterations %12.1f ns/op\n", name,
+            (unsigned long long)iterations, (double)result.mElapsedNs / (iterations ? iterations : 1));
+    return result;
+}
+
+static void printResults(FILE *fp)
+{
+    fprintf(fp, "{\n");
+    fprintf(fp, "  \"sdk_version\": \"%s.%s.%s\",\n", FDB_DEF_TO_STR(FDB_VERSION_MAJOR),
+            FDB_DEF_TO_STR(FDB_VERSION_MINOR), FDB_DEF_TO_STR(FDB_VERSION_BUILD));
+    fprintf(fp, "  \"lib_version\": \"%s\",\n", CFdbContext::getFdbLibVersion());
+    fprintf(fp, "  \"benchmarks\": [");
+    for (auto it = fdb_bench_results.begin(); it != fdb_bench_results.end(); ++it)
+    {
+        double ns_per_op = (double)it->mElapsedNs / (it->mIterations ? it->mIterations : 1);
+        fprintf(fp, "%s\n    {\n", (it == fdb_bench_results.begin()) ? "" : ",");
+        fprintf(fp, "      \"name\": \"%s\",\n", it->mName.c_str());
+        fprintf(fp, "      \"params\": {");
+        for (auto pit = it->mParams.begin(); pit != it->mParams.end(); ++pit)
+        {
+            fprintf(fp, "%s\"%s\": %lld", (pit == it->mParams.begin()) ? "" : ", ",
+                    pit->mName.c_str(), (long long)pit->mValue);
+        }
+        fprintf(fp, "},\n");
+        fprintf(fp, "      \"iterations\": %llu,\n", (unsigned long long)it->mIterations);
+        fprintf(fp, "      \"elapsed_ns\": %llu,\n", (unsigned long long)it->mElapsedNs);
+        fprintf(fp, "      \"ns_per_op\": %.1f,\n", ns_per_op);
+        fprintf(fp, "      \"ops_per_sec\": %.1f", 1000000000.0 / ns_per_op);
+        if (it->mHasLatency)
+        {
+            auto &lat = it->mLatency;
+            fprintf(fp, ",\n      \"latency_us\": {\"min\": %llu, \"mean\": %llu, \"p50\": %llu, "
+                        "\"p90\": %llu, \"p99\": %llu, \"p999\": %llu, \"max\": %llu}",
+                    (unsigned long long)lat.mMin, (unsigned long long)lat.mMean,
+                    (unsigned long long)lat.mP50, (unsigned long long)lat.mP90,
+                    (unsigned long long)lat.mP99, (unsigned long long)lat.mP999,
+                    (unsigned long long)lat.mMax);
+        }
+        fprintf(fp, "\n    }");
+    }
+    fprintf(fp, "\n  ]\n}\n");
+}
+
+/*----------------------------- serializer -----------------------------*/
+static void buildServiceTable(NFdbBase::FdbMsgServiceTable &table, int32_t nr_services)
+{
+    for (int32_t i = 0; i < nr_services; ++i)
+    {
+        auto info = table.add_service_tbl();
+        char name[64];
+        snprintf(name, sizeof(name), "org.fdbus.bench-service-%d", i);
+        auto &addr = info->service_addr();
+        addr.set_service_name(name);
+        addr.set_host_name("bench-host");
+        addr.set_is_local(true);
+        auto item = addr.add_address_list();
+        snprintf(name, sizeof(name), "ipc:///tmp/fdb-ipc%d", i);
+        item->set_tcp_ipc_url(name);
+        item->set_address_type(FDB_SOCKET_IPC);
+        item = addr.add_address_list();
+        item->set_tcp_ipc_address("127.0.0.1");
+        item->set_tcp_port(60000 + i);
+        item->set_address_type(FDB_SOCKET_TCP);
+        auto &host = info->host_addr();
+        host.set_ip_address("127.0.0.1");
+        host.set_ns_url("tcp://127.0.0.1:61000");
+        host.set_host_name("bench-host");
+    }
+}
+
+static void buildTrafficStats(NFdbBase::FdbMsgTrafficStats &stats, int32_t nr_sessions)
+{
+    stats.set_endpoint_name("org.fdbus.bench-server");
+    stats.set_server_name("org.fdbus.bench-server");
+    for (int32_t i = 0; i < nr_sessions; ++i)
+    {
+        auto session = stats.add_sessions();
+        session->set_peer_name("org.fdbus.bench-client");
+        session->set_pid(1000 + i);
+        for (int32_t type = 0; type < 4; ++type)
+        {
+            session->traffic().add_types()->set_traffic(type, 1000 * i, 100000 * i,
+                                                          2000 * i, 200000 * i);
+        }
+    }
+}
+
+static void benchParcelable(const char *ser_name, const char *des_name,
+                            IFdbParcelable &in, IFdbParcelable &out, int32_t iterations)
+{
+    CFdbSimpleSerializer serializer;
+    auto start = CNanoTimer::getNanoSecTimer();
+    for (int32_t i = 0; i < iterations; ++i)
+    {
+        serializer.reset();
+        serializer << in;
+    }
+    auto &ser_result = addResult(ser_name, iterations, CNanoTimer::getNanoSecTimer() - start);
+    ser_result.mParams.push_back(CBenchParam("bytes", serializer.bufferSize()));
+
+    CFdbSimpleDeserializer deserializer;
+    start = CNanoTimer::getNanoSecTimer();
+    for (int32_t i = 0; i < iterations; ++i)
+    {
+        deserializer.reset(serializer.buffer(), serializer.bufferSize());
+        deserializer >> out;
+    }
+    auto &des_result = addResult(des_name, iterations, CNanoTimer::getNanoSecTimer() - start);
+    des_result.mParams.push_back(CBenchParam("bytes", serializer.bufferSize()));
+}
+
+static void benchSerializer()
+{
+    if (benchSelected("serializer/service_table") || benchSelected("deserializer/service_table"))
+    {
+        NFdbBase::FdbMsgServiceTable in;
+        NFdbBase::FdbMsgServiceTable out;
+        buildServiceTable(in, 16);
+        benchParcelable("serializer/service_table", "deserializer/service_table",
+                        in, out, fdb_bench_iterations / 10);
+    }
+    if (benchSelected("serializer/traffic_stats") || benchSelected("deserializer/traffic_stats"))
+    {
+        NFdbBase::FdbMsgTrafficStats in;
+        NFdbBase::FdbMsgTrafficStats out;
+        buildTrafficStats(in, 16);
+        benchParcelable("serializer/traffic_stats", "deserializer/traffic_stats",
+                        in, out, fdb_bench_iterations / 10);
+    }
+}
+
+static void benchMessageHead()
+{
+    NFdbBase::CFdbMessageHeader in;
+    in.set_type(FDB_MT_BROADCAST);
+    in.set_serial_number(1234);
+    in.set_code(56);
+    in.set_flag(0);
+    in.set_object_id(0);
+    in.set_payload_size(1024);
+    in.qos(FDB_QOS_BEST_EFFORTS);
+    in.set_broadcast_filter("bench-topic");
+    in.set_send_or_arrive_time(CNanoTimer::getNanoSecTimer());
+
+    uint64_t aligned_buffer[32];
+    auto buffer = (uint8_t *)aligned_buffer;
+    int32_t iterations = fdb_bench_iterations;
+    if (benchSelected("message_head/build_parcelable") || benchSelected("message_head/parse_parcelable"))
+    {
+        int32_t size = 0;
+        auto start = CNanoTimer::getNanoSecTimer();
+        for (int32_t i = 0; i < iterations; ++i)
+        {
+            CFdbParcelableBuilder builder(in);
+            size = builder.build();
+            builder.toBuffer(buffer, size);
+        }
+        auto &build_result = addResult("message_head/build_parcelable", iterations,
+                                       CNanoTimer::getNanoSecTimer() - start);
+        build_result.mParams.push_back(CBenchParam("bytes", size));
+
+        NFdbBase::CFdbMessageHeader out;
+        start = CNanoTimer::getNanoSecTimer();
+        for (int32_t i = 0; i < iterations; ++i)
+        {
+            out.decode(buffer, size);
+        }
+        auto &parse_result = addResult("message_head/parse_parcelable", iterations,
+                                       CNanoTimer::getNanoSecTimer() - start);
+        parse_result.mParams.push_back(CBenchParam("bytes", size));
+    }
+    if (benchSelected("message_head/build_packed") || benchSelected("message_head/parse_packed"))
+    {
+        int32_t size = 0;
+        auto start = CNanoTimer::getNanoSecTimer();
+        for (int32_t i = 0; i < iterations; ++i)
+        {
+            size = in.packedSize();
+            in.pack(buffer, size);
+        }
+        auto &build_result = addResult("message_head/build_packed", iterations,
+                                       CNanoTimer::getNanoSecTimer() - start);
+        build_result.mParams.push_back(CBenchParam("bytes", size));
+
+        NFdbBase::CFdbMessageHeader out;
+        start = CNanoTimer::getNanoSecTimer();
+        for (int32_t i = 0; i < iterations; ++i)
+        {
+            out.decode(buffer, size);
+        }
+        auto &parse_result = addResult("message_head/parse_packed", iterations,
+                                       CNanoTimer::getNanoSecTimer() - start);
+        parse_result.mParams.push_back(CBenchParam("bytes", size));
+    }
+    if (benchSelected("message_head/build_interned") || benchSelected("message_head/parse_interned"))
+    {
+        // the filter is defined by the first message; measure the id-only steady state
+        NFdbBase::CFdbStringIdTable tx_ids;
+        NFdbBase::CFdbStringIdTable rx_ids;
+        NFdbBase::CFdbMessageHeader out;
+        in.internStrings(tx_ids);
+        int32_t size = in.packedSize();
+        in.pack(buffer, size);
+        out.decode(buffer, size, &rx_ids);
+
+        auto start = CNanoTimer::getNanoSecTimer();
+        for (int32_t i = 0; i < iterations; ++i)
+        {
+            in.internStrings(tx_ids);
+            size = in.packedSize();
+            in.pack(buffer, size);
+        }
+        auto &build_result = addResult("message_head/build_interned", iterations,
+                                       CNanoTimer::getNanoSecTimer() - start);
+        build_result.mParams.push_back(CBenchParam("bytes", size));
+
+        start = CNanoTimer::getNanoSecTimer();
+        for (int32_t i = 0; i < iterations; ++i)
+        {
+            out.decode(buffer, size, &rx_ids);
+        }
+        auto &parse_result = addResult("message_head/parse_interned", iterations,
+                                       CNanoTimer::getNanoSecTimer() - start);
+        parse_result.mParams.push_back(CBenchParam("bytes", size));
+    }
+}
+
+/*----------------------------- compression ----------------------------*/
+static void benchCompression()
+{
+    if (!benchSelected("lz4/compress") && !benchSelected("lz4/decompress"))
+    {
+        return;
+    }
+    // JSON-like payload typical of CFdbCJsonMsgBuilder
+    std::string payload;
+    for (int32_t i = 0; payload.size() < 16 * 1024; ++i)
+    {
+        payload += "{\"id\":" + std::to_string(i) +
+                   ",\"name\":\"vehicle.speed\",\"unit\":\"km/h\",\"value\":" +
+                   std::to_string(i * 31 % 97) + "},";
+    }
+    auto src = (const uint8_t *)payload.data();
+    auto src_size = (int32_t)payload.size();
+    std::vector<uint8_t> compressed(CFdbLZ4::compressBound(src_size));
+    std::vector<uint8_t> decompressed(src_size);
+
+    int32_t iterations = fdb_bench_iterations / 10;
+    int32_t size = 0;
+    auto start = CNanoTimer::getNanoSecTimer();
+    for (int32_t i = 0; i < iterations; ++i)
+    {
+        size = CFdbLZ4::compress(src, src_size, compressed.data());
+    }
+    auto &compress_result = addResult("lz4/compress", iterations,
+                                      CNanoTimer::getNanoSecTimer() - start);
+    compress_result.mParams.push_back(CBenchParam("bytes", src_size));
+    compress_result.mParams.push_back(CBenchParam("compressed", size));
+
+    start = CNanoTimer::getNanoSecTimer();
+    for (int32_t i = 0; i < iterations; ++i)
+    {
+        CFdbLZ4::decompress(compressed.data(), size, decompressed.data(), src_size);
+    }
+    auto &decompress_result = addResult("lz4/decompress", iterations,
+                                        CNanoTimer::getNanoSecTimer() - start);
+    decompress_result.mParams.push_back(CBenchParam("bytes", src_size));
+    decompress_result.mParams.push_back(CBenchParam("compressed", size));
+}
+
+/*
+ * Reference blocks produced by the lz4 tool (lz4 -l -9) and malformed input
+ * derived from them: CFdbLZ4 decodes input from peers, so any of them going
+ * wrong makes fdbus_bench fail rather than just slower.
+ */
+struct CLZ4Vector
+{
+    const char *mName;
+    std::string mPlain;
+    const char *mBlock;
+};
+
+static int32_t fdb_check_failures = 0;
+
+static void checkFailed(const char *name, const char *what, int32_t size)
+{
+    fprintf(stderr, "lz4/check: %s: %s (size %d)!\n", name, what, size);
+    fdb_check_failures++;
+}
+
+static std::vector<uint8_t> fromHex(const char *hex)
+{
+    std::vector<uint8_t> data;
+    for (; hex[0] && hex[1]; hex += 2)
+    {
+        char byte[3] = {hex[0], hex[1], 0};
+        data.push_back((uint8_t)strtoul(byte, 0, 16));
+    }
+    return data;
+}
+
+// repeatable random numbers
+static uint32_t checkRandom(uint32_t &seed)
+{
+    seed = seed * 1103515245 + 12345;
+    return seed >> 16;
+}
+
+/*
+ * Decompress src of exact size (so that reading beyond is caught by memory
+ * checkers) into dst_size bytes followed by guard bytes which must be kept.
+ */
+static int32_t checkDecompress(const char *name, const uint8_t *src, int32_t src_size,
+                               std::vector<uint8_t> &dst, int32_t dst_size)
+{
+    static const int32_t guard_size = 64;
+    std::vector<uint8_t> input(src, src + src_size);
+    dst.assign(dst_size + guard_size, 0xa5);
+    auto ret = CFdbLZ4::decompress(input.data(), src_size, dst.data(), dst_size);
+    if (ret > dst_size)
+    {
+        checkFailed(name, "more than dst_size is returned", src_size);
+    }
+    for (int32_t i = dst_size; i < dst_size + guard_size; ++i)
+    {
+        if (dst[i] != 0xa5)
+        {
+            checkFailed(name, "output is beyond dst_size", src_size);
+            break;
+        }
+    }
+    return ret;
+}
+
+// decode a valid block of plain and then broken copies of it
+static void checkBlock(const char *name, const std::string &plain, const std::vector<uint8_t> &block)
+{
+    auto size = (int32_t)plain.size();
+    auto block_size = (int32_t)block.size();
+    std::vector<uint8_t> dst;
+    if ((checkDecompress(name, block.data(), block_size, dst, size) != size) ||
+        memcmp(dst.data(), plain.data(), size))
+    {
+        checkFailed(name, "block is not decoded", block_size);
+    }
+    if (size && (checkDecompress(name, block.data(), block_size, dst, size - 1) >= 0))
+    {
+        checkFailed(name, "smaller dst is accepted", block_size);
+    }
+    // every cut of small blocks; about 256 ones of large blocks
+    auto step = block_size / 256 + 1;
+    for (int32_t i = 0; i < block_size; i += (i < block_size - 16) ? step : 1)
+    {
+        // a truncated block might be valid but never gives the whole data
+        if (checkDecompress(name, block.data(), i, dst, size) == size)
+        {
+            checkFailed(name, "truncated block is accepted", i);
+        }
+    }
+    auto overlong = block;
+    for (int32_t i = 0; i < 16; ++i)
+    {
+        overlong.push_back((uint8_t)(i * 37));
+        if (checkDecompress(name, overlong.data(), (int32_t)overlong.size(), dst, size) >= 0)
+        {
+            checkFailed(name, "trailing garbage is accepted", (int32_t)overlong.size());
+        }
+    }
+    uint32_t seed = block_size;
+    for (int32_t i = 0; i < 1000; ++i)
+    {
+        auto broken = block;
+        auto nr_changes = 1 + checkRandom(seed) % 4;
+        for (uint32_t j = 0; j < nr_changes; ++j)
+        {
+            broken[checkRandom(seed) % block_size] = (uint8_t)checkRandom(seed);
+        }
+        checkDecompress(name, broken.data(), block_size, dst, size);
+    }
+}
+
+static void checkRoundTrip(const char *name, const std::string &plain)
+{
+    auto size = (int32_t)plain.size();
+    std::vector<uint8_t> block(CFdbLZ4::compressBound(size));
+    auto block_size = CFdbLZ4::compress((const uint8_t *)plain.data(), size, block.data());
+    if ((block_size <= 0) || (block_size > (int32_t)block.size()))
+    {
+        checkFailed(name, "compressed size is out of bound", size);
+        return;
+    }
+    block.resize(block_size);
+    checkBlock(name, plain, block);
+}
+
+static void checkCompression()
+{
+    if (!benchSelected("lz4/check"))
+    {
+        return;
+    }
+    std::string json;
+    for (int32_t i = 0; i < 24; ++i)
+    {
+        json += "{\"id\":" + std::to_string(i) + ",\"name\":\"vehicle.speed\",\"value\":" +
+                std::to_string(i * 31 % 97) + "},";
+    }
+    std::string mixed;
+    for (int32_t i = 0; i < 40; ++i)
+    {
+        mixed += (char)i;
+    }
+    for (int32_t i = 0; i < 150; ++i)
+    {
+        mixed += std::string("\x01\x02\x03\x04");
+    }
+    const CLZ4Vector vectors[] = {
+        {"literals", "FDBus", "504644427573"},
+        {"run", std::string(300, 'a'), "1f610100ff14506161616161"},
+        {"mixed", mixed,
+         "f019000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f20212223"
+         "2425262727000f0400ffff3e500401020304"},
+        {"json", json,
+         "f21b7b226964223a302c226e616d65223a2276656869636c652e7370656564222c2276616c75"
+         "65223a307d2c2a001f312a000d2433312b001f322b000d2436322b001f332b000d2439332b00"
+         "1f342b000d2432372b001f352b000d2435382b001f362b000d2438392b001f3781000e05ac00"
+         "1f3881000e14342b001f3981000e153583010fae010e1531ad001f31b0010e1635db010fb101"
+         "0e1538dc011f31b2010e1631b0000fb3010e2534362c000fb4010e1537df011f31b5010e1631"
+         "b0000fb6010e15348d021f31b7010e1537e2011f31b8010e05af001f32b7010e15338f021f32"
+         "b7010e1536e3011f32b7010e05ae001f32b6010d503a33347d2c"}
+    };
+
+    auto start = CNanoTimer::getNanoSecTimer();
+    for (int32_t i = 0; i < ARRAY_LENGTH(vectors); ++i)
+    {
+        checkBlock(vectors[i].mName, vectors[i].mPlain, fromHex(vectors[i].mBlock));
+        checkRoundTrip(vectors[i].mName, vectors[i].mPlain);
+    }
+
+    const int32_t sizes[] = {1, 12, 13, 100, 4096, 70000};
+    uint32_t seed = 1;
+    for (int32_t i = 0; i < ARRAY_LENGTH(sizes); ++i)
+    {
+        std::string random_data;
+        std::string text;
+        for (int32_t j = 0; j < sizes[i]; ++j)
+        {
+            random_data += (char)checkRandom(seed);
+            text += (char)('a' + checkRandom(seed) % 4);
+        }
+        checkRoundTrip("random", random_data);
+        checkRoundTrip("text", text);
+    }
+    // empty payload is never compressed but must not be decoded either
+    uint8_t empty = 0;
+    std::vector<uint8_t> dst;
+    if (checkDecompress("empty", &empty, 0, dst, 0) >= 0)
+    {
+        checkFailed("empty", "empty block is accepted", 0);
+    }
+
+    auto &result = addResult("lz4/check", ARRAY_LENGTH(vectors) + ARRAY_LENGTH(sizes) * 2,
+                             CNanoTimer::getNanoSecTimer() - start);
+    result.mParams.push_back(CBenchParam("failures", fdb_check_failures));
+}
+
+/*----------------------------- job queue ------------------------------*/
+static std::atomic<int32_t> fdb_pending_jobs;
+static CBaseSemaphore fdb_jobs_done(0);
+
+class CBenchJob : public CBaseJob
+{
+protected:
+    void run(CBaseWorker *worker, Ptr &ref)
+    {
+        if (--fdb_pending_jobs == 0)
+        {
+            fdb_jobs_done.post();
+        }
+    }
+};
+
+static void benchJobQueue()
+{
+    if (!benchSelected("worker/enqueue_dispatch"))
+    {
+        return;
+    }
+    CBaseWorker consumer("bench-consumer");
+    consumer.start();
+
+    static const int32_t producer_counts[] = {1, 2, 4, 8, 16};
+    for (uint32_t i = 0; i < ARRAY_LENGTH(producer_counts); ++i)
+    {
+        int32_t nr_producers = producer_counts[i];
+        int32_t jobs_per_producer = fdb_bench_iterations / nr_producers;
+        fdb_pending_jobs = jobs_per_producer * nr_producers;
+
+        std::vector<std::thread> producers;
+        auto start = CNanoTimer::getNanoSecTimer();
+        for (int32_t p = 0; p < nr_producers; ++p)
+        {
+            producers.push_back(std::thread([&consumer, jobs_per_producer]()
+                {
+                    for (int32_t j = 0; j < jobs_per_producer; ++j)
+                    {
+                        consumer.sendAsync(new CBenchJob());
+                    }
+                }));
+        }
+        for (auto it = producers.begin(); it != producers.end(); ++it)
+        {
+            it->join();
+        }
+        fdb_jobs_done.wait();
+        auto &result = addResult("worker/enqueue_dispatch", jobs_per_producer * nr_producers,
+                                 CNanoTimer::getNanoSecTimer() - start);
+        result.mParams.push_back(CBenchParam("producers", nr_producers));
+    }
+    consumer.exit();
+    consumer.join();
+}
+
+/*----------------------------- message migration ----------------------*/
+/*
+ * Count heap allocations of threads involved in a benchmark so that it can
+ * tell whether a path allocates at all. Other threads such as the context
+ * retrying name server are not counted.
+ */
+static std::atomic<uint64_t> fdb_alloc_count(0);
+static thread_local bool fdb_alloc_tracked = false;
+
+void *operator new(size_t size)
+{
+    if (fdb_alloc_tracked)
+    {
+        fdb_alloc_count.fetch_add(1, std::memory_order_relaxed);
+    }
+    auto ptr = malloc(size ? size : 1);
+    if (!ptr)
+    {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void operator delete(void *ptr) noexcept
+{
+    free(ptr);
+}
+
+static CBaseWorker *fdb_migrate_workers[2];
+static std::atomic<int32_t> fdb_pending_hops;
+static CBaseSemaphore fdb_hops_done(0);
+static tDispatcherCallbackFn fdb_migrate_fn;
+
+// bounce the message to the other worker until no hop is left
+static void migrateHop(CBaseJob::Ptr &msg_ref, CFdbBaseObject *obj)
+{
+    fdb_alloc_tracked = true;
+    auto hops = --fdb_pending_hops;
+    if (hops <= 0)
+    {
+        fdb_hops_done.post();
+        return;
+    }
+    auto msg = castToMessage<CFdbMessage *>(msg_ref);
+    fdbMigrateCallback(msg_ref, msg, fdb_migrate_fn, fdb_migrate_workers[hops & 1], obj);
+}
+
+static void runMigrateHops(CBaseJob::Ptr &msg_ref, int32_t hops)
+{
+    fdb_alloc_tracked = true;
+    fdb_pending_hops = hops;
+    auto msg = castToMessage<CFdbMessage *>(msg_ref);
+    fdbMigrateCallback(msg_ref, msg, fdb_migrate_fn, fdb_migrate_workers[0], 0);
+    fdb_hops_done.wait();
+}
+
+static void benchMigrate()
+{
+    if (!benchSelected("worker/migrate_message"))
+    {
+        return;
+    }
+    CBaseWorker ping("bench-ping");
+    CBaseWorker pong("bench-pong");
+    ping.start();
+    pong.start();
+    fdb_migrate_workers[0] = &ping;
+    fdb_migrate_workers[1] = &pong;
+    fdb_migrate_fn = migrateHop;
+
+    CBaseJob::Ptr msg_ref(new CBaseMessage(BENCH_METHOD_ECHO));
+    // warm up job queues and block pools of both workers
+    runMigrateHops(msg_ref, 1000);
+
+    auto allocs = fdb_alloc_count.load();
+    auto start = CNanoTimer::getNanoSecTimer();
+    runMigrateHops(msg_ref, fdb_bench_iterations);
+    auto elapsed = CNanoTimer::getNanoSecTimer() - start;
+    allocs = fdb_alloc_count.load() - allocs;
+
+    auto &result = addResult("worker/migrate_message", fdb_bench_iterations, elapsed);
+    result.mParams.push_back(CBenchParam("allocs", (int64_t)allocs));
+
+    ping.exit();
+    ping.join();
+    pong.exit();
+    pong.join();
+}
+
+/*----------------------------- fd event loop --------------------------*/
+static CBaseSemaphore fdb_wakeup_done(0);
+
+class CBenchHotWatch : public CBaseFdWatch
+{
+public:
+    CBenchHotWatch(int fd)
+        : CBaseFdWatch(fd, POLLIN)
+    {}
+protected:
+    void onInput(bool &io_error)
+    {
+        char buf[64];
+        while (read(descriptor(), buf, sizeof(buf)) > 0)
+        {
+        }
+        fdb_wakeup_done.post();
+    }
+};
+
+// disable and enable a watch from its worker, which rebuilds the poll set
+class CBenchToggleWatchJob : public CBaseJob
+{
+public:
+    CBenchToggleWatchJob(CBaseFdWatch *watch)
+        : mWatch(watch)
+    {}
+protected:
+    void run(CBaseWorker *worker, Ptr &ref)
+    {
+        mWatch->disable();
+        mWatch->enable();
+    }
+private:
+    CBaseFdWatch *mWatch;
+};
+
+static int32_t getMaxFds()
+{
+#ifdef __LINUX__
+    struct rlimit limit;
+    if (!getrlimit(RLIMIT_NOFILE, &limit))
+    {
+        if (limit.rlim_cur < limit.rlim_max)
+        {
+            limit.rlim_cur = limit.rlim_max;
+            setrlimit(RLIMIT_NOFILE, &limit);
+            getrlimit(RLIMIT_NOFILE, &limit);
+        }
+        return (int32_t)limit.rlim_cur;
+    }
+#endif
+    return 1024;
+}
+
+/*
+ * Time from writing the hot pipe till the hot watch is called. If
+ * changed_watch is given, it is toggled before each wakeup so that the
+ * cost of updating poll set for one changed watch is included.
+ */
+static void runWakeups(const char *name, int32_t nr_fds, CBaseWorker &loop,
+                       CBasePipe &hot_pipe, CBaseFdWatch *changed_watch)
+{
+    if (!benchSelected(name))
+    {
+        return;
+    }
+    int32_t iterations = fdb_bench_iterations / 10;
+    CFdbLatencyHistogram histogram;
+    char data = 0;
+    auto start = CNanoTimer::getNanoSecTimer();
+    for (int32_t j = 0; j < iterations; ++j)
+    {
+        auto wakeup_start = CNanoTimer::getNanoSecTimer();
+        if (changed_watch)
+        {
+            CBaseJob::Ptr job(new CBenchToggleWatchJob(changed_watch));
+            loop.sendSync(job);
+        }
+        hot_pipe.write(&data, 1);
+        fdb_wakeup_done.wait();
+        histogram.recordNano(wakeup_start, CNanoTimer::getNanoSecTimer());
+    }
+    auto &result = addResult(name, iterations, CNanoTimer::getNanoSecTimer() - start);
+    result.mParams.push_back(CBenchParam("fds", nr_fds));
+    histogram.summarize(result.mLatency);
+    result.mHasLatency = true;
+}
+
+static void benchFdLoop(const char *wakeup_name, const char *change_name, uint32_t flag)
+{
+    if (!benchSelected(wakeup_name) && !benchSelected(change_name))
+    {
+        return;
+    }
+    CBaseWorker loop("bench-fdloop");
+    loop.start(flag);
+
+    /*
+     * idle watches all poll dup()ed read end of a pipe which is never
+     * written; only the hot watch becomes readable.
+     */
+    CBasePipe idle_pipe;
+    CBasePipe hot_pipe;
+    if (!idle_pipe.open(false, true) || !hot_pipe.open(false, true))
+    {
+        fprintf(stderr, "%s: unable to create pipe!\n", wakeup_name);
+        return;
+    }
+    auto hot_watch = new CBenchHotWatch(dup(hot_pipe.getReadFd()));
+    hot_watch->attach(&loop, true);
+
+    // reserve fds for sockets, log and so on
+    int32_t max_watches = getMaxFds() - 64;
+    std::vector<CBaseFdWatch *> idle_watches;
+    static const int32_t fd_counts[] = {10, 100, 1000, 10000};
+    for (uint32_t i = 0; i < ARRAY_LENGTH(fd_counts); ++i)
+    {
+        int32_t nr_fds = fd_counts[i];
+        if (nr_fds > max_watches)
+        {
+            fprintf(stderr, "%s: skip %d fds due to RLIMIT_NOFILE.\n", wakeup_name, nr_fds);
+            break;
+        }
+        while ((int32_t)idle_watches.size() < nr_fds - 1)
+        {
+            auto watch = new CBaseFdWatch(dup(idle_pipe.getReadFd()), POLLIN);
+            watch->attach(&loop, true);
+            idle_watches.push_back(watch);
+        }
+
+        runWakeups(wakeup_name, nr_fds, loop, hot_pipe, 0);
+        runWakeups(change_name, nr_fds, loop, hot_pipe, idle_watches.front());
+    }
+
+    for (auto it = idle_watches.begin(); it != idle_watches.end(); ++it)
+    {
+        delete *it;
+    }
+    delete hot_watch;
+    loop.exit();
+    loop.join();
+}
+
+/*----------------------------- endpoints ------------------------------*/
+class CBenchServer : public CBaseServer
+{
+public:
+    CBenchServer()
+        : CBaseServer("org.fdbus.bench-server")
+    {}
+protected:
+    void onInvoke(CBaseJob::Ptr &msg_ref)
+    {
+        auto msg = castToMessage<CBaseMessage *>(msg_ref);
+        msg->reply(msg_ref, msg->getPayloadBuffer(), msg->getPayloadSize());
+    }
+};
+
+static std::atomic<int32_t> fdb_pending_events;
+static CBaseSemaphore fdb_events_done(0);
+
+class CBenchClient : public CBaseClient
+{
+public:
+    CBenchClient()
+        : CBaseClient("org.fdbus.bench-client")
+    {}
+protected:
+    void onBroadcast(CBaseJob::Ptr &msg_ref)
+    {
+        if (--fdb_pending_events == 0)
+        {
+            fdb_events_done.post();
+        }
+    }
+};
+
+static void benchRequestReply(const char *name, const char *url, int32_t block_size)
+{
+    if (!benchSelected(name))
+    {
+        return;
+    }
+    CBenchServer server;
+    CBenchClient client;
+    if (!fdbValidFdbId(server.bind(url)) || !fdbValidFdbId(client.connect(url)))
+    {
+        fprintf(stderr, "%s: unable to setup connection with %s!\n", name, url);
+        return;
+    }
+    std::vector<uint8_t> buffer(block_size, 0);
+    int32_t iterations = fdb_bench_iterations / 10;
+    CFdbLatencyHistogram histogram;
+    int32_t failures = 0;
+    auto start = CNanoTimer::getNanoSecTimer();
+    for (int32_t i = 0; i < iterations; ++i)
+    {
+        auto invoke_start = CNanoTimer::getNanoSecTimer();
+        CBaseJob::Ptr ref(new CBaseMessage(BENCH_METHOD_ECHO));
+        client.invoke(ref, buffer.data(), block_size, BENCH_TIMEOUT);
+        auto msg = castToMessage<CBaseMessage *>(ref);
+        if (msg->isStatus())
+        {
+            failures++;
+        }
+        histogram.recordNano(invoke_start, CNanoTimer::getNanoSecTimer());
+    }
+    auto &result = addResult(name, iterations, CNanoTimer::getNanoSecTimer() - start);
+    result.mParams.push_back(CBenchParam("block_size", block_size));
+    result.mParams.push_back(CBenchParam("failures", failures));
+    histogram.summarize(result.mLatency);
+    result.mHasLatency = true;
+
+    client.prepareDestroy();
+    server.prepareDestroy();
+}
+
+static void benchBroadcast(const char *name, const char *url, int32_t nr_subscribers,
+                           int32_t block_size)
+{
+    if (!benchSelected(name))
+    {
+        return;
+    }
+    CBenchServer server;
+    if (!fdbValidFdbId(server.bind(url)))
+    {
+        fprintf(stderr, "%s: unable to bind %s!\n", name, url);
+        return;
+    }
+    std::vector<CBenchClient *> clients;
+    for (int32_t i = 0; i < nr_subscribers; ++i)
+    {
+        auto client = new CBenchClient();
+        clients.push_back(client);
+        if (!fdbValidFdbId(client->connect(url)))
+        {
+            fprintf(stderr, "%s: unable to connect %s!\n", name, url);
+            break;
+        }
+        CFdbMsgSubscribeList sub_list;
+        client->addNotifyItem(sub_list, BENCH_EVENT_FANOUT);
+        client->subscribeSync(sub_list, BENCH_TIMEOUT);
+    }
+
+    if ((int32_t)clients.size() == nr_subscribers)
+    {
+        std::vector<uint8_t> buffer(block_size, 0);
+        // broadcast in bursts so that socket buffers never overflow
+        int32_t burst = 64;
+        int32_t iterations = (fdb_bench_iterations / 10 / nr_subscribers / burst + 1) * burst;
+        auto start = CNanoTimer::getNanoSecTimer();
+        for (int32_t i = 0; i < iterations; i += burst)
+        {
+            fdb_pending_events = burst * nr_subscribers;
+            for (int32_t j = 0; j < burst; ++j)
+            {
+                server.broadcast(BENCH_EVENT_FANOUT, buffer.data(), block_size);
+            }
+            if (!fdb_events_done.wait(BENCH_TIMEOUT))
+            {
+                fprintf(stderr, "%s: timeout waiting for broadcast!\n", name);
+                break;
+            }
+        }
+        auto &result = addResult(name, iterations, CNanoTimer::getNanoSecTimer() - start);
+        result.mParams.push_back(CBenchParam("subscribers", nr_subscribers));
+        result.mParams.push_back(CBenchParam("block_size", block_size));
+    }
+
+    for (auto it = clients.begin(); it != clients.end(); ++it)
+    {
+        (*it)->prepareDestroy();
+        delete *it;
+    }
+    server.prepareDestroy();
+}
+
+/*
+ * Fan-out of one event in isolation: CEventSubscribeHandle::broadcast()
+ * is called in place at context thread, so neither job queue nor
+ * receivers are included in the elapsed time.
+ */
+class CFanoutServer : public CBenchServer
+{
+public:
+    void fanout(const void *buffer, int32_t size)
+    {
+        broadcastNoQueue(BENCH_EVENT_FANOUT, (const uint8_t *)buffer, size, "",
+                         true, FDB_QOS_RELIABLE);
+    }
+};
+
+class CFanoutJob : public CBaseJob
+{
+public:
+    CFanoutJob(CFanoutServer *server, int32_t count, const std::vector<uint8_t> &buffer)
+        : mServer(server)
+        , mCount(count)
+        , mBuffer(buffer)
+        , mElapsed(0)
+    {}
+    uint64_t elapsed() const
+    {
+        return mElapsed;
+    }
+protected:
+    void run(CBaseWorker *worker, Ptr &ref)
+    {
+        auto start = CNanoTimer::getNanoSecTimer();
+        for (int32_t i = 0; i < mCount; ++i)
+        {
+            mServer->fanout(mBuffer.data(), (int32_t)mBuffer.size());
+        }
+        mElapsed = CNanoTimer::getNanoSecTimer() - start;
+    }
+private:
+    CFanoutServer *mServer;
+    int32_t mCount;
+    const std::vector<uint8_t> &mBuffer;
+    uint64_t mElapsed;
+};
+
+static void benchFanout(const char *name, const char *url, int32_t nr_subscribers,
+                        int32_t block_size)
+{
+    if (!benchSelected(name))
+    {
+        return;
+    }
+    CFanoutServer server;
+    if (!fdbValidFdbId(server.bind(url)))
+    {
+        fprintf(stderr, "%s: unable to bind %s!\n", name, url);
+        return;
+    }
+    std::vector<CBenchClient *> clients;
+    for (int32_t i = 0; i < nr_subscribers; ++i)
+    {
+        auto client = new CBenchClient();
+        clients.push_back(client);
+        if (!fdbValidFdbId(client->connect(url)))
+        {
+            fprintf(stderr, "%s: unable to connect %s!\n", name, url);
+            break;
+        }
+        CFdbMsgSubscribeList sub_list;
+        client->addNotifyItem(sub_list, BENCH_EVENT_FANOUT);
+        client->subscribeSync(sub_list, BENCH_TIMEOUT);
+    }
+
+    if ((int32_t)clients.size() == nr_subscribers)
+    {
+        std::vector<uint8_t> buffer(block_size, 0);
+        // broadcast in bursts so that socket buffers never overflow
+        int32_t burst = 64;
+        int32_t iterations = (fdb_bench_iterations / 10 / nr_subscribers / burst + 1) * burst;
+        uint64_t elapsed = 0;
+        for (int32_t i = 0; i < iterations; i += burst)
+        {
+            fdb_pending_events = burst * nr_subscribers;
+            auto job = new CFanoutJob(&server, burst, buffer);
+            CBaseJob::Ptr job_ref(job);
+            FDB_CONTEXT->sendSync(job_ref);
+            elapsed += job->elapsed();
+            if (!fdb_events_done.wait(BENCH_TIMEOUT))
+            {
+                fprintf(stderr, "%s: timeout waiting for broadcast!\n", name);
+                break;
+            }
+        }
+        auto &result = addResult(name, iterations, elapsed);
+        result.mParams.push_back(CBenchParam("subscribers", nr_subscribers));
+        result.mParams.push_back(CBenchParam("block_size", block_size));
+    }
+
+    for (auto it = clients.begin(); it != clients.end(); ++it)
+    {
+        (*it)->prepareDestroy();
+        delete *it;
+    }
+    server.prepareDestroy();
+}
+
+static void benchEndpoints()
+{
+    benchRequestReply("reqrep/ipc", BENCH_IPC_URL, 64);
+    benchRequestReply("reqrep/ipc", BENCH_IPC_URL, 4096);
+    benchRequestReply("reqrep/tcp", BENCH_TCP_URL, 64);
+    benchRequestReply("reqrep/tcp", BENCH_TCP_URL, 4096);
+
+    static const int32_t subscriber_counts[] = {1, 8, 32};
+    for (uint32_t i = 0; i < ARRAY_LENGTH(subscriber_counts); ++i)
+    {
+        benchBroadcast("broadcast/ipc", BENCH_IPC_URL, subscriber_counts[i], 64);
+    }
+    for (uint32_t i = 0; i < ARRAY_LENGTH(subscriber_counts); ++i)
+    {
+        benchBroadcast("broadcast/tcp", BENCH_TCP_URL, subscriber_counts[i], 64);
+    }
+    for (uint32_t i = 0; i < ARRAY_LENGTH(subscriber_counts); ++i)
+    {
+        benchFanout("fanout/ipc", BENCH_IPC_URL, subscriber_counts[i], 64);
+    }
+}
+
+int main(int argc, char **argv)
+{
+#ifdef __WIN32__
+    WORD wVersionRequested;
+    WSADATA wsaData;
+    int err;
+
+    /* Use the MAKEWORD(lowbyte, highbyte) macro declared in Windef.h */
+    wVersionRequested = MAKEWORD(2, 2);
+
+    err = WSAStartup(wVersionRequested, &wsaData);
+    if (err != 0)
+    {
+        /* Tell the user that we could not find a usable */
+        /* Winsock DLL.                                  */
+        printf("WSAStartup failed with error: %d\n", err);
+        return 1;
+    }
+#endif
+    int32_t help = 0;
+    const struct fdb_option core_options[] = {
+            { FDB_OPTION_INTEGER, "iterations", 'n', &fdb_bench_iterations },
+            { FDB_OPTION_STRING, "filter", 'f', &fdb_bench_filter },
+            { FDB_OPTION_STRING, "output", 'o', &fdb_bench_output },
+            { FDB_OPTION_BOOLEAN, "help", 'h', &help }
+    };
+
+    fdb_parse_options(core_options, ARRAY_LENGTH(core_options), &argc, argv);
+    if (help || (fdb_bench_iterations < 1000))
+    {
+        std::cout << "FDBus - Fast Distributed Bus" << std::endl;
+        std::cout << "    SDK version " << FDB_DEF_TO_STR(FDB_VERSION_MAJOR) "."
+                                           FDB_DEF_TO_STR(FDB_VERSION_MINOR) "."
+                                           FDB_DEF_TO_STR(FDB_VERSION_BUILD) << std::endl;
+        std::cout << "    LIB version " << CFdbContext::getFdbLibVersion() << std::endl;
+        std::cout << "Usage: fdbus_bench[ -n iterations][ -f filter][ -o output]" << std::endl;
+        std::cout << "Run micro benchmarks and print result in JSON" << std::endl;
+        std::cout << "    -n iterations: base number of iterations (>= 1000); 100000 by default" << std::endl;
+        std::cout << "    -f filter: only run benchmarks whose name contains filter" << std::endl;
+        std::cout << "    -o output: write JSON to file instead of stdout" << std::endl;
+        std::cout << "Exit with 1 if lz4/check finds LZ4 codec broken" << std::endl;
+        return 0;
+    }
+
+    FDB_CONTEXT->enableLogger(false);
+    FDB_CONTEXT->start();
+
+    benchSerializer();
+    benchMessageHead();
+    benchCompression();
+    checkCompression();
+    benchJobQueue();
+    benchMigrate();
+    benchFdLoop("fdloop/wakeup", "fdloop/watch_change", FDB_WORKER_ENABLE_FD_LOOP);
+    benchFdLoop("uringloop/wakeup", "uringloop/watch_change", FDB_WORKER_ENABLE_URING_LOOP);
+    benchEndpoints();
+
+    FILE *fp = stdout;
+    if (fdb_bench_output)
+    {
+        fp = fopen(fdb_bench_output, "w");
+        if (!fp)
+        {
+            fprintf(stderr, "Unable to open %s!\n", fdb_bench_output);
+            return -1;
+        }
+    }
+    printResults(fp);
+    if (fp != stdout)
+    {
+        fclose(fp);
+    }
+    exit(fdb_check_failures ? 1 : 0);
+}
@@ -39,7 +39,9 @@ int main(int argc, char **argv)
     }
 #endif
     int32_t help = 0;
+    int32_t warm_restart = 0;
 	const struct fdb_option core_options[] = {
+        { FDB_OPTION_BOOLEAN, "warm restart", 'w', &warm_restart },
         { FDB_OPTION_BOOLEAN, "help", 'h', &help }
     };
 
@@ -51,9 +53,10 @@ int main(int argc, char **argv)
                                            FDB_DEF_TO_STR(FDB_VERSION_MINOR) "."
                                            FDB_DEF_TO_STR(FDB_VERSION_BUILD) << std::endl;
         std::cout << "    LIB version " << CFdbContext::getFdbLibVersion() << std::endl;
-        std::cout << "Usage: host_server" << std::endl;
+        std::cout << "Usage: host_server[ -w]" << std::endl;
         std::cout << "    Start host server in case of multi-host." << std::endl;
         std::cout << "    Note that only one instance is needed to run for a multi-domain system." << std::endl;
+        std::cout << "    -w: keep tokens of hosts in snapshot so that they are recovered upon restart" << std::endl;
         return 0;
     }
 
@@ -65,6 +68,10 @@ int main(int argc, char **argv)
         return 0;
     }
 
+    if (warm_restart && !hs->enableSnapshot(CNsConfig::getHsSnapshotPath()))
+    {
+        std::cout << "Unable to open snapshot; warm restart is disabled." << std::endl;
+    }
     hs->bind();
     FDB_CONTEXT->start(FDB_WORKER_EXE_IN_PLACE);
     return 0;
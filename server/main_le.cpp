@@ -113,6 +113,17 @@ private:
             auto &event_info = *it;
             printf("| %-10d | %-32s | %-10d |\n", event_info.event(), event_info.topic().c_str(), event_info.size());
         }
+        if (event_tbl.has_stats())
+        {
+            auto &stats = event_tbl.stats();
+            printf("\nentries: %llu, bytes: %llu, budget: %llu\n",
+                   (unsigned long long)stats.entries(), (unsigned long long)stats.bytes(),
+                   (unsigned long long)stats.budget());
+            printf("hits: %llu, misses: %llu, updates: %llu, unchanged: %llu, evictions: %llu\n",
+                   (unsigned long long)stats.hits(), (unsigned long long)stats.misses(),
+                   (unsigned long long)stats.updates(), (unsigned long long)stats.unchanged(),
+                   (unsigned long long)stats.evictions());
+        }
     }
 };
 
@@ -25,12 +25,16 @@
 
 static int32_t ls_verbose = 0;
 static int32_t ls_follow = 0;
+static int32_t ls_delta = 0;
 
 class CNameServerProxy : public CBaseClient
 {
 public:
     CNameServerProxy()
         : CBaseClient(FDB_NAME_SERVER_NAME)
+        , mEpoch(0)
+        , mVersion(0)
+        , mQuerying(false)
     {
 
     }
@@ -105,10 +109,23 @@ protected:
                 }
             }
             break;
+            case NFdbBase::REQ_QUERY_SERVICE_DELTA:
+            {
+                NFdbBase::FdbMsgServiceDelta delta;
+                CFdbParcelableParser parser(delta);
+                if (!msg->deserialize(parser))
+                {
+                    LOG_E("CNameServerProxy: unable to decode NFdbBase::FdbMsgServiceDelta.\n");
+                    quit();
+                }
+                mQuerying = false;
+                applyDelta(delta);
+            }
+            break;
             default:
             break;
         }
-        if (!ls_follow)
+        if (!ls_follow && !ls_delta)
         {
             quit();
         }
@@ -128,40 +145,44 @@ protected:
                     LOG_E("CNameServerProxy: unable to decode NFdbBase::FdbMsgAddressList.\n");
                     return;
                 }
-                const char *location = msg_addr_list.is_local() ? "(local)" : "(remote)";
+                printAddressList(msg_addr_list);
                 
-                if (msg_addr_list.address_list().empty())
+                if (ls_verbose)
                 {
-                    std::cout << "[" << msg_addr_list.service_name()
-                              << "]@" << msg_addr_list.host_name() << location
-                              << " - Dropped" << std::endl;
+                    invoke(NFdbBase::REQ_QUERY_SERVICE);
                 }
-                else
+            }
+            break;
+            case NFdbBase::NTF_SERVICE_DELTA_MONITOR:
+            {
+                NFdbBase::FdbMsgServiceDelta delta;
+                CFdbParcelableParser parser(delta);
+                if (!msg->deserialize(parser))
                 {
-                    std::cout << "[" << msg_addr_list.service_name()
-                              << "]@" << msg_addr_list.host_name() << location
-                              << " - Online" << std::endl;
-                    auto &addr_list = msg_addr_list.address_list();
-                    for (auto it = addr_list.vpool().begin(); it != addr_list.vpool().end(); ++it)
-                    {
-                        if (it->has_udp_port() && FDB_VALID_PORT(it->udp_port()))
-                        {
-                            std::cout << "    > " << it->tcp_ipc_url()
-                                      << " udp://" << it->udp_port()
-                                      << std::endl;
-                        }
-                        else
-                        {
-                            std::cout << "    > " << it->tcp_ipc_url()
-                                      << std::endl;
-                        }
-                    }
+                    LOG_E("CNameServerProxy: unable to decode NFdbBase::FdbMsgServiceDelta.\n");
+                    return;
                 }
-                
-                if (ls_verbose)
+                if (mQuerying)
                 {
-                    invoke(NFdbBase::REQ_QUERY_SERVICE);
+                    // covered by the reply of query
+                    return;
+                }
+                if (!delta.full() && (delta.epoch() == mEpoch) && (delta.version() <= mVersion))
+                {
+                    return;
                 }
+                if (!delta.full() && ((delta.epoch() != mEpoch) || (delta.version() != mVersion + 1)))
+                {
+                    // some changes are lost: ask what happened since the last one received
+                    NFdbBase::FdbMsgRegistryVersion since;
+                    since.set_epoch(mEpoch);
+                    since.set_version(mVersion);
+                    CFdbParcelableBuilder builder(since);
+                    invoke(NFdbBase::REQ_QUERY_SERVICE_DELTA, builder);
+                    mQuerying = true;
+                    return;
+                }
+                applyDelta(delta);
             }
             break;
             default:
@@ -171,7 +192,14 @@ protected:
 
     void onOnline(FdbSessionId_t sid, bool is_first)
     {
-        if (ls_follow)
+        if (ls_delta)
+        {
+            mQuerying = false;
+            CFdbMsgSubscribeList subscribe_list;
+            addNotifyItem(subscribe_list, NFdbBase::NTF_SERVICE_DELTA_MONITOR);
+            subscribe(subscribe_list);
+        }
+        else if (ls_follow)
         {
             CFdbMsgSubscribeList subscribe_list;
             addNotifyItem(subscribe_list, NFdbBase::NTF_SERVICE_ONLINE_MONITOR);
@@ -184,10 +212,62 @@ protected:
     }
     
 private:
+    uint32_t mEpoch;
+    uint64_t mVersion;
+    bool mQuerying;
+
     void quit()
     {
         exit(0);
     }
+
+    void printAddressList(NFdbBase::FdbMsgAddressList &msg_addr_list)
+    {
+        const char *location = msg_addr_list.is_local() ? "(local)" : "(remote)";
+
+        if (msg_addr_list.address_list().empty())
+        {
+            std::cout << "[" << msg_addr_list.service_name()
+                      << "]@" << msg_addr_list.host_name() << location
+                      << " - Dropped" << std::endl;
+        }
+        else
+        {
+            std::cout << "[" << msg_addr_list.service_name()
+                      << "]@" << msg_addr_list.host_name() << location
+                      << " - Online" << std::endl;
+            auto &addr_list = msg_addr_list.address_list();
+            for (auto it = addr_list.vpool().begin(); it != addr_list.vpool().end(); ++it)
+            {
+                if (it->has_udp_port() && FDB_VALID_PORT(it->udp_port()))
+                {
+                    std::cout << "    > " << it->tcp_ipc_url()
+                              << " udp://" << it->udp_port()
+                              << std::endl;
+                }
+                else
+                {
+                    std::cout << "    > " << it->tcp_ipc_url()
+                              << std::endl;
+                }
+            }
+        }
+    }
+
+    void applyDelta(NFdbBase::FdbMsgServiceDelta &delta)
+    {
+        if (delta.full())
+        {
+            std::cout << "--- registry version " << delta.version() << " ---" << std::endl;
+        }
+        auto &change_list = delta.change_list();
+        for (auto it = change_list.vpool().begin(); it != change_list.vpool().end(); ++it)
+        {
+            printAddressList(*it);
+        }
+        mEpoch = delta.epoch();
+        mVersion = delta.version();
+    }
 };
 
 int main(int argc, char **argv)
@@ -213,6 +293,7 @@ int main(int argc, char **argv)
 	const struct fdb_option core_options[] = {
             { FDB_OPTION_BOOLEAN, "follow", 'f', &ls_follow },
             { FDB_OPTION_BOOLEAN, "verbose", 'v', &ls_verbose },
+            { FDB_OPTION_BOOLEAN, "delta", 'd', &ls_delta },
             { FDB_OPTION_BOOLEAN, "help", 'h', &help }
     };
 
@@ -224,10 +305,11 @@ int main(int argc, char **argv)
                                            FDB_DEF_TO_STR(FDB_VERSION_MINOR) "."
                                            FDB_DEF_TO_STR(FDB_VERSION_BUILD) << std::endl;
         std::cout << "    LIB version " << CFdbContext::getFdbLibVersion() << std::endl;
-        std::cout << "Usage: lssvc[ -f][ -v]" << std::endl;
+        std::cout << "Usage: lssvc[ -f][ -v][ -d]" << std::endl;
         std::cout << "List name of all services" << std::endl;
         std::cout << "    -f: keep monitoring service name" << std::endl;
         std::cout << "    -v: verbose mode" << std::endl;
+        std::cout << "    -d: keep monitoring changes of local services" << std::endl;
         return 0;
     }
 
@@ -46,12 +46,14 @@ int main(int argc, char **argv)
     int32_t help = 0;
     int32_t ret = 0;
     char *watchdog_params = 0;
+    int32_t warm_restart = 0;
     const struct fdb_option core_options[] = {
         { FDB_OPTION_STRING, "url", 'u', &tcp_addr },
         { FDB_OPTION_STRING, "name", 'n', &host_name },
         { FDB_OPTION_STRING, "interface ip list", 'i', &interface_ips },
         { FDB_OPTION_STRING, "interface name list", 'm', &interface_names },
         { FDB_OPTION_STRING, "watchdog", 'd', &watchdog_params },
+        { FDB_OPTION_BOOLEAN, "warm restart", 'w', &warm_restart },
         { FDB_OPTION_BOOLEAN, "help", 'h', &help }
     };
 
@@ -63,7 +65,7 @@ int main(int argc, char **argv)
                                            FDB_DEF_TO_STR(FDB_VERSION_MINOR) "."
                                            FDB_DEF_TO_STR(FDB_VERSION_BUILD) << std::endl;
         std::cout << "    LIB version " << CFdbContext::getFdbLibVersion() << std::endl;
-        std::cout << "Usage: name_server[ -n host_name][ -u host_url][ -i ip1,ip2...][ -m if_name1,if_name2...]" << std::endl;
+        std::cout << "Usage: name_server[ -n host_name][ -u host_url][ -i ip1,ip2...][ -m if_name1,if_name2...][ -w]" << std::endl;
         std::cout << "Service naming server" << std::endl;
         std::cout << "    -n host_name: host name of this machine" << std::endl;
         std::cout << "    -u host_url: the URL of host server to be connected" << std::endl;
@@ -71,6 +73,7 @@ int main(int argc, char **argv)
         std::cout << "    -m if_name1,if_name2...: interfaces to listen on in form of interface name" << std::endl;
         std::cout << "    -d interval:retries: enable watchdog and specify interval between feeding dog in ms (interval)" << std::endl;
         std::cout << "         and maximum number of retries (retries). If '0' is given, default value will be used." << std::endl;
+        std::cout << "    -w: keep registry in snapshot so that running services are recovered upon restart" << std::endl;
         return 0;
     }
 
@@ -105,6 +108,10 @@ int main(int argc, char **argv)
         std::cout << "Starting watchdog with interval " << wd_interval << " and retries " << wd_retries << std::endl;
         ns->startWatchdog(wd_interval, wd_retries);
     }
+    if (warm_restart && !ns->enableSnapshot(CNsConfig::getNsSnapshotPath()))
+    {
+        std::cout << "Unable to open snapshot; warm restart is disabled." << std::endl;
+    }
     if (!ns->online(tcp_addr, host_name, interface_ips_array, num_interface_ips,
                     interface_names_array, num_interface_names))
     {
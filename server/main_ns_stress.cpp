@@ -0,0 +1,370 @@
+/*
+ * Copyright (C) 2015   Jeremy Chen jeremy_cz@yahoo.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <iostream>
+#include <common_base/fdbus.h>
+#include <common_base/CNanoTimer.h>
+#include <common_base/fdb_option_parser.h>
+#include <server/CFdbIfNameServer.h>
+#include <utils/CNsConfig.h>
+#ifdef __LINUX__
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#endif
+
+/*
+ * Stress test of name server recovery. A number of processes are forked,
+ * each of which binds some services and connects some clients to services
+ * of other processes. Then name server is killed and started again, and
+ * the time until all services are registered and all clients are online
+ * again is measured. Result is printed as JSON.
+ */
+
+#define NS_STRESS_SVC_PREFIX        "stress-"
+#define NS_STRESS_POLL_INTERVAL     10
+#define NS_STRESS_QUERY_TIMEOUT     2000
+#define NS_STRESS_TIMEOUT           60000
+
+static int32_t ns_stress_processes = 500;
+static int32_t ns_stress_services = 1;
+static int32_t ns_stress_clients = 1;
+static int32_t ns_stress_rounds = 3;
+static int32_t ns_stress_downtime = 0;
+static int32_t ns_stress_warm = 0;
+static char *ns_stress_ns_path = 0;
+static char *ns_stress_output = 0;
+
+// number of clients online in all processes; shared by fork()
+static std::atomic<int32_t> *ns_stress_online_clients = 0;
+
+static uint64_t elapsedMs(uint64_t start)
+{
+    return (CNanoTimer::getNanoSecTimer() - start) / 1000000;
+}
+
+static std::string stressSvcName(int32_t process, int32_t service)
+{
+    return std::string(NS_STRESS_SVC_PREFIX) + std::to_string(process) + "-" + std::to_string(service);
+}
+
+class CStressServer : public CBaseServer
+{
+public:
+    CStressServer(const char *name)
+        : CBaseServer(name)
+    {}
+};
+
+class CStressClient : public CBaseClient
+{
+public:
+    CStressClient(const char *name)
+        : CBaseClient(name)
+    {}
+protected:
+    void onOnline(FdbSessionId_t sid, bool is_first)
+    {
+        ns_stress_online_clients->fetch_add(1);
+    }
+    void onOffline(FdbSessionId_t sid, bool is_last)
+    {
+        ns_stress_online_clients->fetch_sub(1);
+    }
+};
+
+class CNsMonitor : public CBaseClient
+{
+public:
+    CNsMonitor()
+        : CBaseClient(FDB_NAME_SERVER_NAME)
+    {}
+    // @return number of stress services having address; < 0 if name server is not reachable
+    int32_t countServices()
+    {
+        if (!connected() && (connect(CNsConfig::getNameServerIPCUrl()) == FDB_INVALID_ID))
+        {
+            return -1;
+        }
+        CBaseJob::Ptr ref(new CBaseMessage(NFdbBase::REQ_QUERY_SERVICE));
+        invoke(ref, 0, 0, NS_STRESS_QUERY_TIMEOUT);
+        auto msg = castToMessage<CBaseMessage *>(ref);
+        if (msg->isStatus())
+        {
+            return -1;
+        }
+        NFdbBase::FdbMsgServiceTable svc_tbl;
+        CFdbParcelableParser parser(svc_tbl);
+        if (!msg->deserialize(parser))
+        {
+            return -1;
+        }
+        int32_t count = 0;
+        auto &svc_list = svc_tbl.service_tbl();
+        for (auto it = svc_list.vpool().begin(); it != svc_list.vpool().end(); ++it)
+        {
+            auto &svc_addr = it->service_addr();
+            if (!svc_addr.service_name().compare(0, strlen(NS_STRESS_SVC_PREFIX), NS_STRESS_SVC_PREFIX) &&
+                !svc_addr.address_list().empty())
+            {
+                count++;
+            }
+        }
+        return count;
+    }
+};
+
+#ifdef __LINUX__
+static void raiseFdLimit()
+{
+    struct rlimit limit;
+    if (!getrlimit(RLIMIT_NOFILE, &limit) && (limit.rlim_cur < limit.rlim_max))
+    {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+static pid_t startNameServer()
+{
+    auto pid = fork();
+    if (pid == 0)
+    {
+        prctl(PR_SET_PDEATHSIG, SIGKILL);
+        const char *path = ns_stress_ns_path ? ns_stress_ns_path : "name_server";
+        if (ns_stress_warm)
+        {
+            execlp(path, path, "-w", (char *)0);
+        }
+        else
+        {
+            execlp(path, path, (char *)0);
+        }
+        fprintf(stderr, "Unable to start %s!\n", path);
+        _exit(1);
+    }
+    return pid;
+}
+
+static void stopNameServer(pid_t pid)
+{
+    kill(pid, SIGKILL);
+    waitpid(pid, 0, 0);
+}
+
+static pid_t startProcess(int32_t idx)
+{
+    auto pid = fork();
+    if (pid)
+    {
+        return pid;
+    }
+
+    prctl(PR_SET_PDEATHSIG, SIGKILL);
+    FDB_CONTEXT->enableLogger(false);
+    // measure recovery through name server only
+    FDB_CONTEXT->enableSvcAddrCache(false);
+    FDB_CONTEXT->start();
+    for (int32_t i = 0; i < ns_stress_services; ++i)
+    {
+        auto server = new CStressServer(stressSvcName(idx, i).c_str());
+        server->bind();
+    }
+    for (int32_t i = 0; i < ns_stress_clients; ++i)
+    {
+        auto peer = (idx + 1 + i) % ns_stress_processes;
+        auto client = new CStressClient((stressSvcName(idx, i) + "-client").c_str());
+        client->connect(("svc://" + stressSvcName(peer, i % ns_stress_services)).c_str());
+    }
+    while (true)
+    {
+        pause();
+    }
+    return 0;
+}
+
+/*
+ * Wait until all services are registered and all clients are online.
+ * @return: false if timeout
+ */
+static bool waitRecovery(CNsMonitor &monitor, uint64_t start, int64_t &ns_ready_ms,
+                         int64_t &services_ms, int64_t &clients_ms)
+{
+    int32_t nr_services = ns_stress_processes * ns_stress_services;
+    int32_t nr_clients = ns_stress_processes * ns_stress_clients;
+    ns_ready_ms = services_ms = clients_ms = -1;
+    while (elapsedMs(start) < NS_STRESS_TIMEOUT)
+    {
+        auto count = monitor.countServices();
+        if ((count >= 0) && (ns_ready_ms < 0))
+        {
+            ns_ready_ms = (int64_t)elapsedMs(start);
+        }
+        if ((count == nr_services) && (services_ms < 0))
+        {
+            services_ms = (int64_t)elapsedMs(start);
+        }
+        if ((ns_stress_online_clients->load() == nr_clients) && (services_ms >= 0))
+        {
+            clients_ms = (int64_t)elapsedMs(start);
+            return true;
+        }
+        sysdep_sleep(NS_STRESS_POLL_INTERVAL);
+    }
+    return false;
+}
+#endif
+
+int main(int argc, char **argv)
+{
+    int32_t help = 0;
+    const struct fdb_option core_options[] = {
+            { FDB_OPTION_INTEGER, "processes", 'p', &ns_stress_processes },
+            { FDB_OPTION_INTEGER, "services", 's', &ns_stress_services },
+            { FDB_OPTION_INTEGER, "clients", 'c', &ns_stress_clients },
+            { FDB_OPTION_INTEGER, "rounds", 'r', &ns_stress_rounds },
+            { FDB_OPTION_INTEGER, "downtime", 'd', &ns_stress_downtime },
+            { FDB_OPTION_BOOLEAN, "warm restart", 'w', &ns_stress_warm },
+            { FDB_OPTION_STRING, "name server", 'n', &ns_stress_ns_path },
+            { FDB_OPTION_STRING, "output", 'o', &ns_stress_output },
+            { FDB_OPTION_BOOLEAN, "help", 'h', &help }
+    };
+
+    fdb_parse_options(core_options, ARRAY_LENGTH(core_options), &argc, argv);
+    if (help || (ns_stress_processes < 1) || (ns_stress_services < 1) || (ns_stress_clients < 0))
+    {
+        std::cout << "FDBus - Fast Distributed Bus" << std::endl;
+        std::cout << "    SDK version " << FDB_DEF_TO_STR(FDB_VERSION_MAJOR) "."
+                                           FDB_DEF_TO_STR(FDB_VERSION_MINOR) "."
+                                           FDB_DEF_TO_STR(FDB_VERSION_BUILD) << std::endl;
+        std::cout << "    LIB version " << CFdbContext::getFdbLibVersion() << std::endl;
+        std::cout << "Usage: fdbnsstress[ -p processes][ -s services][ -c clients][ -r rounds][ -d downtime][ -w][ -n name_server][ -o output]" << std::endl;
+        std::cout << "Measure time for services and clients to recover from restart of name server" << std::endl;
+        std::cout << "    -p processes: number of processes; 500 by default" << std::endl;
+        std::cout << "    -s services: services bound by each process; 1 by default" << std::endl;
+        std::cout << "    -c clients: clients connected by each process to services of others; 1 by default" << std::endl;
+        std::cout << "    -r rounds: times name server is restarted; 3 by default" << std::endl;
+        std::cout << "    -d downtime: ms name server stays dead before restart; 0 by default" << std::endl;
+        std::cout << "    -w: start name server with warm restart" << std::endl;
+        std::cout << "    -n name_server: path of name server; found in PATH by default" << std::endl;
+        std::cout << "    -o output: write JSON to file instead of stdout" << std::endl;
+        std::cout << "Note that name server should not be running." << std::endl;
+        return 0;
+    }
+
+#ifdef __LINUX__
+    raiseFdLimit();
+    ns_stress_online_clients = (std::atomic<int32_t> *)mmap(0, sizeof(std::atomic<int32_t>),
+                                                           PROT_READ | PROT_WRITE,
+                                                           MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (ns_stress_online_clients == MAP_FAILED)
+    {
+        fprintf(stderr, "Unable to map counter!\n");
+        return -1;
+    }
+    new (ns_stress_online_clients) std::atomic<int32_t>(0);
+
+    // fork everything before any thread is created
+    auto ns_pid = startNameServer();
+    sysdep_sleep(200);
+    auto start = CNanoTimer::getNanoSecTimer();
+    std::vector<pid_t> processes;
+    for (int32_t i = 0; i < ns_stress_processes; ++i)
+    {
+        processes.push_back(startProcess(i));
+    }
+
+    FDB_CONTEXT->enableNameProxy(false);
+    FDB_CONTEXT->enableLogger(false);
+    FDB_CONTEXT->start();
+    CNsMonitor monitor;
+
+    int64_t ns_ready_ms;
+    int64_t services_ms;
+    int64_t clients_ms;
+    bool success = waitRecovery(monitor, start, ns_ready_ms, services_ms, clients_ms);
+    int64_t startup_ms = clients_ms;
+
+    std::vector<int64_t> results;
+    for (int32_t i = 0; success && (i < ns_stress_rounds); ++i)
+    {
+        start = CNanoTimer::getNanoSecTimer();
+        stopNameServer(ns_pid);
+        if (ns_stress_downtime > 0)
+        {
+            sysdep_sleep(ns_stress_downtime);
+        }
+        ns_pid = startNameServer();
+        success = waitRecovery(monitor, start, ns_ready_ms, services_ms, clients_ms);
+        results.push_back(ns_ready_ms);
+        results.push_back(services_ms);
+        results.push_back(clients_ms);
+    }
+
+    FILE *fp = stdout;
+    if (ns_stress_output)
+    {
+        fp = fopen(ns_stress_output, "w");
+        if (!fp)
+        {
+            fprintf(stderr, "Unable to open %s!\n", ns_stress_output);
+            fp = stdout;
+        }
+    }
+    fprintf(fp, "{\n");
+    fprintf(fp, "  \"processes\": %d,\n", ns_stress_processes);
+    fprintf(fp, "  \"services\": %d,\n", ns_stress_processes * ns_stress_services);
+    fprintf(fp, "  \"clients\": %d,\n", ns_stress_processes * ns_stress_clients);
+    fprintf(fp, "  \"warm_restart\": %s,\n", ns_stress_warm ? "true" : "false");
+    fprintf(fp, "  \"startup_ms\": %lld,\n", (long long)startup_ms);
+    fprintf(fp, "  \"rounds\": [");
+    for (uint32_t i = 0; i < results.size(); i += 3)
+    {
+        fprintf(fp, "%s\n    {\"ns_ready_ms\": %lld, \"services_ms\": %lld, \"clients_ms\": %lld}",
+                i ? "," : "", (long long)results[i], (long long)results[i + 1], (long long)results[i + 2]);
+    }
+    fprintf(fp, "\n  ],\n");
+    fprintf(fp, "  \"success\": %s\n", success ? "true" : "false");
+    fprintf(fp, "}\n");
+    if (fp != stdout)
+    {
+        fclose(fp);
+    }
+
+    for (auto it = processes.begin(); it != processes.end(); ++it)
+    {
+        kill(*it, SIGKILL);
+    }
+    for (auto it = processes.begin(); it != processes.end(); ++it)
+    {
+        waitpid(*it, 0, 0);
+    }
+    stopNameServer(ns_pid);
+    exit(success ? 0 : 1);
+#else
+    fprintf(stderr, "fdbnsstress is only supported on linux.\n");
+    return -1;
+#endif
+}
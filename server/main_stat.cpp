@@ -0,0 +1,180 @@
+/*
+ * Copyright (C) 2015   Jeremy Chen jeremy_cz@yahoo.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string>
+#include <common_base/CFdbContext.h>
+#include <common_base/CBaseClient.h>
+#include <common_base/CFdbLatencyHistogram.h>
+#include "CFdbIfNameServer.h"
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <utils/Log.h>
+
+static const char *fdb_endpoint_name = "org.fdbus.latency-fetcher";
+
+class CLatencyFetcher : public CBaseClient
+{
+public:
+    CLatencyFetcher(const char *name)
+        : CBaseClient(name)
+    {
+    }
+    ~CLatencyFetcher()
+    {
+        disconnect();
+    }
+
+protected:
+    void onSidebandReply(CBaseJob::Ptr &msg_ref)
+    {
+        auto msg = castToMessage<CFdbMessage *>(msg_ref);
+        if (msg->isStatus())
+        {
+            if (msg->isError())
+            {
+                int32_t id;
+                std::string reason;
+                msg->decodeStatus(id, reason);
+                LOG_I("CLatencyFetcher: status is received: msg code: %d, id: %d, reason: %s\n", msg->code(), id, reason.c_str());
+            }
+            quit();
+            return;
+        }
+
+        switch (msg->code())
+        {
+            case FDB_SIDEBAND_QUERY_LATENCY:
+            {
+                NFdbBase::FdbMsgLatencyStats stats;
+                CFdbParcelableParser parser(stats);
+                if (!msg->deserialize(parser))
+                {
+                    fprintf(stderr, "CLatencyFetcher: unable to decode NFdbBase::FdbMsgLatencyStats.\n");
+                    quit();
+                }
+                printLatency(stats);
+                quit();
+            }
+            break;
+            default:
+            break;
+        }
+    }
+
+    void onOnline(FdbSessionId_t sid, bool is_first)
+    {
+        if (isPrimary())
+        {
+            invokeSideband(FDB_SIDEBAND_QUERY_LATENCY);
+        }
+    }
+
+private:
+    void quit()
+    {
+        exit(0);
+    }
+
+    static const char *latencyTypeName(int32_t type)
+    {
+        static const char *type_name[] = {"client->server", "server process", "total"};
+        if ((type >= 0) && (type < FDB_LATENCY_MAX))
+        {
+            return type_name[type];
+        }
+        return "unknown";
+    }
+
+    static void printSummary(NFdbBase::FdbMsgLatencySummary &latency)
+    {
+        printf("%-10llu | %-8llu | %-8llu | %-8llu | %-8llu | %-8llu | %-9llu | %-8llu |\n",
+               (unsigned long long)latency.count(), (unsigned long long)latency.min(),
+               (unsigned long long)latency.mean(), (unsigned long long)latency.p50(),
+               (unsigned long long)latency.p90(), (unsigned long long)latency.p99(),
+               (unsigned long long)latency.p999(), (unsigned long long)latency.max());
+    }
+
+    void printLatency(NFdbBase::FdbMsgLatencyStats &stats)
+    {
+        printf("Endpoint: %s (latency in us)\n", stats.endpoint_name().c_str());
+        printf("| %-10s | %-16s | %-10s | %-8s | %-8s | %-8s | %-8s | %-8s | %-9s | %-8s |\n",
+               "**CODE**", "**TYPE**", "**COUNT**", "**MIN**", "**MEAN**",
+               "**P50**", "**P90**", "**P99**", "**P99.9**", "**MAX**");
+        auto &methods = stats.methods();
+        for (auto it = methods.vpool().begin(); it != methods.vpool().end(); ++it)
+        {
+            printf("| %-10d | %-16s | ", it->code(), latencyTypeName(it->type()));
+            printSummary(it->latency());
+        }
+
+        printf("\n| %-29s | %-10s | %-8s | %-8s | %-8s | %-8s | %-8s | %-9s | %-8s |\n",
+               "**QUEUE WAIT OF WORKER**", "**COUNT**", "**MIN**", "**MEAN**",
+               "**P50**", "**P90**", "**P99**", "**P99.9**", "**MAX**");
+        auto &queue_wait = stats.queue_wait();
+        for (auto it = queue_wait.vpool().begin(); it != queue_wait.vpool().end(); ++it)
+        {
+            printf("| %-29s | ", it->worker_name().c_str());
+            printSummary(it->latency());
+        }
+    }
+};
+
+int main(int argc, char **argv)
+{
+#ifdef __WIN32__
+    WORD wVersionRequested;
+    WSADATA wsaData;
+    int err;
+
+    /* Use the MAKEWORD(lowbyte, highbyte) macro declared in Windef.h */
+    wVersionRequested = MAKEWORD(2, 2);
+
+    err = WSAStartup(wVersionRequested, &wsaData);
+    if (err != 0)
+    {
+        /* Tell the user that we could not find a usable */
+        /* Winsock DLL.                                  */
+        printf("WSAStartup failed with error: %d\n", err);
+        return 1;
+    }
+#endif
+    if (argc <= 1)
+    {
+        std::cout << "FDBus - Fast Distributed Bus" << std::endl;
+        std::cout << "    SDK version " << FDB_DEF_TO_STR(FDB_VERSION_MAJOR) "."
+                                           FDB_DEF_TO_STR(FDB_VERSION_MINOR) "."
+                                           FDB_DEF_TO_STR(FDB_VERSION_BUILD) << std::endl;
+        std::cout << "    LIB version " << CFdbContext::getFdbLibVersion() << std::endl;
+        std::cout << "Usage: fdbstat service_name" << std::endl;
+        std::cout << "List latency of each method and queue wait of workers of specified server" << std::endl;
+        return 0;
+    }
+
+    char *server_name = argv[1];
+
+    FDB_CONTEXT->enableLogger(false);
+    FDB_CONTEXT->init();
+
+    std::string server_addr;
+    server_addr = FDB_URL_SVC;
+    server_addr += server_name;
+    auto fetcher = new CLatencyFetcher(fdb_endpoint_name);
+    fetcher->connect(server_addr.c_str());
+
+    FDB_CONTEXT->start(FDB_WORKER_EXE_IN_PLACE);
+    return 0;
+}
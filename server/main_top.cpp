@@ -0,0 +1,316 @@
+/*
+ * Copyright (C) 2015   Jeremy Chen jeremy_cz@yahoo.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <common_base/CFdbContext.h>
+#include <common_base/CBaseClient.h>
+#include <common_base/CBaseLoopTimer.h>
+#include <common_base/CFdbMessage.h>
+#include <server/CFdbIfNameServer.h>
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <common_base/fdb_option_parser.h>
+#include <utils/Log.h>
+
+static const char *fdb_endpoint_name = "org.fdbus.traffic-fetcher";
+static int32_t fdb_top_count = 10;
+static int32_t fdb_sort_by_msgs = 0;
+static int32_t fdb_query_timeout = 3000;
+
+struct CTalker
+{
+    std::string mServerName;
+    std::string mPeerName;
+    uint32_t mPid;
+    uint32_t mPendingMsgs;
+    uint64_t mMsgsIn;
+    uint64_t mMsgsOut;
+    uint64_t mBytesIn;
+    uint64_t mBytesOut;
+    uint64_t mSendRetries;
+    uint64_t mSendBlockedTime;
+
+    uint64_t msgs() const
+    {
+        return mMsgsIn + mMsgsOut;
+    }
+    uint64_t bytes() const
+    {
+        return mBytesIn + mBytesOut;
+    }
+};
+
+struct CServerLoad
+{
+    std::string mServerName;
+    uint32_t mContextJobs;
+    uint32_t mWorkerJobs;
+    uint64_t mMsgs;
+    uint64_t mBytes;
+};
+
+static std::vector<CTalker> fdb_talkers;
+static std::vector<CServerLoad> fdb_servers;
+static int32_t fdb_pending_queries = 0;
+
+static void fillTalker(CTalker &talker, NFdbBase::FdbMsgTraffic &traffic)
+{
+    talker.mMsgsIn = talker.mMsgsOut = talker.mBytesIn = talker.mBytesOut = 0;
+    auto &types = traffic.types();
+    for (auto it = types.vpool().begin(); it != types.vpool().end(); ++it)
+    {
+        talker.mMsgsIn += it->msgs_in();
+        talker.mMsgsOut += it->msgs_out();
+        talker.mBytesIn += it->bytes_in();
+        talker.mBytesOut += it->bytes_out();
+    }
+    talker.mSendRetries = traffic.send_retries();
+    talker.mSendBlockedTime = traffic.send_blocked_time();
+}
+
+static bool compareTalker(const CTalker &a, const CTalker &b)
+{
+    return fdb_sort_by_msgs ? (a.msgs() > b.msgs()) : (a.bytes() > b.bytes());
+}
+
+static bool compareServer(const CServerLoad &a, const CServerLoad &b)
+{
+    return fdb_sort_by_msgs ? (a.mMsgs > b.mMsgs) : (a.mBytes > b.mBytes);
+}
+
+static void printTopTalkers()
+{
+    std::sort(fdb_talkers.begin(), fdb_talkers.end(), compareTalker);
+    std::sort(fdb_servers.begin(), fdb_servers.end(), compareServer);
+
+    printf("| %-32s | %-32s | %-8s | %-10s | %-10s | %-12s | %-12s | %-8s | %-8s | %-12s |\n",
+           "**SERVICE**", "**CLIENT**", "**PID**", "**MSG IN**", "**MSG OUT**",
+           "**BYTE IN**", "**BYTE OUT**", "**PEND**", "**RETRY**", "**BLOCK(us)**");
+    int32_t count = 0;
+    for (auto it = fdb_talkers.begin(); (it != fdb_talkers.end()) && (count < fdb_top_count); ++it, ++count)
+    {
+        printf("| %-32s | %-32s | %-8u | %-10llu | %-10llu | %-12llu | %-12llu | %-8u | %-8llu | %-12llu |\n",
+               it->mServerName.c_str(), it->mPeerName.c_str(), it->mPid,
+               (unsigned long long)it->mMsgsIn, (unsigned long long)it->mMsgsOut,
+               (unsigned long long)it->mBytesIn, (unsigned long long)it->mBytesOut,
+               it->mPendingMsgs, (unsigned long long)it->mSendRetries,
+               (unsigned long long)it->mSendBlockedTime);
+    }
+
+    printf("\n| %-32s | %-12s | %-12s | %-14s | %-15s |\n",
+           "**SERVICE**", "**MSGS**", "**BYTES**", "**CTX JOBS**", "**WORKER JOBS**");
+    for (auto it = fdb_servers.begin(); it != fdb_servers.end(); ++it)
+    {
+        printf("| %-32s | %-12llu | %-12llu | %-14u | %-15u |\n",
+               it->mServerName.c_str(), (unsigned long long)it->mMsgs,
+               (unsigned long long)it->mBytes, it->mContextJobs, it->mWorkerJobs);
+    }
+    exit(0);
+}
+
+class CTrafficFetcher : public CBaseClient
+{
+public:
+    CTrafficFetcher()
+        : CBaseClient(fdb_endpoint_name)
+    {
+    }
+
+protected:
+    void onSidebandReply(CBaseJob::Ptr &msg_ref)
+    {
+        auto msg = castToMessage<CFdbMessage *>(msg_ref);
+        if (!msg->isStatus() && (msg->code() == FDB_SIDEBAND_QUERY_TRAFFIC))
+        {
+            NFdbBase::FdbMsgTrafficStats stats;
+            CFdbParcelableParser parser(stats);
+            if (msg->deserialize(parser))
+            {
+                addStats(stats);
+            }
+            else
+            {
+                fprintf(stderr, "CTrafficFetcher: unable to decode NFdbBase::FdbMsgTrafficStats.\n");
+            }
+        }
+
+        if (--fdb_pending_queries <= 0)
+        {
+            printTopTalkers();
+        }
+    }
+
+    void onOnline(FdbSessionId_t sid, bool is_first)
+    {
+        if (isPrimary())
+        {
+            invokeSideband(FDB_SIDEBAND_QUERY_TRAFFIC);
+        }
+    }
+
+private:
+    void addStats(NFdbBase::FdbMsgTrafficStats &stats)
+    {
+        CTalker server_total;
+        fillTalker(server_total, stats.traffic());
+        CServerLoad load;
+        load.mServerName = stats.server_name();
+        load.mContextJobs = stats.context_jobs();
+        load.mWorkerJobs = stats.worker_jobs();
+        load.mMsgs = server_total.msgs();
+        load.mBytes = server_total.bytes();
+        fdb_servers.push_back(load);
+
+        auto &sessions = stats.sessions();
+        for (auto it = sessions.vpool().begin(); it != sessions.vpool().end(); ++it)
+        {
+            if (!it->peer_name().compare(fdb_endpoint_name))
+            {
+                continue;
+            }
+            CTalker talker;
+            talker.mServerName = stats.server_name();
+            talker.mPeerName = it->peer_name();
+            talker.mPid = it->pid();
+            talker.mPendingMsgs = it->pending_msgs();
+            fillTalker(talker, it->traffic());
+            fdb_talkers.push_back(talker);
+        }
+    }
+};
+
+class CQueryTimer : public CBaseLoopTimer
+{
+public:
+    CQueryTimer()
+        : CBaseLoopTimer(fdb_query_timeout, false)
+    {
+    }
+protected:
+    void run()
+    {
+        // print whatever has been collected; some servers do not respond
+        printTopTalkers();
+    }
+};
+
+class CNameServerProxy : public CBaseClient
+{
+public:
+    CNameServerProxy()
+        : CBaseClient(FDB_NAME_SERVER_NAME)
+    {
+    }
+protected:
+    void onOnline(FdbSessionId_t sid, bool is_first)
+    {
+        invoke(NFdbBase::REQ_QUERY_SERVICE);
+    }
+
+    void onReply(CBaseJob::Ptr &msg_ref)
+    {
+        auto msg = castToMessage<CFdbMessage *>(msg_ref);
+        if (msg->isStatus() || (msg->code() != NFdbBase::REQ_QUERY_SERVICE))
+        {
+            return;
+        }
+        NFdbBase::FdbMsgServiceTable svc_tbl;
+        CFdbParcelableParser parser(svc_tbl);
+        if (!msg->deserialize(parser))
+        {
+            LOG_E("CNameServerProxy: unable to decode NFdbBase::FdbMsgServiceTable.\n");
+            exit(-1);
+        }
+
+        auto &svc_list = svc_tbl.service_tbl();
+        for (auto svc_it = svc_list.vpool().begin(); svc_it != svc_list.vpool().end(); ++svc_it)
+        {
+            auto &service_addr = svc_it->service_addr();
+            if (!service_addr.is_local())
+            {
+                continue;
+            }
+            std::string server_addr = FDB_URL_SVC;
+            server_addr += service_addr.service_name();
+            auto fetcher = new CTrafficFetcher();
+            fetcher->connect(server_addr.c_str());
+            fdb_pending_queries++;
+        }
+
+        if (!fdb_pending_queries)
+        {
+            printTopTalkers();
+        }
+        mTimer.attach(FDB_CONTEXT, true);
+    }
+private:
+    CQueryTimer mTimer;
+};
+
+int main(int argc, char **argv)
+{
+#ifdef __WIN32__
+    WORD wVersionRequested;
+    WSADATA wsaData;
+    int err;
+
+    /* Use the MAKEWORD(lowbyte, highbyte) macro declared in Windef.h */
+    wVersionRequested = MAKEWORD(2, 2);
+
+    err = WSAStartup(wVersionRequested, &wsaData);
+    if (err != 0)
+    {
+        /* Tell the user that we could not find a usable */
+        /* Winsock DLL.                                  */
+        printf("WSAStartup failed with error: %d\n", err);
+        return 1;
+    }
+#endif
+    int32_t help = 0;
+    const struct fdb_option core_options[] = {
+            { FDB_OPTION_INTEGER, "number", 'n', &fdb_top_count },
+            { FDB_OPTION_BOOLEAN, "messages", 'm', &fdb_sort_by_msgs },
+            { FDB_OPTION_INTEGER, "timeout", 't', &fdb_query_timeout },
+            { FDB_OPTION_BOOLEAN, "help", 'h', &help }
+    };
+
+    fdb_parse_options(core_options, ARRAY_LENGTH(core_options), &argc, argv);
+    if (help)
+    {
+        std::cout << "FDBus - Fast Distributed Bus" << std::endl;
+        std::cout << "    SDK version " << FDB_DEF_TO_STR(FDB_VERSION_MAJOR) "."
+                                           FDB_DEF_TO_STR(FDB_VERSION_MINOR) "."
+                                           FDB_DEF_TO_STR(FDB_VERSION_BUILD) << std::endl;
+        std::cout << "    LIB version " << CFdbContext::getFdbLibVersion() << std::endl;
+        std::cout << "Usage: fdbtop[ -n number][ -m][ -t timeout]" << std::endl;
+        std::cout << "List clients generating most traffic on all local services" << std::endl;
+        std::cout << "    -n number: how many clients are listed; 10 by default" << std::endl;
+        std::cout << "    -m: sort by number of messages; otherwise by bytes" << std::endl;
+        std::cout << "    -t timeout: time in ms waiting for services to respond" << std::endl;
+        return 0;
+    }
+
+    FDB_CONTEXT->enableLogger(false);
+    FDB_CONTEXT->init();
+
+    CNameServerProxy nsp;
+    nsp.connect();
+    FDB_CONTEXT->start(FDB_WORKER_EXE_IN_PLACE);
+    return 0;
+}
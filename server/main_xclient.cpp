@@ -18,403 +18,677 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <iostream>
-#include <common_base/fdbus.h>
+#include <vector>
+#include <atomic>
 #include <mutex>
-#include <list>
+#include <random>
+#include <common_base/fdbus.h>
+#include <common_base/CFdbLatencyHistogram.h>
+#include <common_base/cJSON/cJSON.h>
+
+/*
+ * Load generator of fdbxserver. Traffic is described by a scenario file
+ * (see example/config/fdbxclient.json) or by command line options.
+ *
+ * Requests are issued open-loop: each sender thread has a fixed schedule
+ * derived from target rate and latency is measured from the time a message
+ * was *supposed* to be sent rather than when it was actually sent. So if
+ * the client falls behind because of a stalled bus, the stall is charged
+ * to every message waiting behind it (no coordinated omission).
+ *
+ * The intended send time travels inside the payload and is checked by the
+ * receiver, so no per-message bookkeeping is needed at sender side. Each
+ * thread records into its own histograms which are merged at the end.
+ */
 
 #define XCLT_TEST_SINGLE_DIRECTION 0
 #define XCLT_TEST_BI_DIRECTION     1
-#define XCLT_INIT_SKIP_COUNT       16
 
-class CXTestJob : public CBaseJob
+#define XCLT_MIN_PAYLOAD_SIZE      16
+#define XCLT_MAX_PAYLOAD_SIZE      (1024 * 1024)
+#define XCLT_ONLINE_TIMEOUT        10000
+#define XCLT_DRAIN_TIMEOUT         3000
+
+enum EXKind
 {
-public:
-    CXTestJob()
-    {}
-protected:
-    void run(CBaseWorker* worker, Ptr& ref);
+    XKIND_INVOKE,   // request/reply over TCP/UDS
+    XKIND_SEND,     // one-way message broadcast back to subscribers over TCP/UDS
+    XKIND_UDP,      // one-way message broadcast back to subscribers over UDP
+    XKIND_MAX
 };
 
-class CUDPSenderTimer : public CNanoTimer
+static const char *fdb_kind_names[XKIND_MAX] = {"invoke", "send", "udp"};
+
+enum EXPayloadDistribution
 {
-public:
-    CUDPSenderTimer()
-        : mSn(0)
-    {}
-    CUDPSenderTimer(uint32_t sn)
-        : mSn(sn)
-    {}
-    uint32_t mSn;
+    XPAYLOAD_FIXED,
+    XPAYLOAD_UNIFORM,
+    XPAYLOAD_EXPONENTIAL,
+    XPAYLOAD_WEIGHTED
 };
 
-class CXClient;
-static CXClient *fdb_xtest_client;
-static CBaseWorker *fdb_worker_A;
-static CBaseWorker *fdb_worker_B;
-static CBaseWorker *fdb_statistic_worker;
-static bool fdb_stop_job = false;
-
-static uint32_t fdb_burst_size = 16;
-static bool fdb_udp_test = false;
-static uint32_t fdb_block_size = 1024;
-static uint32_t fdb_delay = 0;
-static bool fdb_sync_invoke = false;
-static std::mutex fdb_ts_mutex;
-static std::list<CUDPSenderTimer *> fdb_timestamps;
-static int32_t fdb_init_skip_count = XCLT_INIT_SKIP_COUNT;
-
-class CStatisticTimer : public CMethodLoopTimer<CXClient>
+struct CXPayloadSize
 {
-public:
-    CStatisticTimer(CXClient *client);
+    uint32_t mSize;
+    uint32_t mWeight;
 };
 
-class CXClient : public CBaseClient
+struct CXScenario
 {
-public:
-    CXClient(const char *name, CBaseWorker *worker = 0)
-        : CBaseClient(name, worker)
-        , mFailureCount(0)
-    {
-        /* create the request timer, attach to a worker thread, but do not start it */
-        mTimer = new CStatisticTimer(this);
-        mTimer->attach(fdb_statistic_worker, false);
-        mBuffer = (uint8_t *)malloc(fdb_block_size);
-        memset(mBuffer, 0, fdb_block_size);
-        resetTotal();
-        enableUDP(true);
-        enableTimeStamp(true);
-    }
-    void doStatistic(CMethodLoopTimer<CXClient> *timer)
-    {
-        static bool title_printed = false;
-        if (!title_printed)
-        {
-            printf("  |%12s| |%12s|    |%8s|   |%8s||%8s||%6s/%-6s||%10s||%10s|\n",
-                   "Avg Data Rate", "Inst Data Rate", "Avg Trans", "Inst Trans", "Pending", "Total", "Failure", "Avg Delay", "Max Delay");
-            title_printed = true;
-        }
-        uint64_t interval_s = mIntervalNanoTimer.snapshotSeconds();
-        uint64_t total_s = mTotalNanoTimer.snapshotSeconds();
-        if (interval_s <= 0) interval_s = 1;
-        if (total_s <= 0) total_s = 1;
-
-        uint64_t avg_data_rate = mTotalBytesReceived / total_s;
-        uint64_t inst_data_rate = mIntervalBytesReceived / interval_s;
-        uint64_t avg_trans_rate = mTotalRequest / total_s;
-        uint64_t inst_trans_rate = mIntervalRequest / interval_s;
-        uint64_t pending_req = 0;
-        if (fdb_udp_test)
-        {
-            pending_req = (uint64_t)fdb_timestamps.size();
-        }
-        else if (mTotalRequest > mTotalReply)
-        {
-            pending_req = mTotalRequest - mTotalReply;
-        }
-        uint64_t avg_delay = mTotalReply ? mTotalDelay / mTotalReply : 0;
-        
-        printf("%12u B/s %12u B/s %8u Req/s %8u Req/s %8u %12u/%-4u %8u us %8u us\n",
-                (uint32_t)avg_data_rate, (uint32_t)inst_data_rate, (uint32_t)avg_trans_rate,
-                (uint32_t)inst_trans_rate, (uint32_t)pending_req, (uint32_t)mTotalRequest,
-                (uint32_t)mFailureCount, (uint32_t)avg_delay, (uint32_t)mMaxDelay);
-        resetInterval();
-    }
-    void sendData()
+    CXScenario()
+        : mUrl(FDB_URL_SVC FDB_XTEST_NAME)
+        , mDuration(10)
+        , mRate(1000)
+        , mConnections(1)
+        , mSubscribers(1)
+        , mThreads(1)
+        , mTimeout(5000)
+        , mDistribution(XPAYLOAD_FIXED)
+        , mMinSize(1024)
+        , mMaxSize(1024)
+        , mMeanSize(1024)
     {
-        static uint32_t sn = 0;
+        mWeights[XKIND_INVOKE] = 1;
+        mWeights[XKIND_SEND] = 0;
+        mWeights[XKIND_UDP] = 0;
+    }
+    std::string mUrl;
+    // seconds to run
+    uint32_t mDuration;
+    // target messages per second over all threads; 0: as fast as possible
+    uint32_t mRate;
+    // connections issuing messages
+    uint32_t mConnections;
+    // connections subscribing to messages broadcasted by the server
+    uint32_t mSubscribers;
+    // sender threads
+    uint32_t mThreads;
+    // timeout of invoke in ms
+    int32_t mTimeout;
+    uint32_t mWeights[XKIND_MAX];
+    EXPayloadDistribution mDistribution;
+    uint32_t mMinSize;
+    uint32_t mMaxSize;
+    uint32_t mMeanSize;
+    std::vector<CXPayloadSize> mSizes;
+};
 
-        if (fdb_init_skip_count)
-        {
-            send(XCLT_TEST_SINGLE_DIRECTION, mBuffer, fdb_block_size, FDB_QOS_BEST_EFFORTS);
-            return;
-        }
+struct CXPayloadHeader
+{
+    uint64_t mIntendedTime;
+    uint32_t mKind;
+};
 
-        auto timer = new CUDPSenderTimer(sn);
-        timer->start();
-        // shoud be pushed to list before sending!!!
+/*
+ * Counters and histograms owned by one thread. Others only read them
+ * when printing progress or result.
+ */
+struct CXThreadStats
+{
+    CXThreadStats()
+        : mMaxLag(0)
+    {
+        for (int32_t i = 0; i < XKIND_MAX; ++i)
         {
-        std::lock_guard<std::mutex> _l(fdb_ts_mutex);
-        fdb_timestamps.push_back(timer);
+            mSent[i] = 0;
+            mSentBytes[i] = 0;
+            mReceived[i] = 0;
+            mErrors[i] = 0;
         }
+    }
+    std::atomic<uint64_t> mSent[XKIND_MAX];
+    std::atomic<uint64_t> mSentBytes[XKIND_MAX];
+    std::atomic<uint64_t> mReceived[XKIND_MAX];
+    std::atomic<uint64_t> mErrors[XKIND_MAX];
+    // how far the sender is behind its schedule at most, in ns
+    std::atomic<uint64_t> mMaxLag;
+    CFdbLatencyHistogram mLatency[XKIND_MAX];
+};
+
+static CXScenario fdb_scenario;
+static std::mutex fdb_stats_mutex;
+static std::vector<CXThreadStats *> fdb_thread_stats;
+static thread_local CXThreadStats *fdb_local_stats = 0;
+static std::atomic<bool> fdb_stop_sending(false);
+static CBaseSemaphore fdb_online_sem(0);
 
-        incrementSend(fdb_block_size);
-        uint8_t *ptr = (uint8_t *)mBuffer;
-        *(ptr++) = (uint8_t)((sn >> 0) & 0xff);
-        *(ptr++) = (uint8_t)((sn >> 8) & 0xff);
-        *(ptr++) = (uint8_t)((sn >> 16) & 0xff);
-        *(ptr++) = (uint8_t)((sn >> 24) & 0xff);
-        send(XCLT_TEST_SINGLE_DIRECTION, mBuffer, fdb_block_size, FDB_QOS_BEST_EFFORTS);
-        sn++;
+static CXThreadStats *localStats()
+{
+    if (!fdb_local_stats)
+    {
+        fdb_local_stats = new CXThreadStats();
+        std::lock_guard<std::mutex> _l(fdb_stats_mutex);
+        fdb_thread_stats.push_back(fdb_local_stats);
     }
-    void invokeMethod()
+    return fdb_local_stats;
+}
+
+static void sumStats(uint64_t *sent, uint64_t *sent_bytes, uint64_t *received,
+                     uint64_t *errors, uint64_t &max_lag)
+{
+    for (int32_t i = 0; i < XKIND_MAX; ++i)
+    {
+        sent[i] = sent_bytes[i] = received[i] = errors[i] = 0;
+    }
+    max_lag = 0;
+    std::lock_guard<std::mutex> _l(fdb_stats_mutex);
+    for (auto it = fdb_thread_stats.begin(); it != fdb_thread_stats.end(); ++it)
     {
-        incrementSend(fdb_block_size);
-        if (fdb_sync_invoke)
+        for (int32_t i = 0; i < XKIND_MAX; ++i)
         {
-            CBaseJob::Ptr ref(new CBaseMessage(XCLT_TEST_BI_DIRECTION));
-            invoke(ref, mBuffer, fdb_block_size);
-            handleReply(ref);
+            sent[i] += (*it)->mSent[i].load(std::memory_order_relaxed);
+            sent_bytes[i] += (*it)->mSentBytes[i].load(std::memory_order_relaxed);
+            received[i] += (*it)->mReceived[i].load(std::memory_order_relaxed);
+            errors[i] += (*it)->mErrors[i].load(std::memory_order_relaxed);
         }
-        else
+        auto lag = (*it)->mMaxLag.load(std::memory_order_relaxed);
+        if (lag > max_lag)
         {
-            invoke(XCLT_TEST_BI_DIRECTION, mBuffer, fdb_block_size);
+            max_lag = lag;
         }
     }
+}
+
+static void recordReceived(const void *payload, int32_t size)
+{
+    if (size < (int32_t)sizeof(CXPayloadHeader))
+    {
+        return;
+    }
+    CXPayloadHeader header;
+    memcpy(&header, payload, sizeof(header));
+    if (header.mKind >= XKIND_MAX)
+    {
+        return;
+    }
+    auto stats = localStats();
+    stats->mReceived[header.mKind].fetch_add(1, std::memory_order_relaxed);
+    stats->mLatency[header.mKind].recordNano(header.mIntendedTime, CNanoTimer::getNanoSecTimer());
+}
+
+class CXClient : public CBaseClient
+{
+public:
+    CXClient(bool subscriber)
+        : CBaseClient(FDB_XTEST_NAME)
+        , mSubscriber(subscriber)
+    {
+        enableUDP(fdb_scenario.mWeights[XKIND_UDP] != 0);
+    }
+    bool subscriber() const
+    {
+        return mSubscriber;
+    }
 protected:
-    /* called when connected to the server */
     void onOnline(FdbSessionId_t sid, bool is_first)
     {
-        resetTotal();
-        mTimer->enable();
-        fdb_stop_job = false;
-        fdb_worker_A->sendAsync(new CXTestJob());
-        CFdbMsgSubscribeList sub_list;
-        addNotifyItem(sub_list, XCLT_TEST_SINGLE_DIRECTION);
-        subscribe(sub_list);
+        fdb_online_sem.post();
     }
     void onOffline(FdbSessionId_t sid, bool is_last)
     {
-        mTimer->disable();
-        fdb_stop_job = true;
+        fprintf(stderr, "fdbxclient: connection to server is lost!\n");
     }
     void onReply(CBaseJob::Ptr &msg_ref)
     {
-        handleReply(msg_ref);
+        auto msg = castToMessage<CBaseMessage *>(msg_ref);
+        if (msg->code() != XCLT_TEST_BI_DIRECTION)
+        {
+            return;
+        }
+        if (msg->isStatus())
+        {
+            localStats()->mErrors[XKIND_INVOKE].fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        recordReceived(msg->getPayloadBuffer(), msg->getPayloadSize());
     }
     void onBroadcast(CBaseJob::Ptr &msg_ref)
     {
-        if (fdb_init_skip_count)
+        auto msg = castToMessage<CBaseMessage *>(msg_ref);
+        if (msg->code() == XCLT_TEST_SINGLE_DIRECTION)
         {
-            fdb_init_skip_count--;
-            return;
+            recordReceived(msg->getPayloadBuffer(), msg->getPayloadSize());
+        }
+    }
+private:
+    bool mSubscriber;
+};
+
+static std::vector<CXClient *> fdb_senders;
+static std::vector<CXClient *> fdb_subscribers;
+
+class CXSenderThread : public CBaseThread
+{
+public:
+    CXSenderThread(uint32_t index)
+        : CBaseThread("xclient-sender")
+        , mIndex(index)
+        , mRandom(index + 1)
+    {}
+protected:
+    void run();
+private:
+    uint32_t mIndex;
+    std::mt19937 mRandom;
+
+    EXKind pickKind();
+    uint32_t pickSize();
+};
+
+EXKind CXSenderThread::pickKind()
+{
+    auto &weights = fdb_scenario.mWeights;
+    uint32_t total = weights[XKIND_INVOKE] + weights[XKIND_SEND] + weights[XKIND_UDP];
+    uint32_t value = std::uniform_int_distribution<uint32_t>(0, total - 1)(mRandom);
+    for (int32_t i = 0; i < XKIND_MAX; ++i)
+    {
+        if (value < weights[i])
+        {
+            return (EXKind)i;
         }
-        auto msg = castToMessage<CFdbMessage *>(msg_ref);
-        switch (msg->code())
+        value -= weights[i];
+    }
+    return XKIND_INVOKE;
+}
+
+uint32_t CXSenderThread::pickSize()
+{
+    auto &sc = fdb_scenario;
+    uint32_t size = sc.mMinSize;
+    switch (sc.mDistribution)
+    {
+        case XPAYLOAD_UNIFORM:
+            size = std::uniform_int_distribution<uint32_t>(sc.mMinSize, sc.mMaxSize)(mRandom);
+        break;
+        case XPAYLOAD_EXPONENTIAL:
+            size = (uint32_t)std::exponential_distribution<double>(1.0 / sc.mMeanSize)(mRandom);
+        break;
+        case XPAYLOAD_WEIGHTED:
         {
-            case XCLT_TEST_SINGLE_DIRECTION:
+            uint32_t total = 0;
+            for (auto it = sc.mSizes.begin(); it != sc.mSizes.end(); ++it)
             {
-                uint8_t *ptr = (uint8_t *)(msg->getPayloadBuffer());
-                uint32_t sn = 0;
-                sn |= (uint32_t)(*(ptr + 0) << 0);
-                sn |= (uint32_t)(*(ptr + 1) << 8);
-                sn |= (uint32_t)(*(ptr + 2) << 16);
-                sn |= (uint32_t)(*(ptr + 3) << 24);
-
-                CUDPSenderTimer *timer = 0;
-                {
-                std::lock_guard<std::mutex> _l(fdb_ts_mutex);
-                for (auto it = fdb_timestamps.begin(); it != fdb_timestamps.end();)
-                {
-                    if ((*it)->mSn < sn)
-                    {
-                        mFailureCount++;
-                        ++it;
-                        delete fdb_timestamps.front();
-                        fdb_timestamps.pop_front();
-                    }
-                    else if ((*it)->mSn == sn)
-                    {
-                        timer = fdb_timestamps.front();
-                        fdb_timestamps.pop_front();
-                        break;
-                    }
-                    else
-                    {
-                        break;
-                    }
-                }
-                }
-                incrementReceive(msg->getPayloadSize());
-                if (timer)
-                {
-                    getdownDelay(timer->snapshotMicroseconds());
-                    delete timer;
-                }
-                else
+                total += it->mWeight;
+            }
+            uint32_t value = std::uniform_int_distribution<uint32_t>(0, total - 1)(mRandom);
+            for (auto it = sc.mSizes.begin(); it != sc.mSizes.end(); ++it)
+            {
+                if (value < it->mWeight)
                 {
+                    size = it->mSize;
+                    break;
                 }
+                value -= it->mWeight;
             }
-            break;
         }
+        break;
+        case XPAYLOAD_FIXED:
+        default:
+        break;
     }
-private:
-    CNanoTimer mTotalNanoTimer;
-    CNanoTimer mIntervalNanoTimer;
-    uint64_t mTotalBytesSent;
-    uint64_t mTotalBytesReceived;
-    uint64_t mTotalRequest;
-    uint64_t mTotalReply;
-    
-    uint64_t mIntervalBytesSent;
-    uint64_t mIntervalBytesReceived;
-    uint64_t mIntervalRequest;
-    uint64_t mIntervalReply;
-
-    uint64_t mMaxDelay;
-    uint64_t mMinDelay;
-    uint64_t mTotalDelay;
-    uint64_t mIntervalDelay;
-
-    uint8_t *mBuffer;
-    uint64_t mFailureCount;
-
-    CStatisticTimer *mTimer;
+    if (size < sc.mMinSize)
+    {
+        size = sc.mMinSize;
+    }
+    else if (size > sc.mMaxSize)
+    {
+        size = sc.mMaxSize;
+    }
+    return size;
+}
 
-    void resetTotal()
+void CXSenderThread::run()
+{
+    auto stats = localStats();
+    std::vector<uint8_t> buffer(fdb_scenario.mMaxSize, 0);
+    std::vector<CXClient *> clients;
+    for (uint32_t i = mIndex; i < fdb_senders.size(); i += fdb_scenario.mThreads)
+    {
+        clients.push_back(fdb_senders[i]);
+    }
+    if (clients.empty())
     {
-        mTotalNanoTimer.start();
-        mTotalBytesSent = 0;
-        mTotalBytesReceived = 0;
-        mTotalRequest = 0;
-        mTotalReply = 0;
+        return;
+    }
 
-        resetInterval();
+    uint64_t interval = 0;
+    if (fdb_scenario.mRate)
+    {
+        interval = (uint64_t)fdb_scenario.mThreads * 1000000000 / fdb_scenario.mRate;
+    }
+    uint64_t start = CNanoTimer::getNanoSecTimer();
+    uint64_t seq = 0;
+    while (!fdb_stop_sending.load(std::memory_order_relaxed))
+    {
+        uint64_t now = CNanoTimer::getNanoSecTimer();
+        uint64_t intended = interval ? start + seq * interval : now;
+        if (now < intended)
+        {
+            uint64_t ahead_us = (intended - now) / 1000;
+            if (ahead_us > 100)
+            {
+                sysdep_usleep((uint32_t)(ahead_us - 50));
+            }
+            continue;
+        }
+        uint64_t lag = now - intended;
+        if (lag > stats->mMaxLag.load(std::memory_order_relaxed))
+        {
+            stats->mMaxLag.store(lag, std::memory_order_relaxed);
+        }
 
-        mMaxDelay = 0;
-        mMinDelay = (uint64_t)~0;
-        mTotalDelay = 0;
+        auto kind = pickKind();
+        auto size = pickSize();
+        CXPayloadHeader header;
+        header.mIntendedTime = intended;
+        header.mKind = kind;
+        memcpy(buffer.data(), &header, sizeof(header));
 
-        fdb_init_skip_count = XCLT_INIT_SKIP_COUNT;
-        std::lock_guard<std::mutex> _l(fdb_ts_mutex);
-        fdb_timestamps.clear();
+        auto client = clients[seq % clients.size()];
+        bool ok;
+        switch (kind)
+        {
+            case XKIND_SEND:
+                ok = client->send(XCLT_TEST_SINGLE_DIRECTION, buffer.data(), size, FDB_QOS_RELIABLE);
+            break;
+            case XKIND_UDP:
+                ok = client->send(XCLT_TEST_SINGLE_DIRECTION, buffer.data(), size, FDB_QOS_BEST_EFFORTS);
+            break;
+            case XKIND_INVOKE:
+            default:
+                ok = client->invoke(XCLT_TEST_BI_DIRECTION, buffer.data(), size, fdb_scenario.mTimeout);
+            break;
+        }
+        if (ok)
+        {
+            stats->mSent[kind].fetch_add(1, std::memory_order_relaxed);
+            stats->mSentBytes[kind].fetch_add(size, std::memory_order_relaxed);
+        }
+        else
+        {
+            stats->mErrors[kind].fetch_add(1, std::memory_order_relaxed);
+        }
+        seq++;
     }
+}
 
-    void resetInterval()
+static bool getUInt(cJSON *obj, const char *key, uint32_t &value)
+{
+    auto item = cJSON_GetObjectItem(obj, key);
+    if (!item)
     {
-        mIntervalNanoTimer.start();
-        mIntervalBytesSent = 0;
-        mIntervalBytesReceived = 0;
-        mIntervalRequest = 0;
-        mIntervalReply = 0;
-        mIntervalDelay = 0;
+        return true;
     }
+    if (!cJSON_IsNumber(item) || (item->valueint < 0))
+    {
+        fprintf(stderr, "fdbxclient: '%s' should be a non-negative number!\n", key);
+        return false;
+    }
+    value = (uint32_t)item->valueint;
+    return true;
+}
 
-    void incrementSend(uint32_t size)
+static bool parsePayload(cJSON *payload, CXScenario &sc)
+{
+    auto dist = cJSON_GetObjectItem(payload, "distribution");
+    const char *dist_name = cJSON_IsString(dist) ? dist->valuestring : "fixed";
+    if (!strcmp(dist_name, "fixed"))
     {
-        if (fdb_init_skip_count)
+        sc.mDistribution = XPAYLOAD_FIXED;
+        uint32_t size = sc.mMinSize;
+        if (!getUInt(payload, "size", size))
         {
-            return;
+            return false;
         }
-        mTotalBytesSent += size;
-        mIntervalBytesSent += size;
-        mTotalRequest++;
-        mIntervalRequest++;
+        sc.mMinSize = sc.mMaxSize = sc.mMeanSize = size;
+        return true;
     }
-
-    void incrementReceive(uint32_t size)
+    if (!getUInt(payload, "min", sc.mMinSize) || !getUInt(payload, "max", sc.mMaxSize) ||
+        !getUInt(payload, "mean", sc.mMeanSize))
+    {
+        return false;
+    }
+    if (!strcmp(dist_name, "uniform"))
+    {
+        sc.mDistribution = XPAYLOAD_UNIFORM;
+    }
+    else if (!strcmp(dist_name, "exponential"))
     {
-        if (fdb_init_skip_count)
+        sc.mDistribution = XPAYLOAD_EXPONENTIAL;
+        if (!sc.mMeanSize)
         {
-            return;
+            fprintf(stderr, "fdbxclient: 'mean' of exponential distribution should not be 0!\n");
+            return false;
         }
-        mTotalBytesReceived += size;
-        mIntervalBytesReceived += size;
-        mTotalReply++;
-        mIntervalReply++;
     }
-
-    void getdownDelay(uint64_t delay)
+    else if (!strcmp(dist_name, "weighted"))
     {
-        if (fdb_init_skip_count)
+        sc.mDistribution = XPAYLOAD_WEIGHTED;
+        auto sizes = cJSON_GetObjectItem(payload, "sizes");
+        if (!cJSON_IsArray(sizes))
         {
-            return;
+            fprintf(stderr, "fdbxclient: 'sizes' is required by weighted distribution!\n");
+            return false;
         }
-        if (delay > mMaxDelay)
+        uint32_t total = 0;
+        cJSON *entry;
+        cJSON_ArrayForEach(entry, sizes)
         {
-            mMaxDelay = delay;
+            CXPayloadSize size = {0, 0};
+            if (!getUInt(entry, "size", size.mSize) || !getUInt(entry, "weight", size.mWeight))
+            {
+                return false;
+            }
+            total += size.mWeight;
+            sc.mSizes.push_back(size);
+            if (size.mSize > sc.mMaxSize)
+            {
+                sc.mMaxSize = size.mSize;
+            }
         }
-        if (delay < mMinDelay)
+        if (!total)
         {
-            mMinDelay = delay;
+            fprintf(stderr, "fdbxclient: total weight of 'sizes' should not be 0!\n");
+            return false;
         }
-        mTotalDelay += delay;
-        mIntervalDelay += delay;
     }
+    else
+    {
+        fprintf(stderr, "fdbxclient: unknown distribution '%s'!\n", dist_name);
+        return false;
+    }
+    return true;
+}
 
-    void handleReply(CBaseJob::Ptr &msg_ref)
+static bool loadScenario(const char *file_name, CXScenario &sc)
+{
+    FILE *fp = fopen(file_name, "rb");
+    if (!fp)
     {
-        if (fdb_init_skip_count)
+        fprintf(stderr, "fdbxclient: unable to open %s!\n", file_name);
+        return false;
+    }
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    cJSON *root = 0;
+    if (size > 0)
+    {
+        char *buffer = (char *)malloc(size + 1);
+        if (fread(buffer, 1, size, fp) == (size_t)size)
         {
-            fdb_init_skip_count--;
-            return;
+            buffer[size] = '\0';
+            root = cJSON_Parse(buffer);
         }
-        auto msg = castToMessage<CBaseMessage *>(msg_ref);
-        const CFdbMsgMetadata *md = msg->metadata();
-        switch (msg->code())
+        free(buffer);
+    }
+    fclose(fp);
+    if (!cJSON_IsObject(root))
+    {
+        fprintf(stderr, "fdbxclient: error when parsing %s!\n", file_name);
+        cJSON_Delete(root);
+        return false;
+    }
+
+    bool ok = getUInt(root, "duration", sc.mDuration) &&
+              getUInt(root, "rate", sc.mRate) &&
+              getUInt(root, "connections", sc.mConnections) &&
+              getUInt(root, "subscribers", sc.mSubscribers) &&
+              getUInt(root, "threads", sc.mThreads);
+    uint32_t timeout = (uint32_t)sc.mTimeout;
+    ok = ok && getUInt(root, "timeout", timeout);
+    sc.mTimeout = (int32_t)timeout;
+
+    auto url = cJSON_GetObjectItem(root, "url");
+    if (cJSON_IsString(url))
+    {
+        sc.mUrl = url->valuestring;
+    }
+    auto mix = cJSON_GetObjectItem(root, "mix");
+    if (ok && cJSON_IsObject(mix))
+    {
+        for (int32_t i = 0; i < XKIND_MAX; ++i)
         {
-            case XCLT_TEST_BI_DIRECTION:
-            {
-                if (msg->isStatus())
-                {
-                    /* Unable to get intended reply from server... Check what happen. */
-                    if (msg->isError())
-                    {
-                        int32_t error_code;
-                        std::string reason;
-                        if (!msg->decodeStatus(error_code, reason))
-                        {
-                            std::cout << "onReply: fail to decode status!\n" << std::endl;
-                            return;
-                        }
-                        std::cout << "onReply(): status is received: msg code: " << msg->code()
-                                  << ", error_code: " << error_code
-                                  << ", reason: " << reason
-                                  << std::endl;
-                        mFailureCount++;
-                    }
-                    return;
-                }
-                incrementReceive(msg->getPayloadSize());
-                getdownDelay((md->mReceiveTime - md->mSendTime) / 1000);
-            }
-            break;
-            default:
-            break;
+            sc.mWeights[i] = 0;
+            ok = ok && getUInt(mix, fdb_kind_names[i], sc.mWeights[i]);
         }
     }
-};
-
-CStatisticTimer::CStatisticTimer(CXClient *client)
-    : CMethodLoopTimer<CXClient>(1000, true, client, &CXClient::doStatistic)
-{}
+    auto payload = cJSON_GetObjectItem(root, "payload");
+    if (ok && cJSON_IsObject(payload))
+    {
+        ok = parsePayload(payload, sc);
+    }
+    cJSON_Delete(root);
+    return ok;
+}
 
-void CXTestJob::run(CBaseWorker *worker, Ptr &ref)
+static bool validateScenario(CXScenario &sc)
 {
-    if (fdb_stop_job)
+    if (!(sc.mWeights[XKIND_INVOKE] + sc.mWeights[XKIND_SEND] + sc.mWeights[XKIND_UDP]))
     {
-        return;
+        fprintf(stderr, "fdbxclient: message mix is empty!\n");
+        return false;
     }
-    for (uint32_t i = 0; i < fdb_burst_size; ++i)
+    if (!sc.mConnections || !sc.mThreads)
     {
-        if (fdb_udp_test)
-        {
-            fdb_xtest_client->sendData();
-        }
-        else
-        {
-            fdb_xtest_client->invokeMethod();
-        }
+        fprintf(stderr, "fdbxclient: at least one connection and one thread are needed!\n");
+        return false;
     }
-    if (fdb_delay)
+    if (sc.mMinSize < XCLT_MIN_PAYLOAD_SIZE)
     {
-        sysdep_usleep(fdb_delay);
+        sc.mMinSize = XCLT_MIN_PAYLOAD_SIZE;
     }
+    if (sc.mMaxSize > XCLT_MAX_PAYLOAD_SIZE)
+    {
+        sc.mMaxSize = XCLT_MAX_PAYLOAD_SIZE;
+    }
+    if (sc.mMaxSize < sc.mMinSize)
+    {
+        sc.mMaxSize = sc.mMinSize;
+    }
+    return true;
+}
 
-    CBaseWorker *peer_worker;
-    if (fdb_worker_A->isSelf())
+static void printProgress(uint64_t elapsed_ns, uint64_t *last_sent, uint64_t *last_received)
+{
+    uint64_t sent[XKIND_MAX], sent_bytes[XKIND_MAX], received[XKIND_MAX], errors[XKIND_MAX];
+    uint64_t max_lag;
+    sumStats(sent, sent_bytes, received, errors, max_lag);
+    uint64_t total_sent = 0, total_received = 0, total_errors = 0;
+    for (int32_t i = 0; i < XKIND_MAX; ++i)
     {
-        peer_worker = fdb_worker_B;
+        total_sent += sent[i];
+        total_received += received[i];
+        total_errors += errors[i];
     }
-    else
+    fprintf(stderr, "%6.1f s %10llu sent/s %10llu received/s %8llu errors %10llu us max lag\n",
+            (double)elapsed_ns / 1000000000.0,
+            (unsigned long long)(total_sent - *last_sent),
+            (unsigned long long)(total_received - *last_received),
+            (unsigned long long)total_errors, (unsigned long long)(max_lag / 1000));
+    *last_sent = total_sent;
+    *last_received = total_received;
+}
+
+static void printResult(FILE *fp, uint64_t elapsed_ns)
+{
+    uint64_t sent[XKIND_MAX], sent_bytes[XKIND_MAX], received[XKIND_MAX], errors[XKIND_MAX];
+    uint64_t max_lag;
+    sumStats(sent, sent_bytes, received, errors, max_lag);
+    double seconds = (double)elapsed_ns / 1000000000.0;
+    if (seconds <= 0)
+    {
+        seconds = 1;
+    }
+
+    uint64_t total_sent = 0, total_bytes = 0, total_received = 0;
+    for (int32_t i = 0; i < XKIND_MAX; ++i)
     {
-        peer_worker = fdb_worker_A;
+        total_sent += sent[i];
+        total_bytes += sent_bytes[i];
+        total_received += received[i];
     }
 
-    // trigger another thread to send immediately meanwhile
-    peer_worker->sendAsync(new CXTestJob());
-    // wait until message sent above is really consumed
-    FDB_CONTEXT->flush();
+    fprintf(fp, "{\n");
+    fprintf(fp, "  \"url\": \"%s\",\n", fdb_scenario.mUrl.c_str());
+    fprintf(fp, "  \"duration_s\": %.3f,\n", seconds);
+    fprintf(fp, "  \"target_rate\": %u,\n", fdb_scenario.mRate);
+    fprintf(fp, "  \"connections\": %u,\n", fdb_scenario.mConnections);
+    fprintf(fp, "  \"subscribers\": %u,\n", fdb_scenario.mSubscribers);
+    fprintf(fp, "  \"threads\": %u,\n", fdb_scenario.mThreads);
+    fprintf(fp, "  \"max_schedule_lag_us\": %llu,\n", (unsigned long long)(max_lag / 1000));
+    fprintf(fp, "  \"throughput\": {\"sent\": %llu, \"received\": %llu, \"sent_per_sec\": %.1f, "
+                "\"received_per_sec\": %.1f, \"sent_bytes_per_sec\": %.1f},\n",
+            (unsigned long long)total_sent, (unsigned long long)total_received,
+            (double)total_sent / seconds, (double)total_received / seconds,
+            (double)total_bytes / seconds);
+    fprintf(fp, "  \"kinds\": [");
+    bool first = true;
+    for (int32_t i = 0; i < XKIND_MAX; ++i)
+    {
+        if (!fdb_scenario.mWeights[i])
+        {
+            continue;
+        }
+        CFdbLatencyHistogram histogram;
+        {
+        std::lock_guard<std::mutex> _l(fdb_stats_mutex);
+        for (auto it = fdb_thread_stats.begin(); it != fdb_thread_stats.end(); ++it)
+        {
+            histogram.merge((*it)->mLatency[i]);
+        }
+        }
+        CFdbLatencySummary lat;
+        histogram.summarize(lat);
+        // one-way messages come back once per subscriber
+        uint64_t expected = (i == XKIND_INVOKE) ? sent[i] : sent[i] * fdb_scenario.mSubscribers;
+        uint64_t lost = (expected > received[i]) ? (expected - received[i]) : 0;
+
+        fprintf(fp, "%s\n    {\n", first ? "" : ",");
+        fprintf(fp, "      \"kind\": \"%s\",\n", fdb_kind_names[i]);
+        fprintf(fp, "      \"sent\": %llu,\n", (unsigned long long)sent[i]);
+        fprintf(fp, "      \"received\": %llu,\n", (unsigned long long)received[i]);
+        fprintf(fp, "      \"lost\": %llu,\n", (unsigned long long)lost);
+        fprintf(fp, "      \"errors\": %llu,\n", (unsigned long long)errors[i]);
+        fprintf(fp, "      \"latency_us\": {\"p50\": %llu, \"p90\": %llu, \"p99\": %llu, "
+                    "\"p999\": %llu, \"max\": %llu, \"mean\": %llu}\n",
+                (unsigned long long)lat.mP50, (unsigned long long)lat.mP90,
+                (unsigned long long)lat.mP99, (unsigned long long)lat.mP999,
+                (unsigned long long)lat.mMax, (unsigned long long)lat.mMean);
+        fprintf(fp, "    }");
+        first = false;
+    }
+    fprintf(fp, "\n  ]\n}\n");
+}
+
+static bool allReceived()
+{
+    uint64_t sent[XKIND_MAX], sent_bytes[XKIND_MAX], received[XKIND_MAX], errors[XKIND_MAX];
+    uint64_t max_lag;
+    sumStats(sent, sent_bytes, received, errors, max_lag);
+    return (received[XKIND_INVOKE] + errors[XKIND_INVOKE] >= sent[XKIND_INVOKE]) &&
+           (received[XKIND_SEND] >= sent[XKIND_SEND] * fdb_scenario.mSubscribers) &&
+           (received[XKIND_UDP] >= sent[XKIND_UDP] * fdb_scenario.mSubscribers);
 }
 
 int main(int argc, char **argv)
@@ -436,34 +710,23 @@ int main(int argc, char **argv)
     }
 #endif
     int32_t help = 0;
-    uint32_t burst_size = 16;
+    char *scenario_file = 0;
+    char *output_file = 0;
+    int32_t duration = -1;
+    int32_t rate = -1;
+    int32_t block_size = -1;
     int32_t udp_test = 0;
-    uint32_t block_size = 1024;
-    uint32_t delay = 0;
-    int32_t sync_invoke = 0;
     const struct fdb_option core_options[] = {
+        { FDB_OPTION_STRING, "scenario", 'c', &scenario_file},
+        { FDB_OPTION_STRING, "output", 'o', &output_file},
+        { FDB_OPTION_INTEGER, "duration", 'd', &duration},
+        { FDB_OPTION_INTEGER, "rate", 'r', &rate},
         { FDB_OPTION_INTEGER, "block_size", 'b', &block_size},
-        { FDB_OPTION_INTEGER, "burst_size", 's', &burst_size},
-        { FDB_OPTION_INTEGER, "delay", 'd', &delay},
         { FDB_OPTION_BOOLEAN, "udp_test", 'u', &udp_test},
-        { FDB_OPTION_BOOLEAN, "sync", 'y', &sync_invoke},
         { FDB_OPTION_BOOLEAN, "help", 'h', &help}
     };
     fdb_parse_options(core_options, ARRAY_LENGTH(core_options), &argc, argv);
 
-    fdb_burst_size = burst_size;
-    fdb_udp_test = !!udp_test;
-    fdb_block_size = block_size;
-    fdb_delay = delay;
-    fdb_sync_invoke = !!sync_invoke;
-
-    std::cout << "block size: " << fdb_block_size
-              << ", burst size: " << fdb_burst_size
-              << ", UDP test: " << (fdb_udp_test ? "true" : "false")
-              << ", delay: " << fdb_delay
-              << ", sync: " << (fdb_sync_invoke ? "true" : "false")
-              << std::endl;
-
     if (help)
     {
         std::cout << "FDBus - Fast Distributed Bus" << std::endl;
@@ -471,31 +734,131 @@ int main(int argc, char **argv)
                                            FDB_DEF_TO_STR(FDB_VERSION_MINOR) "."
                                            FDB_DEF_TO_STR(FDB_VERSION_BUILD) << std::endl;
         std::cout << "    LIB version " << CFdbContext::getFdbLibVersion() << std::endl;
-        std::cout << "Usage: fdbxclient[ -b block size][ -s burst size][-d delay][ -u]" << std::endl;
-        std::cout << "    -b block size: specify size of date sent for each request" << std::endl;
-        std::cout << "    -s burst size: specify how many requests are sent in batch for a burst" << std::endl;
-        std::cout << "    -d delay: specify delay between two bursts in micro second" << std::endl;
-        std::cout << "    -u: if set, UDP is tested; otherwise TCP/UDS will be tested" << std::endl;
-        std::cout << "    -y: if set, TCP test with synchronous API; otherwise asynchronous API will be called" << std::endl;
+        std::cout << "Usage: fdbxclient[ -c scenario][ -o output][ -d duration][ -r rate][ -b block size][ -u]" << std::endl;
+        std::cout << "Generate load to fdbxserver and report latency percentile in JSON" << std::endl;
+        std::cout << "    -c scenario: JSON file describing message mix, payload size, rate, connections..." << std::endl;
+        std::cout << "    -o output: write JSON result to file instead of stdout" << std::endl;
+        std::cout << "    -d duration: seconds to run, overriding scenario" << std::endl;
+        std::cout << "    -r rate: target messages per second (0: as fast as possible), overriding scenario" << std::endl;
+        std::cout << "    -b block size: fixed payload size, overriding scenario" << std::endl;
+        std::cout << "    -u: if set, only UDP is tested, overriding scenario" << std::endl;
         exit(0);
     }
 
+    if (scenario_file && !loadScenario(scenario_file, fdb_scenario))
+    {
+        return -1;
+    }
+    if (duration >= 0)
+    {
+        fdb_scenario.mDuration = (uint32_t)duration;
+    }
+    if (rate >= 0)
+    {
+        fdb_scenario.mRate = (uint32_t)rate;
+    }
+    if (block_size >= 0)
+    {
+        fdb_scenario.mDistribution = XPAYLOAD_FIXED;
+        fdb_scenario.mMinSize = fdb_scenario.mMaxSize = fdb_scenario.mMeanSize = (uint32_t)block_size;
+    }
+    if (udp_test)
+    {
+        fdb_scenario.mWeights[XKIND_INVOKE] = 0;
+        fdb_scenario.mWeights[XKIND_SEND] = 0;
+        fdb_scenario.mWeights[XKIND_UDP] = 1;
+    }
+    if (!fdb_scenario.mWeights[XKIND_SEND] && !fdb_scenario.mWeights[XKIND_UDP])
+    {
+        // nothing is broadcasted back
+        fdb_scenario.mSubscribers = 0;
+    }
+    if (!validateScenario(fdb_scenario))
+    {
+        return -1;
+    }
+
     FDB_CONTEXT->enableLogger(false);
     /* start fdbus context thread */
     FDB_CONTEXT->start();
 
-    fdb_worker_A = new CBaseWorker();
-    fdb_worker_B = new CBaseWorker();
-    fdb_statistic_worker = new CBaseWorker();
-    fdb_worker_A->start();
-    fdb_worker_B->start();
-    fdb_statistic_worker->start();
-    fdb_xtest_client = new CXClient(FDB_XTEST_NAME);
+    for (uint32_t i = 0; i < fdb_scenario.mConnections; ++i)
+    {
+        fdb_senders.push_back(new CXClient(false));
+    }
+    for (uint32_t i = 0; i < fdb_scenario.mSubscribers; ++i)
+    {
+        fdb_subscribers.push_back(new CXClient(true));
+    }
+    for (auto it = fdb_senders.begin(); it != fdb_senders.end(); ++it)
+    {
+        (*it)->connect(fdb_scenario.mUrl.c_str());
+    }
+    for (auto it = fdb_subscribers.begin(); it != fdb_subscribers.end(); ++it)
+    {
+        (*it)->connect(fdb_scenario.mUrl.c_str());
+    }
+    for (uint32_t i = 0; i < fdb_senders.size() + fdb_subscribers.size(); ++i)
+    {
+        if (!fdb_online_sem.wait(XCLT_ONLINE_TIMEOUT))
+        {
+            fprintf(stderr, "fdbxclient: unable to connect to %s!\n", fdb_scenario.mUrl.c_str());
+            exit(-1);
+        }
+    }
+    for (auto it = fdb_subscribers.begin(); it != fdb_subscribers.end(); ++it)
+    {
+        CFdbMsgSubscribeList sub_list;
+        (*it)->addNotifyItem(sub_list, XCLT_TEST_SINGLE_DIRECTION);
+        (*it)->subscribeSync(sub_list, XCLT_ONLINE_TIMEOUT);
+    }
 
-    fdb_xtest_client->connect();
+    std::vector<CXSenderThread *> threads;
+    for (uint32_t i = 0; i < fdb_scenario.mThreads; ++i)
+    {
+        threads.push_back(new CXSenderThread(i));
+    }
+    uint64_t start = CNanoTimer::getNanoSecTimer();
+    for (auto it = threads.begin(); it != threads.end(); ++it)
+    {
+        (*it)->start();
+    }
 
-    /* convert main thread into worker */
-    CBaseWorker background_worker;
-    background_worker.start(FDB_WORKER_EXE_IN_PLACE);
-}
+    uint64_t last_sent = 0;
+    uint64_t last_received = 0;
+    uint64_t end = start + (uint64_t)fdb_scenario.mDuration * 1000000000;
+    while (CNanoTimer::getNanoSecTimer() < end)
+    {
+        sysdep_sleep(1000);
+        printProgress(CNanoTimer::getNanoSecTimer() - start, &last_sent, &last_received);
+    }
+    fdb_stop_sending = true;
+    for (auto it = threads.begin(); it != threads.end(); ++it)
+    {
+        (*it)->join();
+    }
+    uint64_t elapsed = CNanoTimer::getNanoSecTimer() - start;
+
+    // wait for messages still on the way; the rest is reported as lost
+    for (int32_t i = 0; (i < XCLT_DRAIN_TIMEOUT / 10) && !allReceived(); ++i)
+    {
+        sysdep_sleep(10);
+    }
 
+    FILE *fp = stdout;
+    if (output_file)
+    {
+        fp = fopen(output_file, "w");
+        if (!fp)
+        {
+            fprintf(stderr, "fdbxclient: unable to open %s!\n", output_file);
+            exit(-1);
+        }
+    }
+    printResult(fp, elapsed);
+    if (fp != stdout)
+    {
+        fclose(fp);
+    }
+    exit(0);
+}
@@ -0,0 +1,183 @@
+/*
+ * Copyright (C) 2015   Jeremy Chen jeremy_cz@yahoo.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <new>
+#include <common_base/CFdbBlockPool.h>
+
+// max free blocks kept for each size class in a thread
+#define FDB_BLOCK_MAX_FREE          128
+// large blocks are of 1 << FDB_BLOCK_LARGE_MIN_BITS bytes and up
+#define FDB_BLOCK_LARGE_MIN_BITS    10
+// large blocks are at most 1 << FDB_BLOCK_LARGE_MAX_BITS bytes
+#define FDB_BLOCK_LARGE_MAX_BITS    18
+#define FDB_BLOCK_NR_LARGE_CLASSES  (FDB_BLOCK_LARGE_MAX_BITS - FDB_BLOCK_LARGE_MIN_BITS + 1)
+// max free blocks kept for each large size class in a thread: 1M at most
+#define FDB_BLOCK_MAX_LARGE_FREE    2
+
+struct CFdbFreeBlock
+{
+    CFdbFreeBlock *mNext;
+};
+
+/*
+ * Trivially constructed and destructed so that it is still accessible
+ * while other thread-local objects are destroyed at thread exit.
+ */
+struct CFdbBlockCache
+{
+    CFdbFreeBlock *mFreeList[FDB_BLOCK_NR_CLASSES];
+    uint32_t mNrFree[FDB_BLOCK_NR_CLASSES];
+    uint8_t *mLargeFree[FDB_BLOCK_NR_LARGE_CLASSES][FDB_BLOCK_MAX_LARGE_FREE];
+    uint32_t mNrLargeFree[FDB_BLOCK_NR_LARGE_CLASSES];
+    bool mActive;
+    bool mClosed;
+};
+
+static thread_local CFdbBlockCache fdb_block_cache;
+
+static void freeBlockCache(CFdbBlockCache &cache)
+{
+    for (int32_t i = 0; i < FDB_BLOCK_NR_CLASSES; ++i)
+    {
+        while (cache.mFreeList[i])
+        {
+            auto block = cache.mFreeList[i];
+            cache.mFreeList[i] = block->mNext;
+            ::operator delete(block);
+        }
+        cache.mNrFree[i] = 0;
+    }
+    for (int32_t i = 0; i < FDB_BLOCK_NR_LARGE_CLASSES; ++i)
+    {
+        while (cache.mNrLargeFree[i])
+        {
+            delete[] cache.mLargeFree[i][--cache.mNrLargeFree[i]];
+        }
+    }
+}
+
+// free blocks cached by the thread when it exits
+struct CFdbBlockCacheCleaner
+{
+    ~CFdbBlockCacheCleaner()
+    {
+        freeBlockCache(fdb_block_cache);
+        fdb_block_cache.mClosed = true;
+    }
+};
+
+static thread_local CFdbBlockCacheCleaner fdb_block_cache_cleaner;
+
+static inline int32_t blockClass(size_t size)
+{
+    return size ? (int32_t)((size - 1) >> FDB_BLOCK_CLASS_BITS) : 0;
+}
+
+// class of a block larger than FDB_BLOCK_MAX_SMALL_SIZE; -1 if not cached
+static inline int32_t largeBlockClass(size_t size)
+{
+    if (size > ((size_t)1 << FDB_BLOCK_LARGE_MAX_BITS))
+    {
+        return -1;
+    }
+    int32_t idx = 0;
+    while (size > ((size_t)1 << (idx + FDB_BLOCK_LARGE_MIN_BITS)))
+    {
+        ++idx;
+    }
+    return idx;
+}
+
+static void activateCache(CFdbBlockCache &cache)
+{
+    if (!cache.mActive)
+    {
+        // register cleaner of the thread before the first block is kept
+        (void)&fdb_block_cache_cleaner;
+        cache.mActive = true;
+    }
+}
+
+static void *allocLarge(size_t size)
+{
+    auto idx = largeBlockClass(size);
+    if (idx < 0)
+    {
+        return new uint8_t[size];
+    }
+    auto &cache = fdb_block_cache;
+    if (cache.mNrLargeFree[idx])
+    {
+        return cache.mLargeFree[idx][--cache.mNrLargeFree[idx]];
+    }
+    return new uint8_t[(size_t)1 << (idx + FDB_BLOCK_LARGE_MIN_BITS)];
+}
+
+static void releaseLarge(void *block, size_t size)
+{
+    auto idx = largeBlockClass(size);
+    auto &cache = fdb_block_cache;
+    if ((idx < 0) || cache.mClosed || (cache.mNrLargeFree[idx] >= FDB_BLOCK_MAX_LARGE_FREE))
+    {
+        delete[] (uint8_t *)block;
+        return;
+    }
+    activateCache(cache);
+    cache.mLargeFree[idx][cache.mNrLargeFree[idx]++] = (uint8_t *)block;
+}
+
+void *CFdbBlockPool::alloc(size_t size)
+{
+    auto idx = blockClass(size);
+    if (idx >= FDB_BLOCK_NR_CLASSES)
+    {
+        return allocLarge(size);
+    }
+    auto &cache = fdb_block_cache;
+    auto block = cache.mFreeList[idx];
+    if (block)
+    {
+        cache.mFreeList[idx] = block->mNext;
+        cache.mNrFree[idx]--;
+        return block;
+    }
+    return ::operator new((size_t)(idx + 1) << FDB_BLOCK_CLASS_BITS);
+}
+
+void CFdbBlockPool::release(void *block, size_t size)
+{
+    if (!block)
+    {
+        return;
+    }
+    auto idx = blockClass(size);
+    if (idx >= FDB_BLOCK_NR_CLASSES)
+    {
+        releaseLarge(block, size);
+        return;
+    }
+    auto &cache = fdb_block_cache;
+    if (cache.mClosed || (cache.mNrFree[idx] >= FDB_BLOCK_MAX_FREE))
+    {
+        ::operator delete(block);
+        return;
+    }
+    activateCache(cache);
+    auto free_block = (CFdbFreeBlock *)block;
+    free_block->mNext = cache.mFreeList[idx];
+    cache.mFreeList[idx] = free_block;
+    cache.mNrFree[idx]++;
+}
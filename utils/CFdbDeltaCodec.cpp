@@ -0,0 +1,187 @@
+/*
+ * Copyright (C) 2015   Jeremy Chen jeremy_cz@yahoo.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+#include "CFdbDeltaCodec.h"
+
+/*
+ * Unchanged bytes fewer than this between two changes are sent as literal
+ * since a run costs at least two bytes of varint.
+ */
+#define FDB_DELTA_MIN_COPY      8
+
+// number of bytes starting from pos which are the same in a and b
+static inline int32_t deltaSameBytes(const uint8_t *a, const uint8_t *b, int32_t pos, int32_t end)
+{
+    int32_t start = pos;
+    while ((pos + 8) <= end)
+    {
+        uint64_t va;
+        uint64_t vb;
+        memcpy(&va, a + pos, sizeof(va));
+        memcpy(&vb, b + pos, sizeof(vb));
+        if (va != vb)
+        {
+            break;
+        }
+        pos += 8;
+    }
+    while ((pos < end) && (a[pos] == b[pos]))
+    {
+        pos++;
+    }
+    return pos - start;
+}
+
+static inline bool deltaPutVarint(uint8_t *&dst, const uint8_t *dst_end, uint32_t value)
+{
+    do
+    {
+        if (dst >= dst_end)
+        {
+            return false;
+        }
+        uint8_t byte = value & 0x7f;
+        value >>= 7;
+        *dst++ = value ? (byte | 0x80) : byte;
+    } while (value);
+    return true;
+}
+
+static inline bool deltaGetVarint(const uint8_t *&src, const uint8_t *src_end, uint32_t &value)
+{
+    value = 0;
+    for (int32_t shift = 0; shift < 32; shift += 7)
+    {
+        if (src >= src_end)
+        {
+            return false;
+        }
+        uint8_t byte = *src++;
+        value |= (uint32_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+int32_t CFdbDeltaCodec::encode(const uint8_t *base, int32_t base_size,
+                               const uint8_t *data, int32_t size,
+                               uint8_t *dst, int32_t dst_size)
+{
+    if ((size < 0) || (dst_size < 0))
+    {
+        return -1;
+    }
+    int32_t common = base ? ((base_size < size) ? base_size : size) : 0;
+    auto dst_end = dst + dst_size;
+    auto out = dst;
+    int32_t pos = 0;
+    while (pos < size)
+    {
+        int32_t copy = deltaSameBytes(base, data, pos, common);
+        if ((pos + copy) == size)
+        {
+            // the rest is copied from base
+            break;
+        }
+
+        // extend literal until unchanged bytes are enough to start a run
+        int32_t literal_start = pos + copy;
+        int32_t literal_end = literal_start;
+        while (literal_end < size)
+        {
+            if ((literal_end >= common) || (base[literal_end] != data[literal_end]))
+            {
+                literal_end++;
+                continue;
+            }
+            int32_t gap_end = literal_end + FDB_DELTA_MIN_COPY;
+            int32_t gap = deltaSameBytes(base, data, literal_end,
+                                         (gap_end < common) ? gap_end : common);
+            if ((gap >= FDB_DELTA_MIN_COPY) || ((literal_end + gap) == size))
+            {
+                break;
+            }
+            literal_end += gap;
+        }
+
+        int32_t literal = literal_end - literal_start;
+        if (!deltaPutVarint(out, dst_end, (uint32_t)copy) ||
+            !deltaPutVarint(out, dst_end, (uint32_t)literal) ||
+            ((dst_end - out) < literal))
+        {
+            return -1;
+        }
+        memcpy(out, data + literal_start, literal);
+        out += literal;
+        pos = literal_end;
+    }
+    return (int32_t)(out - dst);
+}
+
+bool CFdbDeltaCodec::decode(const uint8_t *base, int32_t base_size,
+                            const uint8_t *src, int32_t src_size,
+                            uint8_t *dst, int32_t dst_size)
+{
+    if ((base_size < 0) || (src_size < 0) || (dst_size < 0))
+    {
+        return false;
+    }
+    auto src_end = src + src_size;
+    int32_t pos = 0;
+    while (src < src_end)
+    {
+        uint32_t copy;
+        uint32_t literal;
+        if (!deltaGetVarint(src, src_end, copy) || !deltaGetVarint(src, src_end, literal))
+        {
+            return false;
+        }
+        if (copy && ((copy > (uint32_t)(dst_size - pos)) || ((int64_t)pos + copy > base_size)))
+        {
+            return false;
+        }
+        if (copy)
+        {
+            memcpy(dst + pos, base + pos, copy);
+            pos += (int32_t)copy;
+        }
+        if ((literal > (uint32_t)(dst_size - pos)) || (literal > (uint32_t)(src_end - src)))
+        {
+            return false;
+        }
+        if (literal)
+        {
+            memcpy(dst + pos, src, literal);
+            pos += (int32_t)literal;
+            src += literal;
+        }
+    }
+
+    int32_t rest = dst_size - pos;
+    if (rest)
+    {
+        if ((int64_t)pos + rest > base_size)
+        {
+            return false;
+        }
+        memcpy(dst + pos, base + pos, rest);
+    }
+    return true;
+}
@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2015   Jeremy Chen jeremy_cz@yahoo.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __CFDBDELTACODEC_H__
+#define __CFDBDELTACODEC_H__
+
+#include <stdint.h>
+
+/*
+ * Binary diff of a buffer against its previous value. The diff is a
+ * sequence of runs, each of which is:
+ *     <copy: varint> <literal: varint> <literal bytes>
+ * where copy bytes are taken from the base at the same offset and literal
+ * bytes from the diff. Bytes after the last run are copied from the base.
+ * Varint is unsigned LEB128.
+ */
+class CFdbDeltaCodec
+{
+public:
+    /*
+     * Build diff of data against base.
+     *
+     * @iparam base - previous value
+     * @iparam base_size - size of base
+     * @iparam data - new value
+     * @iparam size - size of data
+     * @oparam dst - buffer holding the diff
+     * @iparam dst_size - size of dst
+     * @return size of the diff; < 0 if the diff is larger than dst_size,
+     *      which means the diff is not worth sending
+     */
+    static int32_t encode(const uint8_t *base, int32_t base_size,
+                          const uint8_t *data, int32_t size,
+                          uint8_t *dst, int32_t dst_size);
+    /*
+     * Rebuild value from base and diff. Malformed diff is detected and
+     * never causes reading or writing out of buffer.
+     *
+     * @iparam base - previous value
+     * @iparam base_size - size of base
+     * @iparam src - the diff
+     * @iparam src_size - size of src
+     * @oparam dst - buffer holding the value
+     * @iparam dst_size - size of the value
+     * @return true if the value is rebuilt
+     */
+    static bool decode(const uint8_t *base, int32_t base_size,
+                       const uint8_t *src, int32_t src_size,
+                       uint8_t *dst, int32_t dst_size);
+};
+
+#endif
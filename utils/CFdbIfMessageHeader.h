@@ -18,16 +18,198 @@
 #define __CFDBMESSAGEHEADER_H__
 
 #include <string>
+#include <map>
+#include <vector>
+#include <string.h>
 #include <common_base/CFdbSimpleMsgBuilder.h>
 #include "CFdbIfMsgTokens.h"
 #include <common_base/common_defs.h>
 
+/*
+ * Wire version exchanged with FdbSessionInfo. Peer not telling the version
+ * is taken as version 0, which only knows message head built by
+ * CFdbParcelableBuilder.
+ */
+#define FDB_WIRE_VERSION_PACKED_HEAD    1
+#define FDB_WIRE_VERSION_STRING_ID      2
+#define FDB_WIRE_VERSION_REPLAY_BATCH   3
+#define FDB_WIRE_VERSION_EVENT_DELTA    4
+#define FDB_WIRE_VERSION                FDB_WIRE_VERSION_EVENT_DELTA
+
+/*
+ * Payload compression algorithms accepted by peer, exchanged with
+ * FdbSessionInfo as bit mask. Compressed payload is marked with
+ * MSG_FLAG_COMPRESSED and payload_size of the head tells the size before
+ * compression.
+ */
+#define FDB_COMPRESS_NONE               0
+#define FDB_COMPRESS_LZ4                (1 << 0)
+#define FDB_COMPRESS_SUPPORTED          FDB_COMPRESS_LZ4
+// default size of payload below which compression is not tried
+#define FDB_COMPRESS_THRESHOLD          512
+
 namespace NFdbBase {
+/*
+ * Fixed layout of message head since FDB_WIRE_VERSION_PACKED_HEAD. All
+ * fields are little endian and naturally aligned so that the head can be
+ * read in place. Optional strings follow the fixed part; each is
+ * terminated with '\0' which is not counted in the length. The head is
+ * padded to multiple of 8 bytes so that the payload keeps the alignment.
+ */
+struct CFdbPackedMsgHeader
+{
+    // the first byte of parcelable head is message type, never the magic
+    static const uint8_t mMagicValue = 0xFD;
+
+    uint8_t mMagic;
+    uint8_t mType;
+    uint8_t mQOS;
+    uint8_t mOptions;
+    int32_t mSn;
+    int32_t mCode;
+    uint32_t mFlag;
+    uint32_t mObjId;
+    uint32_t mPayloadSize;
+    uint64_t mSendArriveTime;
+    uint64_t mReplyTime;
+    // offset is counted from the start of the head; 0 if not present
+    uint16_t mFilterOffset;
+    uint16_t mFilterLength;
+    uint16_t mTokenOffset;
+    uint16_t mTokenLength;
+
+    /*
+     * Set in mOptions if CFdbPackedStringIds follows the fixed part (since
+     * FDB_WIRE_VERSION_STRING_ID).
+     */
+    static const uint8_t mOptStringIds = 1 << 7;
+
+    static bool hostSupported()
+    {
+        static const uint16_t endian_check_word = 0x0001;
+        return *(const uint8_t *)&endian_check_word == 0x01;
+    }
+};
+
+/*
+ * Payload of broadcast marked with MSG_FLAG_REPLAY_BATCH (since
+ * FDB_WIRE_VERSION_REPLAY_BATCH) is a sequence of cached events replayed
+ * upon subscribe. Each event starts with the item, followed by topic
+ * terminated with '\0' (not counted in mTopicLength) and then its payload.
+ * Type, serial number, object id and flags of the events come from the
+ * head of the batch.
+ */
+struct CFdbPackedReplayItem
+{
+    int32_t mCode;
+    uint32_t mPayloadSize;
+    uint16_t mTopicLength;
+    uint16_t mReserved;
+};
+
+/*
+ * Payload of broadcast marked with MSG_FLAG_EVENT_DELTA (since
+ * FDB_WIRE_VERSION_EVENT_DELTA) starts with the head, followed by either
+ * the whole value (mTypeFull) or diff built by CFdbDeltaCodec against
+ * the value of mBaseGeneration (mTypeDiff). The receiver keeps the
+ * last value of each object, event and topic to rebuild the payload.
+ */
+struct CFdbPackedDeltaHead
+{
+    static const uint8_t mTypeFull = 0;
+    static const uint8_t mTypeDiff = 1;
+
+    uint8_t mType;
+    uint8_t mReserved[3];
+    // generation of cached value the diff is built against
+    uint32_t mBaseGeneration;
+    // generation of cached value carried by the broadcast
+    uint32_t mGeneration;
+    // size of the value
+    uint32_t mSize;
+};
+
+/*
+ * Ids of filter and token interned in the session; 0 if not interned. The
+ * string with id comes only the first time; later heads carry the id only.
+ */
+struct CFdbPackedStringIds
+{
+    uint16_t mFilterId;
+    uint16_t mTokenId;
+    uint32_t mReserved;
+};
+
+/*
+ * Strings interned in one session. Each side allocates ids for strings it
+ * sends; ids from peer are kept separately. Since TCP keeps the order, the
+ * string always arrives before the id is referred to. Datagrams may be
+ * lost or overtake TCP, so UDP never uses the table.
+ */
+class CFdbStringIdTable
+{
+public:
+    // ids allocated at most; strings beyond that are sent as they are
+    static const uint16_t mMaxIds = 1024;
+
+    CFdbStringIdTable()
+        : mNextTxId(1)
+    {}
+    /*
+     * Get id of string sent to peer.
+     * @oparam define: true if the id is allocated right now; the string
+     *      should be sent together with the id.
+     * @return: the id; 0 if ids are used up.
+     */
+    uint16_t txId(const std::string &str, bool &define)
+    {
+        define = false;
+        auto it = mTxIds.find(str);
+        if (it != mTxIds.end())
+        {
+            return it->second;
+        }
+        if (mNextTxId > mMaxIds)
+        {
+            return 0;
+        }
+        define = true;
+        mTxIds[str] = mNextTxId;
+        return mNextTxId++;
+    }
+    bool rxDefine(uint16_t id, const std::string &str)
+    {
+        if (!id || (id > mMaxIds))
+        {
+            return false;
+        }
+        if (id >= mRxStrings.size())
+        {
+            mRxStrings.resize(id + 1);
+        }
+        mRxStrings[id] = str;
+        return true;
+    }
+    const std::string *rxLookup(uint16_t id) const
+    {
+        return ((id < mRxStrings.size()) && !mRxStrings[id].empty()) ? &mRxStrings[id] : 0;
+    }
+
+private:
+    std::map<std::string, uint16_t> mTxIds;
+    uint16_t mNextTxId;
+    std::vector<std::string> mRxStrings;
+};
+
 class CFdbMessageHeader : public IFdbParcelable
 {
 public:
     CFdbMessageHeader()
         : mOptions(0)
+        , mFilterId(0)
+        , mTokenId(0)
+        , mFilterDefined(false)
+        , mTokenDefined(false)
     {}
     EFdbMessageType type() const
     {
@@ -166,6 +348,105 @@ public:
         }
     }
 
+    /*
+     * Refer to filter and token with ids of the session from now on. Only
+     * takes effect for head in CFdbPackedMsgHeader layout.
+     */
+    void internStrings(CFdbStringIdTable &ids)
+    {
+        mFilterId = (mOptions & mMaskHeadFilter) ? ids.txId(mFilter, mFilterDefined) : 0;
+        mTokenId = (mOptions & mMaskToken) ? ids.txId(mToken, mTokenDefined) : 0;
+    }
+    bool stringsInterned() const
+    {
+        return mFilterId || mTokenId;
+    }
+    /*
+     * Size of the head in CFdbPackedMsgHeader layout. It is always
+     * multiple of 8.
+     */
+    int32_t packedSize() const
+    {
+        int32_t size = (int32_t)sizeof(CFdbPackedMsgHeader);
+        if (stringsInterned())
+        {
+            size += (int32_t)sizeof(CFdbPackedStringIds);
+        }
+        if ((mOptions & mMaskHeadFilter) && (!mFilterId || mFilterDefined))
+        {
+            size += (int32_t)mFilter.size() + 1;
+        }
+        if ((mOptions & mMaskToken) && (!mTokenId || mTokenDefined))
+        {
+            size += (int32_t)mToken.size() + 1;
+        }
+        return (size + 7) & ~7;
+    }
+    /*
+     * Write the head in CFdbPackedMsgHeader layout to buffer of
+     * packedSize() bytes, which should be 8-byte aligned.
+     */
+    void pack(uint8_t *buffer, int32_t size) const
+    {
+        auto packed = (CFdbPackedMsgHeader *)buffer;
+        packed->mMagic = CFdbPackedMsgHeader::mMagicValue;
+        packed->mType = (uint8_t)mType;
+        packed->mQOS = (uint8_t)mQOS;
+        packed->mOptions = mOptions;
+        packed->mSn = mSn;
+        packed->mCode = mCode;
+        packed->mFlag = mFlag;
+        packed->mObjId = mObjId;
+        packed->mPayloadSize = mPayloadSize;
+        packed->mSendArriveTime = (mOptions & mMaskSenderArriveTime) ? mSendArriveTime : 0;
+        packed->mReplyTime = (mOptions & mMaskReplyTime) ? mReplyTime : 0;
+        uint16_t offset = (uint16_t)sizeof(CFdbPackedMsgHeader);
+        if (stringsInterned())
+        {
+            packed->mOptions |= CFdbPackedMsgHeader::mOptStringIds;
+            auto string_ids = (CFdbPackedStringIds *)(buffer + offset);
+            string_ids->mFilterId = mFilterId;
+            string_ids->mTokenId = mTokenId;
+            string_ids->mReserved = 0;
+            offset += (uint16_t)sizeof(CFdbPackedStringIds);
+        }
+        packed->mFilterOffset = packed->mFilterLength = 0;
+        if ((mOptions & mMaskHeadFilter) && (!mFilterId || mFilterDefined))
+        {
+            packed->mFilterOffset = offset;
+            packed->mFilterLength = (uint16_t)mFilter.size();
+            memcpy(buffer + offset, mFilter.c_str(), mFilter.size() + 1);
+            offset += (uint16_t)(mFilter.size() + 1);
+        }
+        packed->mTokenOffset = packed->mTokenLength = 0;
+        if ((mOptions & mMaskToken) && (!mTokenId || mTokenDefined))
+        {
+            packed->mTokenOffset = offset;
+            packed->mTokenLength = (uint16_t)mToken.size();
+            memcpy(buffer + offset, mToken.c_str(), mToken.size() + 1);
+            offset += (uint16_t)(mToken.size() + 1);
+        }
+        if (offset < size)
+        {
+            memset(buffer + offset, 0, size - offset);
+        }
+    }
+    /*
+     * Decode head received from peer, in either CFdbPackedMsgHeader layout
+     * or the parcelable one.
+     * @iparam ids: strings interned in the session; 0 if the head comes
+     *      from UDP, where interned strings are never used.
+     */
+    bool decode(const uint8_t *buffer, int32_t size, CFdbStringIdTable *ids = 0)
+    {
+        if ((size > 0) && (buffer[0] == CFdbPackedMsgHeader::mMagicValue))
+        {
+            return unpack(buffer, size, ids);
+        }
+        CFdbParcelableParser parser(*this);
+        return parser.parse(buffer, size);
+    }
+
     void deserialize(CFdbSimpleDeserializer &deserializer)
     {
         uint8_t msg_type;
@@ -199,6 +480,76 @@ public:
     }
     
 private:
+    bool unpack(const uint8_t *buffer, int32_t size, CFdbStringIdTable *ids)
+    {
+        if ((size < (int32_t)sizeof(CFdbPackedMsgHeader)) || !CFdbPackedMsgHeader::hostSupported())
+        {
+            return false;
+        }
+        CFdbPackedMsgHeader aligned_head;
+        auto packed = (const CFdbPackedMsgHeader *)buffer;
+        if ((uintptr_t)buffer & 7)
+        {
+            memcpy(&aligned_head, buffer, sizeof(aligned_head));
+            packed = &aligned_head;
+        }
+        CFdbPackedStringIds string_ids = {0, 0, 0};
+        if (packed->mOptions & CFdbPackedMsgHeader::mOptStringIds)
+        {
+            if (!ids || (size < (int32_t)(sizeof(CFdbPackedMsgHeader) + sizeof(string_ids))))
+            {
+                return false;
+            }
+            memcpy(&string_ids, buffer + sizeof(CFdbPackedMsgHeader), sizeof(string_ids));
+        }
+        mType = (EFdbMessageType)packed->mType;
+        mQOS = (EFdbQOS)packed->mQOS;
+        mOptions = packed->mOptions & ~CFdbPackedMsgHeader::mOptStringIds;
+        mSn = packed->mSn;
+        mCode = packed->mCode;
+        mFlag = packed->mFlag;
+        mObjId = packed->mObjId;
+        mPayloadSize = packed->mPayloadSize;
+        mSendArriveTime = packed->mSendArriveTime;
+        mReplyTime = packed->mReplyTime;
+        if ((mOptions & mMaskHeadFilter) &&
+            !unpackString(buffer, size, packed->mFilterOffset, packed->mFilterLength,
+                          string_ids.mFilterId, ids, mFilter))
+        {
+            return false;
+        }
+        if ((mOptions & mMaskToken) &&
+            !unpackString(buffer, size, packed->mTokenOffset, packed->mTokenLength,
+                          string_ids.mTokenId, ids, mToken))
+        {
+            return false;
+        }
+        return true;
+    }
+    static bool unpackString(const uint8_t *buffer, int32_t size, uint16_t offset,
+                             uint16_t length, uint16_t id, CFdbStringIdTable *ids,
+                             std::string &str)
+    {
+        if (!offset)
+        {
+            // only id is given: the string is received before
+            auto interned = (id && ids) ? ids->rxLookup(id) : 0;
+            if (!interned)
+            {
+                return false;
+            }
+            str = *interned;
+            return true;
+        }
+        if ((offset < sizeof(CFdbPackedMsgHeader)) || ((int32_t)offset + length >= size) ||
+            (buffer[offset + length] != '\0'))
+        {
+            return false;
+        }
+        str.assign((const char *)buffer + offset, length);
+        return !id || ids->rxDefine(id, str);
+    }
+
     EFdbMessageType mType;
     int32_t mSn;
     int32_t mCode;
@@ -211,6 +562,11 @@ private:
     std::string mToken;
     EFdbQOS mQOS;
     uint8_t mOptions;
+    // only used by sender
+    uint16_t mFilterId;
+    uint16_t mTokenId;
+    bool mFilterDefined;
+    bool mTokenDefined;
         static const uint8_t mMaskHeadFilter = 1 << 1;
         static const uint8_t mMaskSenderArriveTime = 1 << 2;
         static const uint8_t mMaskReplyTime = 1 << 3;
@@ -352,6 +708,37 @@ public:
     {
         mPid = pid;
     }
+    const std::string &multicast_url() const
+    {
+        return mMulticastUrl;
+    }
+    void set_multicast_url(const std::string &url)
+    {
+        mMulticastUrl = url;
+        mOptions |= mMaskHasMulticastUrl;
+    }
+    bool has_multicast_url() const
+    {
+        return !!(mOptions & mMaskHasMulticastUrl);
+    }
+    uint32_t wire_version() const
+    {
+        return (mOptions & mMaskHasWireVersion) ? mWireVersion : 0;
+    }
+    void set_wire_version(uint32_t version)
+    {
+        mWireVersion = version;
+        mOptions |= mMaskHasWireVersion;
+    }
+    uint32_t compression() const
+    {
+        return (mOptions & mMaskHasCompression) ? mCompression : FDB_COMPRESS_NONE;
+    }
+    void set_compression(uint32_t compression)
+    {
+        mCompression = compression;
+        mOptions |= mMaskHasCompression;
+    }
     void serialize(CFdbSimpleSerializer &serializer) const
     {
         serializer << mSenderName
@@ -361,6 +748,18 @@ public:
         {
             serializer << mUDPPort;
         }
+        if (mOptions & mMaskHasMulticastUrl)
+        {
+            serializer << mMulticastUrl;
+        }
+        if (mOptions & mMaskHasWireVersion)
+        {
+            serializer << mWireVersion;
+        }
+        if (mOptions & mMaskHasCompression)
+        {
+            serializer << mCompression;
+        }
     }
     void deserialize(CFdbSimpleDeserializer &deserializer)
     {
@@ -371,13 +770,33 @@ public:
         {
             deserializer >> mUDPPort;
         }
+        if (mOptions & mMaskHasMulticastUrl)
+        {
+            deserializer >> mMulticastUrl;
+        }
+        if (mOptions & mMaskHasWireVersion)
+        {
+            deserializer >> mWireVersion;
+        }
+        if (mOptions & mMaskHasCompression)
+        {
+            deserializer >> mCompression;
+        }
     }
 private:
     std::string mSenderName;
     int32_t mUDPPort;
     uint32_t mPid;
+    // multicast group joined by client
+    std::string mMulticastUrl;
+    uint32_t mWireVersion;
+    // FDB_COMPRESS_XXX accepted
+    uint32_t mCompression;
     uint8_t mOptions;
         static const uint8_t mMaskHasUDPPort = 1 << 0;
+        static const uint8_t mMaskHasMulticastUrl = 1 << 1;
+        static const uint8_t mMaskHasWireVersion = 1 << 2;
+        static const uint8_t mMaskHasCompression = 1 << 3;
 };
 }
 
@@ -0,0 +1,245 @@
+/*
+ * Copyright (C) 2015   Jeremy Chen jeremy_cz@yahoo.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <string.h>
+#include "CFdbLZ4.h"
+
+#define FDB_LZ4_MIN_MATCH       4
+// the last 5 bytes are always literals
+#define FDB_LZ4_LAST_LITERALS   5
+// the last match starts at least 12 bytes before end of block
+#define FDB_LZ4_MFLIMIT         12
+#define FDB_LZ4_MAX_DISTANCE    65535
+#define FDB_LZ4_HASH_BITS       12
+// skip faster when no match is found for a long time
+#define FDB_LZ4_SKIP_TRIGGER    6
+
+static inline uint32_t lz4Read32(const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t lz4Hash(uint32_t sequence)
+{
+    return (sequence * 2654435761U) >> (32 - FDB_LZ4_HASH_BITS);
+}
+
+static inline uint8_t *lz4WriteLength(uint8_t *op, uint32_t length)
+{
+    while (length >= 255)
+    {
+        *op++ = 255;
+        length -= 255;
+    }
+    *op++ = (uint8_t)length;
+    return op;
+}
+
+static inline uint8_t *lz4WriteLiterals(uint8_t *op, const uint8_t *literals,
+                                        uint32_t length, uint32_t match_length)
+{
+    auto token = op++;
+    if (length >= 15)
+    {
+        *token = 15 << 4;
+        op = lz4WriteLength(op, length - 15);
+    }
+    else
+    {
+        *token = (uint8_t)(length << 4);
+    }
+    memcpy(op, literals, length);
+    op += length;
+    if (match_length >= 15)
+    {
+        *token |= 15;
+    }
+    else
+    {
+        *token |= (uint8_t)match_length;
+    }
+    return op;
+}
+
+int32_t CFdbLZ4::compress(const uint8_t *src, int32_t src_size, uint8_t *dst)
+{
+    if (src_size <= 0)
+    {
+        *dst = 0;
+        return 1;
+    }
+    // offset of the last position with the same hash
+    uint32_t table[1 << FDB_LZ4_HASH_BITS];
+    memset(table, 0, sizeof(table));
+
+    auto ip = src;
+    auto anchor = src;
+    auto end = src + src_size;
+    auto op = dst;
+    if (src_size > FDB_LZ4_MFLIMIT)
+    {
+        auto mflimit = end - FDB_LZ4_MFLIMIT;
+        auto match_limit = end - FDB_LZ4_LAST_LITERALS;
+        uint32_t misses = 0;
+        while (ip < mflimit)
+        {
+            auto sequence = lz4Read32(ip);
+            auto hash = lz4Hash(sequence);
+            auto ref = src + table[hash];
+            table[hash] = (uint32_t)(ip - src);
+            if ((ref >= ip) || ((ip - ref) > FDB_LZ4_MAX_DISTANCE) || (lz4Read32(ref) != sequence))
+            {
+                ip += 1 + (misses++ >> FDB_LZ4_SKIP_TRIGGER);
+                continue;
+            }
+            misses = 0;
+
+            while ((ip > anchor) && (ref > src) && (ip[-1] == ref[-1]))
+            {
+                ip--;
+                ref--;
+            }
+            auto match_end = ip + FDB_LZ4_MIN_MATCH;
+            auto ref_end = ref + FDB_LZ4_MIN_MATCH;
+            while ((match_end < match_limit) && (*match_end == *ref_end))
+            {
+                match_end++;
+                ref_end++;
+            }
+
+            auto match_length = (uint32_t)(match_end - ip - FDB_LZ4_MIN_MATCH);
+            op = lz4WriteLiterals(op, anchor, (uint32_t)(ip - anchor), match_length);
+            auto offset = (uint32_t)(ip - ref);
+            *op++ = (uint8_t)(offset & 0xff);
+            *op++ = (uint8_t)(offset >> 8);
+            if (match_length >= 15)
+            {
+                op = lz4WriteLength(op, match_length - 15);
+            }
+
+            ip = match_end;
+            anchor = ip;
+            if (ip < mflimit)
+            {
+                // also index the tail of the match for better ratio
+                table[lz4Hash(lz4Read32(ip - 2))] = (uint32_t)(ip - 2 - src);
+            }
+        }
+    }
+
+    op = lz4WriteLiterals(op, anchor, (uint32_t)(end - anchor), 0);
+    return (int32_t)(op - dst);
+}
+
+static inline bool lz4ReadLength(const uint8_t *&ip, const uint8_t *end, uint32_t &length)
+{
+    uint8_t b;
+    do
+    {
+        if (ip >= end)
+        {
+            return false;
+        }
+        b = *ip++;
+        length += b;
+        if (length > INT32_MAX)
+        {
+            return false;
+        }
+    } while (b == 255);
+    return true;
+}
+
+int32_t CFdbLZ4::decompress(const uint8_t *src, int32_t src_size, uint8_t *dst, int32_t dst_size)
+{
+    if ((src_size <= 0) || (dst_size < 0))
+    {
+        return -1;
+    }
+    auto ip = src;
+    auto end = src + src_size;
+    auto op = dst;
+    auto op_end = dst + dst_size;
+
+    while (1)
+    {
+        uint32_t token = *ip++;
+        uint32_t length = token >> 4;
+        if ((length == 15) && !lz4ReadLength(ip, end, length))
+        {
+            return -1;
+        }
+        if ((length > (uint32_t)(end - ip)) || (length > (uint32_t)(op_end - op)))
+        {
+            return -1;
+        }
+        if (length)
+        {
+            memcpy(op, ip, length);
+            op += length;
+            ip += length;
+        }
+        if (ip == end)
+        {
+            // the last sequence has literals only
+            break;
+        }
+
+        if ((end - ip) < 2)
+        {
+            return -1;
+        }
+        uint32_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (!offset || (offset > (uint32_t)(op - dst)))
+        {
+            return -1;
+        }
+        length = token & 15;
+        if ((length == 15) && !lz4ReadLength(ip, end, length))
+        {
+            return -1;
+        }
+        length += FDB_LZ4_MIN_MATCH;
+        if (length > (uint32_t)(op_end - op))
+        {
+            return -1;
+        }
+        auto match = op - offset;
+        if (offset >= length)
+        {
+            memcpy(op, match, length);
+            op += length;
+        }
+        else
+        {
+            // overlapped copy repeats the last offset bytes
+            for (uint32_t i = 0; i < length; ++i)
+            {
+                *op++ = *match++;
+            }
+        }
+        if (ip >= end)
+        {
+            return -1;
+        }
+    }
+
+    return (int32_t)(op - dst);
+}
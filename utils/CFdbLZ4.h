@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2015   Jeremy Chen jeremy_cz@yahoo.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef __CFDBLZ4_H__
+#define __CFDBLZ4_H__
+
+#include <stdint.h>
+
+/*
+ * Codec of LZ4 block format (https://github.com/lz4/lz4, doc/lz4_Block_format.md).
+ * Only the block format is implemented: no frame, no checksum and no
+ * dictionary. Output of compress() can be decoded by LZ4_decompress_safe()
+ * and vice versa.
+ */
+class CFdbLZ4
+{
+public:
+    /*
+     * Size of buffer large enough to hold compressed data in the worst case.
+     */
+    static int32_t compressBound(int32_t size)
+    {
+        return size + size / 255 + 16;
+    }
+    /*
+     * Compress a block of data.
+     *
+     * @iparam src - data to compress
+     * @iparam src_size - size of src
+     * @oparam dst - buffer holding compressed data; at least
+     *      compressBound(src_size) bytes
+     * @return size of compressed data
+     */
+    static int32_t compress(const uint8_t *src, int32_t src_size, uint8_t *dst);
+    /*
+     * Decompress a block of data. Malformed input is detected and never
+     * causes reading or writing out of buffer.
+     *
+     * @iparam src - compressed data
+     * @iparam src_size - size of src
+     * @oparam dst - buffer holding decompressed data
+     * @iparam dst_size - size of dst
+     * @return size of decompressed data; < 0 if data is malformed or dst
+     *      is too small
+     */
+    static int32_t decompress(const uint8_t *src, int32_t src_size, uint8_t *dst, int32_t dst_size);
+};
+
+#endif
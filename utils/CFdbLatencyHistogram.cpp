@@ -0,0 +1,223 @@
+/*
+ * Copyright (C) 2015   Jeremy Chen jeremy_cz@yahoo.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <common_base/CFdbLatencyHistogram.h>
+
+#define FDB_LATENCY_INVALID_MIN ((uint64_t)-1)
+
+static int32_t fdbMostSignificantBit(uint64_t value)
+{
+#if defined(__GNUC__)
+    return 63 - __builtin_clzll(value);
+#else
+    int32_t msb = 0;
+    while (value >>= 1)
+    {
+        msb++;
+    }
+    return msb;
+#endif
+}
+
+CFdbLatencyHistogram::CFdbLatencyHistogram()
+{
+    reset();
+}
+
+int32_t CFdbLatencyHistogram::bucketIndex(uint64_t value)
+{
+    if (value >= ((uint64_t)1 << mMaxValueBits))
+    {
+        value = ((uint64_t)1 << mMaxValueBits) - 1;
+    }
+    if (value < (uint64_t)mSubBuckets)
+    {
+        return (int32_t)value;
+    }
+    int32_t msb = fdbMostSignificantBit(value);
+    int32_t magnitude = msb - mSubBucketBits + 1;
+    int32_t sub = (int32_t)(value >> (msb - mSubBucketBits)) - mSubBuckets;
+    return magnitude * mSubBuckets + sub;
+}
+
+uint64_t CFdbLatencyHistogram::bucketUpperBound(int32_t index)
+{
+    if (index < mSubBuckets)
+    {
+        return (uint64_t)index;
+    }
+    int32_t magnitude = index / mSubBuckets;
+    uint64_t sub = (uint64_t)(index % mSubBuckets);
+    uint64_t lower = (mSubBuckets + sub) << (magnitude - 1);
+    return lower + ((uint64_t)1 << (magnitude - 1)) - 1;
+}
+
+void CFdbLatencyHistogram::record(uint64_t us)
+{
+    mBuckets[bucketIndex(us)].fetch_add(1, std::memory_order_relaxed);
+    mCount.fetch_add(1, std::memory_order_relaxed);
+    mSum.fetch_add(us, std::memory_order_relaxed);
+
+    auto cur = mMax.load(std::memory_order_relaxed);
+    while ((us > cur) && !mMax.compare_exchange_weak(cur, us, std::memory_order_relaxed))
+    {
+    }
+    cur = mMin.load(std::memory_order_relaxed);
+    while ((us < cur) && !mMin.compare_exchange_weak(cur, us, std::memory_order_relaxed))
+    {
+    }
+}
+
+uint64_t CFdbLatencyHistogram::percentile(double percentile) const
+{
+    uint64_t total = 0;
+    for (int32_t i = 0; i < mNrBuckets; ++i)
+    {
+        total += mBuckets[i].load(std::memory_order_relaxed);
+    }
+    if (!total)
+    {
+        return 0;
+    }
+
+    uint64_t target = (uint64_t)((double)total * percentile / 100.0 + 0.5);
+    if (target < 1)
+    {
+        target = 1;
+    }
+    else if (target > total)
+    {
+        target = total;
+    }
+
+    uint64_t max_value = mMax.load(std::memory_order_relaxed);
+    uint64_t accumulated = 0;
+    for (int32_t i = 0; i < mNrBuckets; ++i)
+    {
+        accumulated += mBuckets[i].load(std::memory_order_relaxed);
+        if (accumulated >= target)
+        {
+            auto value = bucketUpperBound(i);
+            return (value > max_value) ? max_value : value;
+        }
+    }
+    return max_value;
+}
+
+void CFdbLatencyHistogram::summarize(CFdbLatencySummary &summary) const
+{
+    summary.mCount = mCount.load(std::memory_order_relaxed);
+    if (!summary.mCount)
+    {
+        summary = CFdbLatencySummary();
+        return;
+    }
+    summary.mMin = mMin.load(std::memory_order_relaxed);
+    if (summary.mMin == FDB_LATENCY_INVALID_MIN)
+    {
+        summary.mMin = 0;
+    }
+    summary.mMax = mMax.load(std::memory_order_relaxed);
+    summary.mMean = mSum.load(std::memory_order_relaxed) / summary.mCount;
+    summary.mP50 = percentile(50.0);
+    summary.mP90 = percentile(90.0);
+    summary.mP99 = percentile(99.0);
+    summary.mP999 = percentile(99.9);
+}
+
+void CFdbLatencyHistogram::merge(const CFdbLatencyHistogram &other)
+{
+    for (int32_t i = 0; i < mNrBuckets; ++i)
+    {
+        auto count = other.mBuckets[i].load(std::memory_order_relaxed);
+        if (count)
+        {
+            mBuckets[i].fetch_add(count, std::memory_order_relaxed);
+        }
+    }
+    mCount.fetch_add(other.mCount.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    mSum.fetch_add(other.mSum.load(std::memory_order_relaxed), std::memory_order_relaxed);
+
+    auto value = other.mMax.load(std::memory_order_relaxed);
+    auto cur = mMax.load(std::memory_order_relaxed);
+    while ((value > cur) && !mMax.compare_exchange_weak(cur, value, std::memory_order_relaxed))
+    {
+    }
+    value = other.mMin.load(std::memory_order_relaxed);
+    cur = mMin.load(std::memory_order_relaxed);
+    while ((value < cur) && !mMin.compare_exchange_weak(cur, value, std::memory_order_relaxed))
+    {
+    }
+}
+
+void CFdbLatencyHistogram::reset()
+{
+    for (int32_t i = 0; i < mNrBuckets; ++i)
+    {
+        mBuckets[i].store(0, std::memory_order_relaxed);
+    }
+    mCount.store(0, std::memory_order_relaxed);
+    mSum.store(0, std::memory_order_relaxed);
+    mMin.store(FDB_LATENCY_INVALID_MIN, std::memory_order_relaxed);
+    mMax.store(0, std::memory_order_relaxed);
+}
+
+CFdbLatencyStats::~CFdbLatencyStats()
+{
+    for (int32_t type = 0; type < FDB_LATENCY_MAX; ++type)
+    {
+        auto &histograms = mHistograms[type];
+        for (auto it = histograms.begin(); it != histograms.end(); ++it)
+        {
+            delete it->second;
+        }
+        histograms.clear();
+    }
+}
+
+void CFdbLatencyStats::record(FdbMsgCode_t code, EFdbLatencyType type,
+                              uint64_t start_ns, uint64_t end_ns)
+{
+    if (!start_ns || !end_ns || (type >= FDB_LATENCY_MAX))
+    {
+        return;
+    }
+    auto &histograms = mHistograms[type];
+    CFdbLatencyHistogram *histogram;
+    auto it = histograms.find(code);
+    if (it == histograms.end())
+    {
+        histogram = new CFdbLatencyHistogram();
+        histograms[code] = histogram;
+    }
+    else
+    {
+        histogram = it->second;
+    }
+    histogram->recordNano(start_ns, end_ns);
+}
+
+void CFdbLatencyStats::reset()
+{
+    for (int32_t type = 0; type < FDB_LATENCY_MAX; ++type)
+    {
+        auto &histograms = mHistograms[type];
+        for (auto it = histograms.begin(); it != histograms.end(); ++it)
+        {
+            it->second->reset();
+        }
+    }
+}
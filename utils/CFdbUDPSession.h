@@ -18,9 +18,95 @@
 #define __CFDBUDPSESSION_H__
 
 #include <string>
+#include <map>
+#include <set>
+#include <vector>
 #include <common_base/common_defs.h>
 #include <common_base/CBaseFdWatch.h>
 
+/*
+ * Frames bigger than FDB_UDP_FRAGMENT_SIZE are sent in fragments of
+ * FDB_UDP_FRAGMENT_SIZE bytes so that each datagram fits in ethernet MTU
+ * and IP fragmentation is avoided.
+ */
+#define FDB_UDP_FRAGMENT_SIZE           1400
+/*
+ * Peers of the same host are reached through loopback, whose MTU is 64K:
+ * frames to them are split only if a datagram can not hold them.
+ */
+#define FDB_UDP_LOCAL_FRAGMENT_SIZE     (63 * 1024)
+// frame bigger than this is never sent with UDP
+#define FDB_UDP_MAX_FRAME_SIZE          (8 * 1024 * 1024)
+// frames being reassembled at the same time at most
+#define FDB_UDP_MAX_REASSEMBLY_FRAMES   32
+// memory used for reassembly at most
+#define FDB_UDP_MAX_REASSEMBLY_SIZE     (16 * 1024 * 1024)
+// frames not completed in time are dropped
+#define FDB_UDP_REASSEMBLY_TIMEOUT      500 // ms
+
+/*
+ * Head of datagram carrying a fragment. It takes the place of
+ * CFdbMsgPrefix: a valid head length is never mFragmentMark.
+ */
+struct CFdbUDPFragmentHead
+{
+    static const int32_t mSize = 20;
+    static const uint32_t mFragmentMark = 0xFFFFFFFF;
+
+    CFdbUDPFragmentHead(uint32_t total_length, uint32_t frame_id, uint16_t index, uint16_t count,
+                        uint32_t fragment_size)
+        : mTotalLength(total_length)
+        , mFrameId(frame_id)
+        , mIndex(index)
+        , mCount(count)
+        , mFragmentSize(fragment_size)
+    {
+    }
+    CFdbUDPFragmentHead(const uint8_t *buffer)
+    {
+        mTotalLength = getU32(buffer);
+        mFrameId = getU32(buffer + 8);
+        mIndex = (uint16_t)(buffer[12] | (buffer[13] << 8));
+        mCount = (uint16_t)(buffer[14] | (buffer[15] << 8));
+        mFragmentSize = getU32(buffer + 16);
+    }
+    void serialize(uint8_t *buffer) const
+    {
+        putU32(buffer, mTotalLength);
+        putU32(buffer + 4, mFragmentMark);
+        putU32(buffer + 8, mFrameId);
+        buffer[12] = (uint8_t)(mIndex & 0xff);
+        buffer[13] = (uint8_t)((mIndex >> 8) & 0xff);
+        buffer[14] = (uint8_t)(mCount & 0xff);
+        buffer[15] = (uint8_t)((mCount >> 8) & 0xff);
+        putU32(buffer + 16, mFragmentSize);
+    }
+    static bool isFragment(const uint8_t *buffer, int32_t size)
+    {
+        return (size >= mSize) && (getU32(buffer + 4) == mFragmentMark);
+    }
+
+    uint32_t mTotalLength;  // size of the whole frame
+    uint32_t mFrameId;      // unique among frames of the same sender
+    uint16_t mIndex;
+    uint16_t mCount;
+    uint32_t mFragmentSize; // size of all fragments but the last one
+
+private:
+    static uint32_t getU32(const uint8_t *buffer)
+    {
+        return (uint32_t)buffer[0] | ((uint32_t)buffer[1] << 8) |
+               ((uint32_t)buffer[2] << 16) | ((uint32_t)buffer[3] << 24);
+    }
+    static void putU32(uint8_t *buffer, uint32_t value)
+    {
+        buffer[0] = (uint8_t)((value >> 0) & 0xff);
+        buffer[1] = (uint8_t)((value >> 8) & 0xff);
+        buffer[2] = (uint8_t)((value >> 16) & 0xff);
+        buffer[3] = (uint8_t)((value >> 24) & 0xff);
+    }
+};
+
 class CFdbSessionContainer;
 class CSocketImp;
 struct CFdbSocketAddr;
@@ -33,11 +119,25 @@ namespace NFdbBase {
 class CFdbUDPSession : public CBaseFdWatch
 {
 public:
-    CFdbUDPSession(CFdbSessionContainer *container, CSocketImp *socket);
+    /*
+     * @iparam multicast: true if the socket receives broadcast from
+     *      multicast group, where events not subscribed are dropped.
+     */
+    CFdbUDPSession(CFdbSessionContainer *container, CSocketImp *socket, bool multicast = false);
     virtual ~CFdbUDPSession();
 
     bool sendMessage(const uint8_t *buffer, int32_t size, const CFdbSocketAddr &dest_addr);
-    bool sendMessage(CFdbMessage *msg, const CFdbSocketAddr &dest_addr);
+    bool sendMessage(CFdbMessage *msg, const CFdbSocketAddr &dest_addr, bool packed_head = false);
+    /*
+     * Send the same message to several peers at once. Message bigger than
+     * FDB_UDP_FRAGMENT_SIZE (FDB_UDP_LOCAL_FRAGMENT_SIZE if all peers are
+     * of the same host) is split into fragments.
+     * @iparam packed_head: true if all peers understand head of fixed layout
+     * @return: number of peers, counted from the first, the message is
+     *      sent to.
+     */
+    int32_t sendMessage(CFdbMessage *msg, const CFdbSocketAddr **dest_addrs, int32_t nr_dests,
+                        bool packed_head = false);
 
     CSocketImp *getSocket()
     {
@@ -49,12 +149,48 @@ protected:
     void onHup();
 
 private:
+    // frame being reassembled
+    struct CReassembly
+    {
+        uint8_t *mBuffer;
+        uint32_t mTotalLength;
+        uint32_t mFragmentSize;
+        uint16_t mCount;
+        uint16_t mReceived;
+        std::vector<bool> mArrived;
+        uint64_t mStartTime;
+    };
+    // (sender, frame id) -> frame
+    typedef std::map<std::pair<uint64_t, uint32_t>, CReassembly> tReassemblyTbl;
+
     CFdbSessionContainer *mContainer;
     CSocketImp *mSocket;
+    bool mMulticast;
+    uint32_t mFrameId;
+    tReassemblyTbl mReassemblyTbl;
+    uint32_t mReassemblySize;
+    // IP addresses of this host, taken when the session is created
+    std::set<std::string> mLocalAddrs;
 
-    int32_t receiveData(uint8_t *buf, int32_t size);
-    void doBroadcast(NFdbBase::CFdbMessageHeader &head, CFdbMsgPrefix &prefix, uint8_t *buffer);
-    void doRequest(NFdbBase::CFdbMessageHeader &head, CFdbMsgPrefix &prefix, uint8_t *buffer);
+    bool sameHost(const CFdbSocketAddr &addr) const;
+    int32_t fragmentSize(const CFdbSocketAddr **dest_addrs, int32_t nr_dests) const;
+    int32_t sendFragments(const uint8_t *frame, int32_t size, int32_t fragment_size,
+                          const CFdbSocketAddr **dest_addrs, int32_t nr_dests);
+    /*
+     * @ioparam rx_buffer: receive buffer holding the datagram; set to 0 if
+     *      it is handed over to the message.
+     */
+    void processDatagram(uint8_t *&rx_buffer, int32_t rx_size, uint64_t source);
+    void processFragment(const uint8_t *datagram, int32_t size, uint64_t source);
+    // pooled_size: size of block from CFdbBlockPool; 0 if from new[]
+    void processFrame(uint8_t *whole_buf, int32_t pooled_size);
+    void dropReassembly(tReassemblyTbl::iterator it);
+    void expireReassembly(uint64_t now);
+    bool reserveReassembly(uint32_t size);
+    void doBroadcast(NFdbBase::CFdbMessageHeader &head, CFdbMsgPrefix &prefix,
+                     uint8_t *buffer, int32_t pooled_size);
+    void doRequest(NFdbBase::CFdbMessageHeader &head, CFdbMsgPrefix &prefix,
+                   uint8_t *buffer, int32_t pooled_size);
 };
 
 #endif
@@ -26,14 +26,27 @@ public:
 #if !defined(FDB_CFG_SOCKET_PATH)
 #define FDB_CFG_SOCKET_PATH "/tmp"
 #endif
+#if !defined(FDB_CFG_SVC_CACHE_PATH)
+#define FDB_CFG_SVC_CACHE_PATH "/run"
+#endif
+#if !defined(FDB_CFG_SNAPSHOT_PATH)
+#define FDB_CFG_SNAPSHOT_PATH "/run"
+#endif
 
 #define NS_CFG_NR_HB_RETRIES            5
 #define NS_CFG_HB_INTERVAL              1000
 #define NS_CFG_HB_TIMEOUT               (NS_CFG_NR_HB_RETRIES * NS_CFG_HB_INTERVAL)
+#define NS_CFG_HB_TICK                  250
+#define NS_CFG_HOST_BATCH_INTERVAL      50
 #define NS_CFG_HS_RECONNECT_INTERVAL    1500
 #define NS_CFG_NS_RECONNECT_INTERVAL    500
+#define NS_CFG_NS_RECONNECT_INTERVAL_MAX 4000
 #define NS_CFG_CHECK_IP_INTERVAL        500
 #define NS_CFG_ADDRESS_BIND_RETRY_CNT   5
+#define NS_CFG_SNAPSHOT_GRACE_PERIOD    3000
+#define NS_CFG_SNAPSHOT_FLUSH_DELAY     100
+#define NS_CFG_REGISTRY_LOG_SIZE        512
+#define NS_CFG_HOST_LOG_SIZE            128
 #ifdef FDB_CONFIG_UDS_ABSTRACT
     #define NS_CFG_UDS_ADDRESS_PREFIX  "@"
 #else
@@ -90,6 +103,23 @@ public:
         return 60000;
     }
 
+    /* File shared by processes to cache address of services */
+    static const char *getSvcAddrCachePath()
+    {
+        return FDB_CFG_SVC_CACHE_PATH "/" "fdb-svc-cache";
+    }
+
+    /* Snapshot of registry for warm restart of name server and host server */
+    static const char *getNsSnapshotPath()
+    {
+        return FDB_CFG_SNAPSHOT_PATH "/" "fdb-ns-snapshot";
+    }
+
+    static const char *getHsSnapshotPath()
+    {
+        return FDB_CFG_SNAPSHOT_PATH "/" "fdb-hs-snapshot";
+    }
+
     static const char *getIPCPathBase()
     {
         return NS_CFG_UDS_ADDRESS_PREFIX FDB_CFG_SOCKET_PATH "/" "fdb-ipc";
@@ -110,6 +140,25 @@ public:
         return 65000;
     }
 
+    /*
+     * Multicast groups are taken from administratively scoped range
+     * 239.255.0.0/16; each service gets 239.255.<n>.0/24 and a port.
+     */
+    static const char *getMulticastPrefix()
+    {
+        return "239.255";
+    }
+
+    static int32_t getMulticastPortMin()
+    {
+        return 55000;
+    }
+
+    static int32_t getMulticastPortMax()
+    {
+        return 59999;
+    }
+
     /* Number of un-acknowledged heartbeats before lose is detected */
     static int32_t getHeartBeatRetryNr()
     {
@@ -128,6 +177,18 @@ public:
         return NS_CFG_HB_INTERVAL;
     }
 
+    /* Resolution of per-host heartbeat timers of host server */
+    static int32_t getHeartBeatTick()
+    {
+        return NS_CFG_HB_TICK;
+    }
+
+    /* How long host changes are collected before pushed to name servers */
+    static int32_t getHostBatchInterval()
+    {
+        return NS_CFG_HOST_BATCH_INTERVAL;
+    }
+
     static int32_t getHsReconnectInterval()
     {
         return NS_CFG_HS_RECONNECT_INTERVAL;
@@ -143,10 +204,40 @@ public:
         return NS_CFG_NS_RECONNECT_INTERVAL;
     }
 
+    /* Upper bound of backoff when reconnecting to name server */
+    static int32_t getNsReconnectIntervalMax()
+    {
+        return NS_CFG_NS_RECONNECT_INTERVAL_MAX;
+    }
+
     static int32_t getAddressBindRetryCnt()
     {
         return NS_CFG_ADDRESS_BIND_RETRY_CNT;
     }
+
+    /* How long entries rebuilt from snapshot wait for their owners */
+    static int32_t getSnapshotGracePeriod()
+    {
+        return NS_CFG_SNAPSHOT_GRACE_PERIOD;
+    }
+
+    /* How long registry changes are collected before snapshot is written */
+    static int32_t getSnapshotFlushDelay()
+    {
+        return NS_CFG_SNAPSHOT_FLUSH_DELAY;
+    }
+
+    /* How many registry changes are kept for delta query */
+    static int32_t getRegistryLogSize()
+    {
+        return NS_CFG_REGISTRY_LOG_SIZE;
+    }
+
+    /* How many host changes are kept for delta query */
+    static int32_t getHostLogSize()
+    {
+        return NS_CFG_HOST_LOG_SIZE;
+    }
 };
 
 #endif
@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2015   Jeremy Chen jeremy_cz@yahoo.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __CWORKERCONFIG_H__
+#define __CWORKERCONFIG_H__
+
+#include <common_base/CBaseThread.h>
+
+/*
+ * Scheduling options of workers read from section "worker_scheduling" of
+ * FDB_CFG_CONFIG_PATH/fdbus.fdb. The section is keyed by process name and
+ * then by worker name; "*" matches any process or worker:
+ *
+ * "worker_scheduling": {
+ *     "*": {
+ *         "*": {"cpu_affinity": [0, 1]}
+ *     },
+ *     "name_server": {
+ *         "FDBus Context": {
+ *             "cpu_affinity": [2],
+ *             "sched_policy": "fifo",      // "other", "fifo" or "rr"
+ *             "sched_priority": 10,
+ *             "memory_node": 0
+ *         }
+ *     }
+ * }
+ *
+ * Entries are applied from the most generic to the most specific one and
+ * options present in a more specific entry override generic ones. A cpu
+ * index beyond what the system supports (CPU_SETSIZE on linux) is reported
+ * and the affinity is not changed.
+ */
+class CWorkerConfig
+{
+public:
+    /*
+     * Merge options configured for the worker into attr.
+     *
+     * @iparam worker_name - name of the worker
+     * @ioparam attr - options to be updated
+     * @return true - at least one entry is found for the worker
+     */
+    static bool getSchedAttr(const char *worker_name, CThreadSchedAttr &attr);
+};
+
+#endif
@@ -21,15 +21,20 @@
 #include <common_base/CBaseLoopTimer.h>
 #include <common_base/CBaseFdWatch.h>
 #include <utils/Log.h>
+#include <utils/CWorkerConfig.h>
 #include <common_base/CFdEventLoop.h>
 #include <common_base/CThreadEventLoop.h>
+#include <common_base/CUringEventLoop.h>
+#include <common_base/CFdbBlockPool.h>
 
 /*-----------------------------------------------------------------------------
  * CLASS IMPLEMENTATIONS
  *---------------------------------------------------------------------------*/
 CBaseJob::CBaseJob(uint32_t flag)
-    : mFlag(flag)
+    : mRefCount(0)
+    , mFlag(flag)
     , mSyncReq(0)
+    , mQueuedTime(0)
 {
 }
 
@@ -37,12 +42,23 @@ CBaseJob::~CBaseJob()
 {
 }
 
-void CBaseJob::wakeup(Ptr &ref)
+void *CBaseJob::operator new(size_t size)
 {
-    // Why +1? because the job must be referred locally.
-    // Warning: ref count of the job can not be changed
-    // during the sync waiting!!!
-    if (ref.use_count() == (mSyncReq->mInitSharedCnt + 1))
+    return CFdbBlockPool::alloc(size);
+}
+
+void CBaseJob::operator delete(void *ptr, size_t size)
+{
+    CFdbBlockPool::release(ptr, size);
+}
+
+/*
+ * Called with mSyncLock held after run() of a sync job returns: the
+ * waiting thread is woken up unless the job is completed later.
+ */
+void CBaseJob::wakeup()
+{
+    if (!(mFlag & JOB_COMPLETION_DEFERRED))
     {
         mSyncReq->mSem.post();
     }
@@ -55,7 +71,8 @@ void CBaseJob::terminate(Ptr &ref)
         std::lock_guard<std::mutex> _l(mSyncLock);
         if (mSyncReq)
         {
-            wakeup(ref);
+            mFlag &= ~JOB_COMPLETION_DEFERRED;
+            mSyncReq->mSem.post();
         }
     }
 }
@@ -473,6 +490,7 @@ bool CBaseWorker::CJobQueue::enqueue(CBaseJob::Ptr &job)
         mEventLoop->lock();
         if (!mMaxSize || (mJobQueue.size() < mMaxSize))
         {
+            job->mQueuedTime = sysdep_getsystemtime_nano();
             mJobQueue.push_back(job);
             ret = true;
         }
@@ -488,8 +506,20 @@ bool CBaseWorker::CJobQueue::enqueue(CBaseJob::Ptr &job)
 
 void CBaseWorker::CJobQueue::dumpJobs(tJobContainer &job_queue)
 {
-    job_queue = mJobQueue;
-    mJobQueue.clear();
+    job_queue.swap(mJobQueue);
+    mJobQueue.swap(mSpareQueue);
+}
+
+void CBaseWorker::CJobQueue::recycleJobs(tJobContainer &job_queue)
+{
+    // release jobs without lock
+    job_queue.clear();
+    mEventLoop->lock();
+    if (job_queue.capacity() > mSpareQueue.capacity())
+    {
+        job_queue.swap(mSpareQueue);
+    }
+    mEventLoop->unlock();
 }
 
 void CBaseWorker::CJobQueue::discardJobs()
@@ -559,7 +589,11 @@ bool CBaseWorker::init(uint32_t flag)
             {
                 return true;
             }
-            if (flag & FDB_WORKER_ENABLE_FD_LOOP)
+            if (flag & FDB_WORKER_ENABLE_URING_LOOP)
+            {
+                mEventLoop = new CUringEventLoop();
+            }
+            else if (flag & FDB_WORKER_ENABLE_FD_LOOP)
             {
                 mEventLoop = new CFdEventLoop();
             }
@@ -585,6 +619,11 @@ bool CBaseWorker::init(uint32_t flag)
 
 bool CBaseWorker::start(uint32_t flag)
 {
+    auto attr = schedAttr();
+    if (CWorkerConfig::getSchedAttr(name().c_str(), attr))
+    {
+        schedAttr(attr);
+    }
     return init(flag) ? CBaseThread::start(flag) : false;
 }
 
@@ -628,6 +667,10 @@ void CBaseWorker::run()
 
 void CBaseWorker::runOneJob(tJobContainer::iterator &it, bool run_job)
 {
+    if (run_job)
+    {
+        mQueueWait.recordNano((*it)->mQueuedTime, sysdep_getsystemtime_nano());
+    }
     if ((*it)->sync())
     {
         if ((*it)->mSyncReq)
@@ -646,7 +689,7 @@ void CBaseWorker::runOneJob(tJobContainer::iterator &it, bool run_job)
                     (*it)->success(true);
                     (*it)->run(this, *it);
                 }
-                (*it)->wakeup(*it);
+                (*it)->wakeup();
             }
         }
     }
@@ -686,6 +729,7 @@ void CBaseWorker::processUrgentJobs()
         mEventLoop->unlock();
 
         processUrgentJobs(jobs);
+        mUrgentJobQueue.recycleJobs(jobs);
     }
 }
 
@@ -701,6 +745,7 @@ void CBaseWorker::processJobQueue()
     mEventLoop->unlock();
 
     processUrgentJobs(urgent_jobs);
+    mUrgentJobQueue.recycleJobs(urgent_jobs);
     for (auto it = normal_jobs.begin(); it != normal_jobs.end(); ++it)
     {
         processUrgentJobs();
@@ -708,6 +753,7 @@ void CBaseWorker::processJobQueue()
         bool run_job = (!mNormalJobQueue.jobDiscarded() || (*it)->forceRun()) && !mExitCode;
         runOneJob(it, run_job);
     }
+    mNormalJobQueue.recycleJobs(normal_jobs);
 
     processUrgentJobs();
 }
@@ -771,9 +817,10 @@ bool CBaseWorker::sendSync(CBaseJob::Ptr &job, int32_t milliseconds, bool urgent
     }
 
     // now we can assure the job is not in any worker queue
-    CBaseJob::CSyncRequest sync_req(job.use_count());
+    CBaseJob::CSyncRequest sync_req;
     job->sync(true);
     job->success(false);
+    job->mFlag &= ~JOB_COMPLETION_DEFERRED;
     job->mSyncReq = &sync_req;
     if (!send(job, urgent))
     {
@@ -51,7 +51,7 @@ void CSysFdWatch::fatalError(bool enb)
 {
     if (mFatalError != enb)
     {
-	mEventLoop->rebuildPollFd();
+	mEventLoop->rebuildPollFd(this);
     }
     mFatalError = enb;
 }
@@ -91,9 +91,10 @@ private:
 };
 
 CFdEventLoop::CFdEventLoop()
-    : mWatchRecursiveCnt(0)
+    : mRebuildPollFd(false)
+    , mInputEpoch(0)
+    , mWatchRecursiveCnt(0)
     , mNotifyWatch(0)
-    , mRebuildPollFd(false)
 {
 }
 
@@ -157,24 +158,28 @@ void CFdEventLoop::buildFdArray()
 
     for (auto wi = fatal_error_watches.begin(); wi != fatal_error_watches.end(); ++wi)
     {
-        beginWatchBlackList();
-        auto w = *wi;
-        try
-        {
-            w->enable(false);
-            w->onError();
-        }
-        catch (...)
+        errorWatch(*wi);
+    }
+}
+
+void CFdEventLoop::errorWatch(CSysFdWatch *watch)
+{
+    beginWatchBlackList();
+    try
+    {
+        watch->enable(false);
+        watch->onError();
+    }
+    catch (...)
+    {
+        LOG_E("CFdEventLoop: Exception received at line %d of file %s!\n", __LINE__, __FILE__);
+        if (!watchDestroyed(watch))
         {
-            LOG_E("CFdEventLoop: Exception received at line %d of file %s!\n", __LINE__, __FILE__);
-            if (!watchDestroyed(w))
-            {
-                removeWatch(w);
-                delete w;
-            }
+            removeWatch(watch);
+            delete watch;
         }
-        endWatchBlackList();
     }
+    endWatchBlackList();
 }
 
 void CFdEventLoop::buildInputFdArray(tWatchPollTbl &watches, tFdPollTbl &fds)
@@ -208,23 +213,38 @@ void CFdEventLoop::buildInputFdArray(tWatchPollTbl &watches, tFdPollTbl &fds)
     }
 }
 
-void CFdEventLoop::processWatches()
+void CFdEventLoop::processWatch(uint32_t index)
 {
-    beginWatchBlackList();
-    /*
-     * Since the first fd is for job processing and might delete other watches,
-     * handle it at last.
-     */
-    auto size = mPollWatches.size();
-    for (auto i = (unsigned)0; i < size; ++i)
+    auto w = mPollWatches[index];
+    if (watchDestroyed(w))
     {
-        auto j = size - 1 - i;
-        auto w = mPollWatches[j];
-        if (watchDestroyed(w))
+        return;
+    }
+    if (w->fatalError())
+    {
+        try
         {
-            continue;
+            w->enable(false);
+            w->onError();
+        }
+        catch (...)
+        {
+            LOG_E("CFdEventLoop: Exception received at line %d of file %s!\n", __LINE__, __FILE__);
+            if (!watchDestroyed(w))
+            {
+                removeWatch(w);
+                delete w;
+            }
         }
-        if (w->fatalError())
+        return;
+    }
+
+    int32_t events = w->convertRetEvents(mPollFds[index].revents);
+    mPollFds[index].revents = 0;
+    if (events & (POLLIN | POLLOUT | POLLERR | POLLHUP))
+    {
+        bool io_error = false;
+        if (events & POLLERR)
         {
             try
             {
@@ -240,94 +260,101 @@ void CFdEventLoop::processWatches()
                     delete w;
                 }
             }
-            continue;
+            return;
         }
-
-        int32_t events = w->convertRetEvents(mPollFds[j].revents);
-        mPollFds[j].revents = 0;
-        if (events & (POLLIN | POLLOUT | POLLERR | POLLHUP))
+        if (events & POLLHUP)
         {
-            bool io_error = false;
-            if (events & POLLERR)
+            try
             {
-                try
-                {
-                    w->enable(false);
-                    w->onError();
-                }
-                catch (...)
-                {
-                    LOG_E("CFdEventLoop: Exception received at line %d of file %s!\n", __LINE__, __FILE__);
-                    if (!watchDestroyed(w))
-                    {
-                        removeWatch(w);
-                        delete w;
-                    }
-                }
-                continue;
+                w->onHup();
             }
-            if (events & POLLHUP)
+            catch (...)
             {
-                try
-                {
-                    w->onHup();
-                }
-                catch (...)
-                {
-                    LOG_E("CFdEventLoop: Exception received at line %d of file %s!\n", __LINE__, __FILE__);
-                }
-                continue;
+                LOG_E("CFdEventLoop: Exception received at line %d of file %s!\n", __LINE__, __FILE__);
             }
-            if (events & POLLIN)
+            return;
+        }
+        if (events & POLLIN)
+        {
+            try
             {
-                try
-                {
-                    w->onInput(io_error);
-                }
-                catch (...)
-                {
-                    LOG_E("CFdEventLoop: Exception received at line %d of file %s!\n", __LINE__, __FILE__);
-                }
-                if (watchDestroyed(w))
-                {
-                    continue;
-                }
+                w->onInput(io_error);
             }
-            if (events & POLLOUT)
+            catch (...)
             {
-                try
-                {
-                    w->onOutput(io_error);
-                }
-                catch (...)
-                {
-                    LOG_E("CFdEventLoop: Exception received at line %d of file %s!\n", __LINE__, __FILE__);
-                }
-                if (watchDestroyed(w))
-                {
-                    continue;
-                }
+                LOG_E("CFdEventLoop: Exception received at line %d of file %s!\n", __LINE__, __FILE__);
             }
+            if (watchDestroyed(w))
+            {
+                return;
+            }
+        }
+        if (events & POLLOUT)
+        {
+            try
+            {
+                w->onOutput(io_error);
+            }
+            catch (...)
+            {
+                LOG_E("CFdEventLoop: Exception received at line %d of file %s!\n", __LINE__, __FILE__);
+            }
+            if (watchDestroyed(w))
+            {
+                return;
+            }
+        }
 
-            if (io_error || w->fatalError())
+        if (io_error || w->fatalError())
+        {
+            try
             {
-                try
-                {
-                    w->enable(false);
-                    w->onError();
-                }
-                catch (...)
+                w->enable(false);
+                w->onError();
+            }
+            catch (...)
+            {
+                LOG_E("CFdEventLoop: Exception received at line %d of file %s!\n", __LINE__, __FILE__);
+                if (!watchDestroyed(w))
                 {
-                    LOG_E("CFdEventLoop: Exception received at line %d of file %s!\n", __LINE__, __FILE__);
-                    if (!watchDestroyed(w))
-                    {
-                        removeWatch(w);
-                        delete w;
-                    }
+                    removeWatch(w);
+                    delete w;
                 }
             }
         }
     }
+}
+
+void CFdEventLoop::processWatches()
+{
+    beginWatchBlackList();
+    /*
+     * Since the first fd is for job processing and might delete other watches,
+     * handle it at last.
+     */
+    auto size = mPollWatches.size();
+    for (auto i = (unsigned)0; i < size; ++i)
+    {
+        processWatch(size - 1 - i);
+    }
+    endWatchBlackList();
+}
+
+void CFdEventLoop::processWatches(const tReadyTbl &ready, uint32_t epoch)
+{
+    beginWatchBlackList();
+    for (auto it = ready.begin(); it != ready.end(); ++it)
+    {
+        if (mInputEpoch != epoch)
+        {
+            auto &pfd = mPollFds[*it];
+            if (poll(&pfd, 1, 0) <= 0)
+            {
+                pfd.revents = 0;
+            }
+        }
+        processWatch(*it);
+    }
     endWatchBlackList();
 }
 
@@ -419,6 +446,7 @@ void CFdEventLoop::dispatchInput(int32_t timeout)
     int ret = poll(fds.data(), (int32_t)fds.size(), timeout);
     if (ret > 0)
     {
+        mInputEpoch++;
         processInputWatches(watches, fds);
     }
     else if (ret < 0)
@@ -472,8 +500,22 @@ bool CFdEventLoop::registerWatch(CSysFdWatch *watch, bool enable)
 
 bool CFdEventLoop::enableWatch(CSysFdWatch *watch, bool enable)
 {
+    // the watch is in mWatchWorkingList exactly while it is enabled
+    if (watch->mEnable == enable)
+    {
+        return false;
+    }
     mRebuildPollFd = true;
-    return addWatchToList(mWatchWorkingList, watch, enable);
+    if (enable)
+    {
+        watch->mWorkingPos = mWatchWorkingList.insert(mWatchWorkingList.end(), watch);
+    }
+    else
+    {
+        mWatchWorkingList.erase(watch->mWorkingPos);
+    }
+    onWatchEnabled(watch, enable);
+    return true;
 }
 
 void CFdEventLoop::uninstallWatches()
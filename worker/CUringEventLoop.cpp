@@ -0,0 +1,503 @@
+/*
+ * Copyright (C) 2015   Jeremy Chen jeremy_cz@yahoo.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <algorithm>
+#include <functional>
+#include <utils/Log.h>
+#include <common_base/CUringEventLoop.h>
+#include <common_base/CSysFdWatch.h>
+
+// user_data of requests whose completion is dropped
+#define FDB_URING_IGNORED       (~(uint64_t)0)
+
+#ifdef CONFIG_FDB_IO_URING
+#include <linux/io_uring.h>
+/*
+ * Waiting for completions with timeout (IORING_ENTER_EXT_ARG) is since
+ * linux 5.11; fall back to poll() with older headers.
+ */
+#ifndef IORING_FEAT_EXT_ARG
+#undef CONFIG_FDB_IO_URING
+#endif
+#endif
+
+#ifdef CONFIG_FDB_IO_URING
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <endian.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#define FDB_URING_SQ_ENTRIES    256
+#define FDB_URING_CQ_ENTRIES    4096
+
+/*
+ * Completions are posted as task work of the loop thread. Unless deferred
+ * to io_uring_enter() waiting for them, it interrupts blocking syscalls
+ * called by the thread (e.g. connect() with SO_SNDTIMEO fails with EINTR).
+ * Deferring is since linux 6.1 and requires the ring to be submitted only
+ * by one thread; the ring is enabled at the first dispatch() so that it is
+ * bound to the loop thread rather than the one calling init().
+ */
+#if defined(IORING_SETUP_DEFER_TASKRUN) && defined(IORING_SETUP_SINGLE_ISSUER)
+#define FDB_URING_SETUP_DEFERRED (IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN | \
+                                  IORING_SETUP_R_DISABLED)
+#else
+#define FDB_URING_SETUP_DEFERRED 0
+#endif
+
+struct CUringRing
+{
+    int mFd;
+    void *mRingPtr;
+    size_t mRingSize;
+    io_uring_sqe *mSqes;
+    size_t mSqesSize;
+
+    uint32_t *mSqHead;
+    uint32_t *mSqTail;
+    uint32_t *mSqArray;
+    uint32_t mSqMask;
+    uint32_t mSqEntries;
+    // tail of sqes filled but not yet seen by kernel
+    uint32_t mSqLocalTail;
+
+    uint32_t *mCqHead;
+    uint32_t *mCqTail;
+    uint32_t mCqMask;
+    io_uring_cqe *mCqes;
+    // created with IORING_SETUP_R_DISABLED and not yet enabled
+    bool mDisabled;
+
+    // polls of previous generation waiting to be removed
+    std::vector<uint64_t> mCancelList;
+};
+
+static int uringEnter(CUringRing *ring, uint32_t min_complete, uint32_t flags, void *arg, size_t arg_size)
+{
+    __atomic_store_n(ring->mSqTail, ring->mSqLocalTail, __ATOMIC_RELEASE);
+    auto to_submit = ring->mSqLocalTail - __atomic_load_n(ring->mSqHead, __ATOMIC_ACQUIRE);
+    return (int)syscall(__NR_io_uring_enter, ring->mFd, to_submit, min_complete, flags, arg, arg_size);
+}
+
+static io_uring_sqe *uringGetSqe(CUringRing *ring)
+{
+    if ((ring->mSqLocalTail - __atomic_load_n(ring->mSqHead, __ATOMIC_ACQUIRE)) >= ring->mSqEntries)
+    {
+        // submit without waiting; kernel consumes sqes before it returns
+        uringEnter(ring, 0, 0, 0, 0);
+        if ((ring->mSqLocalTail - __atomic_load_n(ring->mSqHead, __ATOMIC_ACQUIRE)) >= ring->mSqEntries)
+        {
+            return 0;
+        }
+    }
+    auto index = ring->mSqLocalTail & ring->mSqMask;
+    auto sqe = &ring->mSqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    ring->mSqArray[index] = index;
+    ring->mSqLocalTail++;
+    return sqe;
+}
+
+CUringEventLoop::CUringEventLoop()
+    : mRing(0)
+    , mNextSeq(0)
+    , mReapEpoch(0)
+{
+}
+
+CUringEventLoop::~CUringEventLoop()
+{
+    releaseRing();
+}
+
+bool CUringEventLoop::setupRing()
+{
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE | FDB_URING_SETUP_DEFERRED;
+    params.cq_entries = FDB_URING_CQ_ENTRIES;
+    int fd = (int)syscall(__NR_io_uring_setup, FDB_URING_SQ_ENTRIES, &params);
+    if ((fd < 0) && FDB_URING_SETUP_DEFERRED)
+    {
+        memset(&params, 0, sizeof(params));
+        params.flags = IORING_SETUP_CQSIZE;
+        params.cq_entries = FDB_URING_CQ_ENTRIES;
+        fd = (int)syscall(__NR_io_uring_setup, FDB_URING_SQ_ENTRIES, &params);
+    }
+    if (fd < 0)
+    {
+        return false;
+    }
+    // IORING_FEAT_EXT_ARG is since linux 5.11
+    uint32_t features = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG;
+    if ((params.features & features) != features)
+    {
+        close(fd);
+        return false;
+    }
+
+    auto sq_size = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    auto cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    auto ring_size = std::max(sq_size, cq_size);
+    auto ring_ptr = mmap(0, ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         fd, IORING_OFF_SQ_RING);
+    if (ring_ptr == MAP_FAILED)
+    {
+        close(fd);
+        return false;
+    }
+    auto sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    auto sqes = mmap(0, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                     fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED)
+    {
+        munmap(ring_ptr, ring_size);
+        close(fd);
+        return false;
+    }
+
+    auto ring = new CUringRing();
+    auto base = (uint8_t *)ring_ptr;
+    ring->mFd = fd;
+    ring->mRingPtr = ring_ptr;
+    ring->mRingSize = ring_size;
+    ring->mSqes = (io_uring_sqe *)sqes;
+    ring->mSqesSize = sqes_size;
+    ring->mSqHead = (uint32_t *)(base + params.sq_off.head);
+    ring->mSqTail = (uint32_t *)(base + params.sq_off.tail);
+    ring->mSqArray = (uint32_t *)(base + params.sq_off.array);
+    ring->mSqMask = *(uint32_t *)(base + params.sq_off.ring_mask);
+    ring->mSqEntries = *(uint32_t *)(base + params.sq_off.ring_entries);
+    ring->mSqLocalTail = *ring->mSqTail;
+    ring->mCqHead = (uint32_t *)(base + params.cq_off.head);
+    ring->mCqTail = (uint32_t *)(base + params.cq_off.tail);
+    ring->mCqMask = *(uint32_t *)(base + params.cq_off.ring_mask);
+    ring->mCqes = (io_uring_cqe *)(base + params.cq_off.cqes);
+    ring->mDisabled = !!(params.flags & IORING_SETUP_R_DISABLED);
+    mRing = ring;
+    return true;
+}
+
+void CUringEventLoop::releaseRing()
+{
+    if (mRing)
+    {
+        munmap(mRing->mSqes, mRing->mSqesSize);
+        munmap(mRing->mRingPtr, mRing->mRingSize);
+        close(mRing->mFd);
+        delete mRing;
+        mRing = 0;
+    }
+}
+
+void CUringEventLoop::cancelPoll(uint32_t slot)
+{
+    /*
+     * Armed poll holds reference of the file and should be removed,
+     * otherwise socket closed by watch would not be released.
+     */
+    auto &poll = mPolls[slot];
+    if (poll.mArmed)
+    {
+        mRing->mCancelList.push_back(poll.mTag);
+        poll.mArmed = false;
+    }
+    // drop completion already posted
+    poll.mTag = FDB_URING_IGNORED;
+}
+
+void CUringEventLoop::rearmPolls()
+{
+    if (mRing->mDisabled)
+    {
+        // bind the ring to the loop thread
+        syscall(__NR_io_uring_register, mRing->mFd, IORING_REGISTER_ENABLE_RINGS, 0, 0);
+        mRing->mDisabled = false;
+    }
+
+    while (!mRing->mCancelList.empty())
+    {
+        auto sqe = uringGetSqe(mRing);
+        if (!sqe)
+        {
+            return;
+        }
+        sqe->opcode = IORING_OP_POLL_REMOVE;
+        sqe->addr = mRing->mCancelList.back();
+        sqe->user_data = FDB_URING_IGNORED;
+        mRing->mCancelList.pop_back();
+    }
+
+    while (!mUnarmed.empty())
+    {
+        auto slot = mUnarmed.back();
+        auto &poll = mPolls[slot];
+        if (!poll.mEnabled || poll.mArmed)
+        {
+            mUnarmed.pop_back();
+            continue;
+        }
+        auto sqe = uringGetSqe(mRing);
+        if (!sqe)
+        {
+            // try again at next round
+            return;
+        }
+        mUnarmed.pop_back();
+        // flags might be changed by the watch since the last poll
+        mPollFds[slot].events = (int16_t)mPollWatches[slot]->flags();
+        uint32_t events = (uint16_t)mPollFds[slot].events;
+#if __BYTE_ORDER == __BIG_ENDIAN
+        events = (events << 16) | (events >> 16);
+#endif
+        poll.mTag = ((uint64_t)mNextSeq++ << 32) | slot;
+        poll.mArmed = true;
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->fd = mPollFds[slot].fd;
+        sqe->poll32_events = events;
+        sqe->user_data = poll.mTag;
+    }
+}
+
+int32_t CUringEventLoop::waitCompletions(int32_t timeout)
+{
+    __kernel_timespec ts;
+    io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+    if (timeout >= 0)
+    {
+        ts.tv_sec = timeout / 1000;
+        ts.tv_nsec = (timeout % 1000) * 1000000LL;
+        arg.ts = (uint64_t)(uintptr_t)&ts;
+    }
+    int ret = uringEnter(mRing, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+    if ((ret < 0) && (errno != ETIME) && (errno != EINTR) && (errno != EBUSY))
+    {
+        return -1;
+    }
+
+    mReady.clear();
+    auto head = *mRing->mCqHead;
+    auto tail = __atomic_load_n(mRing->mCqTail, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head)
+    {
+        auto cqe = &mRing->mCqes[head & mRing->mCqMask];
+        auto slot = (uint32_t)cqe->user_data;
+        // completion of poll removal or of cancelled poll
+        if ((cqe->user_data == FDB_URING_IGNORED) || (slot >= mPolls.size()) ||
+            (mPolls[slot].mTag != cqe->user_data))
+        {
+            continue;
+        }
+        mPolls[slot].mArmed = false;
+        // re-armed after the watch is processed
+        mUnarmed.push_back(slot);
+        // poll() reports bad fd in revents rather than failing
+        mPollFds[slot].revents = (cqe->res < 0) ? POLLERR : (int16_t)cqe->res;
+        mReady.push_back(slot);
+    }
+    __atomic_store_n(mRing->mCqHead, head, __ATOMIC_RELEASE);
+    return (int32_t)mReady.size();
+}
+
+#else
+struct CUringRing
+{
+};
+
+CUringEventLoop::CUringEventLoop()
+    : mRing(0)
+    , mNextSeq(0)
+    , mReapEpoch(0)
+{
+}
+
+CUringEventLoop::~CUringEventLoop()
+{
+}
+
+bool CUringEventLoop::setupRing()
+{
+    return false;
+}
+
+void CUringEventLoop::releaseRing()
+{
+}
+
+void CUringEventLoop::cancelPoll(uint32_t slot)
+{
+}
+
+void CUringEventLoop::rearmPolls()
+{
+}
+
+int32_t CUringEventLoop::waitCompletions(int32_t timeout)
+{
+    return -1;
+}
+#endif
+
+bool CUringEventLoop::init(CBaseWorker *worker)
+{
+    if (!mRing && !setupRing())
+    {
+        LOG_I("CUringEventLoop: io_uring is not available; poll() is used instead.\n");
+    }
+    return CFdEventLoop::init(worker);
+}
+
+void CUringEventLoop::onWatchEnabled(CSysFdWatch *watch, bool enable)
+{
+    if (!mRing)
+    {
+        return;
+    }
+    if (enable)
+    {
+        int fd = watch->descriptor();
+        if (fd < 0)
+        {
+            LOG_E("CUringEventLoop: Bad file descriptor: %d!\n", fd);
+            return;
+        }
+        uint32_t slot;
+        if (mFreeSlots.empty())
+        {
+            slot = (uint32_t)mPollFds.size();
+            mPollFds.push_back(pollfd());
+            mPollWatches.push_back(0);
+            mPolls.push_back(CUringPoll());
+        }
+        else
+        {
+            slot = mFreeSlots.back();
+            mFreeSlots.pop_back();
+        }
+        mPollFds[slot].fd = fd;
+        mPollFds[slot].events = (int16_t)watch->flags();
+        mPollFds[slot].revents = 0;
+        mPollWatches[slot] = watch;
+        mPolls[slot].mTag = FDB_URING_IGNORED;
+        mPolls[slot].mArmed = false;
+        mPolls[slot].mEnabled = true;
+        mSlots[watch] = slot;
+        mUnarmed.push_back(slot);
+    }
+    else
+    {
+        auto it = mSlots.find(watch);
+        if (it == mSlots.end())
+        {
+            return;
+        }
+        auto slot = it->second;
+        mSlots.erase(it);
+        cancelPoll(slot);
+        mPolls[slot].mEnabled = false;
+        /*
+         * The slot might be in the ready list being processed; keep the
+         * watch there till the next round as buildFdArray() does.
+         */
+        mReleasedSlots.push_back(slot);
+    }
+}
+
+void CUringEventLoop::onWatchFatalError(CSysFdWatch *watch)
+{
+    if (mRing)
+    {
+        mFatalWatches.push_back(watch);
+    }
+}
+
+void CUringEventLoop::freeSlots()
+{
+    for (auto it = mReleasedSlots.begin(); it != mReleasedSlots.end(); ++it)
+    {
+        mPollFds[*it].fd = -1;
+        mPollFds[*it].events = 0;
+        mPollFds[*it].revents = 0;
+        mPollWatches[*it] = 0;
+        mFreeSlots.push_back(*it);
+    }
+    mReleasedSlots.clear();
+}
+
+void CUringEventLoop::dispatch()
+{
+    if (!mRing)
+    {
+        CFdEventLoop::dispatch();
+        return;
+    }
+
+    freeSlots();
+    if (!mFatalWatches.empty())
+    {
+        tWatchPollTbl fatal_watches;
+        fatal_watches.swap(mFatalWatches);
+        for (auto it = fatal_watches.begin(); it != fatal_watches.end(); ++it)
+        {
+            // the watch might be removed or destroyed since then
+            if ((mSlots.find(*it) != mSlots.end()) && (*it)->fatalError())
+            {
+                errorWatch(*it);
+            }
+        }
+    }
+    if (mSlots.empty())
+    {
+        LOG_E("CUringEventLoop: no watch fds enabled!\n");
+        // avoid exhaustive of CPU power
+        sysdep_sleep(LOOP_DEFAULT_INTERVAL);
+        return;
+    }
+
+    rearmPolls();
+    /*
+     * Completion might be posted before input is consumed by dispatchInput()
+     * called while processing the last round.
+     */
+    auto epoch = mReapEpoch;
+    auto nr_ready = waitCompletions(getMostRecentTime());
+    mReapEpoch = mInputEpoch;
+    if (nr_ready < 0)
+    {
+        LOG_E("CUringEventLoop: Error waiting for completion!\n");
+        // avoid exhaustive of CPU power
+        sysdep_sleep(LOOP_DEFAULT_INTERVAL);
+        return;
+    }
+
+    if (mReady.empty())
+    {
+        processTimers();
+    }
+    else
+    {
+        /*
+         * Since the first fd is for job processing and might delete other
+         * watches, handle it at last.
+         */
+        std::sort(mReady.begin(), mReady.end(), std::greater<uint32_t>());
+        processWatches(mReady, epoch);
+    }
+}
@@ -0,0 +1,169 @@
+/*
+ * Copyright (C) 2015   Jeremy Chen jeremy_cz@yahoo.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <mutex>
+#include <common_base/common_defs.h>
+#include <common_base/cJSON/cJSON.h>
+#include <utils/CWorkerConfig.h>
+#include <utils/Log.h>
+
+#define FDB_WORKER_CFG_ANY      "*"
+
+static cJSON *loadWorkerSection(cJSON *&cfg_root)
+{
+    const char *file_name = FDB_CFG_CONFIG_PATH
+                            "/fdbus"
+                            FDB_CFG_CONFIG_FILE_SUFFIX;
+    cfg_root = 0;
+    FILE *fp = fopen(file_name, "rb");
+    if (!fp)
+    {
+        return 0;
+    }
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    if (size <= 0)
+    {
+        fclose(fp);
+        return 0;
+    }
+    char *buffer = (char *)malloc(size + 1);
+    if (fread(buffer, 1, size, fp) == (size_t)size)
+    {
+        buffer[size] = '\0';
+        cfg_root = cJSON_Parse(buffer);
+        if (!cfg_root)
+        {
+            LOG_E("CWorkerConfig: error when parsing %s\n", file_name);
+        }
+    }
+    free(buffer);
+    fclose(fp);
+
+    if (!cfg_root)
+    {
+        return 0;
+    }
+    auto section = cJSON_GetObjectItem(cfg_root, "worker_scheduling");
+    return cJSON_IsObject(section) ? section : 0;
+}
+
+static bool mergeEntry(cJSON *entry, CThreadSchedAttr &attr)
+{
+    if (!cJSON_IsObject(entry))
+    {
+        return false;
+    }
+
+    auto cpus = cJSON_GetObjectItem(entry, "cpu_affinity");
+    if (cJSON_IsArray(cpus))
+    {
+        attr.mCpus.clear();
+        cJSON *cpu;
+        cJSON_ArrayForEach(cpu, cpus)
+        {
+            if (cJSON_IsNumber(cpu))
+            {
+                // range is checked when applied to the thread
+                attr.mCpus.push_back(cpu->valueint);
+            }
+        }
+    }
+
+    auto policy = cJSON_GetObjectItem(entry, "sched_policy");
+    if (cJSON_IsString(policy))
+    {
+        if (!strcmp(policy->valuestring, "fifo"))
+        {
+            attr.mPolicy = FDB_SCHED_FIFO;
+        }
+        else if (!strcmp(policy->valuestring, "rr"))
+        {
+            attr.mPolicy = FDB_SCHED_RR;
+        }
+        else if (!strcmp(policy->valuestring, "other"))
+        {
+            attr.mPolicy = FDB_SCHED_OTHER;
+        }
+        else
+        {
+            LOG_E("CWorkerConfig: unknown scheduling policy %s\n", policy->valuestring);
+        }
+    }
+
+    auto priority = cJSON_GetObjectItem(entry, "sched_priority");
+    if (cJSON_IsNumber(priority))
+    {
+        attr.mPriority = priority->valueint;
+    }
+
+    auto node = cJSON_GetObjectItem(entry, "memory_node");
+    if (cJSON_IsNumber(node))
+    {
+        attr.mMemNode = node->valueint;
+    }
+
+    return true;
+}
+
+bool CWorkerConfig::getSchedAttr(const char *worker_name, CThreadSchedAttr &attr)
+{
+    // the file is small; parse it each time a worker starts rather than
+    // keeping the json tree during the whole life of the process
+    static std::mutex cfg_mutex;
+    std::lock_guard<std::mutex> _l(cfg_mutex);
+
+    cJSON *cfg_root;
+    auto section = loadWorkerSection(cfg_root);
+    bool found = false;
+    if (section)
+    {
+        char proc_name[64];
+        sysdep_getprocname(proc_name, sizeof(proc_name));
+        const char *proc_keys[] = {FDB_WORKER_CFG_ANY, proc_name};
+        const char *worker_keys[] = {FDB_WORKER_CFG_ANY, worker_name ? worker_name : ""};
+        for (int32_t i = 0; i < ARRAY_LENGTH(proc_keys); ++i)
+        {
+            if (!proc_keys[i][0])
+            {
+                continue;
+            }
+            auto proc = cJSON_GetObjectItem(section, proc_keys[i]);
+            if (!cJSON_IsObject(proc))
+            {
+                continue;
+            }
+            for (int32_t j = 0; j < ARRAY_LENGTH(worker_keys); ++j)
+            {
+                if (worker_keys[j][0] &&
+                    mergeEntry(cJSON_GetObjectItem(proc, worker_keys[j]), attr))
+                {
+                    found = true;
+                }
+            }
+        }
+    }
+
+    if (cfg_root)
+    {
+        cJSON_Delete(cfg_root);
+    }
+    return found;
+}